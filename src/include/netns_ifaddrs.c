@@ -461,27 +461,14 @@ static int __ifaddrs_netlink_recv(int fd, unsigned int seq, int type/*消息类
 	}
 }
 
-static int __rtnl_enumerate(int link_af, int addr_af, __s32 netns_id,
+static int __rtnl_enumerate(int fd, int link_af, int addr_af, __s32 netns_id,
 			    bool *netnsid_aware,
 			    int (*cb/*netlink消息响应处理*/)(void *ctx, bool *netnsid_aware, struct nlmsghdr *h),
 			    void *ctx)
 {
-	int fd, r, saved_errno;
+	int r;
 	bool getaddr_netnsid_aware = false, getlink_netnsid_aware = false;
 
-	//创建netlink socket
-	fd = socket(PF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
-	if (fd < 0)
-		return -1;
-
-	r = setsockopt(fd, SOL_NETLINK, NETLINK_GET_STRICT_CHK, &(int){1},
-		       sizeof(int));
-	if (r < 0 && netns_id >= 0) {
-		close(fd);
-		*netnsid_aware = false;
-		return -1;
-	}
-
 	//获取link信息
 	r = __ifaddrs_netlink_recv(fd, 1, RTM_GETLINK, link_af, netns_id,
 				   &getlink_netnsid_aware, cb, ctx);
@@ -490,10 +477,6 @@ static int __rtnl_enumerate(int link_af, int addr_af, __s32 netns_id,
 		r = __ifaddrs_netlink_recv(fd, 2, RTM_GETADDR, addr_af, netns_id,
 					   &getaddr_netnsid_aware, cb, ctx);
 
-	saved_errno = errno;
-	close(fd);
-	errno = saved_errno;
-
 	if (getaddr_netnsid_aware && getlink_netnsid_aware)
 		*netnsid_aware = true;
 	else
@@ -513,8 +496,54 @@ void netns_freeifaddrs(struct netns_ifaddrs *ifp)
 	}
 }
 
+int netns_ifaddrs_socket(void)
+{
+	int fd, saved_errno;
+
+	fd = socket(PF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+	if (fd < 0)
+		return -1;
+
+	/* Without strict checking the kernel ignores the target netns id. */
+	if (setsockopt(fd, SOL_NETLINK, NETLINK_GET_STRICT_CHK, &(int){1},
+		       sizeof(int)) < 0) {
+		saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+		return -1;
+	}
+
+	return fd;
+}
+
 int netns_getifaddrs(struct netns_ifaddrs **ifap, __s32 netns_id,
 		     bool *netnsid_aware)
+{
+	int fd, r, saved_errno;
+
+	//创建netlink socket
+	fd = socket(PF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+	if (fd < 0)
+		return -1;
+
+	r = setsockopt(fd, SOL_NETLINK, NETLINK_GET_STRICT_CHK, &(int){1},
+		       sizeof(int));
+	if (r < 0 && netns_id >= 0) {
+		close(fd);
+		*netnsid_aware = false;
+		return -1;
+	}
+
+	r = netns_getifaddrs_fd(fd, ifap, netns_id, netnsid_aware);
+	saved_errno = errno;
+	close(fd);
+	errno = saved_errno;
+
+	return r;
+}
+
+int netns_getifaddrs_fd(int fd, struct netns_ifaddrs **ifap, __s32 netns_id,
+			bool *netnsid_aware)
 {
 	int r, saved_errno;
 	struct ifaddrs_ctx _ctx;
@@ -522,7 +551,7 @@ int netns_getifaddrs(struct netns_ifaddrs **ifap, __s32 netns_id,
 
 	memset(ctx, 0, sizeof *ctx);
 
-	r = __rtnl_enumerate(AF_UNSPEC, AF_UNSPEC, netns_id, netnsid_aware,
+	r = __rtnl_enumerate(fd, AF_UNSPEC, AF_UNSPEC, netns_id, netnsid_aware,
 			     nl_msg_to_ifaddr, ctx);
 	saved_errno = errno;
 	if (r < 0)
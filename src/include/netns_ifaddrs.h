@@ -56,6 +56,15 @@ define_cleanup_function(struct netns_ifaddrs *, netns_freeifaddrs);
 __hidden extern int netns_getifaddrs(struct netns_ifaddrs **ifap, __s32 netns_id,
 				     bool *netnsid_aware);
 
+/*
+ * Dump through the NETLINK_ROUTE socket @fd, which must come from
+ * netns_ifaddrs_socket() when @netns_id is used. Lets dumps of many network
+ * namespaces share a socket.
+ */
+__hidden extern int netns_ifaddrs_socket(void);
+__hidden extern int netns_getifaddrs_fd(int fd, struct netns_ifaddrs **ifap,
+					__s32 netns_id, bool *netnsid_aware);
+
 #ifdef __cplusplus
 }
 #endif
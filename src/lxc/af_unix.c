@@ -79,7 +79,7 @@ int lxc_abstract_unix_open(const char *path, int type, int flags)
 	if (ret < 0)
 		return -1;
 
-	if (type == SOCK_STREAM) {
+	if (type == SOCK_STREAM || type == SOCK_SEQPACKET) {
 		ret = listen(fd, 100);
 		if (ret < 0)
 			return -1;
@@ -94,7 +94,7 @@ void lxc_abstract_unix_close(int fd)
 }
 
 /*连接到目的地址*/
-int lxc_abstract_unix_connect(const char *path)
+int lxc_abstract_unix_connect_type(const char *path, int type)
 {
 	__do_close int fd = -EBADF;
 	int ret;
@@ -102,7 +102,7 @@ int lxc_abstract_unix_connect(const char *path)
 	struct sockaddr_un addr;
 
 	//创建unix socket，并填充连接目的地址
-	fd = socket(PF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	fd = socket(PF_UNIX, type | SOCK_CLOEXEC, 0);
 	if (fd < 0)
 		return -1;
 
@@ -119,6 +119,11 @@ int lxc_abstract_unix_connect(const char *path)
 	return move_fd(fd);
 }
 
+int lxc_abstract_unix_connect(const char *path)
+{
+	return lxc_abstract_unix_connect_type(path, SOCK_STREAM);
+}
+
 int lxc_abstract_unix_send_fds_iov(int fd, const int *sendfds, int num_sendfds,
 				   struct iovec *const iov, size_t iovlen)
 {
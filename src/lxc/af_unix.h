@@ -102,6 +102,8 @@ __hidden extern int lxc_abstract_unix_open(const char *path, int type, int flags
 __hidden extern void lxc_abstract_unix_close(int fd);
 /* does not enforce \0-termination */
 __hidden extern int lxc_abstract_unix_connect(const char *path);
+/* does not enforce \0-termination */
+__hidden extern int lxc_abstract_unix_connect_type(const char *path, int type);
 
 __hidden extern int lxc_abstract_unix_send_fds(int fd, const int *sendfds,
 					       int num_sendfds, void *data,
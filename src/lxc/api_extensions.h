@@ -46,6 +46,18 @@ static char *api_extensions[] = {
 	"seccomp_proxy_send_notify_fd",
 	"idmapped_mounts",
 	"idmapped_mounts_v2",
+	"running_info",
+	"persistent_commands",
+	"config_cache",
+	"list_parallel",
+	"containers_get_ips",
+	"container_metrics",
+	"monitor_pressure_events",
+	"containers_freeze",
+	"start_timings",
+	"container_pool",
+	"rootfs_overlay_tmpfs",
+	"overlay_layer_store",
 };
 
 static size_t nr_api_extensions = sizeof(api_extensions) / sizeof(*api_extensions);
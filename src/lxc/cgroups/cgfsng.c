@@ -45,6 +45,7 @@
 #include "macro.h"
 #include "mainloop.h"
 #include "memory_utils.h"
+#include "monitor.h"
 #include "mount_utils.h"
 #include "storage/storage.h"
 #include "string_utils.h"
@@ -3746,3 +3747,417 @@ int cgroup_unfreeze(const char *name, const char *lxcpath, int timeout)
 	lxc_cmd_notify_state_listeners(name, lxcpath, !ret ? RUNNING : FROZEN);
 	return ret;
 }
+
+struct cgroup_freeze_wait {
+	int fd;
+	int state_num;
+	int *result;
+};
+
+/* Return the "frozen" value of an open cgroup.events file. */
+static int cgroup_events_frozen(int fd)
+{
+	char buf[256];
+	const char *frozen;
+	ssize_t len;
+
+	len = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (len < 0)
+		return -errno;
+	buf[len] = '\0';
+
+	frozen = strstr(buf, "frozen ");
+	if (!frozen || (frozen != buf && frozen[-1] != '\n'))
+		return ret_errno(ENOENT);
+
+	return frozen[STRLITERALLEN("frozen ")] == '1';
+}
+
+static int freeze_many_cb(int fd, uint32_t events, void *cbdata,
+			  struct lxc_epoll_descr *descr)
+{
+	struct cgroup_freeze_wait *wait = cbdata;
+	int ret;
+
+	/* Reading the file through @fd rearms the notification. */
+	ret = cgroup_events_frozen(fd);
+	if (ret >= 0 && ret != wait->state_num)
+		return LXC_MAINLOOP_CONTINUE;
+
+	/* The cgroup is gone if the container stopped in the meantime. */
+	*wait->result = ret < 0 ? ret : 0;
+	if (lxc_mainloop_del_handler(descr, fd))
+		return LXC_MAINLOOP_ERROR;
+
+	/* Let the caller recompute the remaining time. */
+	return LXC_MAINLOOP_CLOSE;
+}
+
+static int freeze_many_remaining(const struct timespec *deadline)
+{
+	struct timespec now;
+	int64_t ms;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (deadline->tv_sec - now.tv_sec) * 1000 +
+	     (deadline->tv_nsec - now.tv_nsec) / 1000000;
+
+	return ms > 0 ? (int)ms : 0;
+}
+
+int cgroup_freeze_many(const char *const *names, const char *const *lxcpaths,
+		       int count, bool freeze, int timeout, int *results)
+{
+	__do_free struct cgroup_freeze_wait *waits = NULL;
+	call_cleaner(lxc_mainloop_close) struct lxc_epoll_descr *descr_ptr = NULL;
+	const char *state_string = freeze ? "1" : "0";
+	int state_num = freeze ? 1 : 0;
+	struct lxc_epoll_descr descr = {};
+	struct timespec deadline = {};
+	int ret;
+
+	if (count <= 0)
+		return 0;
+
+	waits = zalloc(sizeof(*waits) * count);
+	if (!waits)
+		return ret_errno(ENOMEM);
+
+	ret = lxc_mainloop_open(&descr);
+	if (ret)
+		return log_error_errno(ret, -ret, "Failed to create epoll instance to wait for containers");
+	descr_ptr = &descr;
+
+	if (timeout > 0) {
+		(void)clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += timeout / 1000;
+		deadline.tv_nsec += (timeout % 1000) * 1000000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+	}
+
+	/*
+	 * Request the new state for all containers first so that the kernel
+	 * freezes them concurrently and only then wait for all of them.
+	 */
+	for (int i = 0; i < count; i++) {
+		__do_close int unified_fd = -EBADF;
+		struct cgroup_freeze_wait *wait = &waits[i];
+
+		wait->fd = -EBADF;
+		wait->state_num = state_num;
+		wait->result = &results[i];
+
+		if (is_empty_string(names[i]) || is_empty_string(lxcpaths[i])) {
+			results[i] = -EINVAL;
+			continue;
+		}
+
+		unified_fd = lxc_cmd_get_limit_cgroup2_fd(names[i], lxcpaths[i]);
+		if (unified_fd < 0) {
+			results[i] = -ENOCGROUP2;
+			continue;
+		}
+
+		wait->fd = open_at(unified_fd, "cgroup.events", PROTECT_OPEN,
+				   PROTECT_LOOKUP_BENEATH, 0);
+		if (wait->fd < 0) {
+			results[i] = log_error_errno(-errno, errno, "Failed to open cgroup.events file of %s", names[i]);
+			continue;
+		}
+
+		ret = cgroup_events_frozen(wait->fd);
+		if (ret == state_num) {
+			/* Nothing to do and nobody to notify. */
+			results[i] = 0;
+			close_prot_errno_disarm(wait->fd);
+			continue;
+		}
+
+		lxc_cmd_notify_state_listeners(names[i], lxcpaths[i], freeze ? FREEZING : THAWED);
+
+		results[i] = -ETIMEDOUT;
+		if (timeout != 0) {
+			ret = lxc_mainloop_add_handler_events(&descr, wait->fd, EPOLLPRI,
+							      freeze_many_cb, wait);
+			if (ret < 0) {
+				results[i] = log_error_errno(-EINVAL, EINVAL, "Failed to add cgroup.events fd handler of %s to mainloop", names[i]);
+				continue;
+			}
+		}
+
+		ret = lxc_writeat(unified_fd, "cgroup.freeze", state_string, 1);
+		if (ret < 0) {
+			results[i] = log_error_errno(-errno, errno, "Failed to write cgroup.freeze file of %s", names[i]);
+			if (timeout != 0)
+				(void)lxc_mainloop_del_handler(&descr, wait->fd);
+			continue;
+		}
+
+		if (timeout == 0)
+			results[i] = 0;
+	}
+
+	while (!lxc_list_empty(&descr.handlers)) {
+		int wait_ms = -1;
+
+		if (timeout > 0) {
+			wait_ms = freeze_many_remaining(&deadline);
+			if (wait_ms == 0)
+				break;
+		}
+
+		ret = lxc_mainloop(&descr, wait_ms);
+		if (ret < 0) {
+			SYSERROR("Failed to wait for containers to be %s", freeze ? "frozen" : "unfrozen");
+			break;
+		}
+	}
+
+	ret = 0;
+	for (int i = 0; i < count; i++) {
+		struct cgroup_freeze_wait *wait = &waits[i];
+		bool done = results[i] == 0;
+
+		if (done)
+			ret++;
+
+		if (wait->fd < 0)
+			continue;
+
+		if (!done)
+			ERROR("Failed to %s container %s", freeze ? "freeze" : "unfreeze", names[i]);
+
+		if (freeze)
+			lxc_cmd_notify_state_listeners(names[i], lxcpaths[i], done ? FROZEN : RUNNING);
+		else
+			lxc_cmd_notify_state_listeners(names[i], lxcpaths[i], done ? RUNNING : FROZEN);
+
+		close_prot_errno_disarm(wait->fd);
+	}
+
+	return ret;
+}
+
+struct cgroup_event_watch {
+	int fd;
+	/* lxc_pressure_t of a pressure trigger, -1 for memory.events. */
+	int resource;
+	/* Last seen memory.events counters. */
+	uint64_t counters[LXC_MEMORY_EVENT_MAX];
+	struct cgroup_events *events;
+};
+
+struct cgroup_events {
+	const char *name;
+	const char *lxcpath;
+	unsigned int memory_events;
+	int nr_watches;
+	struct cgroup_event_watch watches[LXC_PRESSURE_MAX + 1];
+};
+
+void cgroup_events_free(struct cgroup_events *events)
+{
+	if (!events)
+		return;
+
+	for (int i = 0; i < events->nr_watches; i++)
+		close_prot_errno_disarm(events->watches[i].fd);
+	free(events);
+}
+
+static int memory_events_read(int fd, uint64_t counters[LXC_MEMORY_EVENT_MAX])
+{
+	char buf[512];
+	char *line;
+	ssize_t len;
+
+	len = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (len < 0)
+		return -errno;
+	buf[len] = '\0';
+
+	lxc_iterate_parts(line, buf, "\n") {
+		char *value;
+		int event;
+
+		value = strchr(line, ' ');
+		if (!value)
+			continue;
+		*value++ = '\0';
+
+		event = lxc_str2memory_event(line);
+		if (event < 0)
+			continue;
+
+		if (lxc_safe_uint64(value, &counters[event], 10) < 0)
+			counters[event] = 0;
+	}
+
+	return 0;
+}
+
+/*
+ * Cgroup files signal EPOLLERR together with every notification, just like
+ * for freezer_cgroup_events_cb(). Only failing reads of the files of a removed
+ * cgroup tell that the container is gone.
+ */
+static int cgroup_event_watch_close(int fd, struct lxc_epoll_descr *descr)
+{
+	TRACE("Stopped watching cgroup events on %d", fd);
+	(void)lxc_mainloop_del_handler(descr, fd);
+	return LXC_MAINLOOP_CONTINUE;
+}
+
+static int cgroup_pressure_cb(int fd, uint32_t events, void *cbdata,
+			      struct lxc_epoll_descr *descr)
+{
+	struct cgroup_event_watch *watch = cbdata;
+	char buf[256];
+
+	if (pread(fd, buf, sizeof(buf), 0) < 0)
+		return cgroup_event_watch_close(fd, descr);
+
+	if (events & EPOLLPRI) {
+		DEBUG("The %s pressure trigger fired", lxc_pressure2str(watch->resource));
+		lxc_monitor_send_pressure(watch->events->name, watch->resource,
+					  watch->events->lxcpath);
+	}
+
+	return LXC_MAINLOOP_CONTINUE;
+}
+
+static int cgroup_memory_events_cb(int fd, uint32_t events, void *cbdata,
+				   struct lxc_epoll_descr *descr)
+{
+	struct cgroup_event_watch *watch = cbdata;
+	uint64_t counters[LXC_MEMORY_EVENT_MAX] = {};
+
+	if (memory_events_read(fd, counters) < 0)
+		return cgroup_event_watch_close(fd, descr);
+
+	for (int i = 0; i < LXC_MEMORY_EVENT_MAX; i++) {
+		if (counters[i] <= watch->counters[i])
+			continue;
+
+		watch->counters[i] = counters[i];
+		if (!(watch->events->memory_events & (1U << i)))
+			continue;
+
+		DEBUG("The memory.events counter \"%s\" increased to %" PRIu64,
+		      lxc_memory_event2str(i), counters[i]);
+		lxc_monitor_send_memory_event(watch->events->name, i,
+					      watch->events->lxcpath);
+	}
+
+	return LXC_MAINLOOP_CONTINUE;
+}
+
+static int cgroup_pressure_watch(struct cgroup_events *events, int dfd,
+				 lxc_pressure_t resource, const char *trigger,
+				 struct lxc_epoll_descr *descr)
+{
+	__do_close int fd = -EBADF;
+	struct cgroup_event_watch *watch;
+	char file[32];
+	int ret;
+
+	ret = strnprintf(file, sizeof(file), "%s.pressure", lxc_pressure2str(resource));
+	if (ret < 0)
+		return ret;
+
+	fd = openat(dfd, file, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0)
+		return log_warn_errno(-errno, errno, "Failed to open %s", file);
+
+	/* The kernel expects the trigger including its \0 byte. */
+	if (lxc_write_nointr(fd, trigger, strlen(trigger) + 1) < 0)
+		return log_warn_errno(-errno, errno, "Failed to set %s trigger \"%s\"", file, trigger);
+
+	watch = &events->watches[events->nr_watches];
+	watch->resource = resource;
+	watch->events = events;
+
+	ret = lxc_mainloop_add_handler_events(descr, fd, EPOLLPRI, cgroup_pressure_cb, watch);
+	if (ret < 0)
+		return log_warn_errno(ret, errno, "Failed to add %s handler to mainloop", file);
+
+	watch->fd = move_fd(fd);
+	events->nr_watches++;
+	return log_info(0, "Watching %s trigger \"%s\"", file, trigger);
+}
+
+static int cgroup_memory_events_watch(struct cgroup_events *events, int dfd,
+				      struct lxc_epoll_descr *descr)
+{
+	__do_close int fd = -EBADF;
+	struct cgroup_event_watch *watch;
+	int ret;
+
+	fd = openat(dfd, "memory.events", O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return log_warn_errno(-errno, errno, "Failed to open memory.events");
+
+	watch = &events->watches[events->nr_watches];
+	watch->resource = -1;
+	watch->events = events;
+
+	/* Only report events that happen from now on. */
+	ret = memory_events_read(fd, watch->counters);
+	if (ret < 0)
+		return log_warn_errno(ret, -ret, "Failed to read memory.events");
+
+	ret = lxc_mainloop_add_handler_events(descr, fd, EPOLLPRI, cgroup_memory_events_cb, watch);
+	if (ret < 0)
+		return log_warn_errno(ret, errno, "Failed to add memory.events handler to mainloop");
+
+	watch->fd = move_fd(fd);
+	events->nr_watches++;
+	return log_info(0, "Watching memory.events");
+}
+
+struct cgroup_events *cgroup_events_mainloop_add(struct cgroup_ops *ops,
+						 struct lxc_handler *handler,
+						 struct lxc_epoll_descr *descr)
+{
+	__do_free struct cgroup_events *events = NULL;
+	struct lxc_conf *conf = handler->conf;
+	bool wanted = conf->monitor_memory_events != 0;
+	int dfd;
+
+	for (int i = 0; i < LXC_PRESSURE_MAX; i++)
+		if (conf->monitor_pressure[i])
+			wanted = true;
+
+	if (!wanted)
+		return NULL;
+
+	if (!ops || !ops->unified)
+		return log_warn(NULL, "Pressure and memory events require a cgroup2 hierarchy");
+
+	dfd = ops->unified->dfd_lim >= 0 ? ops->unified->dfd_lim : ops->unified->dfd_con;
+	if (dfd < 0)
+		return log_warn(NULL, "The container has no cgroup2 cgroup to watch");
+
+	events = zalloc(sizeof(*events));
+	if (!events)
+		return NULL;
+
+	events->name = handler->name;
+	events->lxcpath = handler->lxcpath;
+	events->memory_events = conf->monitor_memory_events;
+
+	for (int i = 0; i < LXC_PRESSURE_MAX; i++)
+		if (conf->monitor_pressure[i])
+			(void)cgroup_pressure_watch(events, dfd, i, conf->monitor_pressure[i], descr);
+
+	if (events->memory_events)
+		(void)cgroup_memory_events_watch(events, dfd, descr);
+
+	if (events->nr_watches == 0)
+		return NULL;
+
+	return move_ptr(events);
+}
@@ -292,6 +292,33 @@ __hidden extern int cgroup_freeze(const char *name, const char *lxcpath, int tim
 __hidden extern int cgroup_unfreeze(const char *name, const char *lxcpath, int timeout);
 __hidden extern int __cgroup_unfreeze(int unified_fd, int timeout);
 
+/*
+ * Freeze or unfreeze @count containers through their cgroup2 freezer. The
+ * new state is written for all of them before waiting up to @timeout
+ * milliseconds in total (-1 waits forever, 0 doesn't wait) for all their
+ * cgroup.events files to report it. @results[i] is set to 0 or a negative
+ * error code for the container at index i; -ENOCGROUP2 means the caller has
+ * to fall back to the legacy freezer. Returns the number of containers in
+ * the requested state.
+ */
+__hidden extern int cgroup_freeze_many(const char *const *names,
+				       const char *const *lxcpaths, int count,
+				       bool freeze, int timeout, int *results);
+
+struct cgroup_events;
+struct lxc_epoll_descr;
+
+/*
+ * Watch the cgroup2 pressure triggers and memory.events counters configured
+ * for the container in the monitor's mainloop and publish them on the
+ * monitor bus. Returns NULL if nothing is watched.
+ */
+__hidden extern struct cgroup_events *cgroup_events_mainloop_add(struct cgroup_ops *ops,
+								 struct lxc_handler *handler,
+								 struct lxc_epoll_descr *descr);
+__hidden extern void cgroup_events_free(struct cgroup_events *events);
+define_cleanup_function(struct cgroup_events *, cgroup_events_free);
+
 static inline bool pure_unified_layout(const struct cgroup_ops *ops)
 {
 	return ops->cgroup_layout == CGROUP_LAYOUT_UNIFIED;
@@ -14,6 +14,7 @@
 #include "config.h"
 #include "file_utils.h"
 #include "log.h"
+#include "lxccontainer.h"
 #include "macro.h"
 #include "memory_utils.h"
 #include "utils.h"
@@ -122,3 +123,229 @@ char *prune_init_scope(char *path)
 
 	return path;
 }
+
+uint64_t metrics_parse_u64(const char *s, const char **end)
+{
+	uint64_t val = 0;
+
+	while (*s == ' ')
+		s++;
+
+	if (strnequal(s, "max", STRLITERALLEN("max"))) {
+		s += STRLITERALLEN("max");
+		val = LXC_METRICS_UNLIMITED;
+	} else {
+		for (; *s >= '0' && *s <= '9'; s++)
+			val = val * 10 + (*s - '0');
+	}
+
+	if (end)
+		*end = s;
+
+	return val;
+}
+
+/*
+ * Parse the fixed point numbers of pressure files without strtod() which
+ * depends on the locale.
+ */
+static double metrics_parse_double(const char *s, const char **end)
+{
+	double val, scale = 1;
+
+	val = metrics_parse_u64(s, &s);
+	if (*s == '.') {
+		for (s++; *s >= '0' && *s <= '9'; s++) {
+			scale /= 10;
+			val += (*s - '0') * scale;
+		}
+	}
+
+	if (end)
+		*end = s;
+
+	return val;
+}
+
+const char *metrics_next_line(const char *s)
+{
+	s = strchrnul(s, '\n');
+	return *s ? s + 1 : s;
+}
+
+uint64_t metrics_keyed(const char *buf, const char *key)
+{
+	size_t len = strlen(key);
+
+	for (const char *line = buf; *line; line = metrics_next_line(line))
+		if (strnequal(line, key, len) && line[len] == ' ')
+			return metrics_parse_u64(line + len, NULL);
+
+	return 0;
+}
+
+static bool metrics_read_u64(int dfd, const char *file, uint64_t *val)
+{
+	char buf[INTTYPE_TO_STRLEN(uint64_t) + 1];
+	ssize_t len;
+
+	len = lxc_read_try_buf_at(dfd, file, buf, sizeof(buf) - 1);
+	if (len <= 0)
+		return false;
+	buf[len] = '\0';
+
+	*val = metrics_parse_u64(buf, NULL);
+	return true;
+}
+
+static ssize_t metrics_read_file(int dfd, const char *file, char *buf, size_t size)
+{
+	ssize_t len;
+
+	len = lxc_read_try_buf_at(dfd, file, buf, size - 1);
+	if (len < 0)
+		return len;
+	buf[len] = '\0';
+
+	return len;
+}
+
+/*
+ * example:
+ *	8:0 rbytes=90430464 wbytes=299008000 rios=8950 wios=1252 dbytes=0 dios=0
+ */
+static void metrics_parse_io(const char *buf, struct lxc_metrics *metrics)
+{
+	static const struct {
+		const char *key;
+		size_t offset;
+	} keys[] = {
+		{ "rbytes=", offsetof(struct lxc_metrics, io_rbytes) },
+		{ "wbytes=", offsetof(struct lxc_metrics, io_wbytes) },
+		{ "rios=",   offsetof(struct lxc_metrics, io_rios)   },
+		{ "wios=",   offsetof(struct lxc_metrics, io_wios)   },
+		{ "dbytes=", offsetof(struct lxc_metrics, io_dbytes) },
+		{ "dios=",   offsetof(struct lxc_metrics, io_dios)   },
+	};
+
+	for (const char *p = strchr(buf, ' '); p; p = strchr(p, ' ')) {
+		p++;
+
+		for (size_t i = 0; i < ARRAY_SIZE(keys); i++) {
+			size_t len = strlen(keys[i].key);
+			uint64_t *val;
+
+			if (!strnequal(p, keys[i].key, len))
+				continue;
+
+			val = (uint64_t *)((char *)metrics + keys[i].offset);
+			*val += metrics_parse_u64(p + len, &p);
+			break;
+		}
+	}
+}
+
+/*
+ * example:
+ *	some avg10=0.00 avg60=0.12 avg300=0.05 total=3174390
+ *	full avg10=0.00 avg60=0.00 avg300=0.00 total=1208755
+ */
+static bool metrics_read_pressure(int dfd, const char *file,
+				  struct lxc_pressure *pressure)
+{
+	char buf[256];
+
+	if (metrics_read_file(dfd, file, buf, sizeof(buf)) <= 0)
+		return false;
+
+	for (const char *line = buf; *line; line = metrics_next_line(line)) {
+		struct lxc_pressure_stats *stats;
+		const char *p;
+
+		if (strnequal(line, "some ", 5))
+			stats = &pressure->some;
+		else if (strnequal(line, "full ", 5))
+			stats = &pressure->full;
+		else
+			continue;
+
+		for (p = line + 5; *p && *p != '\n'; p++) {
+			if (strnequal(p, "avg10=", 6))
+				stats->avg10 = metrics_parse_double(p + 6, &p);
+			else if (strnequal(p, "avg60=", 6))
+				stats->avg60 = metrics_parse_double(p + 6, &p);
+			else if (strnequal(p, "avg300=", 7))
+				stats->avg300 = metrics_parse_double(p + 7, &p);
+			else if (strnequal(p, "total=", 6))
+				stats->total = metrics_parse_u64(p + 6, &p);
+
+			if (*p == '\n' || !*p)
+				break;
+		}
+	}
+
+	return true;
+}
+
+unsigned int cgroup2_read_metrics(int dfd, struct lxc_metrics *metrics)
+{
+	char buf[8192];
+	unsigned int flags = 0, want = metrics->flags;
+
+	memset(metrics, 0, sizeof(*metrics));
+	metrics->flags = want;
+
+	if (metrics->flags & LXC_METRICS_CPU &&
+	    metrics_read_file(dfd, "cpu.stat", buf, sizeof(buf)) > 0) {
+		metrics->cpu_usage_usec		= metrics_keyed(buf, "usage_usec");
+		metrics->cpu_user_usec		= metrics_keyed(buf, "user_usec");
+		metrics->cpu_system_usec	= metrics_keyed(buf, "system_usec");
+		metrics->cpu_nr_periods		= metrics_keyed(buf, "nr_periods");
+		metrics->cpu_nr_throttled	= metrics_keyed(buf, "nr_throttled");
+		metrics->cpu_throttled_usec	= metrics_keyed(buf, "throttled_usec");
+		flags |= LXC_METRICS_CPU;
+	}
+
+	if (metrics->flags & LXC_METRICS_MEMORY &&
+	    metrics_read_u64(dfd, "memory.current", &metrics->memory_current)) {
+		(void)metrics_read_u64(dfd, "memory.max", &metrics->memory_max);
+		(void)metrics_read_u64(dfd, "memory.swap.current", &metrics->memory_swap_current);
+		(void)metrics_read_u64(dfd, "memory.swap.max", &metrics->memory_swap_max);
+
+		if (metrics_read_file(dfd, "memory.stat", buf, sizeof(buf)) > 0) {
+			metrics->memory_anon		= metrics_keyed(buf, "anon");
+			metrics->memory_file		= metrics_keyed(buf, "file");
+			metrics->memory_kernel_stack	= metrics_keyed(buf, "kernel_stack");
+			metrics->memory_slab		= metrics_keyed(buf, "slab");
+			metrics->memory_sock		= metrics_keyed(buf, "sock");
+			metrics->memory_shmem		= metrics_keyed(buf, "shmem");
+			metrics->memory_pgfault		= metrics_keyed(buf, "pgfault");
+			metrics->memory_pgmajfault	= metrics_keyed(buf, "pgmajfault");
+		}
+		flags |= LXC_METRICS_MEMORY;
+	}
+
+	if (metrics->flags & LXC_METRICS_IO &&
+	    metrics_read_file(dfd, "io.stat", buf, sizeof(buf)) >= 0) {
+		metrics_parse_io(buf, metrics);
+		flags |= LXC_METRICS_IO;
+	}
+
+	if (metrics->flags & LXC_METRICS_PIDS &&
+	    metrics_read_u64(dfd, "pids.current", &metrics->pids_current)) {
+		(void)metrics_read_u64(dfd, "pids.max", &metrics->pids_max);
+		flags |= LXC_METRICS_PIDS;
+	}
+
+	if (metrics->flags & LXC_METRICS_PRESSURE) {
+		bool cpu, memory, io;
+
+		cpu = metrics_read_pressure(dfd, "cpu.pressure", &metrics->cpu_pressure);
+		memory = metrics_read_pressure(dfd, "memory.pressure", &metrics->memory_pressure);
+		io = metrics_read_pressure(dfd, "io.pressure", &metrics->io_pressure);
+		if (cpu || memory || io)
+			flags |= LXC_METRICS_PRESSURE;
+	}
+
+	return flags;
+}
@@ -4,6 +4,7 @@
 #define __LXC_CGROUP_UTILS_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #include "compiler.h"
@@ -30,4 +31,21 @@ __hidden extern int cgroup_tree_prune(int dfd, const char *path);
  */
 __hidden extern char *prune_init_scope(char *path);
 
+struct lxc_metrics;
+
+/* Parse the number at @s. "max" reads as LXC_METRICS_UNLIMITED. */
+__hidden extern uint64_t metrics_parse_u64(const char *s, const char **end);
+
+/* Return the start of the line after the one @s points into. */
+__hidden extern const char *metrics_next_line(const char *s);
+
+/* Find the value of @key in a flat keyed file like cpu.stat. */
+__hidden extern uint64_t metrics_keyed(const char *buf, const char *key);
+
+/*
+ * Read the metrics selected by @metrics->flags from the cgroup2 directory
+ * @dfd. Returns the flags of the metrics that were read.
+ */
+__hidden extern unsigned int cgroup2_read_metrics(int dfd, struct lxc_metrics *metrics);
+
 #endif /* __LXC_CGROUP_UTILS_H */
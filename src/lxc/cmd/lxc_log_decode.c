@@ -0,0 +1,411 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "compiler.h"
+#include "config.h"
+#include "log.h"
+#include "macro.h"
+#include "memory_utils.h"
+
+/* Turn binary log records written with lxc.log.format = binary into text. */
+
+#define CALLSITE_BUCKETS 1024
+
+struct callsite {
+	uint64_t source;
+	uint32_t id;
+	uint32_t line;
+	const char *prefix;
+	const char *name;
+	const char *category;
+	const char *file;
+	const char *func;
+	const char *fmt;
+	char *data;
+	struct callsite *next;
+};
+
+static struct callsite *callsites[CALLSITE_BUCKETS];
+
+static void usage(const char *name)
+{
+	printf("usage: %s [-h] [file ..]\n", name);
+	printf("\n");
+	printf("Decode binary lxc log files to text. Reads standard input if no\n");
+	printf("file is given. Text lines are passed through unchanged.\n");
+}
+
+static struct callsite **callsite_slot(uint64_t source, uint32_t id)
+{
+	struct callsite **slot = &callsites[(source * 31 + id) % CALLSITE_BUCKETS];
+
+	while (*slot && ((*slot)->source != source || (*slot)->id != id))
+		slot = &(*slot)->next;
+
+	return slot;
+}
+
+static void callsite_free_all(void)
+{
+	for (size_t i = 0; i < CALLSITE_BUCKETS; i++) {
+		while (callsites[i]) {
+			struct callsite *site = callsites[i];
+
+			callsites[i] = site->next;
+			free(site->data);
+			free(site);
+		}
+	}
+}
+
+static int callsite_add(const struct lxc_log_record *rec, char *data, size_t len)
+{
+	struct callsite **slot, *site;
+	const char **strs[6];
+	size_t off;
+
+	if (len < sizeof(uint32_t) || data[len - 1] != '\0')
+		return -EINVAL;
+
+	slot = callsite_slot(rec->source, rec->id);
+	site = *slot;
+	if (site) {
+		/* A later generation reuses the id. */
+		free(site->data);
+	} else {
+		site = calloc(1, sizeof(*site));
+		if (!site)
+			return -ENOMEM;
+
+		site->source = rec->source;
+		site->id = rec->id;
+		*slot = site;
+	}
+
+	site->data = data;
+	memcpy(&site->line, data, sizeof(site->line));
+
+	strs[0] = &site->prefix;
+	strs[1] = &site->name;
+	strs[2] = &site->category;
+	strs[3] = &site->file;
+	strs[4] = &site->func;
+	strs[5] = &site->fmt;
+
+	off = sizeof(uint32_t);
+	for (size_t i = 0; i < ARRAY_SIZE(strs); i++) {
+		*strs[i] = off < len ? data + off : "";
+		if (off < len)
+			off += strlen(data + off) + 1;
+	}
+
+	return 0;
+}
+
+/* Same format as lxc_unix_epoch_to_utc() in the library. */
+static void format_time(char *buf, size_t size, uint64_t sec, uint32_t nsec)
+{
+	char nanosec[INTTYPE_TO_STRLEN(int64_t)];
+	time_t t = sec;
+	struct tm tm;
+	size_t len;
+
+	if (!gmtime_r(&t, &tm)) {
+		snprintf(buf, size, "%" PRIu64, sec);
+		return;
+	}
+
+	len = strftime(buf, size, "%Y%m%d%H%M%S", &tm);
+	snprintf(nanosec, sizeof(nanosec), "%" PRIu32, nsec);
+	snprintf(buf + len, size - len, ".%.3s", nanosec);
+}
+
+struct payload {
+	const char *data;
+	size_t len;
+	size_t off;
+};
+
+static bool payload_get(struct payload *pl, void *v, size_t len)
+{
+	if (pl->off + len > pl->len)
+		return false;
+
+	memcpy(v, pl->data + pl->off, len);
+	pl->off += len;
+	return true;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#define print_spec(out, spec, stars, nstars, v)				\
+	do {								\
+		if ((nstars) == 2)					\
+			fprintf(out, spec, stars[0], stars[1], v);	\
+		else if ((nstars) == 1)					\
+			fprintf(out, spec, stars[0], v);		\
+		else							\
+			fprintf(out, spec, v);				\
+	} while (0)
+
+static void print_message(FILE *out, const char *fmt, struct payload *pl)
+{
+	for (const char *p = fmt; *p; p++) {
+		struct lxc_log_spec spec;
+		char conv[64];
+		int stars[2] = {0, 0};
+		size_t n = 0;
+		uint64_t v;
+
+		if (*p != '%') {
+			fputc(*p, out);
+			continue;
+		}
+
+		lxc_log_parse_spec(p, &spec);
+		if (spec.len < 2 || spec.len >= sizeof(conv) - 2) {
+			fputs(p, out);
+			return;
+		}
+
+		if (spec.conversion == '%') {
+			fputc('%', out);
+			p += spec.len - 1;
+			continue;
+		}
+
+		/* Rebuild the specification with the length the value has now. */
+		for (size_t i = 0; i < spec.len - 1; i++)
+			if (!strchr("hlLqjzZt", p[i]))
+				conv[n++] = p[i];
+		if (spec.arg >= LXC_LOG_ARG_INT && spec.arg <= LXC_LOG_ARG_INTMAX &&
+		    spec.conversion != 'c') {
+			conv[n++] = 'l';
+			conv[n++] = 'l';
+		}
+		conv[n++] = spec.conversion;
+		conv[n] = '\0';
+		p += spec.len - 1;
+
+		for (int i = 0; i < spec.stars; i++) {
+			if (!payload_get(pl, &v, sizeof(v)))
+				goto truncated;
+			stars[i] = (int)v;
+		}
+
+		switch (spec.arg) {
+		case LXC_LOG_ARG_NONE:
+			break;
+		case LXC_LOG_ARG_INT:
+		case LXC_LOG_ARG_LONG:
+		case LXC_LOG_ARG_LLONG:
+		case LXC_LOG_ARG_SIZE:
+		case LXC_LOG_ARG_PTRDIFF:
+		case LXC_LOG_ARG_INTMAX:
+			if (!payload_get(pl, &v, sizeof(v)))
+				goto truncated;
+
+			if (spec.conversion == 'c')
+				print_spec(out, conv, stars, spec.stars, (int)v);
+			else if (spec.is_unsigned)
+				print_spec(out, conv, stars, spec.stars, (unsigned long long)v);
+			else
+				print_spec(out, conv, stars, spec.stars, (long long)v);
+			break;
+		case LXC_LOG_ARG_DOUBLE:
+		case LXC_LOG_ARG_LDOUBLE: {
+			double d;
+
+			if (!payload_get(pl, &d, sizeof(d)))
+				goto truncated;
+
+			print_spec(out, conv, stars, spec.stars, d);
+			break;
+		}
+		case LXC_LOG_ARG_STRING: {
+			__do_free char *str = NULL;
+			uint32_t len;
+
+			if (!payload_get(pl, &len, sizeof(len)) || pl->off + len > pl->len)
+				goto truncated;
+
+			str = strndup(pl->data + pl->off, len);
+			if (!str)
+				goto truncated;
+			pl->off += len;
+
+			print_spec(out, conv, stars, spec.stars, str);
+			break;
+		}
+		case LXC_LOG_ARG_POINTER:
+			if (!payload_get(pl, &v, sizeof(v)))
+				goto truncated;
+
+			if (spec.conversion == 'p')
+				print_spec(out, conv, stars, spec.stars, (void *)(uintptr_t)v);
+			break;
+		case LXC_LOG_ARG_ERRNO:
+			if (!payload_get(pl, &v, sizeof(v)))
+				goto truncated;
+
+			fputs(strerror((int)v), out);
+			break;
+		}
+	}
+
+	return;
+
+truncated:
+	fputs(" [truncated]", out);
+}
+#pragma GCC diagnostic pop
+
+static void print_event(FILE *out, const struct lxc_log_record *rec,
+			const char *data, size_t len)
+{
+	struct payload pl = {.data = data, .len = len};
+	char date_time[INTTYPE_TO_STRLEN(uint64_t) * 2];
+	struct callsite *site;
+	uint32_t nsec[2];
+	uint64_t sec;
+
+	if (!payload_get(&pl, &sec, sizeof(sec)) || !payload_get(&pl, nsec, sizeof(nsec)))
+		return;
+
+	format_time(date_time, sizeof(date_time), sec, nsec[0]);
+
+	site = *callsite_slot(rec->source, rec->id);
+	if (!site) {
+		fprintf(out, "%s %-8s pid %" PRIu32 " - unknown callsite %" PRIu32 "\n",
+			date_time, lxc_log_priority_to_string(rec->priority),
+			rec->pid, rec->id);
+		return;
+	}
+
+	fprintf(out, "%s%s%s %s %-8s %s - %s:%s:%" PRIu32 " - ",
+		site->prefix, site->name[0] ? " " : "", site->name, date_time,
+		lxc_log_priority_to_string(rec->priority), site->category,
+		site->file, site->func, site->line);
+	print_message(out, site->fmt, &pl);
+	fputc('\n', out);
+}
+
+static int decode_record(FILE *in, FILE *out)
+{
+	struct lxc_log_record rec = {.magic = LXC_LOG_RECORD_MAGIC};
+	char *data;
+	size_t len;
+
+	if (fread((char *)&rec + sizeof(rec.magic), sizeof(rec) - sizeof(rec.magic), 1, in) != 1)
+		return -EIO;
+
+	if (rec.len < sizeof(rec) || rec.len > LXC_LOG_BUFFER_SIZE * 2)
+		return -EBADMSG;
+
+	len = rec.len - sizeof(rec);
+	data = malloc(len + 1);
+	if (!data)
+		return -ENOMEM;
+
+	if (len && fread(data, len, 1, in) != 1) {
+		free(data);
+		return -EIO;
+	}
+
+	switch (rec.type) {
+	case LXC_LOG_RECORD_CALLSITE:
+		/* The callsite keeps @data. */
+		if (callsite_add(&rec, data, len) < 0) {
+			free(data);
+			return -EBADMSG;
+		}
+		return 0;
+	case LXC_LOG_RECORD_EVENT:
+		print_event(out, &rec, data, len);
+		break;
+	}
+
+	free(data);
+	return 0;
+}
+
+static int decode(FILE *in, FILE *out)
+{
+	const uint16_t magic = LXC_LOG_RECORD_MAGIC;
+	const unsigned char *m = (const unsigned char *)&magic;
+	int c;
+
+	while ((c = getc(in)) != EOF) {
+		if (c == m[0]) {
+			int next = getc(in);
+
+			if (next == m[1]) {
+				int ret;
+
+				ret = decode_record(in, out);
+				if (ret < 0)
+					return ret;
+
+				continue;
+			}
+
+			if (next != EOF)
+				ungetc(next, in);
+		}
+
+		/* Text lines are passed through. */
+		fputc(c, out);
+		while (c != '\n' && (c = getc(in)) != EOF)
+			fputc(c, out);
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret = EXIT_SUCCESS;
+
+	if (argc > 1 && (strequal(argv[1], "-h") || strequal(argv[1], "--help"))) {
+		usage(argv[0]);
+		exit(EXIT_SUCCESS);
+	}
+
+	if (argc < 2) {
+		if (decode(stdin, stdout) < 0) {
+			fprintf(stderr, "Failed to decode standard input\n");
+			ret = EXIT_FAILURE;
+		}
+	}
+
+	for (int i = 1; i < argc; i++) {
+		FILE *f;
+
+		f = fopen(argv[i], "re");
+		if (!f) {
+			fprintf(stderr, "Failed to open \"%s\": %s\n", argv[i], strerror(errno));
+			ret = EXIT_FAILURE;
+			continue;
+		}
+
+		if (decode(f, stdout) < 0) {
+			fprintf(stderr, "Failed to decode \"%s\"\n", argv[i]);
+			ret = EXIT_FAILURE;
+		}
+
+		fclose(f);
+	}
+
+	callsite_free_all();
+	exit(ret);
+}
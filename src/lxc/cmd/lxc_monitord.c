@@ -5,6 +5,7 @@
 #endif
 #include <errno.h>
 #include <fcntl.h>
+#include <fnmatch.h>
 #include <net/if.h>
 #include <netinet/in.h>
 #include <pthread.h>
@@ -27,6 +28,7 @@
 #include "config.h"
 #include "log.h"
 #include "mainloop.h"
+#include "memory_utils.h"
 #include "monitor.h"
 #include "process_utils.h"
 #include "utils.h"
@@ -47,6 +49,10 @@ static void lxc_monitord_cleanup(void);
  * @clientfds      : accepted client file descriptors
  * @clientfds_size : number of file descriptors clientfds can hold
  * @clientfds_cnt  : the count of valid fds in clientfds
+ * @busfd          : the file descriptor for the event bus
+ * @subs           : subscribers on the event bus
+ * @subs_size      : number of subscribers subs can hold
+ * @subs_cnt       : the count of valid subscribers in subs
  * @descr          : the lxc_mainloop state
  */
 struct lxc_monitor {
@@ -56,9 +62,25 @@ struct lxc_monitor {
 	int *clientfds;
 	int clientfds_size;
 	int clientfds_cnt;
+	int busfd;
+	struct lxc_monitord_bus_client **subs;
+	int subs_size;
+	int subs_cnt;
 	struct lxc_epoll_descr descr;
 };
 
+/*
+ * A connection to the event bus
+ * @fd    : the accepted connection
+ * @hello : the role and filter the peer announced, role is 0 until then
+ * @mon   : the monitor the connection belongs to
+ */
+struct lxc_monitord_bus_client {
+	int fd;
+	struct lxc_monitor_hello hello;
+	struct lxc_monitor *mon;
+};
+
 static struct lxc_monitor monitor;
 static int quit;
 
@@ -220,6 +242,231 @@ out:
 	return ret;
 }
 
+static bool lxc_monitord_bus_match(const struct lxc_monitor_hello *filter,
+				   const struct lxc_msg *msg)
+{
+	if (filter->types) {
+		if (msg->type < 0 || msg->type >= 32)
+			return false;
+
+		if (!(filter->types & (1U << msg->type)))
+			return false;
+	}
+
+	if (filter->states && msg->type == lxc_msg_state) {
+		if (msg->value < 0 || msg->value >= 32)
+			return false;
+
+		if (!(filter->states & (1U << msg->value)))
+			return false;
+	}
+
+	if (filter->name[0] && fnmatch(filter->name, msg->name, 0))
+		return false;
+
+	return true;
+}
+
+/*
+ * A client which doesn't keep up must not stall the other clients, or the
+ * monitors publishing state changes, so it misses the messages which don't
+ * fit into its socket buffer. A client that only got part of a message is
+ * disconnected. Its socket is only shut down here since handlers can't be
+ * removed while the mainloop may still dispatch events for them. Its own
+ * handler removes it once it sees the hangup.
+ */
+static void lxc_monitord_broadcast(struct lxc_monitor *mon,
+				   const struct lxc_msg *msg)
+{
+	int i;
+	ssize_t ret;
+
+	for (i = 0; i < mon->clientfds_cnt; i++) {
+		ret = lxc_send_nointr(mon->clientfds[i], (void *)msg, sizeof(*msg),
+				      MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (ret == sizeof(*msg) || (ret < 0 && IN_SET(errno, EAGAIN, EPIPE)))
+			continue;
+
+		SYSWARN("Disconnecting client file descriptor %d", mon->clientfds[i]);
+		(void)shutdown(mon->clientfds[i], SHUT_RDWR);
+	}
+
+	/* Messages on the bus are datagrams and are never split. */
+	for (i = 0; i < mon->subs_cnt; i++) {
+		struct lxc_monitord_bus_client *sub = mon->subs[i];
+
+		if (!lxc_monitord_bus_match(&sub->hello, msg))
+			continue;
+
+		ret = lxc_send_nointr(sub->fd, (void *)msg, sizeof(*msg),
+				      MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (ret == sizeof(*msg) || (ret < 0 && IN_SET(errno, EAGAIN, EPIPE)))
+			continue;
+
+		SYSWARN("Disconnecting subscriber file descriptor %d", sub->fd);
+		(void)shutdown(sub->fd, SHUT_RDWR);
+	}
+}
+
+static void lxc_monitord_bus_remove(struct lxc_monitord_bus_client *client)
+{
+	struct lxc_monitor *mon = client->mon;
+
+	if (lxc_mainloop_del_handler(&mon->descr, client->fd))
+		CRIT("File descriptor %d not found in mainloop", client->fd);
+	close(client->fd);
+
+	if (client->hello.role == LXC_MONITOR_BUS_SUBSCRIBER) {
+		int i;
+
+		for (i = 0; i < mon->subs_cnt; i++)
+			if (mon->subs[i] == client)
+				break;
+
+		if (i < mon->subs_cnt) {
+			memmove(&mon->subs[i], &mon->subs[i+1],
+				(mon->subs_cnt - i - 1) * sizeof(mon->subs[0]));
+			mon->subs_cnt--;
+		}
+	}
+
+	free(client);
+}
+
+static int lxc_monitord_bus_hello(struct lxc_monitord_bus_client *client)
+{
+	struct lxc_monitor *mon = client->mon;
+	struct lxc_monitor_hello *hello = &client->hello;
+	ssize_t ret;
+	int ack = 0;
+
+	ret = lxc_recv_nointr(client->fd, hello, sizeof(*hello), 0);
+	if (ret != sizeof(*hello))
+		return -1;
+	hello->name[sizeof(hello->name) - 1] = '\0';
+
+	switch (hello->role) {
+	case LXC_MONITOR_BUS_PUBLISHER:
+		return 0;
+	case LXC_MONITOR_BUS_SUBSCRIBER:
+		break;
+	default:
+		WARN("Invalid role %u on event bus file descriptor %d", hello->role, client->fd);
+		return -1;
+	}
+
+	if (mon->subs_cnt + 1 > mon->subs_size) {
+		struct lxc_monitord_bus_client **subs;
+
+		subs = realloc(mon->subs,
+			       (mon->subs_size + CLIENTFDS_CHUNK) * sizeof(mon->subs[0]));
+		if (!subs) {
+			ERROR("Failed to realloc memory for %d subscribers",
+			      mon->subs_size + CLIENTFDS_CHUNK);
+			hello->role = 0;
+			return -1;
+		}
+
+		mon->subs = subs;
+		mon->subs_size += CLIENTFDS_CHUNK;
+	}
+
+	mon->subs[mon->subs_cnt++] = client;
+
+	ret = lxc_send_nointr(client->fd, &ack, sizeof(ack), MSG_NOSIGNAL);
+	if (ret != sizeof(ack))
+		return -1;
+
+	INFO("Accepted subscriber file descriptor %d. Number of subscribers is now %d",
+	     client->fd, mon->subs_cnt);
+	return 0;
+}
+
+static int lxc_monitord_bus_handler(int fd, uint32_t events, void *data,
+				    struct lxc_epoll_descr *descr)
+{
+	struct lxc_monitord_bus_client *client = data;
+	struct lxc_msg msglxc;
+	ssize_t ret;
+
+	if (client->hello.role == 0) {
+		if (lxc_monitord_bus_hello(client) < 0)
+			lxc_monitord_bus_remove(client);
+
+		return LXC_MAINLOOP_CONTINUE;
+	}
+
+	/* Subscribers only ever hang up. */
+	if (client->hello.role != LXC_MONITOR_BUS_PUBLISHER) {
+		lxc_monitord_bus_remove(client);
+		return LXC_MAINLOOP_CONTINUE;
+	}
+
+	/* Drain what the publisher queued up to save on wakeups. */
+	for (int i = 0; i < CLIENTFDS_CHUNK; i++) {
+		ret = recv(fd, &msglxc, sizeof(msglxc), MSG_DONTWAIT);
+		if (ret < 0 && (errno == EAGAIN || errno == EINTR))
+			break;
+
+		if (ret != sizeof(msglxc)) {
+			if (ret != 0)
+				WARN("Invalid message on event bus file descriptor %d", fd);
+			lxc_monitord_bus_remove(client);
+			break;
+		}
+
+		msglxc.name[sizeof(msglxc.name) - 1] = '\0';
+		lxc_monitord_broadcast(client->mon, &msglxc);
+	}
+
+	return LXC_MAINLOOP_CONTINUE;
+}
+
+static int lxc_monitord_bus_accept(int fd, uint32_t events, void *data,
+				   struct lxc_epoll_descr *descr)
+{
+	__do_close int clientfd = -EBADF;
+	__do_free struct lxc_monitord_bus_client *client = NULL;
+	struct lxc_monitor *mon = data;
+	struct ucred cred;
+	socklen_t credsz = sizeof(cred);
+	int ret;
+
+	clientfd = accept4(fd, NULL, 0, SOCK_CLOEXEC);
+	if (clientfd < 0) {
+		SYSERROR("Failed to accept connection for event bus file descriptor %d", fd);
+		return LXC_MAINLOOP_ERROR;
+	}
+
+	if (getsockopt(clientfd, SOL_SOCKET, SO_PEERCRED, &cred, &credsz)) {
+		SYSERROR("Failed to get credentials on event bus connection %d", clientfd);
+		return LXC_MAINLOOP_CONTINUE;
+	}
+
+	if (cred.uid && cred.uid != geteuid()) {
+		WARN("Monitor denied for uid %d on event bus connection %d", cred.uid, clientfd);
+		return LXC_MAINLOOP_CONTINUE;
+	}
+
+	client = zalloc(sizeof(*client));
+	if (!client)
+		return LXC_MAINLOOP_CONTINUE;
+
+	client->fd = clientfd;
+	client->mon = mon;
+
+	ret = lxc_mainloop_add_handler(&mon->descr, clientfd,
+				       lxc_monitord_bus_handler, client);
+	if (ret < 0) {
+		ERROR("Failed to add event bus handler");
+		return LXC_MAINLOOP_CONTINUE;
+	}
+
+	move_fd(clientfd);
+	move_ptr(client);
+	return LXC_MAINLOOP_CONTINUE;
+}
+
 static int lxc_monitord_sock_create(struct lxc_monitor *mon)
 {
 	struct sockaddr_un addr;
@@ -238,6 +485,24 @@ static int lxc_monitord_sock_create(struct lxc_monitor *mon)
 	return 0;
 }
 
+static int lxc_monitord_bus_create(struct lxc_monitor *mon)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (lxc_monitor_bus_name(mon->lxcpath, &addr) < 0)
+		return -1;
+
+	fd = lxc_abstract_unix_open(addr.sun_path, SOCK_SEQPACKET, 0);
+	if (fd < 0) {
+		SYSERROR("Failed to open event bus socket");
+		return -1;
+	}
+
+	mon->busfd = fd;
+	return 0;
+}
+
 static int lxc_monitord_sock_delete(struct lxc_monitor *mon)
 {
 	struct sockaddr_un addr;
@@ -259,6 +524,10 @@ static int lxc_monitord_create(struct lxc_monitor *mon)
 	if (ret < 0)
 		return ret;
 
+	ret = lxc_monitord_bus_create(mon);
+	if (ret < 0)
+		return ret;
+
 	return lxc_monitord_sock_create(mon);
 }
 
@@ -274,18 +543,24 @@ static void lxc_monitord_delete(struct lxc_monitor *mon)
 	lxc_monitord_fifo_delete(mon);
 	close(mon->fifofd);
 
+	lxc_mainloop_del_handler(&mon->descr, mon->busfd);
+	close(mon->busfd);
+
 	for (i = 0; i < mon->clientfds_cnt; i++) {
 		lxc_mainloop_del_handler(&mon->descr, mon->clientfds[i]);
 		close(mon->clientfds[i]);
 	}
 
 	mon->clientfds_cnt = 0;
+
+	while (mon->subs_cnt > 0)
+		lxc_monitord_bus_remove(mon->subs[0]);
 }
 
 static int lxc_monitord_fifo_handler(int fd, uint32_t events, void *data,
 				     struct lxc_epoll_descr *descr)
 {
-	int ret, i;
+	int ret;
 	struct lxc_msg msglxc;
 	struct lxc_monitor *mon = data;
 
@@ -295,13 +570,7 @@ static int lxc_monitord_fifo_handler(int fd, uint32_t events, void *data,
 		return LXC_MAINLOOP_CLOSE;
 	}
 
-	for (i = 0; i < mon->clientfds_cnt; i++) {
-		ret = lxc_write_nointr(mon->clientfds[i], &msglxc, sizeof(msglxc));
-		if (ret < 0)
-			SYSERROR("Failed to send message to client file descriptor %d",
-				 mon->clientfds[i]);
-	}
-
+	lxc_monitord_broadcast(mon, &msglxc);
 	return LXC_MAINLOOP_CONTINUE;
 }
 
@@ -323,6 +592,13 @@ static int lxc_monitord_mainloop_add(struct lxc_monitor *mon)
 		return -1;
 	}
 
+	ret = lxc_mainloop_add_handler(&mon->descr, mon->busfd,
+				       lxc_monitord_bus_accept, mon);
+	if (ret < 0) {
+		ERROR("Failed to add to mainloop monitor handler for event bus");
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -438,7 +714,7 @@ int main(int argc, char *argv[])
 			break;
 		}
 
-		if (monitor.clientfds_cnt <= 0) {
+		if (monitor.clientfds_cnt + monitor.subs_cnt <= 0) {
 			NOTICE("No remaining clients. lxc-monitord is exiting");
 			break;
 		}
@@ -8,6 +8,7 @@
 #include <fcntl.h>
 #include <malloc.h>
 #include <poll.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -62,6 +63,9 @@
 
 lxc_log_define(commands, lxc);
 
+/* Seconds a command session waits for a response. */
+#define LXC_CMD_SESSION_TIMEOUT 30
+
 /*返回各cmd对应的字符形式*/
 static const char *lxc_cmd_str(lxc_cmd_t cmd)
 {
@@ -92,6 +96,9 @@ static const char *lxc_cmd_str(lxc_cmd_t cmd)
 		[LXC_CMD_GET_CGROUP_CTX]		= "get_cgroup_ctx",
 		[LXC_CMD_GET_CGROUP_FD]			= "get_cgroup_fd",
 		[LXC_CMD_GET_LIMIT_CGROUP_FD]		= "get_limit_cgroup_fd",
+		[LXC_CMD_GET_INFO]			= "get_info",
+		[LXC_CMD_SESSION_START]			= "session_start",
+		[LXC_CMD_GET_START_TIMINGS]		= "get_start_timings",
 	};
 
 	if (cmd >= LXC_CMD_MAX)
@@ -231,10 +238,16 @@ static ssize_t lxc_cmd_rsp_recv(int sock, struct lxc_cmd_rr *cmd)
 	 * console ringbuffer.
 	 */
 	if ((rsp->datalen > LXC_CMD_DATA_MAX) &&
-	    (cur_cmd != LXC_CMD_CONSOLE_LOG))
+	    (cur_cmd != LXC_CMD_CONSOLE_LOG) &&
+	    (cur_cmd != LXC_CMD_GET_INFO))
 		return syserror_set(-E2BIG, "Response data for command \"%s\" is too long: %d bytes > %d",
 				    cur_cmdstr, rsp->datalen, LXC_CMD_DATA_MAX);
 
+	if ((rsp->datalen > LXC_CMD_INFO_DATA_MAX) &&
+	    (cur_cmd == LXC_CMD_GET_INFO))
+		return syserror_set(-E2BIG, "Response data for command \"%s\" is too long: %d bytes > %d",
+				    cur_cmdstr, rsp->datalen, LXC_CMD_INFO_DATA_MAX);
+
 	/*
 	 * Prepare buffer for any command that expects to receive additional
 	 * data. Note that some don't want any additional data.
@@ -335,6 +348,12 @@ static ssize_t lxc_cmd_rsp_recv(int sock, struct lxc_cmd_rr *cmd)
 	return bytes_recv;
 }
 
+/*
+ * Set whenever a response is sent so the command session handler can tell
+ * whether a callback answered. The mainloop runs in a single thread.
+ */
+static bool lxc_cmd_rsp_sent;
+
 /*
  * lxc_cmd_rsp_send: Send a command response
  *
@@ -347,6 +366,8 @@ static int __lxc_cmd_rsp_send(int fd, struct lxc_cmd_rsp *rsp)
 {
 	ssize_t ret;
 
+	lxc_cmd_rsp_sent = true;
+
 	//发送rsp头部
 	ret = lxc_send_nointr(fd, rsp, sizeof(*rsp), MSG_NOSIGNAL);
 	if (ret < 0 || (size_t)ret != sizeof(*rsp))
@@ -389,6 +410,7 @@ static inline int rsp_one_fd_reap(int fd, int fd_send, struct lxc_cmd_rsp *rsp)
 {
 	ssize_t ret;
 
+	lxc_cmd_rsp_sent = true;
 	ret = lxc_abstract_unix_send_fds(fd, &fd_send, 1, rsp, sizeof(*rsp));
 	if (ret < 0)
 		return ret;
@@ -427,6 +449,7 @@ __access_r(3, 2) static int rsp_many_fds_reap(int fd, __u32 fds_len,
 		return lxc_cmd_rsp_send_reap(fd, rsp);
 	}
 
+	lxc_cmd_rsp_sent = true;
 	ret = lxc_abstract_unix_send_fds(fd, fds, fds_len, rsp, sizeof(*rsp));
 	if (ret < 0)
 		return ret;
@@ -479,6 +502,387 @@ static int lxc_cmd_send(const char *name, struct lxc_cmd_rr *cmd,
 	return move_fd(client_fd);
 }
 
+/*
+ * Commands that keep the client fd around, don't answer at all, pass file
+ * descriptors along with the request or may take longer to answer than
+ * LXC_CMD_SESSION_TIMEOUT can't be sent over a session.
+ */
+static bool lxc_cmd_session_allowed(lxc_cmd_t cmd)
+{
+	switch (cmd) {
+	case LXC_CMD_FREEZE:
+		__fallthrough;
+	case LXC_CMD_UNFREEZE:
+		__fallthrough;
+	case LXC_CMD_GET_TTY_FD:
+		__fallthrough;
+	case LXC_CMD_TERMINAL_WINCH:
+		__fallthrough;
+	case LXC_CMD_STOP:
+		__fallthrough;
+	case LXC_CMD_ADD_STATE_CLIENT:
+		__fallthrough;
+	case LXC_CMD_SECCOMP_NOTIFY_ADD_LISTENER:
+		__fallthrough;
+	case LXC_CMD_SESSION_START:
+		return false;
+	default:
+		break;
+	}
+
+	return true;
+}
+
+/*
+ * Commands which don't change the state of the container and can be sent
+ * again if the server went away before answering.
+ */
+static bool lxc_cmd_read_only(lxc_cmd_t cmd)
+{
+	switch (cmd) {
+	case LXC_CMD_GET_STATE:
+		__fallthrough;
+	case LXC_CMD_GET_INIT_PID:
+		__fallthrough;
+	case LXC_CMD_GET_CLONE_FLAGS:
+		__fallthrough;
+	case LXC_CMD_GET_CGROUP:
+		__fallthrough;
+	case LXC_CMD_GET_CONFIG_ITEM:
+		__fallthrough;
+	case LXC_CMD_GET_NAME:
+		__fallthrough;
+	case LXC_CMD_GET_LXCPATH:
+		__fallthrough;
+	case LXC_CMD_GET_CGROUP2_FD:
+		__fallthrough;
+	case LXC_CMD_GET_INIT_PIDFD:
+		__fallthrough;
+	case LXC_CMD_GET_LIMIT_CGROUP:
+		__fallthrough;
+	case LXC_CMD_GET_LIMIT_CGROUP2_FD:
+		__fallthrough;
+	case LXC_CMD_GET_DEVPTS_FD:
+		__fallthrough;
+	case LXC_CMD_GET_SECCOMP_NOTIFY_FD:
+		__fallthrough;
+	case LXC_CMD_GET_CGROUP_CTX:
+		__fallthrough;
+	case LXC_CMD_GET_CGROUP_FD:
+		__fallthrough;
+	case LXC_CMD_GET_LIMIT_CGROUP_FD:
+		__fallthrough;
+	case LXC_CMD_GET_INFO:
+		__fallthrough;
+	case LXC_CMD_GET_START_TIMINGS:
+		return true;
+	default:
+		break;
+	}
+
+	return false;
+}
+
+int lxc_cmd_session_open(const char *name, const char *lxcpath)
+{
+	__do_close int client_fd = -EBADF;
+	struct lxc_cmd_rr cmd;
+	ssize_t ret;
+
+	lxc_cmd_init(&cmd, LXC_CMD_SESSION_START);
+
+	client_fd = lxc_cmd_send(name, &cmd, lxcpath, NULL);
+	if (client_fd < 0)
+		return -errno;
+
+	ret = lxc_cmd_rsp_recv(client_fd, &cmd);
+	if (ret <= 0)
+		return ret_errno(ECONNRESET);
+
+	/* Servers that predate sessions answer with -ENOSYS. */
+	if (cmd.rsp.ret < 0)
+		return ret_errno(cmd.rsp.ret);
+
+	/* A server that never answers must not block the client forever. */
+	if (lxc_socket_set_timeout(client_fd, LXC_CMD_SESSION_TIMEOUT,
+				   LXC_CMD_SESSION_TIMEOUT) < 0)
+		return -errno;
+
+	TRACE("Opened command session fd %d to container \"%s\"", client_fd, name);
+	return move_fd(client_fd);
+}
+
+int lxc_cmd_session_send(int fd, __u64 id, struct lxc_cmd_rr *cmd)
+{
+	struct lxc_cmd_session_req sreq = {
+		.id	= id,
+		.req	= cmd->req,
+	};
+	ssize_t ret;
+
+	if (!lxc_cmd_session_allowed(cmd->req.cmd))
+		return ret_errno(EINVAL);
+
+	ret = lxc_abstract_unix_send_credential(fd, &sreq, sizeof(sreq));
+	if (ret < 0)
+		return ret_errno(ENOTCONN);
+
+	if ((size_t)ret != sizeof(sreq))
+		return -1;
+
+	if (cmd->req.datalen <= 0)
+		return 0;
+
+	errno = EMSGSIZE;
+	ret = lxc_send_nointr(fd, (void *)cmd->req.data, cmd->req.datalen,
+			      MSG_NOSIGNAL);
+	if (ret < 0 || ret != (ssize_t)cmd->req.datalen)
+		return -1;
+
+	return 0;
+}
+
+ssize_t lxc_cmd_session_recv(int fd, __u64 id, struct lxc_cmd_rr *cmd)
+{
+	__u64 rsp_id;
+	ssize_t ret;
+
+	ret = lxc_recv_nointr(fd, &rsp_id, sizeof(rsp_id), MSG_WAITALL);
+	if (ret <= 0)
+		return ret;
+
+	if ((size_t)ret != sizeof(rsp_id))
+		return syserror_set(-EPROTO, "Received truncated response id on command session fd %d", fd);
+
+	if (rsp_id != id)
+		return syserror_set(-EPROTO, "Received response id %llu instead of %llu on command session fd %d",
+				    (unsigned long long)rsp_id, (unsigned long long)id, fd);
+
+	/* The server went away after it started answering. */
+	ret = lxc_cmd_rsp_recv(fd, cmd);
+	if (ret == 0)
+		return ret_errno(ECONNRESET);
+
+	return ret;
+}
+
+struct lxc_cmd_session {
+	char *name;
+	char *lxcpath;
+	/* The session socket or -EBADF if not connected. */
+	int fd;
+	/* The process that opened @fd. Forked children open their own. */
+	pid_t owner;
+	/* The id of the next request sent over @fd. */
+	__u64 id;
+	/* The server predates sessions. */
+	bool unsupported;
+	/* Protected by lxc_cmd_sessions_lock. */
+	unsigned int refcount;
+	struct lxc_cmd_session *next;
+	/* Serializes requests over @fd. */
+	pthread_mutex_t lock;
+};
+
+static struct lxc_cmd_session *lxc_cmd_sessions;
+static pthread_mutex_t lxc_cmd_sessions_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Must be called with lxc_cmd_sessions_lock held. */
+static struct lxc_cmd_session *__lxc_cmd_session_find(const char *name,
+						      const char *lxcpath)
+{
+	struct lxc_cmd_session *session;
+
+	for (session = lxc_cmd_sessions; session; session = session->next)
+		if (strequal(session->name, name) &&
+		    strequal(session->lxcpath, lxcpath))
+			return session;
+
+	return NULL;
+}
+
+static void lxc_cmd_session_free(struct lxc_cmd_session *session)
+{
+	close_prot_errno_disarm(session->fd);
+	pthread_mutex_destroy(&session->lock);
+	free(session->name);
+	free(session->lxcpath);
+	free(session);
+}
+
+struct lxc_cmd_session *lxc_cmd_session_get(const char *name,
+					    const char *lxcpath)
+{
+	struct lxc_cmd_session *session;
+
+	if (!name || !lxcpath)
+		return ret_set_errno(NULL, EINVAL);
+
+	pthread_mutex_lock(&lxc_cmd_sessions_lock);
+
+	session = __lxc_cmd_session_find(name, lxcpath);
+	if (session) {
+		session->refcount++;
+		goto out;
+	}
+
+	session = zalloc(sizeof(*session));
+	if (!session)
+		goto out;
+
+	session->name = strdup(name);
+	session->lxcpath = strdup(lxcpath);
+	if (!session->name || !session->lxcpath) {
+		free(session->name);
+		free(session->lxcpath);
+		free_disarm(session);
+		goto out;
+	}
+
+	session->fd = -EBADF;
+	session->refcount = 1;
+	pthread_mutex_init(&session->lock, NULL);
+	session->next = lxc_cmd_sessions;
+	lxc_cmd_sessions = session;
+
+out:
+	pthread_mutex_unlock(&lxc_cmd_sessions_lock);
+	return session;
+}
+
+void lxc_cmd_session_put(struct lxc_cmd_session *session)
+{
+	struct lxc_cmd_session **cur;
+
+	if (!session)
+		return;
+
+	pthread_mutex_lock(&lxc_cmd_sessions_lock);
+
+	if (--session->refcount > 0) {
+		pthread_mutex_unlock(&lxc_cmd_sessions_lock);
+		return;
+	}
+
+	for (cur = &lxc_cmd_sessions; *cur; cur = &(*cur)->next) {
+		if (*cur == session) {
+			*cur = session->next;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&lxc_cmd_sessions_lock);
+
+	lxc_cmd_session_free(session);
+}
+
+/*
+ * Send @cmd over @session and collect the response. Returns false if the
+ * caller should fall back to a one-shot connection.
+ * Must be called with @session->lock held.
+ */
+static bool __lxc_cmd_session_rr(struct lxc_cmd_session *session,
+				 struct lxc_cmd_rr *cmd, bool *stopped,
+				 ssize_t *ret)
+{
+	pid_t pid = lxc_raw_getpid();
+
+	/* Never interleave requests with the process we were forked from. */
+	if (session->fd >= 0 && session->owner != pid)
+		close_prot_errno_disarm(session->fd);
+
+	for (int attempt = 0; attempt < 2; attempt++) {
+		__u64 id;
+		int sent;
+
+		if (session->fd < 0) {
+			if (session->unsupported)
+				return false;
+
+			session->fd = lxc_cmd_session_open(session->name, session->lxcpath);
+			if (session->fd < 0) {
+				if (errno == ENOSYS)
+					session->unsupported = true;
+
+				if (errno != ECONNREFUSED)
+					return false;
+
+				*stopped = true;
+				*ret = -1;
+				return true;
+			}
+
+			session->owner = pid;
+		}
+
+		id = session->id++;
+		sent = lxc_cmd_session_send(session->fd, id, cmd);
+		if (sent == 0) {
+			*ret = lxc_cmd_session_recv(session->fd, id, cmd);
+			if (*ret > 0)
+				return true;
+
+			if (*ret < 0) {
+				if (errno == ECONNRESET)
+					*stopped = true;
+
+				close_prot_errno_disarm(session->fd);
+				return true;
+			}
+		}
+
+		/*
+		 * The server may have run the request before it went away.
+		 * Only send it again if it doesn't change anything.
+		 */
+		if (sent != -ENOTCONN && !lxc_cmd_read_only(cmd->req.cmd)) {
+			close_prot_errno_disarm(session->fd);
+			*ret = sent == 0 ? 0 : -1;
+			return true;
+		}
+
+		/*
+		 * The session went stale, e.g. because the container was
+		 * restarted, so reconnect.
+		 */
+		TRACE("Command session fd %d to container \"%s\" went stale", session->fd, session->name);
+		close_prot_errno_disarm(session->fd);
+	}
+
+	return false;
+}
+
+static bool lxc_cmd_session_rr(const char *name, const char *lxcpath,
+			       struct lxc_cmd_rr *cmd, bool *stopped,
+			       ssize_t *ret)
+{
+	struct lxc_cmd_session *session;
+	bool handled = false;
+
+	if (!lxcpath || !lxc_cmd_session_allowed(cmd->req.cmd))
+		return false;
+
+	pthread_mutex_lock(&lxc_cmd_sessions_lock);
+	session = __lxc_cmd_session_find(name, lxcpath);
+	if (session)
+		session->refcount++;
+	pthread_mutex_unlock(&lxc_cmd_sessions_lock);
+	if (!session)
+		return false;
+
+	/*
+	 * Don't make concurrent callers wait for each other. Whoever can't
+	 * get the session uses a one-shot connection instead.
+	 */
+	if (pthread_mutex_trylock(&session->lock) == 0) {
+		handled = __lxc_cmd_session_rr(session, cmd, stopped, ret);
+		pthread_mutex_unlock(&session->lock);
+	}
+
+	lxc_cmd_session_put(session);
+	return handled;
+}
+
 /*
  * lxc_cmd: Connect to the specified running container, send it a command
  * request and collect the response
@@ -511,6 +915,10 @@ static ssize_t lxc_cmd(const char *name, struct lxc_cmd_rr *cmd, bool *stopped,
 
 	*stopped = 0;
 
+	/* Reuse a cached session to the container if there is one. */
+	if (!hashed_sock_name && lxc_cmd_session_rr(name, lxcpath, cmd, stopped, &ret))
+		return ret;
+
 	/*发送命令请求*/
 	client_fd = lxc_cmd_send(name, cmd, lxcpath, hashed_sock_name);
 	if (client_fd < 0) {
@@ -1006,34 +1414,45 @@ char *lxc_cmd_get_config_item(const char *name, const char *item,
 	return NULL;
 }
 
-static int lxc_cmd_get_config_item_callback(int fd, struct lxc_cmd_req *req,
-					    struct lxc_handler *handler,
-					    struct lxc_epoll_descr *descr)
+static char *lxc_cmd_config_item(struct lxc_conf *conf, const char *key,
+				 int *len)
 {
 	__do_free char *cidata = NULL;
 	int cilen;
 	struct lxc_config_t *item;
-	struct lxc_cmd_rsp rsp;
 
-	memset(&rsp, 0, sizeof(rsp));
-	item = lxc_get_config(req->data);
-	cilen = item->get(req->data, NULL, 0, handler->conf, NULL);
+	item = lxc_get_config(key);
+	cilen = item->get(key, NULL, 0, conf, NULL);
 	if (cilen <= 0)
-		goto err1;
+		return NULL;
 
 	cidata = must_realloc(NULL, cilen + 1);
-	if (item->get(req->data, cidata, cilen + 1, handler->conf, NULL) != cilen)
-		goto err1;
+	if (item->get(key, cidata, cilen + 1, conf, NULL) != cilen)
+		return NULL;
 
 	cidata[cilen] = '\0';
-	rsp.data = cidata;
-	rsp.datalen = cilen + 1;
-	rsp.ret = 0;
-	goto out;
+	*len = cilen + 1;
+	return move_ptr(cidata);
+}
+
+static int lxc_cmd_get_config_item_callback(int fd, struct lxc_cmd_req *req,
+					    struct lxc_handler *handler,
+					    struct lxc_epoll_descr *descr)
+{
+	__do_free char *cidata = NULL;
+	int cilen = 0;
+	struct lxc_cmd_rsp rsp;
+
+	memset(&rsp, 0, sizeof(rsp));
+	cidata = lxc_cmd_config_item(handler->conf, req->data, &cilen);
+	if (!cidata) {
+		rsp.ret = -1;
+	} else {
+		rsp.data = cidata;
+		rsp.datalen = cilen;
+		rsp.ret = 0;
+	}
 
-err1:
-	rsp.ret = -1;
-out:
 	return lxc_cmd_rsp_send_reap(fd, &rsp);
 }
 
@@ -1863,6 +2282,413 @@ static int lxc_cmd_get_limit_cgroup2_fd_callback(int fd, struct lxc_cmd_req *req
 	return __lxc_cmd_get_cgroup2_fd_callback(fd, req, handler, descr, true);
 }
 
+static void lxc_running_info_reset(struct lxc_running_info *info)
+{
+	if (info->values) {
+		for (int i = 0; i < info->nr_keys; i++)
+			free(info->values[i]);
+		free_disarm(info->values);
+	}
+	free_disarm(info->cgroup);
+	free_disarm(info->limit_cgroup);
+	info->state = NULL;
+	info->init_pid = -1;
+}
+
+/*
+ * Parse the next value of a LXC_CMD_GET_INFO response. Returns a copy of the
+ * value, NULL if the server couldn't retrieve it, or an error pointer if the
+ * response is malformed.
+ */
+static char *lxc_cmd_info_value(const char **data, const char *end)
+{
+	struct lxc_cmd_info_value hdr;
+	const char *value;
+	char *copy;
+
+	if ((size_t)(end - *data) < sizeof(hdr))
+		return ERR_PTR(-EPROTO);
+
+	memcpy(&hdr, *data, sizeof(hdr));
+	value = *data + sizeof(hdr);
+	if ((size_t)(end - value) < hdr.len)
+		return ERR_PTR(-EPROTO);
+	*data = value + hdr.len;
+
+	if (hdr.ret < 0 || hdr.len == 0)
+		return NULL;
+
+	if (value[hdr.len - 1] != '\0')
+		return ERR_PTR(-EPROTO);
+
+	copy = strdup(value);
+	if (!copy)
+		return ERR_PTR(-ENOMEM);
+
+	return copy;
+}
+
+/*
+ * lxc_cmd_get_info: Retrieve state, init pid, cgroup paths and config items of
+ * a running container in a single request.
+ *
+ * @name      : name of container to connect to
+ * @lxcpath   : the lxcpath in which the container is running
+ * @info      : selects what to retrieve and is filled in on success
+ *
+ * Returns 0 on success, < 0 on failure. If the container's monitor doesn't
+ * know about this command -ENOSYS is returned.
+ */
+int lxc_cmd_get_info(const char *name, const char *lxcpath,
+		     struct lxc_running_info *info)
+{
+	__do_free char *reqdata = NULL, *rspdata = NULL;
+	struct lxc_cmd_info_req req = {
+		.flags		= info->flags,
+	};
+	struct lxc_cmd_info_rsp rsp;
+	bool stopped = false;
+	const char *cur, *end;
+	size_t len = sizeof(req);
+	ssize_t ret;
+	struct lxc_cmd_rr cmd;
+
+	if (info->nr_keys < 0 || (info->nr_keys > 0 && !info->keys))
+		return ret_errno(EINVAL);
+
+	for (int i = 0; i < info->nr_keys; i++) {
+		if (is_empty_string(info->keys[i]))
+			return ret_errno(EINVAL);
+
+		len += strlen(info->keys[i]) + 1;
+		if (len > LXC_CMD_DATA_MAX)
+			return ret_errno(E2BIG);
+	}
+
+	reqdata = zalloc(len);
+	if (!reqdata)
+		return ret_errno(ENOMEM);
+
+	req.nr_keys = info->nr_keys;
+	memcpy(reqdata, &req, sizeof(req));
+	len = sizeof(req);
+	for (int i = 0; i < info->nr_keys; i++) {
+		size_t keylen = strlen(info->keys[i]) + 1;
+
+		memcpy(reqdata + len, info->keys[i], keylen);
+		len += keylen;
+	}
+
+	lxc_cmd_init(&cmd, LXC_CMD_GET_INFO);
+	lxc_cmd_data(&cmd, len, reqdata);
+
+	ret = lxc_cmd(name, &cmd, &stopped, lxcpath, NULL);
+	if (ret < 0)
+		return sysdebug("Failed to process \"%s\"",
+				lxc_cmd_str(LXC_CMD_GET_INFO));
+	rspdata = cmd.rsp.data;
+
+	/* Older monitors close the connection or report -ENOSYS. */
+	if (ret == 0)
+		return ret_errno(ENOSYS);
+
+	if (cmd.rsp.ret < 0)
+		return sysdebug_set(cmd.rsp.ret, "Failed to retrieve info for \"%s\"",
+				    lxc_cmd_str(LXC_CMD_GET_INFO));
+
+	if (!rspdata || (size_t)cmd.rsp.datalen < sizeof(rsp))
+		return syserror_set(-EPROTO, "Invalid response size from server for \"%s\"",
+				    lxc_cmd_str(LXC_CMD_GET_INFO));
+
+	memcpy(&rsp, rspdata, sizeof(rsp));
+	cur = rspdata + sizeof(rsp);
+	end = rspdata + cmd.rsp.datalen;
+
+	if (rsp.nr_values != (__u32)info->nr_keys +
+			     !!(info->flags & LXC_INFO_CGROUP) +
+			     !!(info->flags & LXC_INFO_LIMIT_CGROUP))
+		return syserror_set(-EPROTO, "Unexpected number of values %u for \"%s\"",
+				    rsp.nr_values, lxc_cmd_str(LXC_CMD_GET_INFO));
+
+	info->cgroup = NULL;
+	info->limit_cgroup = NULL;
+	info->values = NULL;
+	if (info->nr_keys > 0) {
+		info->values = zalloc(info->nr_keys * sizeof(char *));
+		if (!info->values)
+			return ret_errno(ENOMEM);
+	}
+
+	info->state = NULL;
+	if (rsp.flags & LXC_INFO_STATE)
+		info->state = lxc_state2str(rsp.state);
+
+	info->init_pid = -1;
+	if (rsp.flags & LXC_INFO_INIT_PID)
+		info->init_pid = rsp.init_pid;
+
+	for (__u32 i = 0; i < rsp.nr_values; i++) {
+		char *value;
+
+		value = lxc_cmd_info_value(&cur, end);
+		if (IS_ERR(value)) {
+			lxc_running_info_reset(info);
+			return syserror_set((int)PTR_ERR(value), "Failed to parse value for \"%s\"",
+					    lxc_cmd_str(LXC_CMD_GET_INFO));
+		}
+
+		if ((info->flags & LXC_INFO_CGROUP) && i == 0) {
+			info->cgroup = value;
+			if (!value)
+				rsp.flags &= ~LXC_INFO_CGROUP;
+		} else if ((info->flags & LXC_INFO_LIMIT_CGROUP) &&
+			   i == !!(info->flags & LXC_INFO_CGROUP)) {
+			info->limit_cgroup = value;
+			if (!value)
+				rsp.flags &= ~LXC_INFO_LIMIT_CGROUP;
+		} else {
+			info->values[i - (rsp.nr_values - info->nr_keys)] = value;
+		}
+	}
+
+	info->flags = rsp.flags;
+	return 0;
+}
+
+static int lxc_cmd_info_append(char **buf, size_t *len, int err,
+			       const char *value, size_t value_len)
+{
+	struct lxc_cmd_info_value hdr = {
+		.ret = err,
+	};
+	size_t new_len;
+	char *new_buf;
+
+	if (err < 0)
+		value_len = 0;
+
+	new_len = *len + sizeof(hdr) + value_len;
+	if (new_len > LXC_CMD_INFO_DATA_MAX) {
+		hdr.ret = -E2BIG;
+		value_len = 0;
+		new_len = *len + sizeof(hdr);
+	}
+
+	new_buf = realloc(*buf, new_len);
+	if (!new_buf)
+		return ret_errno(ENOMEM);
+
+	hdr.len = value_len;
+	memcpy(new_buf + *len, &hdr, sizeof(hdr));
+	if (value_len > 0)
+		memcpy(new_buf + *len + sizeof(hdr), value, value_len);
+
+	*buf = new_buf;
+	*len = new_len;
+	return 0;
+}
+
+static int lxc_cmd_info_append_cgroup(char **buf, size_t *len,
+				      const char *path)
+{
+	if (!path)
+		return lxc_cmd_info_append(buf, len, -ENOENT, NULL, 0);
+
+	return lxc_cmd_info_append(buf, len, 0, path, strlen(path) + 1);
+}
+
+static int lxc_cmd_get_info_callback(int fd, struct lxc_cmd_req *req,
+				     struct lxc_handler *handler,
+				     struct lxc_epoll_descr *descr)
+{
+	__do_free char *buf = NULL;
+	struct lxc_cmd_rsp rsp = {
+		.ret = -EINVAL,
+	};
+	struct lxc_cmd_info_req info_req;
+	struct lxc_cmd_info_rsp info_rsp = {};
+	struct cgroup_ops *ops = handler->cgroup_ops;
+	const char *key, *end;
+	size_t len;
+	int ret;
+
+	if ((size_t)req->datalen < sizeof(info_req))
+		return lxc_cmd_rsp_send_reap(fd, &rsp);
+
+	memcpy(&info_req, req->data, sizeof(info_req));
+	key = (const char *)req->data + sizeof(info_req);
+	end = (const char *)req->data + req->datalen;
+
+	/* Make sure all keys are \0-terminated. */
+	if (info_req.nr_keys > 0 && (key == end || end[-1] != '\0'))
+		return lxc_cmd_rsp_send_reap(fd, &rsp);
+
+	len = sizeof(info_rsp);
+	buf = zalloc(len);
+	if (!buf) {
+		rsp.ret = -ENOMEM;
+		return lxc_cmd_rsp_send_reap(fd, &rsp);
+	}
+
+	info_rsp.flags = info_req.flags & (LXC_INFO_STATE | LXC_INFO_INIT_PID |
+					   LXC_INFO_CGROUP | LXC_INFO_LIMIT_CGROUP);
+	info_rsp.state = handler->state;
+	info_rsp.init_pid = handler->pid;
+
+	if (info_rsp.flags & LXC_INFO_CGROUP) {
+		ret = lxc_cmd_info_append_cgroup(&buf, &len, ops->get_cgroup(ops, NULL));
+		if (ret < 0) {
+			rsp.ret = ret;
+			return lxc_cmd_rsp_send_reap(fd, &rsp);
+		}
+		info_rsp.nr_values++;
+	}
+
+	if (info_rsp.flags & LXC_INFO_LIMIT_CGROUP) {
+		ret = lxc_cmd_info_append_cgroup(&buf, &len, ops->get_limit_cgroup(ops, NULL));
+		if (ret < 0) {
+			rsp.ret = ret;
+			return lxc_cmd_rsp_send_reap(fd, &rsp);
+		}
+		info_rsp.nr_values++;
+	}
+
+	for (__u32 i = 0; i < info_req.nr_keys; i++) {
+		__do_free char *cidata = NULL;
+		int cilen = 0;
+
+		if (key >= end)
+			return lxc_cmd_rsp_send_reap(fd, &rsp);
+
+		cidata = lxc_cmd_config_item(handler->conf, key, &cilen);
+		if (cidata)
+			ret = lxc_cmd_info_append(&buf, &len, 0, cidata, cilen);
+		else
+			ret = lxc_cmd_info_append(&buf, &len, -ENOENT, NULL, 0);
+		if (ret < 0) {
+			rsp.ret = ret;
+			return lxc_cmd_rsp_send_reap(fd, &rsp);
+		}
+		info_rsp.nr_values++;
+
+		key += strlen(key) + 1;
+	}
+
+	memcpy(buf, &info_rsp, sizeof(info_rsp));
+	rsp.ret = 0;
+	rsp.data = buf;
+	rsp.datalen = len;
+	return lxc_cmd_rsp_send_reap(fd, &rsp);
+}
+
+/*
+ * lxc_cmd_get_start_timings: Retrieve the time spent in each phase of the
+ * container's last start.
+ *
+ * @name     : name of container to connect to
+ * @lxcpath  : the lxcpath in which the container is running
+ * @timings  : the phase timings, in nanoseconds
+ *
+ * Returns 0 on success, -ENODATA if the container didn't record timings, < 0
+ * on other errors.
+ */
+int lxc_cmd_get_start_timings(const char *name, const char *lxcpath,
+			      struct lxc_start_timings *timings)
+{
+	__do_free void *data = NULL;
+	bool stopped = false;
+	struct lxc_cmd_rr cmd;
+	ssize_t ret;
+
+	lxc_cmd_init(&cmd, LXC_CMD_GET_START_TIMINGS);
+
+	ret = lxc_cmd(name, &cmd, &stopped, lxcpath, NULL);
+	data = cmd.rsp.data;
+	if (ret < 0)
+		return sysdebug("Failed to process \"%s\"",
+				lxc_cmd_str(LXC_CMD_GET_START_TIMINGS));
+
+	if (cmd.rsp.ret < 0)
+		return sysdebug_set(cmd.rsp.ret, "Failed to receive start timings");
+
+	if (!data || (size_t)cmd.rsp.datalen != sizeof(*timings))
+		return syserror_set(-EPROTO, "Received invalid start timings");
+
+	memcpy(timings, data, sizeof(*timings));
+	return 0;
+}
+
+static int lxc_cmd_get_start_timings_callback(int fd, struct lxc_cmd_req *req,
+					      struct lxc_handler *handler,
+					      struct lxc_epoll_descr *descr)
+{
+	struct lxc_cmd_rsp rsp = {
+		.ret = -ENODATA,
+	};
+
+	if (handler->timings && handler->timings->total) {
+		rsp.ret = 0;
+		rsp.data = handler->timings;
+		rsp.datalen = sizeof(*handler->timings);
+	}
+
+	return lxc_cmd_rsp_send_reap(fd, &rsp);
+}
+
+static int lxc_cmd_session_handler(int fd, uint32_t events, void *data,
+				   struct lxc_epoll_descr *descr);
+
+static void lxc_cmd_session_del(struct lxc_handler *handler, int fd)
+{
+	struct lxc_list *cur, *next;
+
+	lxc_list_for_each_safe(cur, &handler->conf->cmd_sessions, next) {
+		if (PTR_TO_INT(cur->elem) != fd)
+			continue;
+
+		lxc_list_del(cur);
+		free(cur);
+		break;
+	}
+}
+
+static int lxc_cmd_session_start_callback(int fd, struct lxc_cmd_req *req,
+					  struct lxc_handler *handler,
+					  struct lxc_epoll_descr *descr)
+{
+	__do_free struct lxc_list *session = NULL;
+	struct lxc_cmd_rsp rsp = {
+		.ret = 0,
+	};
+	int ret;
+
+	session = malloc(sizeof(*session));
+	if (!session) {
+		rsp.ret = -ENOMEM;
+		return lxc_cmd_rsp_send_reap(fd, &rsp);
+	}
+
+	/* From now on requests on this fd are handled as session requests. */
+	ret = lxc_mainloop_del_handler(descr, fd);
+	if (ret < 0)
+		return syserror_ret(ret, "Failed to remove command handler for fd %d", fd);
+
+	ret = lxc_mainloop_add_handler(descr, fd, lxc_cmd_session_handler, handler);
+	if (ret < 0)
+		return log_error(ret, "Failed to add command session handler for fd %d", fd);
+
+	session->elem = INT_TO_PTR(fd);
+	lxc_list_add_tail(&handler->conf->cmd_sessions, move_ptr(session));
+
+	ret = lxc_cmd_rsp_send_keep(fd, &rsp);
+	if (ret < 0) {
+		lxc_cmd_session_del(handler, fd);
+		return ret;
+	}
+
+	return log_trace(LXC_CMD_KEEP_CLIENT_FD, "Started command session on fd %d", fd);
+}
+
 static int lxc_cmd_rsp_send_enosys(int fd, int id)
 {
 	struct lxc_cmd_rsp rsp = {
@@ -1908,6 +2734,9 @@ static int lxc_cmd_process(int fd, struct lxc_cmd_req *req,
 		[LXC_CMD_GET_CGROUP_CTX]		= lxc_cmd_get_cgroup_ctx_callback,
 		[LXC_CMD_GET_CGROUP_FD]			= lxc_cmd_get_cgroup_fd_callback,
 		[LXC_CMD_GET_LIMIT_CGROUP_FD]		= lxc_cmd_get_limit_cgroup_fd_callback,
+		[LXC_CMD_GET_INFO]			= lxc_cmd_get_info_callback,
+		[LXC_CMD_SESSION_START]			= lxc_cmd_session_start_callback,
+		[LXC_CMD_GET_START_TIMINGS]		= lxc_cmd_get_start_timings_callback,
 	};
 
 	if (req->cmd >= LXC_CMD_MAX)
@@ -1962,6 +2791,122 @@ static void lxc_cmd_fd_cleanup(int fd, struct lxc_handler *handler,
 	close(fd);
 }
 
+static int lxc_cmd_session_set_nonblock(int fd, bool nonblock)
+{
+	int flags;
+
+	flags = fcntl(fd, F_GETFL);
+	if (flags < 0)
+		return -errno;
+
+	if (nonblock)
+		flags |= O_NONBLOCK;
+	else
+		flags &= ~O_NONBLOCK;
+
+	return fcntl(fd, F_SETFL, flags) < 0 ? -errno : 0;
+}
+
+static int lxc_cmd_session_handler(int fd, uint32_t events, void *data,
+				   struct lxc_epoll_descr *descr)
+{
+	__do_free void *reqdata = NULL;
+	struct lxc_handler *handler = data;
+	struct lxc_cmd_session_req sreq;
+	ssize_t ret;
+
+	ret = lxc_abstract_unix_rcv_credential(fd, &sreq, sizeof(sreq));
+	if (ret < 0) {
+		SYSERROR("Failed to receive data on command session fd %d", fd);
+		goto out_close;
+	}
+
+	/* The client closed the session. */
+	if (ret == 0)
+		goto out_close;
+
+	if ((size_t)ret != sizeof(sreq)) {
+		WARN("Failed to receive full command request on command session fd %d", fd);
+		goto out_close;
+	}
+
+	if ((sreq.req.datalen > LXC_CMD_DATA_MAX) && (sreq.req.cmd != LXC_CMD_CONSOLE_LOG)) {
+		ERROR("Received command data length %d is too large for command \"%s\"", sreq.req.datalen, lxc_cmd_str(sreq.req.cmd));
+		goto out_close;
+	}
+
+	if (sreq.req.datalen > 0) {
+		reqdata = must_realloc(NULL, sreq.req.datalen);
+		ret = lxc_recv_nointr(fd, reqdata, sreq.req.datalen, MSG_WAITALL);
+		if (ret != sreq.req.datalen) {
+			WARN("Failed to receive full command request. Ignoring request for \"%s\"", lxc_cmd_str(sreq.req.cmd));
+			goto out_close;
+		}
+
+		sreq.req.data = reqdata;
+	}
+
+	/*
+	 * A client which stops reading its responses must not stall the
+	 * mainloop. Once its socket buffer is full the session is closed.
+	 */
+	if (lxc_cmd_session_set_nonblock(fd, true)) {
+		SYSERROR("Failed to make command session fd %d non-blocking", fd);
+		goto out_close;
+	}
+
+	/* Tell the client which request the following response belongs to. */
+	ret = lxc_send_nointr(fd, &sreq.id, sizeof(sreq.id), MSG_NOSIGNAL);
+	if (ret < 0 || (size_t)ret != sizeof(sreq.id)) {
+		SYSERROR("Failed to send response id on command session fd %d", fd);
+		goto out_close;
+	}
+
+	if (!lxc_cmd_session_allowed(sreq.req.cmd)) {
+		struct lxc_cmd_rsp rsp = {
+			.ret = -EINVAL,
+		};
+
+		WARN("Command \"%s\" is not supported on command sessions", lxc_cmd_str(sreq.req.cmd));
+		if (__lxc_cmd_rsp_send(fd, &rsp))
+			goto out_close;
+	} else {
+		lxc_cmd_rsp_sent = false;
+		ret = lxc_cmd_process(fd, &sreq.req, handler, descr);
+
+		/* The client waits for a response to every request. */
+		if (!lxc_cmd_rsp_sent) {
+			struct lxc_cmd_rsp rsp = {
+				.ret = ret < 0 ? ret : -EIO,
+			};
+
+			WARN("Command %s didn't answer on command session fd %d", lxc_cmd_str(sreq.req.cmd), fd);
+			if (__lxc_cmd_rsp_send(fd, &rsp))
+				goto out_close;
+		}
+
+		if (ret < 0) {
+			DEBUG("Failed to process command %s; closing command session fd %d", lxc_cmd_str(sreq.req.cmd), fd);
+			goto out_close;
+		}
+
+		TRACE("Processed command %s on command session fd %d", lxc_cmd_str(sreq.req.cmd), fd);
+	}
+
+	/* The next request is read with blocking calls again. */
+	if (lxc_cmd_session_set_nonblock(fd, false)) {
+		SYSERROR("Failed to make command session fd %d blocking", fd);
+		goto out_close;
+	}
+
+	return LXC_MAINLOOP_CONTINUE;
+
+out_close:
+	lxc_cmd_session_del(handler, fd);
+	lxc_cmd_fd_cleanup(fd, handler, descr, LXC_CMD_SESSION_START);
+	return LXC_MAINLOOP_CONTINUE;
+}
+
 static int lxc_cmd_handler(int fd, uint32_t events, void *data,
 			   struct lxc_epoll_descr *descr)
 {
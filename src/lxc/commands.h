@@ -49,6 +49,9 @@ typedef enum {
 	LXC_CMD_GET_CGROUP_CTX			= 23,
 	LXC_CMD_GET_CGROUP_FD			= 24,
 	LXC_CMD_GET_LIMIT_CGROUP_FD		= 25,
+	LXC_CMD_GET_INFO			= 26,
+	LXC_CMD_SESSION_START			= 27,
+	LXC_CMD_GET_START_TIMINGS		= 28,
 	LXC_CMD_MAX,
 } lxc_cmd_t;
 
@@ -99,6 +102,49 @@ struct lxc_cmd_console_log {
 
 };
 
+/*
+ * LXC_CMD_GET_INFO request: a struct lxc_cmd_info_req followed by @nr_keys
+ * \0-terminated config keys.
+ */
+struct lxc_cmd_info_req {
+	__u32 flags;
+	__u32 nr_keys;
+};
+
+/*
+ * LXC_CMD_GET_INFO response: a struct lxc_cmd_info_rsp followed by
+ * @nr_values records each made up of a struct lxc_cmd_info_value and @len
+ * bytes of \0-terminated data. The records are, in this order, the cgroup,
+ * the limit cgroup, and the requested config keys. The cgroup records are
+ * only present if requested.
+ */
+struct lxc_cmd_info_rsp {
+	__u32 flags;
+	__s32 state;
+	__s32 init_pid;
+	__u32 nr_values;
+};
+
+struct lxc_cmd_info_value {
+	__s32 ret; /* 0 on success, -errno on failure */
+	__u32 len;
+};
+
+/* The response to LXC_CMD_GET_INFO may carry many items. */
+#define LXC_CMD_INFO_DATA_MAX (LXC_CMD_DATA_MAX * 16)
+
+/*
+ * After a successful LXC_CMD_SESSION_START the connection stays open and
+ * carries any number of requests. Each request is prefixed with a
+ * client-chosen id and the server echoes the id right before the regular
+ * response. Requests are answered in the order they were sent so a client
+ * can pipeline them.
+ */
+struct lxc_cmd_session_req {
+	__u64 id;
+	struct lxc_cmd_req req;
+};
+
 __hidden extern int lxc_cmd_terminal_winch(const char *name, const char *lxcpath);
 __hidden extern int lxc_cmd_get_tty_fd(const char *name, int *ttynum, int *fd,
 				       const char *lxcpath);
@@ -174,5 +220,53 @@ __hidden extern int lxc_cmd_get_limit_cgroup_fd(const char *name,
 						size_t size_ret_fd,
 						struct cgroup_fd *ret_fd);
 __hidden extern int lxc_cmd_get_devpts_fd(const char *name, const char *lxcpath);
+__hidden extern int lxc_cmd_get_info(const char *name, const char *lxcpath,
+				     struct lxc_running_info *info);
+
+struct lxc_start_timings;
+__hidden extern int lxc_cmd_get_start_timings(const char *name, const char *lxcpath,
+					      struct lxc_start_timings *timings);
+
+/* lxc_cmd_session_open        Open a persistent session to the container's
+ *                             command server.
+ *
+ * @param[in] name             Name of container to connect to.
+ * @param[in] lxcpath          The lxcpath in which the container is running.
+ * @return                     Session socket on success, -ENOSYS if the
+ *                             server doesn't support sessions, -ECONNREFUSED
+ *                             if the container isn't running, < 0 on error.
+ */
+__hidden extern int lxc_cmd_session_open(const char *name, const char *lxcpath);
+
+/* lxc_cmd_session_send        Send a request over a session socket.
+ *
+ * @param[in] fd               Session socket.
+ * @param[in] id               Id the server echoes with the response.
+ * @param[in] cmd              Command with initialized request to send.
+ * @return                     0 on success, -ENOTCONN if nothing was sent,
+ *                             < 0 on other errors.
+ */
+__hidden extern int lxc_cmd_session_send(int fd, __u64 id, struct lxc_cmd_rr *cmd);
+
+/* lxc_cmd_session_recv        Receive the response to a request sent with
+ *                             lxc_cmd_session_send(). Responses arrive in
+ *                             request order.
+ *
+ * @param[in] fd               Session socket.
+ * @param[in] id               Id of the request @cmd was sent with.
+ * @param[in,out] cmd          Command to put response in.
+ * @return                     Size of the response message, 0 if the server
+ *                             closed the session, < 0 on error.
+ */
+__hidden extern ssize_t lxc_cmd_session_recv(int fd, __u64 id, struct lxc_cmd_rr *cmd);
+
+/*
+ * Persistent sessions cached per (lxcpath, name). While a cached session
+ * exists all commands that can be sent over a session reuse its connection.
+ */
+struct lxc_cmd_session;
+__hidden extern struct lxc_cmd_session *lxc_cmd_session_get(const char *name,
+							    const char *lxcpath);
+__hidden extern void lxc_cmd_session_put(struct lxc_cmd_session *session);
 
 #endif /* __commands_h */
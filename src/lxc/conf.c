@@ -1435,6 +1435,15 @@ static int lxc_mount_rootfs(struct lxc_rootfs *rootfs)
 		return log_error_errno(-1, errno, "Failed to access to \"%s\". Check it is present",
 				       rootfs->mount);
 
+	/* Only the container's own rootfs mount gets a throwaway upper layer. */
+	if (rootfs->overlay_tmpfs) {
+		if (strequal(rootfs->storage->type, "overlay") ||
+		    strequal(rootfs->storage->type, "overlayfs"))
+			rootfs->storage->flags |= LXC_STORAGE_INTERNAL_TMPFS_UPPER;
+		else
+			WARN("Ignoring lxc.rootfs.overlay.tmpfs for %s rootfs", rootfs->storage->type);
+	}
+
 	//挂载块设备
 	ret = rootfs->storage->ops->mount(rootfs->storage);
 	if (ret < 0)
@@ -3265,6 +3274,7 @@ struct lxc_conf *lxc_conf_init(void)
 		lxc_list_init(&new->hooks[i]);
 	lxc_list_init(&new->groups);
 	lxc_list_init(&new->state_clients);
+	lxc_list_init(&new->cmd_sessions);
 	new->lsm_aa_profile = NULL;
 	lxc_list_init(&new->lsm_aa_raw);
 	new->lsm_se_context = NULL;
@@ -4639,6 +4649,8 @@ void lxc_conf_free(struct lxc_conf *conf)
 	free(conf->init_cwd);
 	free(conf->unexpanded_config);
 	free(conf->syslog);
+	for (int i = 0; i < LXC_PRESSURE_MAX; i++)
+		free(conf->monitor_pressure[i]);
 	lxc_free_networks(&conf->network);
 	free(conf->lsm_aa_profile);
 	free(conf->lsm_aa_profile_computed);
@@ -22,6 +22,7 @@
 #include "list.h"
 #include "lxcseccomp.h"
 #include "memory_utils.h"
+#include "monitor.h"
 #include "namespace.h"
 #include "ringbuf.h"
 #include "start.h"
@@ -246,6 +247,8 @@ struct lxc_rootfs {
 	bool managed;
 	struct lxc_mount_options mnt_opts;
 	struct lxc_storage *storage;
+	/* Size of the tmpfs holding the upper layer of an overlay rootfs. */
+	uint64_t overlay_tmpfs;
 };
 
 /*
@@ -428,6 +431,8 @@ struct lxc_conf {
 	char *logfile; /* the logfile as specified in config */
 	int loglevel; /* loglevel as specified in config (if any) */
 	int logfd;
+	uint64_t log_buffer_size; /* 0 writes every log line right away */
+	int log_format; /* enum lxc_log_format of the logfile */
 
 	unsigned int start_auto;
 	unsigned int start_delay;
@@ -439,6 +444,12 @@ struct lxc_conf {
 	unsigned int monitor_unshare;
 	unsigned int monitor_signal_pdeath;
 
+	/* cgroup2 PSI triggers, e.g. "some 150000 1000000", per resource and
+	 * the bitmask of memory.events counters the monitor reports.
+	 */
+	char *monitor_pressure[LXC_PRESSURE_MAX];
+	unsigned int monitor_memory_events;
+
 	/* list of included files */
 	struct lxc_list includes;
 	/* config entries which are not "lxc.*" are aliens */
@@ -500,6 +511,9 @@ struct lxc_conf {
 	/* A list of clients registered to be informed about a container state. */
 	struct lxc_list state_clients;
 
+	/* A list of client fds that switched to a persistent command session. */
+	struct lxc_list cmd_sessions;
+
 	/* sysctls */
 	struct lxc_list sysctls;
 
@@ -12,6 +12,7 @@
 #include <inttypes.h>
 #include <net/if.h>
 #include <netinet/in.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -94,10 +95,14 @@ lxc_config_define(init_uid);
 lxc_config_define(init_groups);
 lxc_config_define(jump_table_net);
 lxc_config_define(keyring_session);
+lxc_config_define(log_buffer_size);
 lxc_config_define(log_file);
+lxc_config_define(log_format);
 lxc_config_define(log_level);
 lxc_config_define(log_syslog);
 lxc_config_define(monitor);
+lxc_config_define(monitor_memory_events);
+lxc_config_define(monitor_pressure);
 lxc_config_define(monitor_signal_pdeath);
 lxc_config_define(mount);
 lxc_config_define(mount_auto);
@@ -138,6 +143,7 @@ lxc_config_define(pty_max);
 lxc_config_define(rootfs_managed);
 lxc_config_define(rootfs_mount);
 lxc_config_define(rootfs_options);
+lxc_config_define(rootfs_overlay_tmpfs);
 lxc_config_define(rootfs_path);
 lxc_config_define(seccomp_profile);
 lxc_config_define(seccomp_allow_nesting);
@@ -232,11 +238,17 @@ static struct lxc_config_t config_jump_table[] = {
 	{ "lxc.init.uid",                   true,  set_config_init_uid,                   get_config_init_uid,                   clr_config_init_uid,                   },
 	{ "lxc.init.cwd",                   true,  set_config_init_cwd,                   get_config_init_cwd,                   clr_config_init_cwd,                   },
 	{ "lxc.keyring.session",            true,  set_config_keyring_session,            get_config_keyring_session,            clr_config_keyring_session             },
+	{ "lxc.log.buffer.size",            true,  set_config_log_buffer_size,            get_config_log_buffer_size,            clr_config_log_buffer_size,            },
 	{ "lxc.log.file",                   true,  set_config_log_file,                   get_config_log_file,                   clr_config_log_file,                   },
+	{ "lxc.log.format",                 true,  set_config_log_format,                 get_config_log_format,                 clr_config_log_format,                 },
 	{ "lxc.log.level",                  true,  set_config_log_level,                  get_config_log_level,                  clr_config_log_level,                  },
 	{ "lxc.log.syslog",                 true,  set_config_log_syslog,                 get_config_log_syslog,                 clr_config_log_syslog,                 },
 	{ "lxc.monitor.unshare",            true,  set_config_monitor,                    get_config_monitor,                    clr_config_monitor,                    },
 	{ "lxc.monitor.signal.pdeath",      true,  set_config_monitor_signal_pdeath,      get_config_monitor_signal_pdeath,      clr_config_monitor_signal_pdeath,      },
+	{ "lxc.monitor.pressure.cpu",       true,  set_config_monitor_pressure,           get_config_monitor_pressure,           clr_config_monitor_pressure,           },
+	{ "lxc.monitor.pressure.memory",    true,  set_config_monitor_pressure,           get_config_monitor_pressure,           clr_config_monitor_pressure,           },
+	{ "lxc.monitor.pressure.io",        true,  set_config_monitor_pressure,           get_config_monitor_pressure,           clr_config_monitor_pressure,           },
+	{ "lxc.monitor.memory_events",      true,  set_config_monitor_memory_events,      get_config_monitor_memory_events,      clr_config_monitor_memory_events,      },
 	{ "lxc.mount.auto",                 true,  set_config_mount_auto,                 get_config_mount_auto,                 clr_config_mount_auto,                 },
 	{ "lxc.mount.entry",                true,  set_config_mount,                      get_config_mount,                      clr_config_mount,                      },
 	{ "lxc.mount.fstab",                true,  set_config_mount_fstab,                get_config_mount_fstab,                clr_config_mount_fstab,                },
@@ -253,6 +265,7 @@ static struct lxc_config_t config_jump_table[] = {
 	{ "lxc.rootfs.managed",             true,  set_config_rootfs_managed,             get_config_rootfs_managed,             clr_config_rootfs_managed,             },
 	{ "lxc.rootfs.mount",               true,  set_config_rootfs_mount,               get_config_rootfs_mount,               clr_config_rootfs_mount,               },
 	{ "lxc.rootfs.options",             true,  set_config_rootfs_options,             get_config_rootfs_options,             clr_config_rootfs_options,             },
+	{ "lxc.rootfs.overlay.tmpfs",       true,  set_config_rootfs_overlay_tmpfs,       get_config_rootfs_overlay_tmpfs,       clr_config_rootfs_overlay_tmpfs,       },
 	{ "lxc.rootfs.path",                true,  set_config_rootfs_path,                get_config_rootfs_path,                clr_config_rootfs_path,                },
 	{ "lxc.seccomp.allow_nesting",      true,  set_config_seccomp_allow_nesting,      get_config_seccomp_allow_nesting,      clr_config_seccomp_allow_nesting,      },
 	{ "lxc.seccomp.notify.cookie",      true,  set_config_seccomp_notify_cookie,      get_config_seccomp_notify_cookie,      clr_config_seccomp_notify_cookie,      },
@@ -321,73 +334,149 @@ static struct lxc_config_net_t unsupported_config_net_key = {
 	clr_config_unsupported_key,
 };
 
-struct lxc_config_t *lxc_get_config_exact(const char *key)
+/*
+ * Hash index over the names of a jump table so a lookup doesn't have to
+ * compare the key against every entry. Entries which aren't strict match on a
+ * prefix of the key and are additionally kept in @prefixes in table order so
+ * the first matching entry still wins.
+ */
+#define LXC_CONFIG_INDEX_SIZE 256
+
+struct lxc_config_index {
+	struct {
+		const char *name;
+		size_t idx;
+	} slots[LXC_CONFIG_INDEX_SIZE];
+	struct {
+		const char *name;
+		size_t len;
+		size_t idx;
+	} prefixes[LXC_CONFIG_INDEX_SIZE];
+	size_t nr_prefixes;
+};
+
+static struct lxc_config_index config_index;
+static struct lxc_config_index config_net_index;
+
+/* FNV-1a */
+static inline uint32_t lxc_config_hash(const char *key)
 {
-	size_t i;
+	uint32_t hash = 2166136261U;
 
-	for (i = 0; i < ARRAY_SIZE(config_jump_table); i++)
-		if (strequal(config_jump_table[i].name, key))
-			return &config_jump_table[i];
+	for (; *key; key++) {
+		hash ^= (unsigned char)*key;
+		hash *= 16777619U;
+	}
 
-	return NULL;
+	return hash;
 }
 
-/* Assume a reasonable subkey size limit. */
-#define LXC_SUBKEY_LEN_MAX 256
-
-static inline int match_config_item(const struct lxc_config_t *entry, const char *key)
+static void lxc_config_index_add(struct lxc_config_index *index,
+				 const char *name, bool strict, size_t idx)
 {
-	size_t len;
+	uint32_t slot = lxc_config_hash(name);
+
+	for (;; slot++) {
+		slot &= LXC_CONFIG_INDEX_SIZE - 1;
+		if (!index->slots[slot].name)
+			break;
 
-	if (entry->strict)
-		return strequal(entry->name, key);
+		/* Keep the first entry of duplicate names. */
+		if (strequal(index->slots[slot].name, name))
+			return;
+	}
 
-	/* There should be no subkey longer than this. */
-	len = strnlen(entry->name, LXC_SUBKEY_LEN_MAX);
-	if (len == LXC_SUBKEY_LEN_MAX)
-		return error_ret(-E2BIG, "Excessive subkey length");
+	index->slots[slot].name = name;
+	index->slots[slot].idx = idx;
 
-	return strnequal(entry->name, key, len);
+	if (!strict) {
+		index->prefixes[index->nr_prefixes].name = name;
+		index->prefixes[index->nr_prefixes].len = strlen(name);
+		index->prefixes[index->nr_prefixes].idx = idx;
+		index->nr_prefixes++;
+	}
 }
 
-struct lxc_config_t *lxc_get_config(const char *key)
+/* Returns the table index of the entry named @key or -1. */
+static ssize_t lxc_config_index_exact(const struct lxc_config_index *index,
+				      const char *key)
 {
-	for (size_t i = 0; i < ARRAY_SIZE(config_jump_table); i++) {
-		struct lxc_config_t *cur = &config_jump_table[i];
+	uint32_t slot = lxc_config_hash(key);
 
-		switch (match_config_item(cur, key)) {
-		case 0:
-			continue;
-		case -E2BIG:
-			return &unsupported_config_key;
-		}
+	for (;; slot++) {
+		slot &= LXC_CONFIG_INDEX_SIZE - 1;
+		if (!index->slots[slot].name)
+			return -1;
 
-		return cur;
+		if (strequal(index->slots[slot].name, key))
+			return index->slots[slot].idx;
 	}
+}
 
-	return &unsupported_config_key;
+/* Returns the table index of the first entry matching @key or -1. */
+static ssize_t lxc_config_index_find(const struct lxc_config_index *index,
+				     const char *key)
+{
+	ssize_t idx;
+
+	idx = lxc_config_index_exact(index, key);
+	for (size_t i = 0; i < index->nr_prefixes; i++) {
+		if (idx >= 0 && index->prefixes[i].idx >= (size_t)idx)
+			break;
+
+		if (strnequal(index->prefixes[i].name, key, index->prefixes[i].len))
+			return index->prefixes[i].idx;
+	}
+
+	return idx;
 }
 
-static inline bool match_config_net_item(const struct lxc_config_net_t *entry,
-					 const char *key)
+__attribute__((constructor)) static void lxc_config_index_init(void)
 {
-	if (entry->strict)
-		return strequal(entry->name, key);
-	return strnequal(entry->name, key, strlen(entry->name));
+	/* Leave enough free slots to keep probe sequences short. */
+	BUILD_BUG_ON(ARRAY_SIZE(config_jump_table) > LXC_CONFIG_INDEX_SIZE / 2);
+	BUILD_BUG_ON(ARRAY_SIZE(config_jump_table_net) > LXC_CONFIG_INDEX_SIZE / 2);
+
+	for (size_t i = 0; i < ARRAY_SIZE(config_jump_table); i++)
+		lxc_config_index_add(&config_index, config_jump_table[i].name,
+				     config_jump_table[i].strict, i);
+
+	for (size_t i = 0; i < ARRAY_SIZE(config_jump_table_net); i++)
+		lxc_config_index_add(&config_net_index, config_jump_table_net[i].name,
+				     config_jump_table_net[i].strict, i);
 }
 
-static struct lxc_config_net_t *lxc_get_config_net(const char *key)
+struct lxc_config_t *lxc_get_config_exact(const char *key)
 {
-	for (size_t i = 0; i < ARRAY_SIZE(config_jump_table_net); i++) {
-		struct lxc_config_net_t *cur = &config_jump_table_net[i];
+	ssize_t idx;
 
-		if (!match_config_net_item(cur, key))
-			continue;
+	idx = lxc_config_index_exact(&config_index, key);
+	if (idx < 0)
+		return NULL;
 
-		return cur;
-	}
+	return &config_jump_table[idx];
+}
+
+struct lxc_config_t *lxc_get_config(const char *key)
+{
+	ssize_t idx;
+
+	idx = lxc_config_index_find(&config_index, key);
+	if (idx < 0)
+		return &unsupported_config_key;
+
+	return &config_jump_table[idx];
+}
+
+static struct lxc_config_net_t *lxc_get_config_net(const char *key)
+{
+	ssize_t idx;
+
+	idx = lxc_config_index_find(&config_net_index, key);
+	if (idx < 0)
+		return &unsupported_config_net_key;
 
-	return &unsupported_config_net_key;
+	return &config_jump_table_net[idx];
 }
 
 //通过lxc.net 配置lxc无网络
@@ -1529,6 +1618,69 @@ static int set_config_monitor_signal_pdeath(const char *key, const char *value,
 	return ret_errno(EINVAL);
 }
 
+/*
+ * A cgroup2 PSI trigger as written to the pressure file, e.g.
+ * "some 150000 1000000" for a stall of 150ms within a 1s window.
+ */
+static int set_config_monitor_pressure(const char *key, const char *value,
+				       struct lxc_conf *lxc_conf, void *data)
+{
+	__do_free char *trigger = NULL;
+	unsigned int stall, window;
+	int resource;
+	char kind[5];
+
+	resource = lxc_str2pressure(key + STRLITERALLEN("lxc.monitor.pressure."));
+	if (resource < 0)
+		return ret_errno(EINVAL);
+
+	if (lxc_config_value_empty(value))
+		return clr_config_monitor_pressure(key, lxc_conf, data);
+
+	if (sscanf(value, "%4s %u %u", kind, &stall, &window) != 3 ||
+	    (!strequal(kind, "some") && !strequal(kind, "full")))
+		return log_error_errno(-EINVAL, EINVAL, "Invalid pressure trigger \"%s\"", value);
+
+	if (stall == 0 || stall > window)
+		return log_error_errno(-EINVAL, EINVAL, "Invalid pressure trigger \"%s\"", value);
+
+	trigger = strdup(value);
+	if (!trigger)
+		return ret_errno(ENOMEM);
+
+	free(lxc_conf->monitor_pressure[resource]);
+	lxc_conf->monitor_pressure[resource] = move_ptr(trigger);
+	return 0;
+}
+
+static int set_config_monitor_memory_events(const char *key, const char *value,
+					    struct lxc_conf *lxc_conf, void *data)
+{
+	__do_free char *events = NULL;
+	unsigned int mask = 0;
+	char *token;
+
+	if (lxc_config_value_empty(value))
+		return clr_config_monitor_memory_events(key, lxc_conf, data);
+
+	events = strdup(value);
+	if (!events)
+		return ret_errno(ENOMEM);
+
+	lxc_iterate_parts(token, events, " \t") {
+		int event;
+
+		event = lxc_str2memory_event(token);
+		if (event < 0)
+			return log_error_errno(-EINVAL, EINVAL, "Invalid memory event \"%s\"", token);
+
+		mask |= (1U << event);
+	}
+
+	lxc_conf->monitor_memory_events |= mask;
+	return 0;
+}
+
 static int set_config_group(const char *key, const char *value,
 			    struct lxc_conf *lxc_conf, void *data)
 {
@@ -1764,6 +1916,55 @@ static int set_config_log_file(const char *key, const char *value,
 	return ret;
 }
 
+static int set_config_log_buffer_size(const char *key, const char *value,
+				      struct lxc_conf *lxc_conf, void *data)
+{
+	int ret;
+	long long int size;
+
+	if (lxc_config_value_empty(value)) {
+		lxc_conf->log_buffer_size = 0;
+		return 0;
+	}
+
+	/* If the user specified "auto" the default buffer size is 2^16 = 64 Kib */
+	if (strequal(value, "auto")) {
+		lxc_conf->log_buffer_size = 1 << 16;
+		return 0;
+	}
+
+	ret = parse_byte_size_string(value, &size);
+	if (ret)
+		return ret;
+
+	if (size < 0)
+		return ret_errno(EINVAL);
+
+	/* A buffer must fit at least one complete log line. */
+	if (size > 0 && size < LXC_LOG_BUFFER_SIZE) {
+		NOTICE("Requested log buffer size is %lld but must be at least %d bytes. Setting log buffer size to %d bytes",
+		       size, LXC_LOG_BUFFER_SIZE, LXC_LOG_BUFFER_SIZE);
+		size = LXC_LOG_BUFFER_SIZE;
+	}
+
+	lxc_conf->log_buffer_size = size;
+
+	return 0;
+}
+
+static int set_config_log_format(const char *key, const char *value,
+				 struct lxc_conf *lxc_conf, void *data)
+{
+	if (lxc_config_value_empty(value) || strequal(value, "text"))
+		lxc_conf->log_format = LXC_LOG_FORMAT_TEXT;
+	else if (strequal(value, "binary"))
+		lxc_conf->log_format = LXC_LOG_FORMAT_BINARY;
+	else
+		return ret_errno(EINVAL);
+
+	return 0;
+}
+
 static int set_config_log_level(const char *key, const char *value,
 			       struct lxc_conf *lxc_conf, void *data)
 {
@@ -2722,12 +2923,166 @@ int append_unexp_config_line(const char *line, struct lxc_conf *conf)
 	return 0;
 }
 
+static int append_unexp_config(const char *buf, size_t len, struct lxc_conf *conf)
+{
+	while (conf->unexpanded_alloced <= conf->unexpanded_len + len + 1) {
+		char *tmp;
+
+		tmp = realloc(conf->unexpanded_config, conf->unexpanded_alloced + MAX(len, 1024));
+		if (!tmp)
+			return ret_errno(ENOMEM);
+
+		if (!conf->unexpanded_config)
+			*tmp = '\0';
+
+		conf->unexpanded_config = tmp;
+		conf->unexpanded_alloced += MAX(len, 1024);
+	}
+
+	memcpy(conf->unexpanded_config + conf->unexpanded_len, buf, len);
+	conf->unexpanded_len += len;
+	conf->unexpanded_config[conf->unexpanded_len] = '\0';
+
+	return 0;
+}
+
+/*
+ * Snapshot of a parsed config file. It records the key/value pairs handed to
+ * the setters after all includes have been expanded, the raw text of the top
+ * level file and the identity of every file and include directory that was
+ * read so it can be replayed as long as none of them changed.
+ */
+struct lxc_config_file_id {
+	char *path;
+	bool missing;
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+	struct timespec ctime;
+};
+
+struct lxc_config_snapshot {
+	char *path;
+	uint32_t hash;
+	int refcount;
+	/* Set if replaying would not give the same result as parsing. */
+	bool uncacheable;
+	struct lxc_config_file_id *files;
+	size_t nr_files;
+	char *unexpanded;
+	size_t unexpanded_len;
+	/* "key\0value\0" for each recorded line. */
+	char *items;
+	size_t items_len;
+	size_t items_alloced;
+	struct lxc_config_snapshot *next;
+};
+
+/* The snapshot being recorded by the current config read, if any. */
+static thread_local struct lxc_config_snapshot *config_snapshot;
+
+static void config_snapshot_put(struct lxc_config_snapshot *snap)
+{
+	if (!snap || __atomic_sub_fetch(&snap->refcount, 1, __ATOMIC_ACQ_REL))
+		return;
+
+	for (size_t i = 0; i < snap->nr_files; i++)
+		free(snap->files[i].path);
+	free(snap->files);
+	free(snap->unexpanded);
+	free(snap->items);
+	free(snap->path);
+	free(snap);
+}
+
+static bool config_file_id_get(const char *path, bool dir,
+			       struct lxc_config_file_id *id)
+{
+	struct stat st;
+
+	if (stat(path, &st) < 0) {
+		/* A missing include directory is silently skipped. */
+		if (!dir || errno != ENOENT)
+			return false;
+
+		id->missing = true;
+		return true;
+	}
+
+	id->missing = false;
+	id->dev = st.st_dev;
+	id->ino = st.st_ino;
+	id->size = st.st_size;
+	id->mtime = st.st_mtim;
+	id->ctime = st.st_ctim;
+	return true;
+}
+
+static void config_snapshot_add_file(struct lxc_config_snapshot *snap,
+				     const char *path, bool dir)
+{
+	struct lxc_config_file_id *files, *id;
+
+	if (snap->uncacheable)
+		return;
+
+	files = realloc(snap->files, (snap->nr_files + 1) * sizeof(*files));
+	if (!files) {
+		snap->uncacheable = true;
+		return;
+	}
+	snap->files = files;
+
+	id = &files[snap->nr_files];
+	id->path = strdup(path);
+	if (!id->path || !config_file_id_get(path, dir, id)) {
+		free(id->path);
+		snap->uncacheable = true;
+		return;
+	}
+
+	snap->nr_files++;
+}
+
+static void config_snapshot_add_item(struct lxc_config_snapshot *snap,
+				     const char *key, const char *value)
+{
+	size_t keylen = strlen(key) + 1, valuelen = strlen(value) + 1;
+
+	if (snap->uncacheable)
+		return;
+
+	if (snap->items_len + keylen + valuelen > snap->items_alloced) {
+		size_t alloced = MAX(snap->items_alloced * 2, snap->items_len + keylen + valuelen);
+		char *items;
+
+		items = realloc(snap->items, alloced);
+		if (!items) {
+			snap->uncacheable = true;
+			return;
+		}
+
+		snap->items = items;
+		snap->items_alloced = alloced;
+	}
+
+	memcpy(snap->items + snap->items_len, key, keylen);
+	snap->items_len += keylen;
+	memcpy(snap->items + snap->items_len, value, valuelen);
+	snap->items_len += valuelen;
+}
+
 static int do_includedir(const char *dirp, struct lxc_conf *lxc_conf)
 {
 	__do_closedir DIR *dir = NULL;
 	struct dirent *direntp;
 	int len, ret;
 
+	/* Entries being added or removed change the directory's mtime. */
+	if (config_snapshot)
+		config_snapshot_add_file(config_snapshot, dirp, true);
+
 	dir = opendir(dirp);
 	if (!dir)
 		return errno == ENOENT ? 0 : -errno;
@@ -2873,6 +3228,28 @@ static int set_config_rootfs_options(const char *key, const char *value,
 	return 0;
 }
 
+static int set_config_rootfs_overlay_tmpfs(const char *key, const char *value,
+					   struct lxc_conf *lxc_conf, void *data)
+{
+	int ret;
+	long long int size;
+
+	if (lxc_config_value_empty(value)) {
+		lxc_conf->rootfs.overlay_tmpfs = 0;
+		return 0;
+	}
+
+	ret = parse_byte_size_string(value, &size);
+	if (ret)
+		return ret;
+
+	if (size < 0)
+		return ret_errno(EINVAL);
+
+	lxc_conf->rootfs.overlay_tmpfs = size;
+	return 0;
+}
+
 static int set_config_uts_name(const char *key, const char *value,
 			      struct lxc_conf *lxc_conf, void *data)
 {
@@ -3090,6 +3467,10 @@ static int parse_line(char *buffer, void *data)
 		ret = append_unexp_config_line(line, plc->conf);
 		if (ret < 0)
 			return ret;
+
+		/* A randomized hwaddr has to be generated anew on every load. */
+		if (config_snapshot && !strequal(line, dup))
+			config_snapshot->uncacheable = true;
 	}
 
 	if (empty_line)
@@ -3136,6 +3517,12 @@ static int parse_line(char *buffer, void *data)
 
 	//查询key配置是否为合法的配置项
 	config = lxc_get_config(key);
+
+	/* The lines of included files are recorded as they are read. */
+	if (config_snapshot && (config->set != set_config_includefiles ||
+				lxc_config_value_empty(value)))
+		config_snapshot_add_item(config_snapshot, key, value);
+
 	//设置配置的key,value
 	return config->set(key, value, plc->conf, NULL);
 }
@@ -3207,7 +3594,7 @@ static struct new_config_item *parse_new_conf_line(char *buffer)
 }
 
 //加载配置文件
-int lxc_config_read(const char *file/*配置文件的名称*/, struct lxc_conf *conf, bool from_include)
+static int __lxc_config_read(const char *file/*配置文件的名称*/, struct lxc_conf *conf, bool from_include)
 {
 	struct parse_line_conf plc;
 
@@ -3222,10 +3609,250 @@ int lxc_config_read(const char *file/*配置文件的名称*/, struct lxc_conf *
 	    /*如果未指定rcfile,则使用file做为rcfile*/
 		conf->rcfile = strdup(file);
 
+	if (config_snapshot)
+		config_snapshot_add_file(config_snapshot, file, false);
+
 	//针对每行配置文件，执行parse_line函数，解析key,value,并将其添加到conf中
 	return lxc_file_for_each_line_mmap(file, parse_line, &plc);
 }
 
+#define LXC_CONFIG_CACHE_BUCKETS 1024
+#define LXC_CONFIG_CACHE_MAX 65536
+
+static struct lxc_config_cache {
+	pthread_mutex_t lock;
+	bool enabled;
+	size_t nr_snapshots;
+	struct lxc_config_snapshot *buckets[LXC_CONFIG_CACHE_BUCKETS];
+} config_cache = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static bool config_snapshot_valid(const struct lxc_config_snapshot *snap)
+{
+	for (size_t i = 0; i < snap->nr_files; i++) {
+		const struct lxc_config_file_id *id = &snap->files[i];
+		struct lxc_config_file_id cur;
+
+		if (!config_file_id_get(id->path, id->missing, &cur))
+			return false;
+
+		if (cur.missing || id->missing) {
+			if (cur.missing != id->missing)
+				return false;
+
+			continue;
+		}
+
+		if (cur.dev != id->dev || cur.ino != id->ino ||
+		    cur.size != id->size ||
+		    cur.mtime.tv_sec != id->mtime.tv_sec ||
+		    cur.mtime.tv_nsec != id->mtime.tv_nsec ||
+		    cur.ctime.tv_sec != id->ctime.tv_sec ||
+		    cur.ctime.tv_nsec != id->ctime.tv_nsec)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * A file changed within the granularity of the filesystem's timestamps may be
+ * changed again without its identity changing. Don't keep snapshots of such
+ * files around, the next load will record them again.
+ */
+static bool config_snapshot_racy(const struct lxc_config_snapshot *snap)
+{
+	struct timespec now;
+
+	if (clock_gettime(CLOCK_REALTIME, &now) < 0)
+		return true;
+
+	for (size_t i = 0; i < snap->nr_files; i++) {
+		const struct lxc_config_file_id *id = &snap->files[i];
+
+		if (id->missing)
+			continue;
+
+		if (id->ctime.tv_sec + 1 >= now.tv_sec ||
+		    id->mtime.tv_sec + 1 >= now.tv_sec)
+			return true;
+	}
+
+	return false;
+}
+
+static struct lxc_config_snapshot *config_cache_get(const char *file)
+{
+	struct lxc_config_snapshot *snap;
+	uint32_t hash = lxc_config_hash(file);
+
+	pthread_mutex_lock(&config_cache.lock);
+	for (snap = config_cache.buckets[hash % LXC_CONFIG_CACHE_BUCKETS]; snap; snap = snap->next) {
+		if (snap->hash == hash && strequal(snap->path, file)) {
+			__atomic_add_fetch(&snap->refcount, 1, __ATOMIC_RELAXED);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&config_cache.lock);
+
+	return snap;
+}
+
+/* Replace the snapshot of @snap->path. Takes over the caller's reference. */
+static void config_cache_store(struct lxc_config_snapshot *snap)
+{
+	struct lxc_config_snapshot **slot, *old = NULL;
+
+	pthread_mutex_lock(&config_cache.lock);
+	slot = &config_cache.buckets[snap->hash % LXC_CONFIG_CACHE_BUCKETS];
+	for (; *slot; slot = &(*slot)->next) {
+		if ((*slot)->hash == snap->hash && strequal((*slot)->path, snap->path)) {
+			old = *slot;
+			*slot = old->next;
+			config_cache.nr_snapshots--;
+			break;
+		}
+	}
+
+	if (snap->uncacheable || !config_cache.enabled ||
+	    config_cache.nr_snapshots >= LXC_CONFIG_CACHE_MAX) {
+		pthread_mutex_unlock(&config_cache.lock);
+		config_snapshot_put(old);
+		config_snapshot_put(snap);
+		return;
+	}
+
+	slot = &config_cache.buckets[snap->hash % LXC_CONFIG_CACHE_BUCKETS];
+	snap->next = *slot;
+	*slot = snap;
+	config_cache.nr_snapshots++;
+	pthread_mutex_unlock(&config_cache.lock);
+
+	config_snapshot_put(old);
+}
+
+void lxc_config_cache_set(bool enable)
+{
+	struct lxc_config_snapshot *snaps = NULL;
+
+	pthread_mutex_lock(&config_cache.lock);
+	config_cache.enabled = enable;
+	if (!enable) {
+		for (size_t i = 0; i < LXC_CONFIG_CACHE_BUCKETS; i++) {
+			while (config_cache.buckets[i]) {
+				struct lxc_config_snapshot *snap = config_cache.buckets[i];
+
+				config_cache.buckets[i] = snap->next;
+				snap->next = snaps;
+				snaps = snap;
+			}
+		}
+		config_cache.nr_snapshots = 0;
+	}
+	pthread_mutex_unlock(&config_cache.lock);
+
+	while (snaps) {
+		struct lxc_config_snapshot *snap = snaps;
+
+		snaps = snap->next;
+		config_snapshot_put(snap);
+	}
+}
+
+static int config_snapshot_replay(const struct lxc_config_snapshot *snap,
+				  const char *file, struct lxc_conf *conf)
+{
+	const char *end = snap->items + snap->items_len;
+	int ret;
+
+	if (!conf->rcfile)
+		conf->rcfile = strdup(file);
+
+	if (snap->unexpanded_len) {
+		ret = append_unexp_config(snap->unexpanded, snap->unexpanded_len, conf);
+		if (ret < 0)
+			return ret;
+	}
+
+	for (const char *key = snap->items; key < end;) {
+		const char *value = key + strlen(key) + 1;
+
+		ret = lxc_get_config(key)->set(key, value, conf, NULL);
+		if (ret < 0)
+			return ret;
+
+		key = value + strlen(value) + 1;
+	}
+
+	return 0;
+}
+
+static int lxc_config_read_cached(const char *file, struct lxc_conf *conf)
+{
+	struct lxc_config_snapshot *snap;
+	size_t unexpanded_len;
+	int ret;
+
+	snap = config_cache_get(file);
+	if (snap) {
+		if (config_snapshot_valid(snap)) {
+			TRACE("Replaying cached config \"%s\"", file);
+			ret = config_snapshot_replay(snap, file, conf);
+			config_snapshot_put(snap);
+			return ret;
+		}
+
+		config_snapshot_put(snap);
+	}
+
+	snap = zalloc(sizeof(*snap));
+	if (!snap)
+		return ret_errno(ENOMEM);
+
+	snap->refcount = 1;
+	snap->path = strdup(file);
+	if (!snap->path) {
+		config_snapshot_put(snap);
+		return ret_errno(ENOMEM);
+	}
+	snap->hash = lxc_config_hash(file);
+
+	unexpanded_len = conf->unexpanded_len;
+	config_snapshot = snap;
+	ret = __lxc_config_read(file, conf, false);
+	config_snapshot = NULL;
+	if (ret < 0) {
+		config_snapshot_put(snap);
+		return ret;
+	}
+
+	if (!snap->uncacheable) {
+		snap->unexpanded_len = conf->unexpanded_len - unexpanded_len;
+		if (snap->unexpanded_len) {
+			snap->unexpanded = memdup(conf->unexpanded_config + unexpanded_len,
+						  snap->unexpanded_len + 1);
+			if (!snap->unexpanded)
+				snap->uncacheable = true;
+		}
+
+		if (config_snapshot_racy(snap))
+			snap->uncacheable = true;
+	}
+
+	config_cache_store(snap);
+	return ret;
+}
+
+int lxc_config_read(const char *file, struct lxc_conf *conf, bool from_include)
+{
+	if (!from_include && conf &&
+	    __atomic_load_n(&config_cache.enabled, __ATOMIC_RELAXED))
+		return lxc_config_read_cached(file, conf);
+
+	return __lxc_config_read(file, conf, from_include);
+}
+
 //将命令行传入的配置行加入defines
 int lxc_config_define_add(struct lxc_list *defines, char *arg)
 {
@@ -4149,12 +4776,25 @@ static int get_config_log_level(const char *key, char *retv, int inlen,
 	return lxc_get_conf_str(retv, inlen, v);
 }
 
+static int get_config_log_buffer_size(const char *key, char *retv, int inlen,
+				      struct lxc_conf *c, void *data)
+{
+	return lxc_get_conf_uint64(c, retv, inlen, c->log_buffer_size);
+}
+
 static int get_config_log_file(const char *key, char *retv, int inlen,
 			      struct lxc_conf *c, void *data)
 {
 	return lxc_get_conf_str(retv, inlen, c->logfile);
 }
 
+static int get_config_log_format(const char *key, char *retv, int inlen,
+				 struct lxc_conf *c, void *data)
+{
+	return lxc_get_conf_str(retv, inlen,
+				c->log_format == LXC_LOG_FORMAT_BINARY ? "binary" : "text");
+}
+
 static int get_config_mount_fstab(const char *key, char *retv, int inlen,
 				  struct lxc_conf *c, void *data)
 {
@@ -4279,6 +4919,12 @@ static int get_config_rootfs_options(const char *key, char *retv, int inlen,
 	return lxc_get_conf_str(retv, inlen, c->rootfs.options);
 }
 
+static int get_config_rootfs_overlay_tmpfs(const char *key, char *retv, int inlen,
+					   struct lxc_conf *c, void *data)
+{
+	return lxc_get_conf_uint64(c, retv, inlen, c->rootfs.overlay_tmpfs);
+}
+
 static int get_config_uts_name(const char *key, char *retv, int inlen,
 			      struct lxc_conf *c, void *data)
 {
@@ -4525,6 +5171,39 @@ static int get_config_monitor_signal_pdeath(const char *key, char *retv,
 	return lxc_get_conf_int(c, retv, inlen, c->monitor_signal_pdeath);
 }
 
+static int get_config_monitor_pressure(const char *key, char *retv, int inlen,
+				       struct lxc_conf *c, void *data)
+{
+	int resource;
+
+	resource = lxc_str2pressure(key + STRLITERALLEN("lxc.monitor.pressure."));
+	if (resource < 0)
+		return ret_errno(EINVAL);
+
+	return lxc_get_conf_str(retv, inlen, c->monitor_pressure[resource]);
+}
+
+static int get_config_monitor_memory_events(const char *key, char *retv,
+					    int inlen, struct lxc_conf *c,
+					    void *data)
+{
+	int len;
+	int fulllen = 0;
+
+	if (!retv)
+		inlen = 0;
+	else
+		memset(retv, 0, inlen);
+
+	for (int i = 0; i < LXC_MEMORY_EVENT_MAX; i++) {
+		if (c->monitor_memory_events & (1U << i))
+			strprint(retv, inlen, "%s%s", fulllen ? " " : "",
+				 lxc_memory_event2str(i));
+	}
+
+	return fulllen;
+}
+
 static int get_config_group(const char *key, char *retv, int inlen,
 			    struct lxc_conf *c, void *data)
 {
@@ -5028,6 +5707,20 @@ static inline int clr_config_idmaps(const char *key, struct lxc_conf *c,
 	return lxc_clear_idmaps(c);
 }
 
+static inline int clr_config_log_buffer_size(const char *key,
+					     struct lxc_conf *c, void *data)
+{
+	c->log_buffer_size = 0;
+	return 0;
+}
+
+static inline int clr_config_log_format(const char *key, struct lxc_conf *c,
+				       void *data)
+{
+	c->log_format = LXC_LOG_FORMAT_TEXT;
+	return 0;
+}
+
 static inline int clr_config_log_level(const char *key, struct lxc_conf *c,
 				      void *data)
 {
@@ -5091,6 +5784,13 @@ static inline int clr_config_rootfs_options(const char *key, struct lxc_conf *c,
 	return 0;
 }
 
+static inline int clr_config_rootfs_overlay_tmpfs(const char *key,
+						  struct lxc_conf *c, void *data)
+{
+	c->rootfs.overlay_tmpfs = 0;
+	return 0;
+}
+
 static inline int clr_config_uts_name(const char *key, struct lxc_conf *c,
 				     void *data)
 {
@@ -5278,6 +5978,26 @@ static inline int clr_config_monitor_signal_pdeath(const char *key,
 	return 0;
 }
 
+static inline int clr_config_monitor_pressure(const char *key,
+					      struct lxc_conf *c, void *data)
+{
+	int resource;
+
+	resource = lxc_str2pressure(key + STRLITERALLEN("lxc.monitor.pressure."));
+	if (resource < 0)
+		return ret_errno(EINVAL);
+
+	free_disarm(c->monitor_pressure[resource]);
+	return 0;
+}
+
+static inline int clr_config_monitor_memory_events(const char *key,
+						   struct lxc_conf *c, void *data)
+{
+	c->monitor_memory_events = 0;
+	return 0;
+}
+
 static inline int clr_config_group(const char *key, struct lxc_conf *c,
 				   void *data)
 {
@@ -74,6 +74,9 @@ __hidden extern int lxc_list_net(struct lxc_conf *c, const char *key, char *retv
 
 __hidden extern int lxc_config_read(const char *file, struct lxc_conf *conf, bool from_include);
 
+/* Enable or disable (and drop) cached snapshots of parsed config files. */
+__hidden extern void lxc_config_cache_set(bool enable);
+
 __hidden extern int append_unexp_config_line(const char *line, struct lxc_conf *conf);
 
 __hidden extern int lxc_config_define_add(struct lxc_list *defines, char *arg);
@@ -16,6 +16,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <syslog.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "caps.h"
@@ -24,6 +25,7 @@
 #include "log.h"
 #include "lxccontainer.h"
 #include "memory_utils.h"
+#include "process_utils.h"
 #include "utils.h"
 
 #ifndef HAVE_STRLCPY
@@ -57,6 +59,25 @@ static char *log_vmname = NULL;
 
 lxc_log_define(log, lxc);
 
+/*
+ * Buffer for log file output, see lxc.log.buffer.size. Only the process that
+ * enabled it appends to it. Other processes, e.g. children created with
+ * lxc_raw_clone() that inherited a copy, log synchronously and never touch it
+ * since they tend to exec() or _exit() without passing a sync point.
+ */
+static struct lxc_log_buffer {
+	pthread_mutex_t lock;
+	pid_t owner;
+	int fd;
+	char *data;
+	size_t size;
+	size_t used;
+} log_buffer = {
+	.lock	= PTHREAD_MUTEX_INITIALIZER,
+	.owner	= -1,
+	.fd	= -EBADF,
+};
+
 static int lxc_log_priority_to_syslog(int priority)
 {
 	switch (priority) {
@@ -300,6 +321,362 @@ static int lxc_unix_epoch_to_utc(char *buf, size_t bufsize, const struct timespe
 	return 0;
 }
 
+static void __lxc_log_flush(void)
+{
+	if (log_buffer.used > 0 && log_buffer.fd >= 0)
+		(void)lxc_write_nointr(log_buffer.fd, log_buffer.data, log_buffer.used);
+
+	log_buffer.used = 0;
+}
+
+void lxc_log_flush(void)
+{
+	if (!log_buffer.used || log_buffer.owner != lxc_raw_getpid())
+		return;
+
+	pthread_mutex_lock(&log_buffer.lock);
+	__lxc_log_flush();
+	pthread_mutex_unlock(&log_buffer.lock);
+}
+
+static void lxc_log_flush_atexit(void)
+{
+	lxc_log_flush();
+}
+
+int lxc_log_buffer_enable(size_t size)
+{
+	static bool registered;
+	char *data;
+
+	if (size < LXC_LOG_BUFFER_SIZE)
+		return ret_errno(EINVAL);
+
+	data = malloc(size);
+	if (!data)
+		return ret_errno(ENOMEM);
+
+	if (!registered && !atexit(lxc_log_flush_atexit))
+		registered = true;
+
+	pthread_mutex_lock(&log_buffer.lock);
+	if (log_buffer.owner == lxc_raw_getpid())
+		__lxc_log_flush();
+	free(log_buffer.data);
+	log_buffer.data = data;
+	log_buffer.size = size;
+	log_buffer.used = 0;
+	log_buffer.fd = -EBADF;
+	log_buffer.owner = lxc_raw_getpid();
+	pthread_mutex_unlock(&log_buffer.lock);
+
+	return 0;
+}
+
+void lxc_log_buffer_disable(void)
+{
+	if (log_buffer.owner != lxc_raw_getpid())
+		return;
+
+	pthread_mutex_lock(&log_buffer.lock);
+	__lxc_log_flush();
+	free_disarm(log_buffer.data);
+	log_buffer.size = 0;
+	log_buffer.fd = -EBADF;
+	log_buffer.owner = -1;
+	pthread_mutex_unlock(&log_buffer.lock);
+}
+
+/*
+ * Queue a formatted line for @fd. Errors and anything more severe are written
+ * out right away together with everything queued before them so the events
+ * leading up to a failure are on disk should the process die.
+ */
+static int log_buffer_append(int fd, int priority, const char *line, size_t len)
+{
+	pthread_mutex_lock(&log_buffer.lock);
+
+	if (log_buffer.fd != fd) {
+		__lxc_log_flush();
+		log_buffer.fd = fd;
+	}
+
+	if (log_buffer.used + len > log_buffer.size)
+		__lxc_log_flush();
+
+	if (len > log_buffer.size) {
+		(void)lxc_write_nointr(fd, line, len);
+		pthread_mutex_unlock(&log_buffer.lock);
+		return 0;
+	}
+
+	memcpy(log_buffer.data + log_buffer.used, line, len);
+	log_buffer.used += len;
+
+	if (priority >= LXC_LOG_LEVEL_ERROR)
+		__lxc_log_flush();
+
+	pthread_mutex_unlock(&log_buffer.lock);
+
+	return 0;
+}
+
+static int log_write(int fd, int priority, const char *buf, size_t len)
+{
+	if (log_buffer.owner == lxc_raw_getpid())
+		return log_buffer_append(fd, priority, buf, len);
+
+	return lxc_write_nointr(fd, buf, len);
+}
+
+#ifndef NO_LXC_CONF
+/*
+ * Callsite ids of binary logs are only meaningful within one process writing
+ * to one log file. Whenever either changes a new generation starts with a new
+ * source id and every callsite gets described again on first use.
+ */
+static uint32_t log_binary_generation;
+static uint32_t log_binary_next_id;
+static uint64_t log_binary_source;
+static pid_t log_binary_pid = -1;
+static int log_binary_fd = -EBADF;
+
+/*
+ * The pid can't tell writers apart since processes in different pid
+ * namespaces may share a log file. Fall back to the clock if there's no
+ * /dev/urandom, e.g. in a container without /dev.
+ */
+static uint64_t log_binary_new_source(pid_t pid)
+{
+	__do_close int fd = -EBADF;
+	struct timespec ts;
+	uint64_t source;
+
+	fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC | O_NOCTTY);
+	if (fd >= 0 && read(fd, &source, sizeof(source)) == sizeof(source))
+		return source;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	source = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	return source ^ ((uint64_t)pid << 32) ^ (uintptr_t)&ts;
+}
+
+static bool log_binary_put(char *buf, size_t size, size_t *off,
+			   const void *data, size_t len)
+{
+	if (*off + len > size)
+		return false;
+
+	memcpy(buf + *off, data, len);
+	*off += len;
+	return true;
+}
+
+static bool log_binary_put_u64(char *buf, size_t size, size_t *off, uint64_t v)
+{
+	return log_binary_put(buf, size, off, &v, sizeof(v));
+}
+
+static bool log_binary_put_str(char *buf, size_t size, size_t *off, const char *str)
+{
+	uint32_t len;
+
+	if (!str)
+		str = "(null)";
+
+	len = strlen(str);
+	if (*off + sizeof(len) > size)
+		return false;
+
+	if (*off + sizeof(len) + len > size)
+		len = size - *off - sizeof(len);
+
+	(void)log_binary_put(buf, size, off, &len, sizeof(len));
+	return log_binary_put(buf, size, off, str, len);
+}
+
+static size_t log_binary_callsite(char *buf, size_t size, uint32_t id,
+				  struct lxc_log_event *event)
+{
+	const char *log_container_name = lxc_log_get_container_name();
+	struct lxc_log_record *rec = (struct lxc_log_record *)buf;
+	uint32_t line = event->locinfo->line;
+	const char *strs[] = {
+		log_prefix,
+		log_container_name ? log_container_name : "",
+		event->category,
+		event->locinfo->file,
+		event->locinfo->func,
+		event->fmt,
+	};
+	size_t off = sizeof(*rec);
+
+	(void)log_binary_put(buf, size, &off, &line, sizeof(line));
+	for (size_t i = 0; i < ARRAY_SIZE(strs); i++) {
+		size_t len = strlen(strs[i]) + 1;
+
+		/* Keep the terminator if the format string has to be cut. */
+		if (off + len > size) {
+			if (off >= size)
+				return 0;
+
+			len = size - off;
+			memcpy(buf + off, strs[i], len - 1);
+			buf[size - 1] = '\0';
+			off = size;
+			continue;
+		}
+
+		(void)log_binary_put(buf, size, &off, strs[i], len);
+	}
+
+	rec->magic = LXC_LOG_RECORD_MAGIC;
+	rec->type = LXC_LOG_RECORD_CALLSITE;
+	rec->priority = event->priority;
+	rec->len = off;
+	rec->pid = lxc_raw_getpid();
+	rec->id = id;
+	rec->source = __atomic_load_n(&log_binary_source, __ATOMIC_RELAXED);
+
+	return off;
+}
+
+static size_t log_binary_event(char *buf, size_t size, uint32_t id,
+			       int saved_errno, struct lxc_log_event *event)
+{
+	struct lxc_log_record *rec = (struct lxc_log_record *)buf;
+	uint64_t sec = event->timestamp.tv_sec;
+	uint32_t nsec[2] = {event->timestamp.tv_nsec, 0};
+	size_t off = sizeof(*rec);
+
+	(void)log_binary_put(buf, size, &off, &sec, sizeof(sec));
+	(void)log_binary_put(buf, size, &off, nsec, sizeof(nsec));
+
+	for (const char *p = event->fmt; *p; p++) {
+		struct lxc_log_spec spec;
+		bool fits = true;
+
+		if (*p != '%')
+			continue;
+
+		lxc_log_parse_spec(p, &spec);
+		p += spec.len - 1;
+		if (spec.len < 2)
+			break;
+
+		for (int i = 0; i < spec.stars && fits; i++)
+			fits = log_binary_put_u64(buf, size, &off, va_arg(*event->vap, int));
+
+		switch (spec.arg) {
+		case LXC_LOG_ARG_NONE:
+			break;
+		case LXC_LOG_ARG_INT:
+			if (spec.is_unsigned)
+				fits = fits && log_binary_put_u64(buf, size, &off, va_arg(*event->vap, unsigned int));
+			else
+				fits = fits && log_binary_put_u64(buf, size, &off, va_arg(*event->vap, int));
+			break;
+		case LXC_LOG_ARG_LONG:
+			if (spec.is_unsigned)
+				fits = fits && log_binary_put_u64(buf, size, &off, va_arg(*event->vap, unsigned long));
+			else
+				fits = fits && log_binary_put_u64(buf, size, &off, va_arg(*event->vap, long));
+			break;
+		case LXC_LOG_ARG_LLONG:
+			if (spec.is_unsigned)
+				fits = fits && log_binary_put_u64(buf, size, &off, va_arg(*event->vap, unsigned long long));
+			else
+				fits = fits && log_binary_put_u64(buf, size, &off, va_arg(*event->vap, long long));
+			break;
+		case LXC_LOG_ARG_SIZE:
+			fits = fits && log_binary_put_u64(buf, size, &off, va_arg(*event->vap, size_t));
+			break;
+		case LXC_LOG_ARG_PTRDIFF:
+			fits = fits && log_binary_put_u64(buf, size, &off, va_arg(*event->vap, ptrdiff_t));
+			break;
+		case LXC_LOG_ARG_INTMAX:
+			fits = fits && log_binary_put_u64(buf, size, &off, va_arg(*event->vap, intmax_t));
+			break;
+		case LXC_LOG_ARG_DOUBLE: {
+			double d = va_arg(*event->vap, double);
+
+			fits = fits && log_binary_put(buf, size, &off, &d, sizeof(d));
+			break;
+		}
+		case LXC_LOG_ARG_LDOUBLE: {
+			double d = va_arg(*event->vap, long double);
+
+			fits = fits && log_binary_put(buf, size, &off, &d, sizeof(d));
+			break;
+		}
+		case LXC_LOG_ARG_STRING:
+			fits = fits && log_binary_put_str(buf, size, &off, va_arg(*event->vap, const char *));
+			break;
+		case LXC_LOG_ARG_POINTER:
+			fits = fits && log_binary_put_u64(buf, size, &off, (uintptr_t)va_arg(*event->vap, void *));
+			break;
+		case LXC_LOG_ARG_ERRNO:
+			fits = fits && log_binary_put_u64(buf, size, &off, saved_errno);
+			break;
+		}
+
+		if (!fits)
+			break;
+	}
+
+	rec->magic = LXC_LOG_RECORD_MAGIC;
+	rec->type = LXC_LOG_RECORD_EVENT;
+	rec->priority = event->priority;
+	rec->len = off;
+	rec->pid = lxc_raw_getpid();
+	rec->id = id;
+	rec->source = __atomic_load_n(&log_binary_source, __ATOMIC_RELAXED);
+
+	return off;
+}
+
+/*
+ * Write @event as binary records instead of formatting it. The message isn't
+ * rendered at all, only the arguments are copied.
+ */
+static int log_append_binary(int fd, struct lxc_log_event *event)
+{
+	struct lxc_log_locinfo *locinfo = event->locinfo;
+	char buffer[LXC_LOG_BUFFER_SIZE * 2];
+	int saved_errno = errno;
+	uint32_t generation, id;
+	size_t n = 0;
+	pid_t pid;
+
+	pid = lxc_raw_getpid();
+	if (log_binary_pid != pid || log_binary_fd != fd) {
+		log_binary_pid = pid;
+		log_binary_fd = fd;
+		__atomic_store_n(&log_binary_source, log_binary_new_source(pid), __ATOMIC_RELAXED);
+		__atomic_store_n(&log_binary_next_id, 0, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&log_binary_generation, 1, __ATOMIC_RELEASE);
+	}
+
+	generation = __atomic_load_n(&log_binary_generation, __ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&locinfo->generation, __ATOMIC_ACQUIRE) == generation) {
+		id = __atomic_load_n(&locinfo->id, __ATOMIC_RELAXED);
+	} else {
+		id = __atomic_add_fetch(&log_binary_next_id, 1, __ATOMIC_RELAXED);
+
+		n = log_binary_callsite(buffer, LXC_LOG_BUFFER_SIZE, id, event);
+		if (n == 0)
+			return ret_errno(EIO);
+
+		__atomic_store_n(&locinfo->id, id, __ATOMIC_RELAXED);
+		__atomic_store_n(&locinfo->generation, generation, __ATOMIC_RELEASE);
+	}
+
+	n += log_binary_event(buffer + n, LXC_LOG_BUFFER_SIZE, id, saved_errno, event);
+
+	return log_write(fd, event->priority, buffer, n);
+}
+#endif /* !NO_LXC_CONF */
+
 /*
  * This function needs to make extra sure that it is thread-safe. We had some
  * problems with that before. This especially involves time-conversion
@@ -344,6 +721,12 @@ static int log_append_logfile(const struct lxc_log_appender *appender,
 	if (fd_to_use < 0)
 		return 0;
 
+#ifndef NO_LXC_CONF
+	if (current_config && fd_to_use == current_config->logfd &&
+	    current_config->log_format == LXC_LOG_FORMAT_BINARY)
+		return log_append_binary(fd_to_use, event);
+#endif
+
 	ret = lxc_unix_epoch_to_utc(date_time, LXC_LOG_TIME_SIZE, &event->timestamp);
 	if (ret)
 		return ret;
@@ -381,7 +764,7 @@ static int log_append_logfile(const struct lxc_log_appender *appender,
 
 	buffer[n] = '\n';
 
-	return lxc_write_nointr(fd_to_use, buffer, n + 1);
+	return log_write(fd_to_use, event->priority, buffer, n + 1);
 }
 
 #if HAVE_DLOG
@@ -741,6 +1124,8 @@ int lxc_log_init(struct lxc_log *log)
 
 void lxc_log_close(void)
 {
+	lxc_log_flush();
+
 	closelog();
 
 	free_disarm(log_vmname);
@@ -833,8 +1218,10 @@ bool lxc_log_has_valid_level(void)
  */
 int lxc_log_set_file(int *fd, const char *fname)
 {
-	if (*fd >= 0)
+	if (*fd >= 0) {
+		lxc_log_flush();
 		close_prot_errno_disarm(*fd);
+	}
 
 	if (is_empty_string(fname))
 		return ret_errno(EINVAL);
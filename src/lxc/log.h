@@ -8,6 +8,7 @@
 #endif
 #include <errno.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <sys/time.h>
 #include <string.h>
@@ -45,16 +46,194 @@ enum lxc_loglevel {
 	LXC_LOG_LEVEL_NOTSET,
 };
 
-/* location information of the logging event */
+/* supported values for lxc.log.format */
+enum lxc_log_format {
+	LXC_LOG_FORMAT_TEXT,
+	LXC_LOG_FORMAT_BINARY,
+};
+
+/*
+ * location information of the logging event
+ * @id         : callsite id in binary logs, valid for @generation only
+ * @generation : binary log generation @id was assigned in
+ */
 struct lxc_log_locinfo {
 	const char *file;
 	const char *func;
 	int line;
+	uint32_t id;
+	uint32_t generation;
 };
 
 #define LXC_LOG_LOCINFO_INIT						\
 	{ .file = __FILE__, .func = __func__, .line = __LINE__	}
 
+/*
+ * Binary log records as written with lxc.log.format = binary. Records use
+ * host byte order and are decoded offline by lxc-log-decode on the same
+ * architecture. Text lines may be interleaved, they never start with the
+ * record magic.
+ *
+ * Every record carries the @source id of the process which wrote it. The
+ * source id is drawn at random whenever a process starts writing to a log
+ * file, so processes in different pid namespaces that share a log file and
+ * a pid never mix up their callsites. @pid is only informational.
+ *
+ * A callsite record describes a log statement once per source id. It is
+ * followed by the line as uint32_t and the NUL-terminated log prefix,
+ * container name, category, file, function and format string.
+ *
+ * An event record refers to its callsite by @id. It is followed by the
+ * timestamp as uint64_t seconds and uint32_t nanoseconds plus padding and
+ * the arguments in format string order: '*' width and precision, integers,
+ * pointers and errno for %m as 64 bit values, floating point numbers as
+ * double and strings as uint32_t length followed by the bytes. Arguments that
+ * don't fit into LXC_LOG_BUFFER_SIZE are cut off.
+ */
+#define LXC_LOG_RECORD_MAGIC 0xb10c
+#define LXC_LOG_RECORD_CALLSITE 1
+#define LXC_LOG_RECORD_EVENT 2
+
+struct lxc_log_record {
+	uint16_t magic;
+	uint8_t type;
+	uint8_t priority;
+	uint32_t len; /* including this header */
+	uint32_t pid;
+	uint32_t id;
+	uint64_t source;
+};
+
+enum lxc_log_arg {
+	LXC_LOG_ARG_NONE,
+	LXC_LOG_ARG_INT,
+	LXC_LOG_ARG_LONG,
+	LXC_LOG_ARG_LLONG,
+	LXC_LOG_ARG_SIZE,
+	LXC_LOG_ARG_PTRDIFF,
+	LXC_LOG_ARG_INTMAX,
+	LXC_LOG_ARG_DOUBLE,
+	LXC_LOG_ARG_LDOUBLE,
+	LXC_LOG_ARG_STRING,
+	LXC_LOG_ARG_POINTER,
+	LXC_LOG_ARG_ERRNO,
+};
+
+/* a single conversion specification of a printf() format string */
+struct lxc_log_spec {
+	size_t len; /* including the leading '%' */
+	int stars; /* '*' width and precision arguments */
+	enum lxc_log_arg arg;
+	bool is_unsigned;
+	char conversion;
+};
+
+/*
+ * Parse the conversion specification starting at the '%' @fmt points to.
+ * Shared between the binary log writer and lxc-log-decode so both agree on
+ * the arguments a format string consumes.
+ */
+static inline void lxc_log_parse_spec(const char *fmt, struct lxc_log_spec *spec)
+{
+	const char *p = fmt + 1;
+	int length = 0;
+
+	memset(spec, 0, sizeof(*spec));
+
+	while (*p && strchr("-+ #0'I", *p))
+		p++;
+
+	if (*p == '*') {
+		spec->stars++;
+		p++;
+	} else {
+		while (*p >= '0' && *p <= '9')
+			p++;
+	}
+
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			spec->stars++;
+			p++;
+		} else {
+			while (*p >= '0' && *p <= '9')
+				p++;
+		}
+	}
+
+	for (; *p && strchr("hlLqjzZt", *p); p++) {
+		if (*p == 'h')
+			continue;
+
+		if (*p == 'l' && length == 'l')
+			length = 'q';
+		else
+			length = *p;
+	}
+
+	spec->conversion = *p;
+	spec->len = (size_t)(p - fmt) + (*p ? 1 : 0);
+
+	switch (*p) {
+	case 'o':
+	case 'u':
+	case 'x':
+	case 'X':
+		spec->is_unsigned = true;
+		__fallthrough;
+	case 'd':
+	case 'i':
+	case 'c':
+		switch (length) {
+		case 'l':
+			spec->arg = LXC_LOG_ARG_LONG;
+			break;
+		case 'q':
+		case 'L':
+			spec->arg = LXC_LOG_ARG_LLONG;
+			break;
+		case 'z':
+		case 'Z':
+			spec->arg = LXC_LOG_ARG_SIZE;
+			break;
+		case 't':
+			spec->arg = LXC_LOG_ARG_PTRDIFF;
+			break;
+		case 'j':
+			spec->arg = LXC_LOG_ARG_INTMAX;
+			break;
+		default:
+			spec->arg = LXC_LOG_ARG_INT;
+			break;
+		}
+		break;
+	case 'a':
+	case 'A':
+	case 'e':
+	case 'E':
+	case 'f':
+	case 'F':
+	case 'g':
+	case 'G':
+		spec->arg = length == 'L' ? LXC_LOG_ARG_LDOUBLE : LXC_LOG_ARG_DOUBLE;
+		break;
+	case 's':
+		spec->arg = LXC_LOG_ARG_STRING;
+		break;
+	case 'p':
+	case 'n':
+		spec->arg = LXC_LOG_ARG_POINTER;
+		break;
+	case 'm':
+		spec->arg = LXC_LOG_ARG_ERRNO;
+		break;
+	default:
+		spec->arg = LXC_LOG_ARG_NONE;
+		break;
+	}
+}
+
 /* brief logging event object */
 struct lxc_log_event {
 	const char *category;
@@ -350,47 +529,47 @@ __lxc_unused static inline void LXC_##LEVEL(struct lxc_log_locinfo* locinfo,	\
  * top categories
  */
 #define TRACE(format, ...) do {						\
-	struct lxc_log_locinfo locinfo = LXC_LOG_LOCINFO_INIT;		\
+	static struct lxc_log_locinfo locinfo = LXC_LOG_LOCINFO_INIT;	\
 	LXC_TRACE(&locinfo, format, ##__VA_ARGS__);			\
 } while (0)
 
 #define DEBUG(format, ...) do {						\
-	struct lxc_log_locinfo locinfo = LXC_LOG_LOCINFO_INIT;		\
+	static struct lxc_log_locinfo locinfo = LXC_LOG_LOCINFO_INIT;	\
 	LXC_DEBUG(&locinfo, format, ##__VA_ARGS__);			\
 } while (0)
 
 #define INFO(format, ...) do {						\
-	struct lxc_log_locinfo locinfo = LXC_LOG_LOCINFO_INIT;		\
+	static struct lxc_log_locinfo locinfo = LXC_LOG_LOCINFO_INIT;	\
 	LXC_INFO(&locinfo, format, ##__VA_ARGS__);			\
 } while (0)
 
 #define NOTICE(format, ...) do {					\
-	struct lxc_log_locinfo locinfo = LXC_LOG_LOCINFO_INIT;		\
+	static struct lxc_log_locinfo locinfo = LXC_LOG_LOCINFO_INIT;	\
 	LXC_NOTICE(&locinfo, format, ##__VA_ARGS__);			\
 } while (0)
 
 #define WARN(format, ...) do {						\
-	struct lxc_log_locinfo locinfo = LXC_LOG_LOCINFO_INIT;		\
+	static struct lxc_log_locinfo locinfo = LXC_LOG_LOCINFO_INIT;	\
 	LXC_WARN(&locinfo, format, ##__VA_ARGS__);			\
 } while (0)
 
 #define ERROR(format, ...) do {						\
-	struct lxc_log_locinfo locinfo = LXC_LOG_LOCINFO_INIT;		\
+	static struct lxc_log_locinfo locinfo = LXC_LOG_LOCINFO_INIT;	\
 	LXC_ERROR(&locinfo, format, ##__VA_ARGS__);			\
 } while (0)
 
 #define CRIT(format, ...) do {						\
-	struct lxc_log_locinfo locinfo = LXC_LOG_LOCINFO_INIT;		\
+	static struct lxc_log_locinfo locinfo = LXC_LOG_LOCINFO_INIT;	\
 	LXC_CRIT(&locinfo, format, ##__VA_ARGS__);			\
 } while (0)
 
 #define ALERT(format, ...) do {						\
-	struct lxc_log_locinfo locinfo = LXC_LOG_LOCINFO_INIT;		\
+	static struct lxc_log_locinfo locinfo = LXC_LOG_LOCINFO_INIT;	\
 	LXC_ALERT(&locinfo, format, ##__VA_ARGS__);			\
 } while (0)
 
 #define FATAL(format, ...) do {						\
-	struct lxc_log_locinfo locinfo = LXC_LOG_LOCINFO_INIT;		\
+	static struct lxc_log_locinfo locinfo = LXC_LOG_LOCINFO_INIT;	\
 	LXC_FATAL(&locinfo, format, ##__VA_ARGS__);			\
 } while (0)
 
@@ -693,5 +872,8 @@ __hidden extern void lxc_log_set_prefix(const char *prefix);
 __hidden extern const char *lxc_log_get_prefix(void);
 __hidden extern void lxc_log_options_no_override(void);
 __hidden extern int lxc_log_get_fd(void);
+__hidden extern int lxc_log_buffer_enable(size_t size);
+__hidden extern void lxc_log_buffer_disable(void);
+__hidden extern void lxc_log_flush(void);
 
 #endif /* __LXC_LOG_H */
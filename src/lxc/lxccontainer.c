@@ -30,6 +30,7 @@
 #include "api_extensions.h"
 #include "attach.h"
 #include "cgroup.h"
+#include "cgroup_utils.h"
 #include "macro.h"
 #include "commands.h"
 #include "commands_utils.h"
@@ -276,6 +277,11 @@ static void lxc_container_free(struct lxc_container *c)
 		c->privlock = NULL;
 	}
 
+	lxc_cmd_session_put(c->cmd_session);
+	c->cmd_session = NULL;
+
+	close_prot_errno_disarm(c->metrics_dfd);
+
 	free(c->name);
 	c->name = NULL;
 
@@ -752,6 +758,107 @@ static bool do_lxcapi_want_close_all_fds(struct lxc_container *c, bool state)
 
 WRAP_API_1(bool, lxcapi_want_close_all_fds, bool)
 
+static bool do_lxcapi_want_persistent_commands(struct lxc_container *c, bool state)
+{
+	bool ret = true;
+
+	if (!c)
+		return false;
+
+	if (container_mem_lock(c))
+		return false;
+
+	if (state && !c->cmd_session) {
+		c->cmd_session = lxc_cmd_session_get(c->name, c->config_path);
+		if (!c->cmd_session)
+			ret = false;
+	} else if (!state && c->cmd_session) {
+		lxc_cmd_session_put(c->cmd_session);
+		c->cmd_session = NULL;
+	}
+
+	container_mem_unlock(c);
+
+	return ret;
+}
+
+WRAP_API_1(bool, lxcapi_want_persistent_commands, bool)
+
+static unsigned int get_metrics_at(int dfd, struct lxc_metrics *metrics,
+				   unsigned int flags)
+{
+	metrics->flags = flags;
+	return cgroup2_read_metrics(dfd, metrics);
+}
+
+/* An overlay reports the filesystem of its upper layer to statfs(). */
+static unsigned int get_rootfs_metrics(struct lxc_container *c,
+				       struct lxc_metrics *metrics)
+{
+	char path[64];
+	struct statfs sb;
+	pid_t pid;
+
+	pid = do_lxcapi_init_pid(c);
+	if (pid <= 0)
+		return 0;
+
+	if (strnprintf(path, sizeof(path), "/proc/%d/root", pid) < 0)
+		return 0;
+
+	if (statfs(path, &sb) < 0)
+		return 0;
+
+	metrics->rootfs_size = (uint64_t)sb.f_blocks * sb.f_bsize;
+	metrics->rootfs_used = (uint64_t)(sb.f_blocks - sb.f_bfree) * sb.f_bsize;
+	return LXC_METRICS_ROOTFS;
+}
+
+static bool do_lxcapi_get_metrics(struct lxc_container *c,
+				  struct lxc_metrics *metrics)
+{
+	unsigned int flags = 0, rootfs = 0, want;
+
+	if (!c || !metrics)
+		return false;
+
+	want = metrics->flags;
+	if (want & LXC_METRICS_ROOTFS) {
+		rootfs = get_rootfs_metrics(c, metrics);
+		want &= ~LXC_METRICS_ROOTFS;
+	}
+
+	if (!want)
+		goto out;
+
+	if (container_mem_lock(c))
+		return false;
+
+	if (c->metrics_dfd >= 0) {
+		flags = get_metrics_at(c->metrics_dfd, metrics, want);
+
+		/* The cgroup is gone if the container stopped or restarted. */
+		if (!flags && faccessat(c->metrics_dfd, "cgroup.procs", F_OK, 0))
+			close_prot_errno_disarm(c->metrics_dfd);
+	}
+
+	if (c->metrics_dfd < 0) {
+		c->metrics_dfd = lxc_cmd_get_limit_cgroup2_fd(c->name, do_lxcapi_get_config_path(c));
+		if (c->metrics_dfd >= 0)
+			flags = get_metrics_at(c->metrics_dfd, metrics, want);
+		else
+			c->metrics_dfd = -EBADF;
+	}
+
+	container_mem_unlock(c);
+
+out:
+	metrics->flags = flags | rootfs;
+	return metrics->flags != 0;
+}
+
+WRAP_API_1(bool, lxcapi_get_metrics, struct lxc_metrics *)
+
 static bool do_lxcapi_wait(struct lxc_container *c, const char *state,
 			   int timeout)
 {
@@ -2434,13 +2541,156 @@ static bool remove_from_array(char ***names, char *cname, int size)
 	return false;
 }
 
+/*
+ * Get the id of the container's network namespace. Containers started by
+ * liblxc have one, others are not given one as that can't be undone.
+ */
+static int container_netnsid(struct lxc_container *c)
+{
+	__do_close int fd = -EBADF;
+	pid_t pid;
+
+	pid = do_lxcapi_init_pid(c);
+	if (pid < 0)
+		return -1;
+
+	fd = lxc_preserve_ns(pid, "net");
+	if (fd < 0)
+		return -1;
+
+	return lxc_netns_get_nsid(fd);
+}
+
+/*
+ * Dump the interfaces and addresses of the network namespace @netnsid from
+ * the host through the NETLINK_ROUTE socket @fd, or a new one if it's
+ * negative. Returns false if the kernel or the caller's privileges don't allow
+ * this, in which case the caller has to fork into the network namespace
+ * instead.
+ */
+static bool netnsid_getifaddrs(int fd, int netnsid, struct netns_ifaddrs **ifaddrs)
+{
+	bool netnsid_aware = false;
+	int ret;
+
+	if (netnsid < 0)
+		return false;
+
+	if (fd < 0)
+		ret = netns_getifaddrs(ifaddrs, netnsid, &netnsid_aware);
+	else
+		ret = netns_getifaddrs_fd(fd, ifaddrs, netnsid, &netnsid_aware);
+	if (ret < 0)
+		return false;
+
+	if (!netnsid_aware) {
+		TRACE("Kernel doesn't support netnsid targeted dumps");
+		netns_freeifaddrs(*ifaddrs);
+		*ifaddrs = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Format the address of @ifa into @buf if it passes the c->get_ips() filters.
+ * Returns NULL if it doesn't.
+ */
+static const char *ifaddr_ip(const struct netns_ifaddrs *ifa,
+			     const char *interface, const char *family,
+			     int scope, char *buf, size_t size)
+{
+	const void *addr;
+
+	if (ifa->ifa_addr == NULL)
+		return NULL;
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wcast-align"
+
+	if (ifa->ifa_addr->sa_family == AF_INET) {
+		if (family && !strequal(family, "inet"))
+			return NULL;
+
+		addr = &((struct sockaddr_in *)ifa->ifa_addr)->sin_addr;
+	} else {
+		if (family && !strequal(family, "inet6"))
+			return NULL;
+
+		if (((struct sockaddr_in6 *)ifa->ifa_addr)->sin6_scope_id != scope)
+			return NULL;
+
+		addr = &((struct sockaddr_in6 *)ifa->ifa_addr)->sin6_addr;
+	}
+
+#pragma GCC diagnostic pop
+
+	if (interface && !strequal(interface, ifa->ifa_name))
+		return NULL;
+	else if (!interface && strequal("lo", ifa->ifa_name))
+		return NULL;
+
+	return inet_ntop(ifa->ifa_addr->sa_family, addr, buf, size);
+}
+
+/* Collect the addresses of @ifaddrs which pass the c->get_ips() filters. */
+static char **ifaddrs_ips(const struct netns_ifaddrs *ifaddrs,
+			  const char *interface, const char *family, int scope)
+{
+	char address[INET6_ADDRSTRLEN];
+	char **addresses = NULL;
+	int count = 0;
+
+	for (const struct netns_ifaddrs *ifa = ifaddrs; ifa; ifa = ifa->ifa_next) {
+		if (!ifaddr_ip(ifa, interface, family, scope, address,
+			       sizeof(address)))
+			continue;
+
+		if (!add_to_array(&addresses, address, count)) {
+			ERROR("Failed to add \"%s\" to array", address);
+			continue;
+		}
+
+		count++;
+	}
+
+	if (addresses)
+		addresses = (char **)lxc_append_null_to_array((void **)addresses, count);
+
+	return addresses;
+}
+
 static char **do_lxcapi_get_interfaces(struct lxc_container *c)
 {
+	call_cleaner(netns_freeifaddrs) struct netns_ifaddrs *host_ifaddrs = NULL;
 	pid_t pid;
 	int i, count = 0, pipefd[2];
 	char **interfaces = NULL;
 	char interface[IFNAMSIZ];
 
+	if (netnsid_getifaddrs(-EBADF, container_netnsid(c), &host_ifaddrs)) {
+		for (struct netns_ifaddrs *ifa = host_ifaddrs; ifa; ifa = ifa->ifa_next) {
+			if (!ifa->ifa_name)
+				continue;
+
+			if (array_contains(&interfaces, ifa->ifa_name, count))
+				continue;
+
+			if (!add_to_array(&interfaces, ifa->ifa_name, count)) {
+				ERROR("Failed to add \"%s\" to array", ifa->ifa_name);
+				continue;
+			}
+
+			count++;
+		}
+
+		if (interfaces)
+			interfaces = (char **)lxc_append_null_to_array((void **)interfaces, count);
+
+		return interfaces;
+	}
+
 	if (pipe2(pipefd, O_CLOEXEC))
 		return log_error_errno(NULL, errno, "Failed to create pipe");
 
@@ -2527,6 +2777,7 @@ WRAP_API(char **, lxcapi_get_interfaces)
 static char **do_lxcapi_get_ips(struct lxc_container *c, const char *interface,
 				const char *family, int scope)
 {
+	call_cleaner(netns_freeifaddrs) struct netns_ifaddrs *host_ifaddrs = NULL;
 	int i, ret;
 	pid_t pid;
 	int pipefd[2];
@@ -2534,6 +2785,9 @@ static char **do_lxcapi_get_ips(struct lxc_container *c, const char *interface,
 	int count = 0;
 	char **addresses = NULL;
 
+	if (netnsid_getifaddrs(-EBADF, container_netnsid(c), &host_ifaddrs))
+		return ifaddrs_ips(host_ifaddrs, interface, family, scope);
+
 	ret = pipe2(pipefd, O_CLOEXEC);
 	if (ret < 0)
 		return log_error_errno(NULL, errno, "Failed to create pipe");
@@ -2551,8 +2805,7 @@ static char **do_lxcapi_get_ips(struct lxc_container *c, const char *interface,
 		struct netns_ifaddrs *ifa = NULL;
 		ssize_t nbytes;
 		char addressOutputBuffer[INET6_ADDRSTRLEN];
-		char *address_ptr = NULL;
-		void *address_ptr_tmp = NULL;
+		const char *address_ptr = NULL;
 
 		/* close the read-end of the pipe */
 		close(pipefd[0]);
@@ -2570,37 +2823,9 @@ static char **do_lxcapi_get_ips(struct lxc_container *c, const char *interface,
 
 		/* Iterate through the interfaces */
 		for (ifa = ifaddrs; ifa; ifa = ifa->ifa_next) {
-			if (ifa->ifa_addr == NULL)
-				continue;
-
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wcast-align"
-
-			if (ifa->ifa_addr->sa_family == AF_INET) {
-				if (family && !strequal(family, "inet"))
-					continue;
-
-				address_ptr_tmp = &((struct sockaddr_in *)ifa->ifa_addr)->sin_addr;
-			} else {
-				if (family && !strequal(family, "inet6"))
-					continue;
-
-				if (((struct sockaddr_in6 *)ifa->ifa_addr)->sin6_scope_id != scope)
-					continue;
-
-				address_ptr_tmp = &((struct sockaddr_in6 *)ifa->ifa_addr)->sin6_addr;
-			}
-
-#pragma GCC diagnostic pop
-
-			if (interface && !strequal(interface, ifa->ifa_name))
-				continue;
-			else if (!interface && strequal("lo", ifa->ifa_name))
-				continue;
-
-			address_ptr = (char *)inet_ntop(ifa->ifa_addr->sa_family, address_ptr_tmp,
-							addressOutputBuffer,
-							sizeof(addressOutputBuffer));
+			address_ptr = ifaddr_ip(ifa, interface, family, scope,
+						addressOutputBuffer,
+						sizeof(addressOutputBuffer));
 			if (!address_ptr)
 				continue;
 
@@ -2693,6 +2918,82 @@ static char* do_lxcapi_get_running_config_item(struct lxc_container *c, const ch
 
 WRAP_API_1(char *, lxcapi_get_running_config_item, const char *)
 
+/* Retrieve running info one command at a time for older monitors. */
+static bool get_running_info_legacy(struct lxc_container *c,
+				    struct lxc_running_info *info)
+{
+	const char *lxcpath = do_lxcapi_get_config_path(c);
+	unsigned int flags = 0;
+	int state;
+
+	info->state = NULL;
+	info->init_pid = -1;
+	info->cgroup = NULL;
+	info->limit_cgroup = NULL;
+	info->values = NULL;
+
+	if (info->flags & LXC_INFO_STATE) {
+		state = lxc_cmd_get_state(c->name, lxcpath);
+		if (state >= 0) {
+			info->state = lxc_state2str(state);
+			flags |= LXC_INFO_STATE;
+		}
+	}
+
+	if (info->flags & LXC_INFO_INIT_PID) {
+		info->init_pid = lxc_cmd_get_init_pid(c->name, lxcpath);
+		if (info->init_pid > 0)
+			flags |= LXC_INFO_INIT_PID;
+	}
+
+	if (info->flags & LXC_INFO_CGROUP) {
+		info->cgroup = lxc_cmd_get_cgroup_path(c->name, lxcpath, NULL);
+		if (info->cgroup)
+			flags |= LXC_INFO_CGROUP;
+	}
+
+	if (info->flags & LXC_INFO_LIMIT_CGROUP) {
+		info->limit_cgroup = lxc_cmd_get_limit_cgroup_path(c->name, lxcpath, NULL);
+		if (info->limit_cgroup)
+			flags |= LXC_INFO_LIMIT_CGROUP;
+	}
+
+	if (info->nr_keys > 0) {
+		info->values = zalloc(info->nr_keys * sizeof(char *));
+		if (!info->values) {
+			free_disarm(info->cgroup);
+			free_disarm(info->limit_cgroup);
+			return false;
+		}
+
+		for (int i = 0; i < info->nr_keys; i++)
+			info->values[i] = lxc_cmd_get_config_item(c->name, info->keys[i], lxcpath);
+	}
+
+	info->flags = flags;
+	return true;
+}
+
+static bool do_lxcapi_get_running_info(struct lxc_container *c,
+				       struct lxc_running_info *info)
+{
+	int ret;
+
+	if (!c || !info)
+		return false;
+
+	if (info->nr_keys < 0 || (info->nr_keys > 0 && !info->keys))
+		return false;
+
+	ret = lxc_cmd_get_info(c->name, do_lxcapi_get_config_path(c), info);
+	if (ret == -ENOSYS)
+		return get_running_info_legacy(c, info);
+
+	return ret == 0;
+}
+
+WRAP_API_1(bool, lxcapi_get_running_info, struct lxc_running_info *)
+
 //列出当前支持的所有key,或者满足要求的keys
 static int do_lxcapi_get_keys(struct lxc_container *c, const char *key, char *retv, int inlen)
 {
@@ -2919,21 +3220,13 @@ out:
 	return bret;
 }
 
-void mod_all_rdeps(struct lxc_container *c, bool inc)
+/* Add @c to or remove it from the snapshots of all containers listed in @path. */
+static void mod_rdepends_of(const char *path, struct lxc_container *c, bool inc)
 {
 	__do_free char *lxcpath = NULL, *lxcname = NULL;
 	__do_fclose FILE *f = NULL;
 	size_t pathlen = 0, namelen = 0;
 	struct lxc_container *p;
-	char path[PATH_MAX];
-	int ret;
-
-	ret = strnprintf(path, sizeof(path), "%s/%s/lxc_rdepends",
-		c->config_path, c->name);
-	if (ret < 0) {
-		ERROR("Path name too long");
-		return;
-	}
 
 	f = fopen(path, "re");
 	if (!f)
@@ -2962,6 +3255,21 @@ void mod_all_rdeps(struct lxc_container *c, bool inc)
 	}
 }
 
+void mod_all_rdeps(struct lxc_container *c, bool inc)
+{
+	char path[PATH_MAX];
+	int ret;
+
+	ret = strnprintf(path, sizeof(path), "%s/%s/lxc_rdepends",
+		c->config_path, c->name);
+	if (ret < 0) {
+		ERROR("Path name too long");
+		return;
+	}
+
+	mod_rdepends_of(path, c, inc);
+}
+
 static bool has_fs_snapshots(struct lxc_container *c)
 {
 	__do_fclose FILE *f = NULL;
@@ -3115,6 +3423,9 @@ static bool container_destroy(struct lxc_container *c,
 			goto out;
 		}
 		INFO("Destroyed rootfs for %s", c->name);
+
+		if (ovl_layers_ref(conf->rootfs.path, c->config_path, c->name, false) < 0)
+			WARN("Failed to drop layer references of %s", c->name);
 	}
 
 	mod_all_rdeps(c, false);
@@ -3701,6 +4012,7 @@ static int copy_storage(struct lxc_container *c0, struct lxc_container *c,
 {
 	struct lxc_storage *bdev;
 	bool need_rdep;
+	int ret;
 
 	if (should_default_to_snapshot(c0, c))
 		flags |= LXC_CLONE_SNAPSHOT;
@@ -3733,6 +4045,13 @@ static int copy_storage(struct lxc_container *c0, struct lxc_container *c,
 	if (flags & LXC_CLONE_SNAPSHOT)
 		copy_rdepends(c, c0);
 
+	/* Layers are kept alive by their references, not by c0. */
+	ret = ovl_layers_ref(c->lxc_conf->rootfs.path, c->config_path, c->name, true);
+	if (ret < 0)
+		return -1;
+	if (ret > 0)
+		need_rdep = false;
+
 	if (need_rdep) {
 		if (!add_rdepends(c, c0))
 			WARN("Error adding reverse dependency from %s to %s",
@@ -5388,6 +5707,7 @@ struct lxc_container *lxc_container_new(const char *name, const char *configpath
 		return NULL;
 	}
 	memset(c, 0, sizeof(*c));
+	c->metrics_dfd = -EBADF;
 
 	if (configpath)
 	    //指定配置文件路径
@@ -5500,6 +5820,9 @@ struct lxc_container *lxc_container_new(const char *name, const char *configpath
 	c->clear_config_item = lxcapi_clear_config_item;
 	c->get_config_item = lxcapi_get_config_item;
 	c->get_running_config_item = lxcapi_get_running_config_item;
+	c->get_running_info = lxcapi_get_running_info;
+	c->want_persistent_commands = lxcapi_want_persistent_commands;
+	c->get_metrics = lxcapi_get_metrics;
 	c->get_cgroup_item = lxcapi_get_cgroup_item;
 	c->set_cgroup_item = lxcapi_set_cgroup_item;
 	c->get_config_path = lxcapi_get_config_path;
@@ -5547,144 +5870,334 @@ int lxc_get_wait_states(const char **states)
 	return MAX_STATE;
 }
 
-/*
- * These next two could probably be done smarter with reusing a common function
- * with different iterators and tests...
- */
-int list_defined_containers(const char *lxcpath, char ***names/*出参，列出目录下所有文件*/, struct lxc_container ***cret)
+#define LXC_LIST_MAX_WORKERS 32
+
+/* Shared by the workers instantiating the containers of a listing. */
+struct list_work {
+	const char *lxcpath;
+	char **names;
+	int nr_names;
+	/* Only keep containers with a config that are defined. */
+	bool defined;
+	/* Per name: the loaded container, NULL if only names are wanted. */
+	struct lxc_container **containers;
+	bool *found;
+	int next;
+};
+
+static void list_work_one(struct list_work *work, int i)
 {
-	__do_closedir DIR *dir = NULL;
-	int i, cfound = 0, nfound = 0;
-	struct dirent *direntp;
+	const char *name = work->names[i];
 	struct lxc_container *c;
 
-	if (!lxcpath)
-		/*未提供lxcpath,取全局配置*/
-		lxcpath = lxc_global_config_value("lxc.lxcpath");
+	/*配置文件是否存在*/
+	if (work->defined && !config_file_exists(work->lxcpath, name))
+		return;
 
-	/*目录必须存在*/
-	dir = opendir(lxcpath);
-	if (!dir) {
-		SYSERROR("opendir on lxcpath");
-		return -1;
+	if (!work->containers) {
+		work->found[i] = true;
+		return;
 	}
 
-	if (cret)
-		*cret = NULL;
+	/*构造container对象*/
+	c = lxc_container_new(name, work->lxcpath);
+	if (!c) {
+		if (work->defined)
+			INFO("Container %s:%s has a config but could not be loaded",
+			     work->lxcpath, name);
+		else
+			WARN("Container %s:%s could not be loaded",
+			     work->lxcpath, name);
+		return;
+	}
 
-	if (names)
-		*names = NULL;
+	/*检查c是否定义了*/
+	if (work->defined && !do_lxcapi_is_defined(c)) {
+		INFO("Container %s:%s has a config but is not defined",
+		     work->lxcpath, name);
+		lxc_container_put(c);
+		return;
+	}
 
-	/*遍历目录下所有成员文件*/
-	while ((direntp = readdir(dir))) {
-		/* Ignore '.', '..' and any hidden directory. */
-		if (strnequal(direntp->d_name, ".", 1))
-			/*跳过'.','..'文件*/
-			continue;
+	work->containers[i] = c;
+	work->found[i] = true;
+}
 
-		/*配置文件是否存在*/
-		if (!config_file_exists(lxcpath, direntp->d_name))
-			continue;
+static void *list_worker(void *data)
+{
+	struct list_work *work = data;
 
-		/*将$d_name加入到names*/
-		if (names)
-			if (!add_to_array(names, direntp->d_name, cfound))
-				goto free_bad;
+	for (;;) {
+		int i = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED);
 
-		cfound++;/*发现的文件名*/
+		if (i >= work->nr_names)
+			break;
 
-		if (!cret) {
-			nfound++;
-			continue;
-		}
+		list_work_one(work, i);
+	}
 
-		/*构造container对象*/
-		c = lxc_container_new(direntp->d_name, lxcpath);
-		if (!c) {
-			INFO("Container %s:%s has a config but could not be loaded",
-				lxcpath, direntp->d_name);
+	return NULL;
+}
 
-			if (names)
-				if(!remove_from_array(names, direntp->d_name, cfound--))
-					goto free_bad;
+/*
+ * Check and load the containers in @names with up to @workers threads, or one
+ * per online cpu if @workers is 0. Names which didn't make it are dropped
+ * from @names and the remaining containers are stored at the same index in
+ * @cret. Both stay in the order of @names.
+ */
+static int list_load_containers(const char *lxcpath, char **names, int nr_names,
+				bool defined, int workers,
+				struct lxc_container ***cret)
+{
+	__do_free struct lxc_container **containers = NULL;
+	__do_free bool *found = NULL;
+	pthread_t threads[LXC_LIST_MAX_WORKERS];
+	struct list_work work = {
+		.lxcpath	= lxcpath,
+		.names		= names,
+		.nr_names	= nr_names,
+		.defined	= defined,
+	};
+	int nr_threads = 0, nr_found = 0;
 
-			continue;
-		}
+	if (nr_names == 0)
+		return 0;
 
-		/*检查c是否定义了*/
-		if (!do_lxcapi_is_defined(c)) {
-			INFO("Container %s:%s has a config but is not defined",
-				lxcpath, direntp->d_name);
+	found = zalloc(nr_names * sizeof(*found));
+	if (!found)
+		return ret_errno(ENOMEM);
+	work.found = found;
 
-			if (names)
-				if(!remove_from_array(names, direntp->d_name, cfound--))
-					goto free_bad;
+	if (cret) {
+		containers = zalloc(nr_names * sizeof(*containers));
+		if (!containers)
+			return ret_errno(ENOMEM);
+		work.containers = containers;
+	}
 
-			lxc_container_put(c);
-			continue;
-		}
+	if (workers <= 0)
+		workers = sysconf(_SC_NPROCESSORS_ONLN);
+	workers = MIN(workers, MIN(nr_names, LXC_LIST_MAX_WORKERS));
+
+	/* The calling thread is a worker too. */
+	for (; nr_threads < workers - 1; nr_threads++)
+		if (pthread_create(&threads[nr_threads], NULL, list_worker, &work))
+			break;
+
+	list_worker(&work);
+
+	for (int i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
 
-		/*将container加入到cret中*/
-		if (!add_to_clist(cret, c, nfound, true)) {
-			lxc_container_put(c);
-			goto free_bad;
+	for (int i = 0; i < nr_names; i++) {
+		if (!found[i]) {
+			free(names[i]);
+			continue;
 		}
 
-		nfound++;
+		names[nr_found] = names[i];
+		if (containers)
+			containers[nr_found] = containers[i];
+		nr_found++;
 	}
 
-	/*返回发现的container数目*/
-	return nfound;
+	if (cret)
+		*cret = move_ptr(containers);
+
+	return nr_found;
+}
+
+static void free_names(char **names, int nr_names)
+{
+	for (int i = 0; i < nr_names; i++)
+		free(names[i]);
+	free(names);
+}
 
-free_bad:
-	if (names && *names) {
-		for (i = 0; i < cfound; i++)
-			free((*names)[i]);
-		free(*names);
+/* Return the sorted names of all entries of @lxcpath except hidden ones. */
+static int list_dir_names(const char *lxcpath, char ***names)
+{
+	__do_closedir DIR *dir = NULL;
+	struct dirent *direntp;
+	char **list = NULL;
+	int nr = 0;
+
+	/*目录必须存在*/
+	dir = opendir(lxcpath);
+	if (!dir) {
+		SYSERROR("opendir on lxcpath");
+		return -1;
 	}
 
-	if (cret && *cret) {
-		for (i = 0; i < nfound; i++)
-			lxc_container_put((*cret)[i]);
-		free(*cret);
+	/*遍历目录下所有成员文件*/
+	while ((direntp = readdir(dir))) {
+		char **tmp;
+
+		/* Ignore '.', '..' and any hidden directory. */
+		if (strnequal(direntp->d_name, ".", 1))
+			continue;
+
+		tmp = realloc(list, (nr + 1) * sizeof(*list));
+		if (!tmp)
+			goto on_error;
+		list = tmp;
+
+		list[nr] = strdup(direntp->d_name);
+		if (!list[nr])
+			goto on_error;
+		nr++;
 	}
 
+	/* Sort once, the result is searched with bsearch(). */
+	if (nr)
+		qsort(list, nr, sizeof(char *),
+		      (int (*)(const void *, const void *))string_cmp);
+
+	*names = list;
+	return nr;
+
+on_error:
+	ERROR("Out of memory");
+	free_names(list, nr);
 	return -1;
 }
 
-//列出活跃的container
-int list_active_containers(const char *lxcpath, char ***nret/*出参，容器名称数组*/,
-			   struct lxc_container ***cret/*出参，容器对象数组*/)
+/* Hand the result of a listing over to the caller. */
+static int list_return(char **names, int nr, char ***nret,
+		       struct lxc_container **containers,
+		       struct lxc_container ***cret)
 {
-	__do_free char *line = NULL;
-	__do_fclose FILE *f = NULL;
-	int i, ret = -1, cret_cnt = 0, ct_name_cnt = 0;
-	int lxcpath_len;
-	char **ct_name = NULL;
-	size_t len = 0;
-	struct lxc_container *c = NULL;
-	bool is_hashed;
+	if (nr == 0) {
+		free(names);
+		names = NULL;
+		free(containers);
+		containers = NULL;
+	}
+
+	if (cret)
+		*cret = containers;
+
+	if (nret)
+		*nret = names;
+	else
+		free_names(names, nr);
+
+	return nr;
+}
+
+int list_defined_containers_parallel(const char *lxcpath, int workers,
+				     char ***names, struct lxc_container ***cret)
+{
+	struct lxc_container **containers = NULL;
+	char **list = NULL;
+	int nr, ret;
 
-	/*获取lxcpath*/
 	if (!lxcpath)
+		/*未提供lxcpath,取全局配置*/
 		lxcpath = lxc_global_config_value("lxc.lxcpath");
-	lxcpath_len = strlen(lxcpath);
 
 	if (cret)
 		*cret = NULL;
 
-	if (nret)
-		*nret = NULL;
+	if (names)
+		*names = NULL;
+
+	nr = list_dir_names(lxcpath, &list);
+	if (nr < 0)
+		return -1;
+
+	ret = list_load_containers(lxcpath, list, nr, true, workers,
+				   cret ? &containers : NULL);
+	if (ret < 0) {
+		free_names(list, nr);
+		return -1;
+	}
+
+	/*返回发现的container数目*/
+	return list_return(list, ret, names, containers, cret);
+}
+
+int list_defined_containers(const char *lxcpath, char ***names/*出参，列出目录下所有文件*/, struct lxc_container ***cret)
+{
+	return list_defined_containers_parallel(lxcpath, 1, names, cret);
+}
+
+/*
+ * Add the running container @name to the list of names and, if requested, to
+ * the list of containers. Returns 1 if the container was added, 0 if it was
+ * skipped, and -1 on allocation failure.
+ */
+static int add_active_container(const char *lxcpath, char *name,
+				char ***ct_name, int *ct_name_cnt,
+				struct lxc_container ***cret, int *cret_cnt)
+{
+	struct lxc_container *c;
+
+	/*检查name是否在ct_name中是否存在,如已存在，则跳过*/
+	if (array_contains(ct_name, name, *ct_name_cnt))
+		return 0;
+
+	/*ct_name中不存在name,这里将其加入*/
+	if (!add_to_array(ct_name, name, *ct_name_cnt))
+		return -1;
+
+	(*ct_name_cnt)++;
+
+	if (!cret)
+		return 1;
+
+	/*构造container*/
+	c = lxc_container_new(name, lxcpath);
+	if (!c) {
+		INFO("Container %s:%s is running but could not be loaded",
+			lxcpath, name);
+
+		remove_from_array(ct_name, name, (*ct_name_cnt)--);
+		return 0;
+	}
+
+	/*
+	 * If this is an anonymous container, then is_defined *can*
+	 * return false.  So we don't do that check.  Count on the
+	 * fact that the command socket exists.
+	 */
+
+	/*将c加入到cret中*/
+	if (!add_to_clist(cret, c, *cret_cnt, true)) {
+		lxc_container_put(c);
+		return -1;
+	}
+
+	(*cret_cnt)++;
+	return 1;
+}
+
+/*
+ * Fallback for when the active container registry can't be trusted, e.g.
+ * because it doesn't exist yet or a monitor failed to register: find the
+ * command sockets of running containers in /proc/net/unix.
+ */
+static int scan_active_containers(const char *lxcpath, char ***ct_name,
+				  int *ct_name_cnt,
+				  struct lxc_container ***cret, int *cret_cnt)
+{
+	__do_free char *line = NULL;
+	__do_fclose FILE *f = NULL;
+	size_t lxcpath_len = strlen(lxcpath);
+	size_t len = 0;
 
 	/*遍历/proc/net/unix文件中每一行*/
 	f = fopen("/proc/net/unix", "re");
 	if (!f)
-		return -1;
+		return -errno;
 
 	//取一行unix
 	while (getline(&line, &len, f) != -1) {
 		//取unix文件路径，含' '
 		char *p = strrchr(line, ' '), *p2;
+		bool is_hashed;
+		int ret;
+
 		if (!p)
 			continue;
 		p++;
@@ -5733,64 +6246,57 @@ int list_active_containers(const char *lxcpath, char ***nret/*出参，容器名
 				continue;
 		}
 
-		/*检查p是否在ct_name中是否存在,如已存在，则continue*/
-		if (array_contains(&ct_name, p, ct_name_cnt)) {
-			if (is_hashed)
-				free(p);
-			continue;
-		}
-
-		/*ct_name中不存在p,这里将其加入*/
-		if (!add_to_array(&ct_name, p, ct_name_cnt)) {
-			if (is_hashed)
-				free(p);
-			goto free_cret_list;
-		}
-
-		ct_name_cnt++;
-
-		if (!cret) {
-			if (is_hashed)
-				free(p);
-			continue;
-		}
+		ret = add_active_container(lxcpath, p, ct_name, ct_name_cnt,
+					   cret, cret_cnt);
+		if (is_hashed)
+			free(p);
+		if (ret < 0)
+			return -ENOMEM;
+	}
 
-		/*构造container*/
-		c = lxc_container_new(p, lxcpath);
-		if (!c) {
-			INFO("Container %s:%s is running but could not be loaded",
-				lxcpath, p);
+	return 0;
+}
 
-			remove_from_array(&ct_name, p, ct_name_cnt--);
-			if (is_hashed)
-				free(p);
+//列出活跃的container
+int list_active_containers(const char *lxcpath, char ***nret/*出参，容器名称数组*/,
+			   struct lxc_container ***cret/*出参，容器对象数组*/)
+{
+	__do_free_string_list char **active = NULL;
+	int i, nr_active, ret = -1, cret_cnt = 0, ct_name_cnt = 0;
+	char **ct_name = NULL;
 
-			continue;
-		}
+	/*获取lxcpath*/
+	if (!lxcpath)
+		lxcpath = lxc_global_config_value("lxc.lxcpath");
 
-		if (is_hashed)
-			free(p);
+	if (cret)
+		*cret = NULL;
 
-		/*
-		 * If this is an anonymous container, then is_defined *can*
-		 * return false.  So we don't do that check.  Count on the
-		 * fact that the command socket exists.
-		 */
+	if (nret)
+		*nret = NULL;
 
-		/*将c加入到cret中*/
-		if (!add_to_clist(cret, c, cret_cnt, true)) {
-			lxc_container_put(c);
+	/*
+	 * The registry maintained by the monitors of running containers lists
+	 * all of them unless it is missing or a monitor failed to register.
+	 * Only then the command sockets of all containers need to be scanned.
+	 */
+	nr_active = lxc_monitor_active_list(lxcpath, &active);
+	if (nr_active == -ENOENT) {
+		if (scan_active_containers(lxcpath, &ct_name, &ct_name_cnt,
+					   cret, &cret_cnt) < 0)
 			goto free_cret_list;
-		}
+	} else if (nr_active < 0) {
+		goto free_cret_list;
+	}
 
-		cret_cnt++;
+	for (i = 0; i < nr_active; i++) {
+		if (add_active_container(lxcpath, active[i], &ct_name,
+					 &ct_name_cnt, cret, &cret_cnt) < 0)
+			goto free_cret_list;
 	}
 
-	if (nret && cret && cret_cnt != ct_name_cnt) {
-		if (c)
-			lxc_container_put(c);
+	if (nret && cret && cret_cnt != ct_name_cnt)
 		goto free_cret_list;
-	}
 
 	ret = ct_name_cnt;
 	if (nret)
@@ -5805,6 +6311,7 @@ free_cret_list:
 		for (i = 0; i < cret_cnt; i++)
 			lxc_container_put((*cret)[i]);
 		free(*cret);
+		*cret = NULL;
 	}
 
 free_ct_name:
@@ -5818,102 +6325,814 @@ out:
 	return ret;
 }
 
-//列出所有container
-int list_all_containers(const char *lxcpath, char ***nret/*出参，所有容器名称数组*/,
-			struct lxc_container ***cret/*出参，所有容器对象数组*/)
+int list_all_containers_parallel(const char *lxcpath, int workers,
+				 char ***nret, struct lxc_container ***cret)
 {
-	int i, ret, active_cnt, ct_cnt, ct_list_cnt;
-	char **active_name;
-	/*列出发现的continer名称*/
-	char **ct_name = NULL;
-	struct lxc_container **ct_list = NULL;
+	struct lxc_container **containers = NULL;
+	char **ct_name = NULL, **active_name = NULL, **all = NULL;
+	int ct_cnt, active_cnt, nr = 0, i = 0, j = 0;
+
+	if (!lxcpath)
+		lxcpath = lxc_global_config_value("lxc.lxcpath");
+
+	if (cret)
+		*cret = NULL;
+
+	if (nret)
+		*nret = NULL;
 
 	/*列出发现的所有container*/
-	ct_cnt = list_defined_containers(lxcpath, &ct_name, NULL);
+	ct_cnt = list_defined_containers_parallel(lxcpath, workers, &ct_name, NULL);
 	if (ct_cnt < 0)
 		return ct_cnt;
 
 	/*列出所有的所有活跃container*/
 	active_cnt = list_active_containers(lxcpath, &active_name, NULL);
 	if (active_cnt < 0) {
-		ret = active_cnt;
-		goto free_ct_name;
+		free_names(ct_name, ct_cnt);
+		return active_cnt;
 	}
 
-	/*在ct_name中添加活跃的容器名称*/
-	for (i = 0; i < active_cnt; i++) {
-		if (!array_contains(&ct_name, active_name[i], ct_cnt)) {
-			if (!add_to_array(&ct_name, active_name[i], ct_cnt)) {
-				ret = -1;
-				goto free_active_name;
-			}
-
-			ct_cnt++;
+	/* Merge both sorted lists, moving the defined names over. */
+	if (ct_cnt + active_cnt > 0) {
+		all = malloc((ct_cnt + active_cnt) * sizeof(*all));
+		if (!all) {
+			free_names(ct_name, ct_cnt);
+			free_names(active_name, active_cnt);
+			return -1;
 		}
-
-		free(active_name[i]);
-		active_name[i] = NULL;
 	}
 
-	free(active_name);
-	active_name = NULL;
-	active_cnt = 0;
+	while (i < ct_cnt || j < active_cnt) {
+		int cmp;
 
-	//构造ct_name对应的container对象，并将其加入到ct_list中
-	for (i = 0, ct_list_cnt = 0; i < ct_cnt && cret; i++) {
-		struct lxc_container *c;
+		if (i == ct_cnt)
+			cmp = 1;
+		else if (j == active_cnt)
+			cmp = -1;
+		else
+			cmp = strcmp(ct_name[i], active_name[j]);
 
-		c = lxc_container_new(ct_name[i], lxcpath);
-		if (!c) {
-			WARN("Container %s:%s could not be loaded", lxcpath, ct_name[i]);
-			remove_from_array(&ct_name, ct_name[i], ct_cnt--);
+		if (cmp <= 0) {
+			all[nr++] = ct_name[i++];
+			if (cmp == 0)
+				j++;
 			continue;
 		}
 
-		if (!add_to_clist(&ct_list, c, ct_list_cnt, false)) {
-			lxc_container_put(c);
-			ret = -1;
-			goto free_ct_list;
+		all[nr] = strdup(active_name[j++]);
+		if (!all[nr]) {
+			free_names(all, nr);
+			for (; i < ct_cnt; i++)
+				free(ct_name[i]);
+			free(ct_name);
+			free_names(active_name, active_cnt);
+			return -1;
 		}
+		nr++;
+	}
+	free(ct_name);
+	free_names(active_name, active_cnt);
+
+	//构造ct_name对应的container对象
+	if (cret) {
+		int ret;
 
-		ct_list_cnt++;
+		ret = list_load_containers(lxcpath, all, nr, false, workers,
+					   &containers);
+		if (ret < 0) {
+			free_names(all, nr);
+			return -1;
+		}
+		nr = ret;
 	}
 
-	if (cret)
-		*cret = ct_list;
+	return list_return(all, nr, nret, containers, cret);
+}
 
-	if (nret) {
-		*nret = ct_name;
-	} else {
-		ret = ct_cnt;
-		goto free_ct_name;
+//列出所有container
+int list_all_containers(const char *lxcpath, char ***nret/*出参，所有容器名称数组*/,
+			struct lxc_container ***cret/*出参，所有容器对象数组*/)
+{
+	return list_all_containers_parallel(lxcpath, 1, nret, cret);
+}
+
+int lxc_containers_get_ips(struct lxc_container **containers, int count,
+			   const char *interface, const char *family,
+			   int scope, char ***ips)
+{
+	__do_close int fd = -EBADF;
+	__do_free int *netnsids = NULL;
+	__do_free bool *done = NULL;
+	int nr_found = 0;
+
+	if (count < 0 || (count > 0 && (!containers || !ips)))
+		return ret_errno(EINVAL);
+
+	if (count == 0)
+		return 0;
+
+	netnsids = malloc(sizeof(*netnsids) * count);
+	done = zalloc(sizeof(*done) * count);
+	if (!netnsids || !done)
+		return ret_errno(ENOMEM);
+
+	for (int i = 0; i < count; i++) {
+		ips[i] = NULL;
+		netnsids[i] = containers[i] ? container_netnsid(containers[i]) : -1;
 	}
 
-	return ct_cnt;
+	/*
+	 * Dump each network namespace once through a shared socket and hand
+	 * the addresses to all containers in it.
+	 */
+	for (int i = 0; i < count; i++) {
+		call_cleaner(netns_freeifaddrs) struct netns_ifaddrs *ifaddrs = NULL;
+
+		if (done[i] || netnsids[i] < 0)
+			continue;
+
+		if (fd < 0)
+			fd = netns_ifaddrs_socket();
+		if (fd < 0)
+			break;
+
+		if (!netnsid_getifaddrs(fd, netnsids[i], &ifaddrs)) {
+			/* Don't read the rest of a failed dump later on. */
+			close_prot_errno_disarm(fd);
+			continue;
+		}
+
+		for (int j = i; j < count; j++) {
+			if (netnsids[j] != netnsids[i])
+				continue;
 
-free_ct_list:
-	for (i = 0; i < ct_list_cnt; i++) {
-		lxc_container_put(ct_list[i]);
+			ips[j] = ifaddrs_ips(ifaddrs, interface, family, scope);
+			done[j] = true;
+		}
 	}
-	free(ct_list);
 
-free_active_name:
-	for (i = 0; i < active_cnt; i++) {
-		free(active_name[i]);
+	for (int i = 0; i < count; i++) {
+		if (!done[i] && containers[i])
+			ips[i] = lxcapi_get_ips(containers[i], interface, family, scope);
+
+		if (ips[i])
+			nr_found++;
 	}
-	free(active_name);
 
-free_ct_name:
-	for (i = 0; i < ct_cnt; i++) {
-		free(ct_name[i]);
+	return nr_found;
+}
+
+int lxc_containers_get_metrics(struct lxc_container **containers, int count,
+			       struct lxc_metrics *metrics)
+{
+	int nr_read = 0;
+
+	if (count < 0 || (count > 0 && (!containers || !metrics)))
+		return ret_errno(EINVAL);
+
+	for (int i = 0; i < count; i++) {
+		if (!containers[i]) {
+			metrics[i].flags = 0;
+			continue;
+		}
+
+		if (lxcapi_get_metrics(containers[i], &metrics[i]))
+			nr_read++;
 	}
-	free(ct_name);
-	return ret;
+
+	return nr_read;
 }
 
-bool lxc_config_item_is_supported(const char *key)
+static int containers_freeze(struct lxc_container **containers, int count,
+			     bool freeze, int timeout, int *results)
 {
-	return !!lxc_get_config_exact(key);
+	__do_free const char **names = NULL, **lxcpaths = NULL;
+	__do_free int *ret_codes = NULL;
+	int nr_done = 0;
+
+	if (count < 0 || (count > 0 && !containers))
+		return ret_errno(EINVAL);
+
+	if (count == 0)
+		return 0;
+
+	names = zalloc(sizeof(*names) * count);
+	lxcpaths = zalloc(sizeof(*lxcpaths) * count);
+	if (!results)
+		results = ret_codes = zalloc(sizeof(*ret_codes) * count);
+	if (!names || !lxcpaths || !results)
+		return ret_errno(ENOMEM);
+
+	for (int i = 0; i < count; i++) {
+		struct lxc_container *c = containers[i];
+
+		if (c && c->lxc_conf) {
+			names[i] = c->name;
+			lxcpaths[i] = c->config_path;
+		}
+	}
+
+	(void)cgroup_freeze_many(names, lxcpaths, count, freeze,
+				 timeout > 0 ? timeout * 1000 : timeout, results);
+
+	for (int i = 0; i < count; i++) {
+		struct lxc_container *c = containers[i];
+
+		/* Containers on the legacy freezer are handled one by one. */
+		if (results[i] == -ENOCGROUP2) {
+			if (!lxcapi_is_running(c))
+				results[i] = -ESRCH;
+			else if (freeze ? lxcapi_freeze(c) : lxcapi_unfreeze(c))
+				results[i] = 0;
+			else
+				results[i] = -EIO;
+		}
+
+		if (results[i] == 0)
+			nr_done++;
+	}
+
+	return nr_done;
+}
+
+int lxc_containers_freeze(struct lxc_container **containers, int count,
+			  int timeout, int *results)
+{
+	return containers_freeze(containers, count, true, timeout, results);
+}
+
+int lxc_containers_unfreeze(struct lxc_container **containers, int count,
+			    int timeout, int *results)
+{
+	return containers_freeze(containers, count, false, timeout, results);
+}
+
+/*
+ * Marks a pool entry whose clone is complete. It holds the path of the
+ * entry's rootfs relative to its directory if the hostname in the rootfs has
+ * to be changed when the entry is claimed and is empty otherwise.
+ */
+#define LXC_POOL_READY "lxc_pool_ready"
+
+struct lxc_pool {
+	pid_t pid;
+	int fd;
+	struct lxc_container *c;
+	int size;
+	int flags;
+	char *bdevtype;
+	/* Entries are hidden containers named "<prefix><pid>.<seq>". */
+	char prefix[NAME_MAX + 1];
+};
+
+static bool pool_entry_ready(const char *lxcpath, const char *name)
+{
+	char path[PATH_MAX];
+
+	if (strnprintf(path, sizeof(path), "%s/%s/" LXC_POOL_READY, lxcpath, name) < 0)
+		return false;
+
+	return file_exists(path);
+}
+
+/*
+ * Call @fn for every entry of @p. Entries which are still being cloned are
+ * only included if @all is set.
+ */
+static int pool_for_each(struct lxc_pool *p, bool all,
+			 int (*fn)(struct lxc_pool *p, const char *name, void *data),
+			 void *data)
+{
+	__do_closedir DIR *dir = NULL;
+	struct dirent *direntp;
+	size_t len = strlen(p->prefix);
+	int ret;
+
+	dir = opendir(p->c->config_path);
+	if (!dir)
+		return -errno;
+
+	while ((direntp = readdir(dir))) {
+		if (!strnequal(direntp->d_name, p->prefix, len))
+			continue;
+
+		if (!all && !pool_entry_ready(p->c->config_path, direntp->d_name))
+			continue;
+
+		ret = fn(p, direntp->d_name, data);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int pool_count_cb(struct lxc_pool *p, const char *name, void *data)
+{
+	(*(int *)data)++;
+	return 0;
+}
+
+static int pool_destroy_cb(struct lxc_pool *p, const char *name, void *data)
+{
+	struct lxc_container *c;
+
+	c = lxc_container_new(name, p->c->config_path);
+	if (!c)
+		return 0;
+
+	if (!c->destroy(c))
+		WARN("Failed to destroy pool entry \"%s\"", name);
+	lxc_container_put(c);
+	return 0;
+}
+
+/*
+ * Claims mustn't mount the rootfs, so only backing stores keeping it as a
+ * directory can be pooled.
+ */
+static bool pool_storage_supported(const char *type)
+{
+	return strequal(type, "dir") || strequal(type, "btrfs") ||
+	       strequal(type, "overlay") || strequal(type, "overlayfs");
+}
+
+/* Get the path of the directory holding @c's rootfs relative to its directory. */
+static int pool_rootfs_dir(struct lxc_container *c, char *buf, size_t size)
+{
+	__do_free char *rootfs = NULL;
+	struct lxc_storage *bdev;
+	char dir[PATH_MAX];
+	const char *path;
+	int ret;
+
+	bdev = storage_init(c->lxc_conf);
+	if (!bdev)
+		return log_error(-EINVAL, "Failed to detect the storage of \"%s\"", c->name);
+
+	if (!pool_storage_supported(bdev->type)) {
+		ERROR("Containers using \"%s\" storage can't be pooled", bdev->type);
+		storage_put(bdev);
+		return -EOPNOTSUPP;
+	}
+
+	if (strequal(bdev->type, "dir") || strequal(bdev->type, "btrfs")) {
+		path = lxc_storage_get_path(bdev->src, bdev->type);
+	} else {
+		/* The upper directory of overlay comes last. */
+		path = strrchr(bdev->src, ':');
+		path = path ? path + 1 : bdev->src;
+	}
+	rootfs = strdup(path);
+	storage_put(bdev);
+	if (!rootfs)
+		return -ENOMEM;
+
+	ret = strnprintf(dir, sizeof(dir), "%s/%s/", c->config_path, c->name);
+	if (ret < 0)
+		return ret;
+
+	if (!strnequal(rootfs, dir, ret))
+		return log_error(-EOPNOTSUPP, "The rootfs \"%s\" isn't stored in \"%s\"",
+				 rootfs, dir);
+
+	return strnprintf(buf, size, "%s", rootfs + ret);
+}
+
+/*
+ * Clone a new entry. Only called from the pool's helper process. The clone
+ * hooks and the hostname update run now, under the name of the entry.
+ */
+static int pool_provision(struct lxc_pool *p, const char *name)
+{
+	struct lxc_container *c;
+	char path[PATH_MAX], rootfs[PATH_MAX];
+	int ret;
+
+	c = p->c->clone(p->c, name, NULL, p->flags, p->bdevtype, NULL, 0, NULL);
+	if (!c)
+		return log_error(-EIO, "Failed to clone \"%s\" into pool entry \"%s\"",
+				 p->c->name, name);
+
+	ret = pool_rootfs_dir(c, rootfs, sizeof(rootfs));
+	if (ret < 0)
+		goto on_error;
+
+	/* Only a hostname written by the clone has to be changed. */
+	if (!(p->flags & LXC_CLONE_KEEPNAME)) {
+		ret = strnprintf(path, sizeof(path), "%s/%s/%s/etc/hostname",
+				 c->config_path, name, rootfs);
+		if (ret < 0)
+			goto on_error;
+
+		if (!file_exists(path))
+			rootfs[0] = '\0';
+	} else {
+		rootfs[0] = '\0';
+	}
+
+	ret = strnprintf(path, sizeof(path), "%s/%s/" LXC_POOL_READY, c->config_path, name);
+	if (ret < 0 || lxc_write_to_file(path, rootfs, strlen(rootfs), false, 0640) < 0) {
+		ERROR("Failed to mark pool entry \"%s\" ready", name);
+		ret = -EIO;
+		goto on_error;
+	}
+
+	lxc_container_put(c);
+	TRACE("Added entry \"%s\" to pool of \"%s\"", name, p->c->name);
+	return 0;
+
+on_error:
+	c->destroy(c);
+	lxc_container_put(c);
+	return ret;
+}
+
+static __noreturn void pool_main(int fd, struct lxc_pool *p)
+{
+	unsigned int seq = 0;
+
+	for (;;) {
+		struct pollfd pfd = {
+			.fd	= fd,
+			.events	= POLLIN,
+		};
+		char name[NAME_MAX + 1];
+		int nr = 0, ret, timeout = -1;
+		char buf[64];
+
+		(void)pool_for_each(p, false, pool_count_cb, &nr);
+		for (; nr < p->size; nr++) {
+			ret = strnprintf(name, sizeof(name), "%s%d.%u", p->prefix,
+					 getpid(), seq++);
+			if (ret < 0)
+				_exit(EXIT_FAILURE);
+
+			ret = pool_provision(p, name);
+			if (ret == -EOPNOTSUPP)
+				_exit(EXIT_FAILURE);
+
+			/* Try again later instead of spinning on a failing clone. */
+			if (ret < 0) {
+				timeout = 5000;
+				break;
+			}
+		}
+
+		/* Claims send a byte, closing the socket stops the pool. */
+		ret = poll(&pfd, 1, timeout);
+		if (ret < 0 && errno != EINTR)
+			break;
+
+		if (ret > 0 && lxc_recv_nointr(fd, buf, sizeof(buf), MSG_DONTWAIT) <= 0)
+			break;
+	}
+
+	_exit(EXIT_SUCCESS);
+}
+
+struct lxc_pool *lxc_pool_new(struct lxc_container *c, int size, int flags,
+			      const char *bdevtype)
+{
+	__do_free struct lxc_pool *p = NULL;
+	int fds[2];
+
+	if (!c || !c->lxc_conf || size <= 0 || !do_lxcapi_is_defined(c))
+		return ret_set_errno(NULL, EINVAL);
+
+	if (bdevtype && !pool_storage_supported(bdevtype)) {
+		ERROR("Containers using \"%s\" storage can't be pooled", bdevtype);
+		return ret_set_errno(NULL, EOPNOTSUPP);
+	}
+
+	/* The helper keeps using @c and liblxc after fork(). */
+	if (!am_single_threaded()) {
+		ERROR("Cannot create a pool when threaded");
+		return ret_set_errno(NULL, EINVAL);
+	}
+
+	p = zalloc(sizeof(*p));
+	if (!p)
+		return ret_set_errno(NULL, ENOMEM);
+
+	if (strnprintf(p->prefix, sizeof(p->prefix), ".pool.%s.", c->name) < 0)
+		return ret_set_errno(NULL, ENAMETOOLONG);
+
+	if (bdevtype) {
+		p->bdevtype = strdup(bdevtype);
+		if (!p->bdevtype)
+			return ret_set_errno(NULL, ENOMEM);
+	}
+
+	if (!lxc_container_get(c)) {
+		free(p->bdevtype);
+		return ret_set_errno(NULL, EINVAL);
+	}
+	p->c = c;
+	p->size = size;
+	p->flags = flags;
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0)
+		goto on_error;
+
+	p->pid = fork();
+	if (p->pid < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		goto on_error;
+	}
+
+	if (p->pid == 0) {
+		close(fds[0]);
+		pool_main(fds[1], p);
+	}
+
+	close(fds[1]);
+	p->fd = fds[0];
+	return move_ptr(p);
+
+on_error:
+	lxc_container_put(c);
+	free(p->bdevtype);
+	return NULL;
+}
+
+struct pool_take {
+	const char *newname;
+	char name[NAME_MAX + 1];
+};
+
+static int pool_take_cb(struct lxc_pool *p, const char *name, void *data)
+{
+	struct pool_take *take = data;
+	char from[PATH_MAX], to[PATH_MAX];
+
+	if (strnprintf(from, sizeof(from), "%s/%s", p->c->config_path, name) < 0 ||
+	    strnprintf(to, sizeof(to), "%s/%s", p->c->config_path, take->newname) < 0)
+		return -ENAMETOOLONG;
+
+	/* Another caller claimed it first. */
+	if (rename(from, to) < 0)
+		return errno == ENOENT ? 0 : -errno;
+
+	(void)strlcpy(take->name, name, sizeof(take->name));
+	return 1;
+}
+
+struct pool_hostname {
+	const char *path;
+	const char *name;
+};
+
+static int pool_write_hostname(void *data)
+{
+	__do_close int fd = -EBADF;
+	struct pool_hostname *h = data;
+	size_t len = strlen(h->name);
+
+	fd = open(h->path, O_WRONLY | O_TRUNC | O_NOFOLLOW | O_CLOEXEC);
+	if (fd < 0)
+		return log_error_errno(-errno, errno, "Failed to open \"%s\"", h->path);
+
+	if (lxc_write_nointr(fd, h->name, len) != (ssize_t)len)
+		return log_error_errno(-EIO, EIO, "Failed to write \"%s\"", h->path);
+
+	return 0;
+}
+
+/*
+ * Turn the entry @name, which has been renamed to @newname, into a container
+ * of its own. Its rootfs was updated when it was cloned, so only the name has
+ * to be changed.
+ */
+static struct lxc_container *pool_adopt(struct lxc_pool *p, const char *name,
+					const char *newname)
+{
+	__do_free char *config = NULL, *orig = NULL;
+	const char *lxcpath = p->c->config_path;
+	struct lxc_container *c = NULL, *old;
+	char from[PATH_MAX], to[PATH_MAX], path[PATH_MAX], rootfs[PATH_MAX];
+	ssize_t len;
+
+	if (strnprintf(path, sizeof(path), "%s/%s/" LXC_POOL_READY, lxcpath, newname) < 0)
+		goto on_error;
+
+	len = lxc_read_from_file(path, rootfs, sizeof(rootfs) - 1);
+	if (len < 0)
+		goto on_error;
+	rootfs[len] = '\0';
+	(void)unlink(path);
+
+	/* All paths to the entry's directory are absolute. */
+	if (strnprintf(from, sizeof(from), "%s/%s/", lxcpath, name) < 0 ||
+	    strnprintf(to, sizeof(to), "%s/%s/", lxcpath, newname) < 0 ||
+	    strnprintf(path, sizeof(path), "%s/%s/" LXC_CONFIG_FNAME, lxcpath, newname) < 0)
+		goto on_error;
+
+	orig = read_file_at(-EBADF, path, PROTECT_OPEN, 0);
+	if (!orig)
+		goto on_error;
+
+	config = lxc_string_replace(from, to, orig);
+	if (!config)
+		goto on_error;
+
+	if (lxc_write_to_file(path, config, strlen(config), false, 0640) < 0)
+		goto on_error;
+
+	c = lxc_container_new(newname, lxcpath);
+	if (!c)
+		goto on_error;
+
+	if (!(p->flags & LXC_CLONE_KEEPNAME)) {
+		clear_unexp_config_line(c->lxc_conf, "lxc.utsname", false);
+		clear_unexp_config_line(c->lxc_conf, "lxc.uts.name", false);
+
+		if (!do_set_config_item_locked(c, "lxc.uts.name", newname) ||
+		    !c->save_config(c, NULL))
+			goto on_error;
+	}
+
+	if (rootfs[0] != '\0') {
+		struct pool_hostname h = {
+			.path	= path,
+			.name	= newname,
+		};
+		int ret;
+
+		if (strnprintf(path, sizeof(path), "%s/%s/%s/etc/hostname",
+			       lxcpath, newname, rootfs) < 0)
+			goto on_error;
+
+		if (am_guest_unpriv())
+			ret = userns_exec_full(c->lxc_conf, pool_write_hostname,
+					       &h, "pool_write_hostname");
+		else
+			ret = pool_write_hostname(&h);
+		if (ret < 0)
+			goto on_error;
+	}
+
+	/* Snapshots of the pooled container are listed by name. */
+	old = lxc_container_new(name, lxcpath);
+	if (old) {
+		if (strnprintf(path, sizeof(path), "%s/%s/lxc_rdepends", lxcpath, newname) >= 0)
+			mod_rdepends_of(path, old, false);
+		lxc_container_put(old);
+	}
+	mod_all_rdeps(c, true);
+
+	if (c->lxc_conf->rootfs.path &&
+	    (ovl_layers_ref(c->lxc_conf->rootfs.path, lxcpath, newname, true) < 0 ||
+	     ovl_layers_ref(c->lxc_conf->rootfs.path, lxcpath, name, false) < 0))
+		goto on_error;
+
+	return c;
+
+on_error:
+	ERROR("Failed to turn pool entry \"%s\" into \"%s\"", name, newname);
+	if (!c)
+		c = lxc_container_new(newname, lxcpath);
+	if (c) {
+		c->destroy(c);
+		lxc_container_put(c);
+	}
+	return NULL;
+}
+
+struct lxc_container *lxc_pool_claim(struct lxc_pool *p, const char *newname)
+{
+	struct pool_take take = {
+		.newname = newname,
+	};
+	char path[PATH_MAX];
+	int ret;
+
+	if (!p || !newname || strnequal(newname, ".", 1))
+		return ret_set_errno(NULL, EINVAL);
+
+	ret = strnprintf(path, sizeof(path), "%s/%s", p->c->config_path, newname);
+	if (ret < 0)
+		return ret_set_errno(NULL, ENAMETOOLONG);
+
+	if (file_exists(path)) {
+		ERROR("Container \"%s\" already exists", newname);
+		return ret_set_errno(NULL, EEXIST);
+	}
+
+	ret = pool_for_each(p, false, pool_take_cb, &take);
+	if (ret < 0)
+		return ret_set_errno(NULL, -ret);
+
+	/* Wake up the helper to replace the entry. */
+	(void)lxc_send_nointr(p->fd, "", 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+	if (ret == 0) {
+		INFO("No clone of \"%s\" ready, cloning it now", p->c->name);
+		return p->c->clone(p->c, newname, NULL, p->flags, p->bdevtype,
+				   NULL, 0, NULL);
+	}
+
+	return pool_adopt(p, take.name, newname);
+}
+
+void lxc_pool_put(struct lxc_pool *p, bool drain)
+{
+	if (!p)
+		return;
+
+	/* The helper exits once its end of the socket is closed. */
+	close(p->fd);
+	(void)wait_for_pid(p->pid);
+
+	if (drain)
+		(void)pool_for_each(p, true, pool_destroy_cb, NULL);
+
+	lxc_container_put(p->c);
+	free(p->bdevtype);
+	free(p);
+}
+
+int lxc_layer_import(const char *lxcpath, const char *path, char *digest)
+{
+	if (!path || !digest)
+		return ret_errno(EINVAL);
+
+	if (!lxcpath)
+		lxcpath = lxc_global_config_value("lxc.lxcpath");
+
+	return ovl_layer_import(lxcpath, path, digest);
+}
+
+bool lxc_layers_create(struct lxc_container *c, const char *const *digests,
+		       int nr)
+{
+	__do_free char *dir = NULL, *rootfs = NULL;
+
+	if (!c || !digests || nr <= 0)
+		return ret_set_errno(false, EINVAL);
+
+	if (do_lxcapi_is_defined(c)) {
+		ERROR("Container \"%s\" already exists in \"%s\"", c->name, c->config_path);
+		return ret_set_errno(false, EEXIST);
+	}
+
+	if (!c->lxc_conf &&
+	    !do_lxcapi_load_config(c, lxc_global_config_value("lxc.default_config"))) {
+		ERROR("Failed to load default configuration file %s",
+		      lxc_global_config_value("lxc.default_config"));
+		return false;
+	}
+
+	if (!create_container_dir(c)) {
+		ERROR("Failed to create container %s", c->name);
+		return false;
+	}
+
+	rootfs = ovl_layers_rootfs(c->config_path, c->name, digests, nr, c->lxc_conf);
+	if (!rootfs)
+		goto on_error;
+
+	clear_unexp_config_line(c->lxc_conf, "lxc.rootfs.path", false);
+	if (!c->set_config_item(c, "lxc.rootfs.path", rootfs))
+		goto on_error;
+
+	if (ovl_layers_ref(rootfs, c->config_path, c->name, true) < 0)
+		goto on_error;
+
+	if (!c->save_config(c, NULL))
+		goto on_error;
+
+	return true;
+
+on_error:
+	ERROR("Failed to create container \"%s\" from layers", c->name);
+	if (rootfs)
+		(void)ovl_layers_ref(rootfs, c->config_path, c->name, false);
+
+	dir = must_make_path(c->config_path, c->name, NULL);
+	if (lxc_rmdir_onedev(dir, NULL) < 0)
+		WARN("Failed to remove \"%s\"", dir);
+	return false;
+}
+
+int lxc_layers_prune(const char *lxcpath)
+{
+	if (!lxcpath)
+		lxcpath = lxc_global_config_value("lxc.lxcpath");
+
+	return ovl_layers_prune(lxcpath);
+}
+
+bool lxc_config_item_is_supported(const char *key)
+{
+	return !!lxc_get_config_exact(key);
+}
+
+void lxc_config_cache_enable(bool enable)
+{
+	lxc_config_cache_set(enable);
 }
 
 bool lxc_has_api_extension(const char *extension)
@@ -36,6 +36,12 @@ struct migrate_opts;
 
 struct lxc_console_log;
 
+struct lxc_running_info;
+
+struct lxc_metrics;
+
+struct lxc_cmd_session;
+
 struct lxc_mount {
 	int version;
 };
@@ -895,6 +901,69 @@ struct lxc_container {
 	 * \return Mount fd of the container's devpts instance.
 	 */
 	int (*devpts_fd)(struct lxc_container *c);
+
+	/*!
+	 * \brief Retrieve state, init pid, cgroup paths and config items of a
+	 * running container in a single request to its monitor.
+	 *
+	 * \param c Container.
+	 * \param info A lxc_running_info struct describing what to retrieve.
+	 *
+	 * \return \c true on success, else \c false.
+	 *
+	 * \note Items that could not be retrieved are left \c NULL and their
+	 *  \c LXC_INFO_* flag is cleared in \p info->flags.
+	 */
+	bool (*get_running_info)(struct lxc_container *c, struct lxc_running_info *info);
+
+	/*!
+	 * \brief Change whether commands sent to the running container reuse
+	 *  a persistent connection to its monitor. The connection is shared by
+	 *  all containers with the same name and lxcpath that opted in.
+	 *
+	 * \param c Container.
+	 * \param state Value for the persistent commands bit (0 or 1).
+	 *
+	 * \return \c true on success, else \c false.
+	 *
+	 * \note Monitors that don't support persistent connections are sent
+	 *  one-shot requests as before.
+	 * \note Requests on the connection fail if they aren't answered within
+	 *  30 seconds. Freezing and unfreezing, which can take longer, always
+	 *  use one-shot requests.
+	 */
+	bool (*want_persistent_commands)(struct lxc_container *c, bool state);
+
+	/*!
+	 * \brief Read resource usage metrics of a running container from its
+	 *  cgroup2 files.
+	 *
+	 * \param c Container.
+	 * \param metrics A lxc_metrics struct describing what to read.
+	 *
+	 * \return \c true if any of the requested metrics was read, else
+	 *  \c false.
+	 *
+	 * \note The container's cgroup is looked up once and kept open, later
+	 *  calls read the files without contacting the container's monitor.
+	 *  Groups of metrics that could not be read have their
+	 *  \c LXC_METRICS_* flag cleared in \p metrics->flags.
+	 */
+	bool (*get_metrics)(struct lxc_container *c, struct lxc_metrics *metrics);
+
+	/*!
+	 * \private
+	 * Persistent connection to the container's monitor.
+	 * \note protected by privlock.
+	 */
+	struct lxc_cmd_session *cmd_session;
+
+	/*!
+	 * \private
+	 * Cgroup2 directory of the running container used by get_metrics().
+	 * \note protected by privlock.
+	 */
+	int metrics_dfd;
 };
 
 /*!
@@ -1018,6 +1087,145 @@ struct lxc_console_log {
 	char *data;
 };
 
+#define LXC_INFO_STATE		(1U << 0) /*!< Retrieve the container state */
+#define LXC_INFO_INIT_PID	(1U << 1) /*!< Retrieve the pid of the container's init */
+#define LXC_INFO_CGROUP		(1U << 2) /*!< Retrieve the container's cgroup2 path */
+#define LXC_INFO_LIMIT_CGROUP	(1U << 3) /*!< Retrieve the container's cgroup2 limit path */
+
+/*!
+ * \brief Options and results for the get_running_info API call.
+ */
+struct lxc_running_info {
+	/* new members should be added at the end */
+
+	/* LXC_INFO_* flags selecting what to retrieve. On return only the
+	 * flags of the fields that were retrieved are set.
+	 */
+	unsigned int flags;
+
+	/* Number of config keys in "keys" and values in "values". */
+	int nr_keys;
+
+	/* Config keys to retrieve, e.g. "lxc.net.0.veth.pair". */
+	const char **keys;
+
+	/* Container state. Static string, must not be freed. */
+	const char *state;
+
+	/* Pid of the container's init process. */
+	pid_t init_pid;
+
+	/* Cgroup paths relative to the cgroup2 mountpoint. Must be freed by
+	 * the caller.
+	 */
+	char *cgroup;
+	char *limit_cgroup;
+
+	/* Array of "nr_keys" values corresponding to "keys". A value is \c NULL
+	 * if it could not be retrieved. The array and each value must be freed
+	 * by the caller.
+	 */
+	char **values;
+};
+
+#define LXC_METRICS_CPU		(1U << 0) /*!< Read cpu.stat */
+#define LXC_METRICS_MEMORY	(1U << 1) /*!< Read memory.current, memory.max, memory.swap.* and memory.stat */
+#define LXC_METRICS_IO		(1U << 2) /*!< Read io.stat */
+#define LXC_METRICS_PIDS	(1U << 3) /*!< Read pids.current and pids.max */
+#define LXC_METRICS_PRESSURE	(1U << 4) /*!< Read cpu.pressure, memory.pressure and io.pressure */
+#define LXC_METRICS_ROOTFS	(1U << 5) /*!< Read the usage of the rootfs' writable layer */
+#define LXC_METRICS_ALL		(LXC_METRICS_CPU | LXC_METRICS_MEMORY | LXC_METRICS_IO | \
+				 LXC_METRICS_PIDS | LXC_METRICS_PRESSURE)
+
+/*!
+ * Value of limits that are set to "max".
+ */
+#define LXC_METRICS_UNLIMITED	UINT64_MAX
+
+/*!
+ * \brief Pressure stall information for tasks that were "some" or "full"
+ * stalled.
+ */
+struct lxc_pressure_stats {
+	/* Share of time stalled in percent over the last 10s, 60s and 300s. */
+	double avg10;
+	double avg60;
+	double avg300;
+
+	/* Total time stalled in microseconds. */
+	uint64_t total;
+};
+
+struct lxc_pressure {
+	struct lxc_pressure_stats some;
+	struct lxc_pressure_stats full;
+};
+
+/*!
+ * \brief Options and results for the get_metrics API call.
+ */
+struct lxc_metrics {
+	/* new members should be added at the end */
+
+	/* LXC_METRICS_* flags selecting what to read. On return only the
+	 * flags of the metrics that were read are set.
+	 */
+	unsigned int flags;
+
+	/* cpu.stat, in microseconds. */
+	uint64_t cpu_usage_usec;
+	uint64_t cpu_user_usec;
+	uint64_t cpu_system_usec;
+	uint64_t cpu_nr_periods;
+	uint64_t cpu_nr_throttled;
+	uint64_t cpu_throttled_usec;
+
+	/* memory.current, memory.max and memory.swap.*, in bytes. The swap
+	 * values are 0 if swap isn't accounted.
+	 */
+	uint64_t memory_current;
+	uint64_t memory_max;
+	uint64_t memory_swap_current;
+	uint64_t memory_swap_max;
+
+	/* memory.stat, in bytes except for the fault counters. */
+	uint64_t memory_anon;
+	uint64_t memory_file;
+	uint64_t memory_kernel_stack;
+	uint64_t memory_slab;
+	uint64_t memory_sock;
+	uint64_t memory_shmem;
+	uint64_t memory_pgfault;
+	uint64_t memory_pgmajfault;
+
+	/* io.stat, summed over all devices. */
+	uint64_t io_rbytes;
+	uint64_t io_wbytes;
+	uint64_t io_rios;
+	uint64_t io_wios;
+	uint64_t io_dbytes;
+	uint64_t io_dios;
+
+	/* pids.current and pids.max. */
+	uint64_t pids_current;
+	uint64_t pids_max;
+
+	/* cpu.pressure, memory.pressure and io.pressure. The "full" line of
+	 * cpu.pressure is only reported by newer kernels.
+	 */
+	struct lxc_pressure cpu_pressure;
+	struct lxc_pressure memory_pressure;
+	struct lxc_pressure io_pressure;
+
+	/* Size and usage of the filesystem the container writes its rootfs
+	 * changes to, in bytes. For an overlay rootfs with
+	 * lxc.rootfs.overlay.tmpfs this is the container's own tmpfs, whose
+	 * pages are also charged to memory_shmem.
+	 */
+	uint64_t rootfs_size;
+	uint64_t rootfs_used;
+};
+
 /*!
  * \brief Create a new container.
  *
@@ -1125,6 +1333,216 @@ int list_active_containers(const char *lxcpath, char ***names, struct lxc_contai
  */
 int list_all_containers(const char *lxcpath, char ***names, struct lxc_container ***cret);
 
+/*!
+ * \brief Get a list of defined containers in a lxcpath, checking and loading
+ *  them with a pool of threads.
+ *
+ * \param lxcpath lxcpath under which to look.
+ * \param workers Maximum number of threads to use, or \c 0 for one per
+ *  online cpu.
+ * \param names If not \c NULL, then a list of container names will be returned here.
+ * \param cret If not \c NULL, then a list of lxc_containers will be returned here.
+ *
+ * \return Number of containers found, or \c -1 on error.
+ *
+ * \note Values returned in \p names and \p cret are sorted by container name
+ *  and \p names[i] is the name of \p cret[i].
+ */
+int list_defined_containers_parallel(const char *lxcpath, int workers,
+				     char ***names, struct lxc_container ***cret);
+
+/*!
+ * \brief Get a complete list of all containers for a given lxcpath, loading
+ *  them with a pool of threads.
+ *
+ * \param lxcpath Full \c LXCPATH path to consider.
+ * \param workers Maximum number of threads to use, or \c 0 for one per
+ *  online cpu.
+ * \param[out] names Dynamically-allocated array of container name.
+ * \param[out] cret Dynamically-allocated list of containers.
+ *
+ * \return Number of containers, or -1 on error.
+ *
+ * \note Some of the containers may not be "defined".
+ * \note Values returned in \p names and \p cret are sorted by container name
+ *  and \p names[i] is the name of \p cret[i].
+ * \note \p names and \p cret must be freed by the caller.
+ */
+int list_all_containers_parallel(const char *lxcpath, int workers,
+				 char ***names, struct lxc_container ***cret);
+
+/*!
+ * \brief Retrieve the IP addresses of a list of containers.
+ *
+ * \param containers Array of \p count containers. \c NULL entries are skipped.
+ * \param count Number of containers in \p containers.
+ * \param interface Network interface name to consider.
+ * \param family Network family (for example "inet", "inet6").
+ * \param scope IPv6 scope id (ignored if \p family is not "inet6").
+ * \param[out] ips Array of \p count entries. Each entry is set to what
+ *  \c get_ips() returns for the container at the same index.
+ *
+ * \return Number of containers whose addresses were retrieved, or a negative
+ *  error code.
+ *
+ * \note Each entry of \p ips must be freed by the caller like the return
+ *  value of \c get_ips().
+ * \note The addresses of each network namespace are dumped once from the host
+ *  through a shared netlink socket. Containers whose network namespace has no
+ *  id in the caller's, like ones not started by liblxc, are queried like
+ *  \c get_ips() does by forking into it.
+ */
+int lxc_containers_get_ips(struct lxc_container **containers, int count,
+			   const char *interface, const char *family,
+			   int scope, char ***ips);
+
+/*!
+ * \brief Read the resource usage metrics of many running containers.
+ *
+ * \param containers Array of containers.
+ * \param count Number of containers in \p containers.
+ * \param[in,out] metrics Array of \p count metrics, each one describing
+ *  what to read for the container at the same index like for \c get_metrics().
+ *
+ * \return Number of containers for which any metrics were read, or a negative
+ *  error code.
+ */
+int lxc_containers_get_metrics(struct lxc_container **containers, int count,
+			       struct lxc_metrics *metrics);
+
+/*!
+ * \brief Freeze many running containers at once.
+ *
+ * \param containers Array of containers.
+ * \param count Number of containers in \p containers.
+ * \param timeout Seconds to wait in total for all containers to be frozen,
+ *  \c -1 to wait forever and \c 0 not to wait.
+ * \param[out] results If not \c NULL, array of \p count entries. Each entry
+ *  is set to \c 0 or a negative error code for the container at the same
+ *  index.
+ *
+ * \return Number of frozen containers, or a negative error code.
+ *
+ * \note The freeze of all containers using the cgroup2 freezer is requested
+ *  before waiting for any of them.
+ */
+int lxc_containers_freeze(struct lxc_container **containers, int count,
+			  int timeout, int *results);
+
+/*!
+ * \brief Thaw many frozen containers at once.
+ *
+ * \param containers Array of containers.
+ * \param count Number of containers in \p containers.
+ * \param timeout Seconds to wait in total for all containers to be thawed,
+ *  \c -1 to wait forever and \c 0 not to wait.
+ * \param[out] results If not \c NULL, array of \p count entries. Each entry
+ *  is set to \c 0 or a negative error code for the container at the same
+ *  index.
+ *
+ * \return Number of thawed containers, or a negative error code.
+ */
+int lxc_containers_unfreeze(struct lxc_container **containers, int count,
+			    int timeout, int *results);
+
+struct lxc_pool;
+
+/*!
+ * \brief Create a pool of ready clones of \p c.
+ *
+ * A helper process forked from the caller keeps \p size clones of \p c
+ * in hidden directories of its lxcpath and creates a new one whenever a clone
+ * is claimed. The clone hooks and the hostname update in the rootfs run when
+ * a clone is created, under its hidden name. Claims don't mount the rootfs, so
+ * only dir, btrfs and overlay backing stores keeping the rootfs in the
+ * container's directory can be pooled.
+ *
+ * \param c Container to clone. It must be stopped.
+ * \param size Number of clones to keep ready.
+ * \param flags Additional \c LXC_CLONE* flags, see \ref clone.
+ * \param bdevtype Optionally force the cloned bdevtype to a specified plugin.
+ *
+ * \return Pool, or \c NULL on error. \c errno is set to \c EOPNOTSUPP if
+ *  \p bdevtype can't be pooled.
+ *
+ * \note The helper is forked from the caller, which therefore must not have
+ *  other threads. \c NULL is returned otherwise.
+ */
+struct lxc_pool *lxc_pool_new(struct lxc_container *c, int size, int flags,
+			      const char *bdevtype);
+
+/*!
+ * \brief Claim a clone from the pool under the name \p newname.
+ *
+ * The clone is renamed and gets the hostname \p newname in its configuration
+ * and rootfs unless \c LXC_CLONE_KEEPNAME was given. If no clone is ready the
+ * container is cloned right away.
+ *
+ * \param p Pool.
+ * \param newname New name for the container.
+ *
+ * \return Newly-allocated container, or \c NULL on error.
+ */
+struct lxc_container *lxc_pool_claim(struct lxc_pool *p, const char *newname);
+
+/*!
+ * \brief Stop the pool's helper process and free \p p.
+ *
+ * \param p Pool.
+ * \param drain Whether to destroy the clones which haven't been claimed.
+ *  Otherwise they can be claimed through the next pool of the container.
+ */
+void lxc_pool_put(struct lxc_pool *p, bool drain);
+
+/*! Length of the hex encoded digest identifying a layer */
+#define LXC_LAYER_DIGEST_LEN 64
+
+/*!
+ * \brief Import a directory as a layer.
+ *
+ * The contents of \p path are copied into the layer store of \p lxcpath and
+ * identified by their sha256 digest. The digest covers the paths, modes,
+ * ownership, extended attributes and hardlinks of all entries and the data of
+ * files and symlinks, but not their timestamps. Importing a directory with the
+ * same contents again returns the digest of the existing layer. Layers are never
+ * modified and can be shared by any number of containers.
+ *
+ * \param lxcpath Path whose layer store to import into.
+ * \param path Directory to import.
+ * \param[out] digest Buffer of \c LXC_LAYER_DIGEST_LEN + 1 bytes for the
+ *  digest of the layer.
+ *
+ * \return \c 0 on success, a negative error code on failure.
+ */
+int lxc_layer_import(const char *lxcpath, const char *path, char *digest);
+
+/*!
+ * \brief Create a container stacking existing layers.
+ *
+ * The rootfs of \p c is an overlay of the layers \p digests from the layer
+ * store of its lxcpath with an empty upper directory of its own, so creating
+ * it copies no data. Clones of \p c keep using the same layers. Each of them
+ * holds a reference on the layers until it is destroyed.
+ *
+ * \param c Container to create. It must not be defined yet.
+ * \param digests Digests of the layers, the first one being the topmost.
+ * \param nr Number of layers.
+ *
+ * \return \c true on success, else \c false.
+ */
+bool lxc_layers_create(struct lxc_container *c, const char *const *digests,
+		       int nr);
+
+/*!
+ * \brief Remove the layers in the store of \p lxcpath which aren't used by
+ * any container.
+ *
+ * \param lxcpath Path whose layer store to prune.
+ *
+ * \return Number of removed layers, or a negative error code on failure.
+ */
+int lxc_layers_prune(const char *lxcpath);
+
 struct lxc_log {
 	const char *name;//容器名称
 	const char *lxcpath;//使用第一个lxcpath
@@ -1153,6 +1571,18 @@ void lxc_log_close(void);
  */
 bool lxc_config_item_is_supported(const char *key);
 
+/*!
+ * \brief Cache parsed container configuration files in this process.
+ *
+ * Loading a configuration file that has been loaded before replays the
+ * recorded configuration items instead of reading and parsing the file and
+ * its includes again, as long as none of them changed on disk.
+ *
+ * \param enable Whether to use the cache. Disabling it drops all cached
+ *  configurations.
+ */
+void lxc_config_cache_enable(bool enable);
+
 /*!
  * \brief Check if an API extension is supported by this LXC instance.
  *
@@ -12,6 +12,7 @@
 #include <unistd.h>
 
 #include "config.h"
+#include "log.h"
 #include "mainloop.h"
 
 struct mainloop_handler {
@@ -29,6 +30,9 @@ int lxc_mainloop(struct lxc_epoll_descr *descr, int timeout_ms)
 	struct epoll_event events[MAX_EVENTS];
 
 	for (;;) {
+		/* Write out buffered log lines before going idle. */
+		lxc_log_flush();
+
 		nfds = epoll_wait(descr->epfd, events, MAX_EVENTS, timeout_ms);
 		if (nfds < 0) {
 			if (errno == EINTR)
@@ -3,17 +3,20 @@
 #ifndef _GNU_SOURCE
 #define _GNU_SOURCE 1
 #endif
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
 #include <net/if.h>
 #include <netinet/in.h>
 #include <poll.h>
+#include <pthread.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/inotify.h>
 #include <sys/param.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -24,6 +27,7 @@
 #include "af_unix.h"
 #include "config.h"
 #include "error.h"
+#include "file_utils.h"
 #include "log.h"
 #include "lxclock.h"
 #include "macro.h"
@@ -73,7 +77,108 @@ int lxc_monitor_fifo_name(const char *lxcpath, char *fifo_path, size_t fifo_path
 	return 0;
 }
 
-static void lxc_monitor_fifo_send(struct lxc_msg *msg, const char *lxcpath)
+/*
+ * Persistent connection of this process to the event bus of lxc-monitord.
+ * Publishers only ever talk to a single lxcpath in practice.
+ */
+static int lxc_monitor_bus = -EBADF;
+static char *lxc_monitor_bus_lxcpath;
+static pthread_mutex_t lxc_monitor_bus_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int lxc_monitor_bus_fd(void)
+{
+	return lxc_monitor_bus;
+}
+
+/*
+ * Connect to the event bus. With @nonblock a full backlog of lxc-monitord
+ * fails with EAGAIN instead of waiting for it to accept the connection.
+ */
+static int lxc_monitor_bus_connect(const char *lxcpath,
+				   const struct lxc_monitor_hello *hello,
+				   bool nonblock)
+{
+	__do_close int fd = -EBADF;
+	struct sockaddr_un addr;
+	ssize_t ret;
+
+	if (lxc_monitor_bus_name(lxcpath, &addr) < 0)
+		return -1;
+
+	fd = lxc_abstract_unix_connect_type(addr.sun_path,
+					    SOCK_SEQPACKET | (nonblock ? SOCK_NONBLOCK : 0));
+	if (fd < 0)
+		return -1;
+
+	ret = lxc_send_nointr(fd, (void *)hello, sizeof(*hello), MSG_NOSIGNAL);
+	if (ret != sizeof(*hello))
+		return -1;
+
+	return move_fd(fd);
+}
+
+/*
+ * Publish @msg on the event bus. Returns false if lxc-monitord doesn't serve
+ * a bus for @lxcpath, e.g. because it isn't running or predates the bus, or
+ * if it is too busy to take the message right away.
+ */
+static bool lxc_monitor_bus_send(struct lxc_msg *msg, const char *lxcpath)
+{
+	const struct lxc_monitor_hello hello = {
+		.role = LXC_MONITOR_BUS_PUBLISHER,
+	};
+	bool sent = false;
+
+	pthread_mutex_lock(&lxc_monitor_bus_lock);
+
+	/* Reconnect once in case lxc-monitord was restarted. */
+	for (int attempt = 0; attempt < 2 && !sent; attempt++) {
+		ssize_t ret;
+
+		if (lxc_monitor_bus >= 0 && !strequal(lxc_monitor_bus_lxcpath, lxcpath)) {
+			close_prot_errno_disarm(lxc_monitor_bus);
+			free_disarm(lxc_monitor_bus_lxcpath);
+		}
+
+		if (lxc_monitor_bus < 0) {
+			lxc_monitor_bus_lxcpath = strdup(lxcpath);
+			if (!lxc_monitor_bus_lxcpath)
+				break;
+
+			lxc_monitor_bus = lxc_monitor_bus_connect(lxcpath, &hello, true);
+			if (lxc_monitor_bus < 0) {
+				free_disarm(lxc_monitor_bus_lxcpath);
+				break;
+			}
+		}
+
+		/*
+		 * Never let a busy lxc-monitord stall the caller on the bus.
+		 * The message goes to the fifo instead.
+		 */
+		ret = lxc_send_nointr(lxc_monitor_bus, msg, sizeof(*msg),
+				      MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (ret == sizeof(*msg)) {
+			sent = true;
+		} else if (ret < 0 && errno == EAGAIN) {
+			break;
+		} else {
+			close_prot_errno_disarm(lxc_monitor_bus);
+			free_disarm(lxc_monitor_bus_lxcpath);
+		}
+	}
+
+	pthread_mutex_unlock(&lxc_monitor_bus_lock);
+
+	return sent;
+}
+
+/*
+ * Write @msg to the fifo of lxc-monitord. Unless @nonblock is set this waits
+ * for room in the fifo so the message isn't lost.
+ */
+static void lxc_monitor_fifo_send(struct lxc_msg *msg, const char *lxcpath,
+				  bool nonblock)
 {
 	int fd,ret;
 	char fifo_path[PATH_MAX];
@@ -99,12 +204,17 @@ static void lxc_monitor_fifo_send(struct lxc_msg *msg, const char *lxcpath)
 		return;
 	}
 
-	if (fcntl(fd, F_SETFL, O_WRONLY) < 0) {
+	if (!nonblock && fcntl(fd, F_SETFL, O_WRONLY) < 0) {
 		close(fd);
 		return;
 	}
 
 	ret = lxc_write_nointr(fd, msg, sizeof(*msg));
+	if (ret < 0 && nonblock && errno == EAGAIN) {
+		close(fd);
+		return;
+	}
+
 	if (ret != sizeof(*msg)) {
 		close(fd);
 		SYSERROR("Failed to write to monitor fifo \"%s\"", fifo_path);
@@ -114,13 +224,30 @@ static void lxc_monitor_fifo_send(struct lxc_msg *msg, const char *lxcpath)
 	close(fd);
 }
 
+static void lxc_monitor_msg_send(struct lxc_msg *msg, const char *lxcpath)
+{
+	/* Fall back to the fifo for lxc-monitord versions without a bus. */
+	if (!lxc_monitor_bus_send(msg, lxcpath))
+		lxc_monitor_fifo_send(msg, lxcpath, false);
+}
+
+/*
+ * Events which can fire at a high rate are dropped rather than stalling the
+ * monitor's mainloop when lxc-monitord doesn't keep up.
+ */
+static void lxc_monitor_msg_try_send(struct lxc_msg *msg, const char *lxcpath)
+{
+	if (!lxc_monitor_bus_send(msg, lxcpath))
+		lxc_monitor_fifo_send(msg, lxcpath, true);
+}
+
 void lxc_monitor_send_state(const char *name, lxc_state_t state,
 			    const char *lxcpath)
 {
 	struct lxc_msg msg = {.type = lxc_msg_state, .value = state};
 
 	(void)strlcpy(msg.name, name, sizeof(msg.name));
-	lxc_monitor_fifo_send(&msg, lxcpath);
+	lxc_monitor_msg_send(&msg, lxcpath);
 }
 
 void lxc_monitor_send_exit_code(const char *name, int exit_code,
@@ -129,7 +256,328 @@ void lxc_monitor_send_exit_code(const char *name, int exit_code,
 	struct lxc_msg msg = {.type = lxc_msg_exit_code, .value = exit_code};
 
 	(void)strlcpy(msg.name, name, sizeof(msg.name));
-	lxc_monitor_fifo_send(&msg, lxcpath);
+	lxc_monitor_msg_send(&msg, lxcpath);
+}
+
+void lxc_monitor_send_pressure(const char *name, lxc_pressure_t resource,
+			       const char *lxcpath)
+{
+	struct lxc_msg msg = {.type = lxc_msg_pressure, .value = resource};
+
+	(void)strlcpy(msg.name, name, sizeof(msg.name));
+	lxc_monitor_msg_try_send(&msg, lxcpath);
+}
+
+void lxc_monitor_send_memory_event(const char *name, lxc_memory_event_t event,
+				   const char *lxcpath)
+{
+	struct lxc_msg msg = {.type = lxc_msg_memory_event, .value = event};
+
+	(void)strlcpy(msg.name, name, sizeof(msg.name));
+	lxc_monitor_msg_try_send(&msg, lxcpath);
+}
+
+static const char *const pressure_names[LXC_PRESSURE_MAX] = {
+	[LXC_PRESSURE_CPU]	= "cpu",
+	[LXC_PRESSURE_MEMORY]	= "memory",
+	[LXC_PRESSURE_IO]	= "io",
+};
+
+static const char *const memory_event_names[LXC_MEMORY_EVENT_MAX] = {
+	[LXC_MEMORY_EVENT_LOW]			= "low",
+	[LXC_MEMORY_EVENT_HIGH]			= "high",
+	[LXC_MEMORY_EVENT_LIMIT]		= "max",
+	[LXC_MEMORY_EVENT_OOM]			= "oom",
+	[LXC_MEMORY_EVENT_OOM_KILL]		= "oom_kill",
+	[LXC_MEMORY_EVENT_OOM_GROUP_KILL]	= "oom_group_kill",
+};
+
+const char *lxc_pressure2str(lxc_pressure_t resource)
+{
+	if (resource < 0 || resource >= LXC_PRESSURE_MAX)
+		return NULL;
+
+	return pressure_names[resource];
+}
+
+int lxc_str2pressure(const char *resource)
+{
+	for (int i = 0; i < LXC_PRESSURE_MAX; i++)
+		if (strequal(pressure_names[i], resource))
+			return i;
+
+	return ret_errno(EINVAL);
+}
+
+const char *lxc_memory_event2str(lxc_memory_event_t event)
+{
+	if (event < 0 || event >= LXC_MEMORY_EVENT_MAX)
+		return NULL;
+
+	return memory_event_names[event];
+}
+
+int lxc_str2memory_event(const char *event)
+{
+	for (int i = 0; i < LXC_MEMORY_EVENT_MAX; i++)
+		if (strequal(memory_event_names[i], event))
+			return i;
+
+	return ret_errno(EINVAL);
+}
+
+/*
+ * Registry of running containers.
+ *
+ * Every monitor process registers the container it supervises in
+ * <rundir>/lxc/<lxcpath>/active/<name>. The entry records the pid and the
+ * start time of the monitor so that readers can tell live entries from stale
+ * ones left behind by a monitor that got SIGKILLed. This allows to enumerate
+ * running containers in O(running) instead of scanning /proc/net/unix.
+ *
+ * The registry is only complete while the marker created along with it
+ * exists. A monitor failing to register removes it, readers then have to
+ * fall back to scanning until the rundir is cleared on reboot.
+ */
+int lxc_monitor_active_dir(const char *lxcpath, char *path, size_t path_sz,
+			   bool do_mkdirp)
+{
+	__do_free char *rundir = NULL;
+	__do_close int dfd = -EBADF, fd = -EBADF;
+	int ret;
+
+	rundir = get_rundir();
+	if (!rundir)
+		return -ENOENT;
+
+	ret = strnprintf(path, path_sz, "%s/lxc/%s/active", rundir, lxcpath);
+	if (ret < 0)
+		return log_error_errno(-ENAMETOOLONG, ENAMETOOLONG,
+				       "rundir/lxcpath (%s/%s) too long for active container registry",
+				       rundir, lxcpath);
+
+	if (!do_mkdirp || dir_exists(path))
+		return 0;
+
+	ret = mkdir_p(path, 0755);
+	if (ret < 0)
+		return log_error_errno(-errno, errno,
+				       "Failed to create active container registry %s", path);
+
+	dfd = open(path, O_DIRECTORY | O_PATH | O_CLOEXEC);
+	if (dfd >= 0)
+		fd = openat(dfd, LXC_MONITOR_ACTIVE_COMPLETE,
+			    O_WRONLY | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0644);
+	if (fd < 0)
+		SYSWARN("Failed to mark active container registry %s as complete", path);
+
+	return 0;
+}
+
+int lxc_monitor_active_watch(const char *lxcpath)
+{
+	__do_close int fd = -EBADF;
+	char path[PATH_MAX];
+	int ret;
+
+	ret = lxc_monitor_active_dir(lxcpath, path, sizeof(path), true);
+	if (ret < 0)
+		return ret;
+
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0)
+		return log_error_errno(-errno, errno, "Failed to initialize inotify");
+
+	/*
+	 * Registering truncates a stale entry instead of creating it so
+	 * watch for IN_CLOSE_WRITE too.
+	 */
+	ret = inotify_add_watch(fd, path, IN_CREATE | IN_MOVED_TO | IN_CLOSE_WRITE);
+	if (ret < 0)
+		return log_error_errno(-errno, errno, "Failed to watch active container registry %s", path);
+
+	return move_fd(fd);
+}
+
+static int lxc_monitor_pid_starttime(pid_t pid, unsigned long long *starttime)
+{
+	char path[LXC_PROC_STATUS_LEN];
+	char buf[LXC_LINELEN];
+	char *p;
+	ssize_t ret;
+
+	ret = strnprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	if (ret < 0)
+		return -1;
+
+	ret = lxc_read_from_file(path, buf, sizeof(buf) - 1);
+	if (ret <= 0)
+		return -1;
+	buf[ret] = '\0';
+
+	/* The command name may contain spaces so start after its closing ')'. */
+	p = strrchr(buf, ')');
+	if (!p)
+		return -1;
+
+	/* The start time is the 22nd field, the state field is the 3rd one. */
+	for (int i = 3; i <= 22; i++) {
+		p = strchr(p, ' ');
+		if (!p)
+			return -1;
+		p++;
+	}
+
+	*starttime = strtoull(p, NULL, 10);
+	return 0;
+}
+
+static int __lxc_monitor_active_register(const char *name, const char *lxcpath,
+					 pid_t monitor_pid)
+{
+	__do_close int dfd = -EBADF, fd = -EBADF;
+	char path[PATH_MAX];
+	char buf[INTTYPE_TO_STRLEN(pid_t) + INTTYPE_TO_STRLEN(unsigned long long) + 2];
+	unsigned long long starttime;
+	ssize_t len;
+	int ret;
+
+	ret = lxc_monitor_pid_starttime(monitor_pid, &starttime);
+	if (ret < 0)
+		return log_error_errno(-ESRCH, ESRCH, "Failed to retrieve start time of monitor %d", monitor_pid);
+
+	ret = lxc_monitor_active_dir(lxcpath, path, sizeof(path), true);
+	if (ret < 0)
+		return ret;
+
+	dfd = open(path, O_DIRECTORY | O_PATH | O_CLOEXEC);
+	if (dfd < 0)
+		return log_error_errno(-errno, errno, "Failed to open active container registry %s", path);
+
+	len = strnprintf(buf, sizeof(buf), "%d %llu\n", monitor_pid, starttime);
+	if (len < 0)
+		return -EIO;
+
+	fd = openat(dfd, name, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return log_error_errno(-errno, errno, "Failed to create active container entry %s/%s", path, name);
+
+	if (lxc_write_nointr(fd, buf, len) != len)
+		return log_error_errno(-EIO, EIO, "Failed to write active container entry %s/%s", path, name);
+
+	TRACE("Registered container \"%s\" with monitor %d in %s", name, monitor_pid, path);
+	return 0;
+}
+
+int lxc_monitor_active_register(const char *name, const char *lxcpath,
+				pid_t monitor_pid)
+{
+	char path[PATH_MAX];
+	int ret;
+
+	ret = __lxc_monitor_active_register(name, lxcpath, monitor_pid);
+	if (ret == 0)
+		return 0;
+
+	/* Readers must not rely on the registry anymore. */
+	if (lxc_monitor_active_dir(lxcpath, path, sizeof(path), false) == 0 &&
+	    strnprintf(path + strlen(path), sizeof(path) - strlen(path),
+		       "/" LXC_MONITOR_ACTIVE_COMPLETE) >= 0 &&
+	    unlink(path) < 0 && errno != ENOENT)
+		SYSERROR("Failed to mark active container registry as incomplete");
+
+	return ret;
+}
+
+void lxc_monitor_active_unregister(const char *name, const char *lxcpath)
+{
+	char path[PATH_MAX];
+	size_t len;
+	int ret;
+
+	ret = lxc_monitor_active_dir(lxcpath, path, sizeof(path), false);
+	if (ret < 0)
+		return;
+
+	len = strlen(path);
+	ret = strnprintf(path + len, sizeof(path) - len, "/%s", name);
+	if (ret < 0)
+		return;
+
+	ret = unlink(path);
+	if (ret < 0 && errno != ENOENT)
+		SYSWARN("Failed to remove active container entry %s", path);
+	else
+		TRACE("Unregistered container \"%s\"", name);
+}
+
+int lxc_monitor_active_list(const char *lxcpath, char ***names)
+{
+	__do_closedir DIR *dir = NULL;
+	__do_free_string_list char **list = NULL;
+	char path[PATH_MAX];
+	struct dirent *direntp;
+	size_t nr = 0;
+	int dfd, ret;
+
+	ret = lxc_monitor_active_dir(lxcpath, path, sizeof(path), false);
+	if (ret < 0)
+		return ret;
+
+	dir = opendir(path);
+	if (!dir)
+		return -errno;
+	dfd = dirfd(dir);
+
+	if (faccessat(dfd, LXC_MONITOR_ACTIVE_COMPLETE, F_OK, AT_SYMLINK_NOFOLLOW) < 0)
+		return -errno;
+
+	list = zalloc(sizeof(char *));
+	if (!list)
+		return -ENOMEM;
+
+	while ((direntp = readdir(dir))) {
+		char buf[INTTYPE_TO_STRLEN(pid_t) + INTTYPE_TO_STRLEN(unsigned long long) + 2];
+		unsigned long long starttime, cur_starttime;
+		pid_t monitor_pid;
+		char **new_list;
+
+		if (direntp->d_name[0] == '.')
+			continue;
+
+		ret = lxc_readat(dfd, direntp->d_name, buf, sizeof(buf) - 1);
+		if (ret <= 0)
+			continue;
+		buf[ret] = '\0';
+
+		ret = sscanf(buf, "%d %llu", &monitor_pid, &starttime);
+		if (ret != 2)
+			continue;
+
+		/*
+		 * An entry whose monitor is gone or whose pid has been recycled
+		 * is stale. Don't remove it here, it would race with a new
+		 * monitor registering the same container.
+		 */
+		ret = lxc_monitor_pid_starttime(monitor_pid, &cur_starttime);
+		if (ret < 0 || cur_starttime != starttime) {
+			TRACE("Skipping stale active container entry %s/%s", path, direntp->d_name);
+			continue;
+		}
+
+		new_list = realloc(list, (nr + 2) * sizeof(char *));
+		if (!new_list)
+			return -ENOMEM;
+		list = new_list;
+
+		list[nr] = strdup(direntp->d_name);
+		if (!list[nr])
+			return -ENOMEM;
+		list[++nr] = NULL;
+	}
+
+	*names = move_ptr(list);
+	return nr;
 }
 
 /* routines used by monitor subscribers (lxc-monitor) */
@@ -147,7 +595,8 @@ int lxc_monitor_close(int fd)
  * have a maximum of 106 chars. But to not break backwards compatibility we keep
  * the limit at 105.
  */
-int lxc_monitor_sock_name(const char *lxcpath, struct sockaddr_un *addr)
+static int __lxc_monitor_sock_name(const char *lxcpath, const char *suffix,
+				   struct sockaddr_un *addr)
 {
 	__do_free char *path = NULL;
 	size_t len;
@@ -160,10 +609,10 @@ int lxc_monitor_sock_name(const char *lxcpath, struct sockaddr_un *addr)
 	memset(addr, 0, sizeof(*addr));
 	addr->sun_family = AF_UNIX;
 
-	/* strlen("lxc/") + strlen("/monitor-sock") + 1 = 18 */
-	len = strlen(lxcpath) + 18;
+	/* strlen("lxc/") + strlen("/") + 1 = 6 */
+	len = strlen(lxcpath) + strlen(suffix) + 6;
 	path = must_realloc(NULL, len);
-	ret = strnprintf(path, len, "lxc/%s/monitor-sock", lxcpath);
+	ret = strnprintf(path, len, "lxc/%s/%s", lxcpath, suffix);
 	if (ret < 0) {
 		ERROR("Failed to create name for monitor socket");
 		return -1;
@@ -192,6 +641,16 @@ on_error:
 	return -1;
 }
 
+int lxc_monitor_sock_name(const char *lxcpath, struct sockaddr_un *addr)
+{
+	return __lxc_monitor_sock_name(lxcpath, "monitor-sock", addr);
+}
+
+int lxc_monitor_bus_name(const char *lxcpath, struct sockaddr_un *addr)
+{
+	return __lxc_monitor_sock_name(lxcpath, "monitor-bus", addr);
+}
+
 int lxc_monitor_open(const char *lxcpath)
 {
 	struct sockaddr_un addr;
@@ -221,6 +680,36 @@ int lxc_monitor_open(const char *lxcpath)
 	return fd;
 }
 
+int lxc_monitor_subscribe(const char *lxcpath, const char *name,
+			  unsigned int types, unsigned int states)
+{
+	__do_close int fd = -EBADF;
+	struct lxc_monitor_hello hello = {
+		.role	= LXC_MONITOR_BUS_SUBSCRIBER,
+		.types	= types,
+		.states	= states,
+	};
+	ssize_t ret;
+	int ack;
+
+	if (name && strlcpy(hello.name, name, sizeof(hello.name)) >= sizeof(hello.name))
+		return ret_set_errno(-1, ENAMETOOLONG);
+
+	fd = lxc_monitor_bus_connect(lxcpath, &hello, false);
+	if (fd < 0)
+		return log_error_errno(-1, errno, "Failed to connect to monitor event bus");
+
+	/* Wait until the filter is in place so no message is missed. */
+	ret = lxc_recv_nointr(fd, &ack, sizeof(ack), 0);
+	if (ret != sizeof(ack))
+		return log_error_errno(-1, EPROTO, "Failed to subscribe to monitor event bus");
+
+	if (ack < 0)
+		return log_error_errno(-1, -ack, "Monitor event bus rejected subscription");
+
+	return move_fd(fd);
+}
+
 int lxc_monitor_read_fdset(struct pollfd *fds, nfds_t nfds, struct lxc_msg *msg,
 			   int timeout)
 {
@@ -4,31 +4,130 @@
 #define __LXC_MONITOR_H
 
 #include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <poll.h>
 #include <sys/param.h>
 #include <sys/un.h>
 
 #include "compiler.h"
+#include "state.h"
 
 typedef enum {
 	lxc_msg_state,
 	lxc_msg_priority,
 	lxc_msg_exit_code,
+	lxc_msg_pressure,
+	lxc_msg_memory_event,
 } lxc_msg_type_t;
 
+/* Value of lxc_msg_pressure messages: the resource whose trigger fired. */
+typedef enum {
+	LXC_PRESSURE_CPU,
+	LXC_PRESSURE_MEMORY,
+	LXC_PRESSURE_IO,
+	LXC_PRESSURE_MAX,
+} lxc_pressure_t;
+
+/* Value of lxc_msg_memory_event messages: the memory.events counter. */
+typedef enum {
+	LXC_MEMORY_EVENT_LOW,
+	LXC_MEMORY_EVENT_HIGH,
+	LXC_MEMORY_EVENT_LIMIT,
+	LXC_MEMORY_EVENT_OOM,
+	LXC_MEMORY_EVENT_OOM_KILL,
+	LXC_MEMORY_EVENT_OOM_GROUP_KILL,
+	LXC_MEMORY_EVENT_MAX,
+} lxc_memory_event_t;
+
 struct lxc_msg {
 	lxc_msg_type_t type;
 	char name[NAME_MAX + 1];
 	int value;
 };
 
+/*
+ * Besides the monitor fifo lxc-monitord serves a SOCK_SEQPACKET event bus.
+ * Every connection starts with a struct lxc_monitor_hello. Publishers then
+ * keep the connection open and send one struct lxc_msg per packet.
+ * Subscribers receive an int acknowledging the subscription followed by one
+ * struct lxc_msg per packet that passed their filter.
+ */
+#define LXC_MONITOR_BUS_PUBLISHER 1
+#define LXC_MONITOR_BUS_SUBSCRIBER 2
+
+struct lxc_monitor_hello {
+	uint32_t role;
+	/* Bitmask of lxc_msg_type_t to deliver, 0 for all. */
+	uint32_t types;
+	/* Bitmask of lxc_state_t to deliver for lxc_msg_state, 0 for all. */
+	uint32_t states;
+	/* Glob matched against the container name, empty for all. */
+	char name[NAME_MAX + 1];
+};
+
 __hidden extern int lxc_monitor_sock_name(const char *lxcpath, struct sockaddr_un *addr);
+__hidden extern int lxc_monitor_bus_name(const char *lxcpath, struct sockaddr_un *addr);
+/* The publisher's persistent connection to the event bus or -EBADF. */
+__hidden extern int lxc_monitor_bus_fd(void);
 __hidden extern int lxc_monitor_fifo_name(const char *lxcpath, char *fifo_path, size_t fifo_path_sz,
 					  int do_mkdirp);
 __hidden extern void lxc_monitor_send_state(const char *name, lxc_state_t state, const char *lxcpath);
 __hidden extern void lxc_monitor_send_exit_code(const char *name, int exit_code, const char *lxcpath);
+/* Never block, the event is dropped if lxc-monitord can't take it right away. */
+__hidden extern void lxc_monitor_send_pressure(const char *name, lxc_pressure_t resource,
+					       const char *lxcpath);
+__hidden extern void lxc_monitor_send_memory_event(const char *name, lxc_memory_event_t event,
+						   const char *lxcpath);
+
+/* Names of resources and memory.events counters as used in the config. */
+__hidden extern const char *lxc_pressure2str(lxc_pressure_t resource);
+__hidden extern int lxc_str2pressure(const char *resource);
+__hidden extern const char *lxc_memory_event2str(lxc_memory_event_t event);
+__hidden extern int lxc_str2memory_event(const char *event);
 __hidden extern int lxc_monitord_spawn(const char *lxcpath);
 
+/*
+ * Subscribe to the event bus of lxc-monitord for @lxcpath
+ * @lxcpath : the lxcpath to monitor
+ * @name    : glob matched against container names, NULL for all
+ * @types   : bitmask of lxc_msg_type_t to receive, 0 for all
+ * @states  : bitmask of lxc_state_t to receive, 0 for all
+ * Returns a socket to read messages from with lxc_monitor_read*() or -1 on
+ * error. lxc-monitord must already be running.
+ */
+__hidden extern int lxc_monitor_subscribe(const char *lxcpath, const char *name,
+					  unsigned int types, unsigned int states);
+
+/*
+ * Registry of running containers kept below the rundir. Monitors register
+ * themselves when a container starts and unregister when it stops. The
+ * registry lists all running containers as long as it contains
+ * LXC_MONITOR_ACTIVE_COMPLETE.
+ */
+#define LXC_MONITOR_ACTIVE_COMPLETE ".complete"
+
+__hidden extern int lxc_monitor_active_dir(const char *lxcpath, char *path, size_t path_sz,
+					   bool do_mkdirp);
+__hidden extern int lxc_monitor_active_register(const char *name, const char *lxcpath,
+						pid_t monitor_pid);
+__hidden extern void lxc_monitor_active_unregister(const char *name, const char *lxcpath);
+
+/*
+ * Create a non-blocking inotify fd that reports containers registering in
+ * @lxcpath. Returns the inotify fd or a negative errno value.
+ */
+__hidden extern int lxc_monitor_active_watch(const char *lxcpath);
+
+/*
+ * List the containers registered as running in @lxcpath
+ * @lxcpath : the lxcpath to list
+ * @names   : NULL-terminated array of container names, freed by the caller
+ * Returns the number of running containers or a negative errno value, -ENOENT
+ * if the registry of @lxcpath doesn't exist or may be missing containers.
+ */
+__hidden extern int lxc_monitor_active_list(const char *lxcpath, char ***names);
+
 /*
  * Open the monitoring mechanism for a specific container
  * The function will return an fd corresponding to the events
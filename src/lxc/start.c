@@ -7,6 +7,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <grp.h>
+#include <inttypes.h>
 #include <poll.h>
 #include <pthread.h>
 #include <signal.h>
@@ -14,6 +15,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/file.h>
+#include <sys/mman.h>
 #include <sys/mount.h>
 #include <sys/param.h>
 #include <sys/prctl.h>
@@ -326,6 +328,10 @@ restart:
 		if (current_config && fd == current_config->logfd)
 			continue;
 
+		/* Keep the persistent connection to the monitor event bus. */
+		if (fd == lxc_monitor_bus_fd())
+			continue;
+
 		//跳过标认输出输出等fd
 		if (match_stdfds(fd))
 			continue;
@@ -600,6 +606,7 @@ int lxc_set_state(const char *name, struct lxc_handler *handler,
 
 int lxc_poll(const char *name, struct lxc_handler *handler)
 {
+	call_cleaner(cgroup_events_free) struct cgroup_events *cgroup_events = NULL;
 	int ret;
 	bool has_console = true;
 	struct lxc_epoll_descr descr, descr_console;
@@ -658,6 +665,8 @@ int lxc_poll(const char *name, struct lxc_handler *handler)
 		goto out_mainloop_console;
 	}
 
+	cgroup_events = cgroup_events_mainloop_add(handler->cgroup_ops, handler, &descr);
+
 	TRACE("Mainloop is ready");
 
 	ret = lxc_mainloop(&descr, -1);
@@ -696,10 +705,13 @@ void lxc_put_handler(struct lxc_handler *handler)
 	close_prot_errno_disarm(handler->state_socket_pair[0]);
 	close_prot_errno_disarm(handler->state_socket_pair[1]);
 	cgroup_exit(handler->cgroup_ops);
-	if (handler->conf && handler->conf->reboot == REBOOT_NONE)
+	if (handler->conf && handler->conf->reboot == REBOOT_NONE) {
+		if (handler->timings)
+			munmap(handler->timings, sizeof(*handler->timings));
 		free_disarm(handler);
-	else
+	} else {
 		handler->conf = NULL;
+	}
 }
 
 struct lxc_handler *lxc_init_handler(struct lxc_handler *old,
@@ -818,6 +830,11 @@ int lxc_init(const char *name/*容器名称*/, struct lxc_handler *handler)
 		return log_error(-1, "Failed to set state to \"%s\"", lxc_state2str(STARTING));
 	TRACE("Set container state to \"STARTING\"");
 
+	/* Failing to register makes listing fall back to scanning sockets. */
+	ret = lxc_monitor_active_register(name, handler->lxcpath, handler->monitor_pid);
+	if (ret < 0)
+		WARN("Failed to register container \"%s\" as running", name);
+
 	//设置环境变量，并调用pre-start hook点
 	/* Start of environment variable setup for hooks. */
 	//容器名称环境变量
@@ -878,10 +895,12 @@ int lxc_init(const char *name/*容器名称*/, struct lxc_handler *handler)
 	TRACE("Set environment variables");
 
 	//运行pre-start hook
+	lxc_start_phase_end(handler, LXC_START_PHASE_INIT);
 	ret = run_lxc_hooks(name, "pre-start", conf, NULL);
 	if (ret < 0)
 		return log_error(-1, "Failed to run lxc.hook.pre-start for container \"%s\"", name);
 	TRACE("Ran pre-start hooks");
+	lxc_start_phase_end(handler, LXC_START_PHASE_HOOK_PRE_START);
 
 	/* The signal fd has to be created before forking otherwise if the child
 	 * process exits before we setup the signal fd, the event will be lost
@@ -914,12 +933,14 @@ int lxc_init(const char *name/*容器名称*/, struct lxc_handler *handler)
 		return log_error(-1, "Failed loading seccomp policy");
 	TRACE("Read seccomp policy");
 
+	lxc_start_phase_end(handler, LXC_START_PHASE_PREPARE);
 	ret = handler->lsm_ops->prepare(handler->lsm_ops, conf, handler->lxcpath);
 	if (ret < 0) {
 		ERROR("Failed to initialize LSM");
 		goto out_delete_terminal;
 	}
 	TRACE("Initialized LSM");
+	lxc_start_phase_end(handler, LXC_START_PHASE_LSM_PREPARE);
 
 	INFO("Container \"%s\" is initialized", name);
 	handler->monitor_status_fd = move_fd(status_fd);
@@ -1008,6 +1029,8 @@ void lxc_end(struct lxc_handler *handler)
 		close_prot_errno_disarm(handler->conf->maincmd_fd);
 		TRACE("Closed command socket");
 
+		lxc_monitor_active_unregister(name, handler->lxcpath);
+
 		/* This function will try to connect to the legacy lxc-monitord
 		 * state server and only exists for backwards compatibility.
 		 */
@@ -1066,10 +1089,18 @@ void lxc_end(struct lxc_handler *handler)
 		free(cur);
 	}
 
+	/* Command sessions don't outlive the mainloop that served them. */
+	lxc_list_for_each_safe(cur, &handler->conf->cmd_sessions, next) {
+		lxc_list_del(cur);
+		close(PTR_TO_INT(cur->elem));
+		free(cur);
+	}
+
 	if (handler->conf->ephemeral == 1 && handler->conf->reboot != REBOOT_REQ)
 		lxc_destroy_container_on_signal(handler, name);
 
 	lxc_put_handler(handler);
+	lxc_log_buffer_disable();
 }
 
 void lxc_abort(struct lxc_handler *handler)
@@ -1093,6 +1124,8 @@ void lxc_abort(struct lxc_handler *handler)
 	do {
 		ret = waitpid(-1, &status, 0);
 	} while (ret > 0);
+
+	lxc_log_flush();
 }
 
 //容器入口
@@ -1108,6 +1141,7 @@ static int do_start(void *data)
 	struct lxc_list *iterator;
 	uid_t nsuid = 0;
 	gid_t nsgid = 0;
+	uint64_t begin;
 
 	//关注子进程不使用的sync socket
 	lxc_sync_fini_parent(handler);
@@ -1327,16 +1361,20 @@ static int do_start(void *data)
 		goto out_warn_father;
 
 	/* Setup the container, ip, names, utsname, ... */
+	begin = lxc_start_timing_now();
 	ret = lxc_setup(handler);
 	if (ret < 0) {
 		ERROR("Failed to setup container \"%s\"", handler->name);
 		goto out_warn_father;
 	}
+	lxc_start_phase_add(handler, LXC_START_PHASE_CHILD_SETUP, begin);
 
 	/* Set the label to change to when we exec(2) the container's init. */
+	begin = lxc_start_timing_now();
 	ret = handler->lsm_ops->process_label_set(handler->lsm_ops, NULL, handler->conf, true);
 	if (ret < 0)
 		goto out_warn_father;
+	lxc_start_phase_add(handler, LXC_START_PHASE_CHILD_LSM, begin);
 
 	/* Set PR_SET_NO_NEW_PRIVS after we changed the lsm label. If we do it
 	 * before we aren't allowed anymore.
@@ -1354,17 +1392,21 @@ static int do_start(void *data)
 	/* If we mounted a temporary proc, then unmount it now. */
 	tmp_proc_unmount(handler->conf);
 
+	begin = lxc_start_timing_now();
 	ret = lxc_seccomp_load(handler->conf);
 	if (ret < 0)
 		goto out_warn_father;
+	lxc_start_phase_add(handler, LXC_START_PHASE_CHILD_SECCOMP, begin);
 
 	//执行start hook点的脚本
+	begin = lxc_start_timing_now();
 	ret = run_lxc_hooks(handler->name, "start", handler->conf, NULL);
 	if (ret < 0) {
 		ERROR("Failed to run lxc.hook.start for container \"%s\"",
 		      handler->name);
 		goto out_warn_father;
 	}
+	lxc_start_phase_add(handler, LXC_START_PHASE_CHILD_HOOK_START, begin);
 
 	close_prot_errno_disarm(handler->sigfd);
 
@@ -1625,6 +1667,102 @@ static inline int do_share_ns(void *arg)
 	return 0;
 }
 
+static const char *const start_phase_names[LXC_START_PHASE_MAX] = {
+	[LXC_START_PHASE_INIT]			= "init",
+	[LXC_START_PHASE_HOOK_PRE_START]	= "hook-pre-start",
+	[LXC_START_PHASE_PREPARE]		= "prepare",
+	[LXC_START_PHASE_LSM_PREPARE]		= "lsm-prepare",
+	[LXC_START_PHASE_BLOCK_DEVICE]		= "block-device",
+	[LXC_START_PHASE_MONITOR_CGROUP]	= "monitor-cgroup",
+	[LXC_START_PHASE_ROOTFS]		= "rootfs",
+	[LXC_START_PHASE_CGROUP_CREATE]		= "cgroup-create",
+	[LXC_START_PHASE_CLONE]			= "clone",
+	[LXC_START_PHASE_CGROUP_SETUP]		= "cgroup-setup",
+	[LXC_START_PHASE_SYNC_STARTUP]		= "sync-startup",
+	[LXC_START_PHASE_NETWORK]		= "network",
+	[LXC_START_PHASE_ROOTFS_PREPARE]	= "rootfs-prepare",
+	[LXC_START_PHASE_SYNC_IDMAPPED_MOUNTS]	= "sync-idmapped-mounts",
+	[LXC_START_PHASE_IDMAPPED_MOUNTS]	= "idmapped-mounts",
+	[LXC_START_PHASE_SYNC_CGROUP_LIMITS]	= "sync-cgroup-limits",
+	[LXC_START_PHASE_DEVICES]		= "devices",
+	[LXC_START_PHASE_HOOK_START_HOST]	= "hook-start-host",
+	[LXC_START_PHASE_SYNC_FDS]		= "sync-fds",
+	[LXC_START_PHASE_SYNC_READY_START]	= "sync-ready-start",
+	[LXC_START_PHASE_POST_START]		= "post-start",
+	[LXC_START_PHASE_CHILD_SETUP]		= "child-setup",
+	[LXC_START_PHASE_CHILD_LSM]		= "child-lsm",
+	[LXC_START_PHASE_CHILD_SECCOMP]		= "child-seccomp",
+	[LXC_START_PHASE_CHILD_HOOK_START]	= "child-hook-start",
+};
+
+const char *lxc_start_phase_name(enum lxc_start_phase phase)
+{
+	if (phase >= LXC_START_PHASE_MAX)
+		return NULL;
+
+	return start_phase_names[phase];
+}
+
+static void lxc_start_timings_begin(struct lxc_handler *handler)
+{
+	/* Kept across reboots. */
+	if (!handler->timings) {
+		void *timings;
+
+		timings = mmap(NULL, sizeof(*handler->timings),
+			       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+			       -1, 0);
+		if (timings == MAP_FAILED) {
+			SYSWARN("Failed to allocate startup timings");
+			return;
+		}
+		handler->timings = timings;
+	}
+
+	memset(handler->timings, 0, sizeof(*handler->timings));
+	handler->timings->started = lxc_start_timing_now();
+	handler->timings->last = handler->timings->started;
+}
+
+static void lxc_start_timings_finish(struct lxc_handler *handler)
+{
+	struct lxc_start_timings *timings = handler->timings;
+	char buf[LXC_START_PHASE_MAX * 48];
+	size_t len;
+	int ret;
+
+	if (!timings)
+		return;
+
+	timings->total = timings->last - timings->started;
+
+	/* Machine-readable summary in microseconds, only worth building for
+	 * debug logs. The timings stay available through lxc-info.
+	 */
+	if (lxc_log_get_level() > LXC_LOG_LEVEL_DEBUG)
+		return;
+
+	ret = strnprintf(buf, sizeof(buf), "{\"total\":%" PRIu64, timings->total / 1000);
+	if (ret < 0)
+		return;
+	len = ret;
+
+	for (int i = 0; i < LXC_START_PHASE_MAX; i++) {
+		ret = strnprintf(buf + len, sizeof(buf) - len, ",\"%s\":%" PRIu64,
+				 start_phase_names[i], timings->phases[i] / 1000);
+		if (ret < 0)
+			return;
+		len += ret;
+	}
+
+	if (len + 2 > sizeof(buf))
+		return;
+	buf[len++] = '}';
+	buf[len] = '\0';
+
+	DEBUG("Start timings: %s", buf);
+}
+
 /* lxc_spawn() performs crucial setup tasks and clone()s the new process which
  * exec()s the requested container binary.
  * Note that lxc_spawn() runs in the parent namespaces. Any operations performed
@@ -1689,6 +1827,7 @@ static int lxc_spawn(struct lxc_handler *handler)
 		ERROR("Failed creating cgroups");
 		goto out_delete_net;
 	}
+	lxc_start_phase_end(handler, LXC_START_PHASE_CGROUP_CREATE);
 
 	/* Create a process in a new set of namespaces. */
 	if (share_ns) {
@@ -1837,6 +1976,7 @@ static int lxc_spawn(struct lxc_handler *handler)
 			}
 		}
 	}
+	lxc_start_phase_end(handler, LXC_START_PHASE_CLONE);
 
 	if (!cgroup_ops->setup_limits_legacy(cgroup_ops, handler->conf, false)) {
 		ERROR("Failed to setup cgroup limits for container \"%s\"", name);
@@ -1860,9 +2000,11 @@ static int lxc_spawn(struct lxc_handler *handler)
 
 	if (!cgroup_ops->chown(cgroup_ops, handler->conf))
 		goto out_delete_net;
+	lxc_start_phase_end(handler, LXC_START_PHASE_CGROUP_SETUP);
 
 	if (!lxc_sync_barrier_child(handler, START_SYNC_STARTUP))
 		goto out_delete_net;
+	lxc_start_phase_end(handler, LXC_START_PHASE_SYNC_STARTUP);
 
 	/* If not done yet, we're now ready to preserve the network namespace */
 	//设定相应的net namespace
@@ -1909,6 +2051,7 @@ static int lxc_spawn(struct lxc_handler *handler)
 	/* Tell the child to continue its initialization. */
 	if (!lxc_sync_wake_child(handler, START_SYNC_POST_CONFIGURE))
 		goto out_delete_net;
+	lxc_start_phase_end(handler, LXC_START_PHASE_NETWORK);
 
 	ret = lxc_rootfs_prepare_parent(handler);
 	if (ret) {
@@ -1924,17 +2067,22 @@ static int lxc_spawn(struct lxc_handler *handler)
 		}
 	}
 
+	lxc_start_phase_end(handler, LXC_START_PHASE_ROOTFS_PREPARE);
+
 	if (!lxc_sync_wait_child(handler, START_SYNC_IDMAPPED_MOUNTS))
 		goto out_delete_net;
+	lxc_start_phase_end(handler, LXC_START_PHASE_SYNC_IDMAPPED_MOUNTS);
 
 	ret = lxc_idmapped_mounts_parent(handler);
 	if (ret) {
 		ERROR("Failed to setup mount entries");
 		goto out_delete_net;
 	}
+	lxc_start_phase_end(handler, LXC_START_PHASE_IDMAPPED_MOUNTS);
 
 	if (!lxc_sync_wait_child(handler, START_SYNC_CGROUP_LIMITS))
 		goto out_delete_net;
+	lxc_start_phase_end(handler, LXC_START_PHASE_SYNC_CGROUP_LIMITS);
 
 	/*
 	 * With isolation the limiting devices cgroup was already setup, so
@@ -1955,6 +2103,7 @@ static int lxc_spawn(struct lxc_handler *handler)
 
 	cgroup_ops->finalize(cgroup_ops);
 	TRACE("Finished setting up cgroups");
+	lxc_start_phase_end(handler, LXC_START_PHASE_DEVICES);
 
 	/* Run any host-side start hooks */
 	ret = run_lxc_hooks(name, "start-host", conf, NULL);
@@ -1962,6 +2111,7 @@ static int lxc_spawn(struct lxc_handler *handler)
 		ERROR("Failed to run lxc.hook.start-host");
 		goto out_delete_net;
 	}
+	lxc_start_phase_end(handler, LXC_START_PHASE_HOOK_START_HOST);
 
 	if (!lxc_sync_wake_child(handler, START_SYNC_FDS))
 		goto out_delete_net;
@@ -2003,8 +2153,11 @@ static int lxc_spawn(struct lxc_handler *handler)
 	 * causing lxc_sync_barrier_child to return success, or return a
 	 * different value, causing us to error out).
 	 */
+	lxc_start_phase_end(handler, LXC_START_PHASE_SYNC_FDS);
+
 	if (!lxc_sync_barrier_child(handler, START_SYNC_READY_START))
 		goto out_delete_net;
+	lxc_start_phase_end(handler, LXC_START_PHASE_SYNC_READY_START);
 
 	/* Now all networks are created, network devices are moved into place,
 	 * and the correct names and ifindices in the respective namespaces have
@@ -2018,6 +2171,9 @@ static int lxc_spawn(struct lxc_handler *handler)
 	if (ret < 0)
 		goto out_abort;
 
+	lxc_start_phase_end(handler, LXC_START_PHASE_POST_START);
+	lxc_start_timings_finish(handler);
+
 	//设置进程状态
 	ret = lxc_set_state(name, handler, RUNNING);
 	if (ret < 0) {
@@ -2050,6 +2206,12 @@ int __lxc_start(struct lxc_handler *handler, struct lxc_operations *ops,
 	struct lxc_conf *conf = handler->conf;
 	struct cgroup_ops *cgroup_ops;
 
+	lxc_start_timings_begin(handler);
+
+	/* Buffered logging lasts until lxc_end(). */
+	if (conf->log_buffer_size > 0 && lxc_log_buffer_enable(conf->log_buffer_size))
+		WARN("Failed to enable log buffer, logging synchronously");
+
 	ret = lxc_init(name, handler);
 	if (ret < 0) {
 		ERROR("Failed to initialize container \"%s\"", name);
@@ -2065,6 +2227,7 @@ int __lxc_start(struct lxc_handler *handler, struct lxc_operations *ops,
 		ret = -1;
 		goto out_abort;
 	}
+	lxc_start_phase_end(handler, LXC_START_PHASE_BLOCK_DEVICE);
 
 	if (!cgroup_ops->monitor_create(cgroup_ops, handler)) {
 		ERROR("Failed to create monitor cgroup");
@@ -2083,6 +2246,7 @@ int __lxc_start(struct lxc_handler *handler, struct lxc_operations *ops,
 		ret = -1;
 		goto out_abort;
 	}
+	lxc_start_phase_end(handler, LXC_START_PHASE_MONITOR_CGROUP);
 
 	/* If the rootfs is not a blockdev, prevent the container from marking
 	 * it readonly.
@@ -2116,6 +2280,8 @@ int __lxc_start(struct lxc_handler *handler, struct lxc_operations *ops,
 		}
 	}
 
+	lxc_start_phase_end(handler, LXC_START_PHASE_ROOTFS);
+
 	ret = lxc_spawn(handler);
 	if (ret < 0) {
 		ERROR("Failed to spawn container \"%s\"", name);
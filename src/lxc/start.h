@@ -7,9 +7,11 @@
 #include <sched.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/param.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <time.h>
 
 #include "compiler.h"
 #include "conf.h"
@@ -17,6 +19,61 @@
 #include "namespace.h"
 #include "state.h"
 
+/*
+ * Phases of a container start. The parent phases end one after the other, each
+ * exactly once, in lxc_init(), __lxc_start() and lxc_spawn(); a sync phase is the time spent waiting for
+ * the child at a sync barrier. The child phases are measured by the child
+ * inside the parent's sync phases.
+ */
+enum lxc_start_phase {
+	LXC_START_PHASE_INIT,
+	LXC_START_PHASE_HOOK_PRE_START,
+	LXC_START_PHASE_PREPARE,
+	LXC_START_PHASE_LSM_PREPARE,
+	LXC_START_PHASE_BLOCK_DEVICE,
+	LXC_START_PHASE_MONITOR_CGROUP,
+	LXC_START_PHASE_ROOTFS,
+	LXC_START_PHASE_CGROUP_CREATE,
+	LXC_START_PHASE_CLONE,
+	LXC_START_PHASE_CGROUP_SETUP,
+	LXC_START_PHASE_SYNC_STARTUP,
+	LXC_START_PHASE_NETWORK,
+	LXC_START_PHASE_ROOTFS_PREPARE,
+	LXC_START_PHASE_SYNC_IDMAPPED_MOUNTS,
+	LXC_START_PHASE_IDMAPPED_MOUNTS,
+	LXC_START_PHASE_SYNC_CGROUP_LIMITS,
+	LXC_START_PHASE_DEVICES,
+	LXC_START_PHASE_HOOK_START_HOST,
+	LXC_START_PHASE_SYNC_FDS,
+	LXC_START_PHASE_SYNC_READY_START,
+	LXC_START_PHASE_POST_START,
+	LXC_START_PHASE_CHILD_SETUP,
+	LXC_START_PHASE_CHILD_LSM,
+	LXC_START_PHASE_CHILD_SECCOMP,
+	LXC_START_PHASE_CHILD_HOOK_START,
+	LXC_START_PHASE_MAX,
+};
+
+/* Shared with the child, which only writes its own phases. */
+struct lxc_start_timings {
+	/* CLOCK_MONOTONIC nanoseconds when __lxc_start() was entered. */
+	uint64_t started;
+	/* End of the last parent phase. */
+	uint64_t last;
+	/* Nanoseconds until the container was RUNNING, 0 before. */
+	uint64_t total;
+	/* Nanoseconds spent in each phase. */
+	uint64_t phases[LXC_START_PHASE_MAX];
+};
+
+static inline uint64_t lxc_start_timing_now(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 struct lxc_handler {
 	/* Record the clone for namespaces flags that the container requested.
 	 *
@@ -135,6 +192,9 @@ struct lxc_handler {
 	/* The namesace idx is _not_ guaranteed to match the stashed namespace path. */
 	lxc_namespace_t hook_argc;
 	char *hook_argv[LXC_NS_MAX + 1];
+
+	/* Startup phase timings, mapped shared so the child can record its own. */
+	struct lxc_start_timings *timings;
 };
 
 struct execute_args {
@@ -181,6 +241,32 @@ __hidden extern int __lxc_start(struct lxc_handler *, struct lxc_operations *, v
 				bool, int *);
 
 __hidden extern int resolve_clone_flags(struct lxc_handler *handler);
+
+__hidden extern const char *lxc_start_phase_name(enum lxc_start_phase phase);
+
+/* End the current parent phase and account its time to @phase. */
+static inline void lxc_start_phase_end(struct lxc_handler *handler,
+				       enum lxc_start_phase phase)
+{
+	struct lxc_start_timings *timings = handler->timings;
+	uint64_t now;
+
+	if (!timings)
+		return;
+
+	now = lxc_start_timing_now();
+	timings->phases[phase] += now - timings->last;
+	timings->last = now;
+}
+
+/* Account the time since @begin to the child phase @phase. */
+static inline void lxc_start_phase_add(struct lxc_handler *handler,
+				       enum lxc_start_phase phase, uint64_t begin)
+{
+	if (handler->timings)
+		handler->timings->phases[phase] += lxc_start_timing_now() - begin;
+}
+
 __hidden extern void lxc_expose_namespace_environment(const struct lxc_handler *handler);
 
 static inline bool container_uses_namespace(const struct lxc_handler *handler,
@@ -5,10 +5,12 @@
 #endif
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/file.h>
+#include <sys/inotify.h>
 #include <sys/param.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -84,20 +86,89 @@ static int fillwaitedstates(const char *strstates, lxc_state_t *states)
 	return 0;
 }
 
+/* Milliseconds left until @deadline, 0 if it has passed. */
+static int lxc_wait_remaining(const struct timespec *deadline)
+{
+	struct timespec now;
+	int64_t ms;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (deadline->tv_sec - now.tv_sec) * 1000 +
+	     (deadline->tv_nsec - now.tv_nsec) / 1000000;
+
+	return ms > 0 ? (int)ms : 0;
+}
+
+/*
+ * The registry can miss a container, e.g. one started by an older monitor or
+ * one whose monitor died before registering it, so never sleep longer than
+ * this before asking the command socket again.
+ */
+#define LXC_WAIT_RECHECK_MS 1000
+
+/*
+ * Sleep until a container registers on @watch_fd, for at most @timeout_ms or
+ * LXC_WAIT_RECHECK_MS. Returns 0 when the caller should check the state of
+ * the container again and -1 on error.
+ */
+static int lxc_wait_registered(int watch_fd, int timeout_ms)
+{
+	char buf[sizeof(struct inotify_event) + NAME_MAX + 1]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+	struct pollfd pfd = {
+		.fd	= watch_fd,
+		.events	= POLLIN,
+	};
+	int ret;
+
+	if (timeout_ms < 0 || timeout_ms > LXC_WAIT_RECHECK_MS)
+		timeout_ms = LXC_WAIT_RECHECK_MS;
+
+	ret = poll(&pfd, 1, timeout_ms);
+	if (ret < 0 && errno != EINTR)
+		return log_error_errno(-1, errno, "Failed to wait for container registration");
+
+	if (ret <= 0)
+		return 0;
+
+	/* Which container registered doesn't matter, it's checked anyway. */
+	while (read(watch_fd, buf, sizeof(buf)) > 0)
+		;
+
+	return 0;
+}
+
 int lxc_wait(const char *lxcname, const char *states, int timeout,
 	     const char *lxcpath)
 {
+	__do_close int watch_fd = -EBADF;
+	bool watch = true;
 	int state = -1;
 	lxc_state_t s[MAX_STATE] = {0};
+	struct timespec deadline = {0};
 
 	if (fillwaitedstates(states, s))
 		return -1;
 
+	if (!lxcpath)
+		lxcpath = lxc_global_config_value("lxc.lxcpath");
+
+	if (timeout > 0) {
+		(void)clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec += timeout;
+	}
+
 	for (;;) {
-		struct timespec onesec = {
-		    .tv_sec = 1,
-		    .tv_nsec = 0,
-		};
+		int remaining = -1;
+
+		if (timeout > 0) {
+			remaining = lxc_wait_remaining(&deadline);
+			if (remaining == 0)
+				return -1;
+
+			/* Round up to the granularity of the state socket. */
+			timeout = (remaining + 999) / 1000;
+		}
 
 		state = lxc_cmd_sock_get_state(lxcname, lxcpath, s, timeout);
 		if (state >= 0)
@@ -106,13 +177,35 @@ int lxc_wait(const char *lxcname, const char *states, int timeout,
 		if (errno != ECONNREFUSED)
 			return log_error_errno(-1, errno, "Failed to receive state from monitor");
 
-		if (timeout > 0)
-			timeout--;
-
 		if (timeout == 0)
 			return -1;
 
-		(void)nanosleep(&onesec, NULL);
+		/*
+		 * The container isn't running yet. Wait for its monitor to
+		 * register it instead of polling the command socket. Retry
+		 * right after setting up the watch since the container might
+		 * have registered in between.
+		 */
+		if (watch && watch_fd < 0) {
+			watch_fd = lxc_monitor_active_watch(lxcpath);
+			if (watch_fd >= 0)
+				continue;
+
+			WARN("Falling back to polling for container \"%s\"", lxcname);
+			watch = false;
+		}
+
+		if (watch_fd >= 0) {
+			if (lxc_wait_registered(watch_fd, remaining) < 0)
+				return -1;
+		} else {
+			struct timespec onesec = {
+			    .tv_sec = 1,
+			    .tv_nsec = 0,
+			};
+
+			(void)nanosleep(&onesec, NULL);
+		}
 	}
 
 	TRACE("Retrieved state of container %s", lxc_state2str(state));
@@ -3,11 +3,17 @@
 #ifndef _GNU_SOURCE
 #define _GNU_SOURCE 1
 #endif
+#include <fcntl.h>
+#include <libgen.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "config.h"
+#include "file_utils.h"
 #include "log.h"
 #include "macro.h"
 #include "memory_utils.h"
@@ -15,11 +21,62 @@
 #include "storage.h"
 #include "utils.h"
 
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
 lxc_log_define(dir, lxc);
 
+/*
+ * Whether the files below @src can be cloned into @dest, or its parent if it
+ * doesn't exist yet, with FICLONE. Both have to be on the same filesystem and
+ * it has to support sharing extents, like btrfs or XFS with reflink=1.
+ */
+bool dir_can_reflink(const char *src, const char *dest)
+{
+	__do_close int fd_from = -EBADF, fd_to = -EBADF;
+	__do_free char *parent = NULL;
+	char buf[4096] = {0};
+	struct stat st_src, st_dest;
+	const char *dir = dest;
+
+	if (stat(src, &st_src) < 0)
+		return false;
+
+	if (stat(dir, &st_dest) < 0) {
+		parent = strdup(dest);
+		if (!parent)
+			return false;
+
+		dir = dirname(parent);
+		if (stat(dir, &st_dest) < 0)
+			return false;
+	}
+
+	if (st_src.st_dev != st_dest.st_dev)
+		return log_trace(false, "\"%s\" and \"%s\" are on different filesystems", src, dir);
+
+	fd_from = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+	if (fd_from < 0)
+		return false;
+
+	fd_to = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+	if (fd_to < 0)
+		return false;
+
+	if (lxc_write_nointr(fd_from, buf, sizeof(buf)) != sizeof(buf))
+		return false;
+
+	if (ioctl(fd_to, FICLONE, fd_from) < 0)
+		return log_trace_errno(false, errno, "Filesystem of \"%s\" can't reflink", dir);
+
+	return true;
+}
+
 /*
  * For a simple directory bind mount, we substitute the old container name and
- * paths for the new.
+ * paths for the new. A snapshot is a copy sharing the extents of all files with
+ * the original, so it's only possible if the filesystem supports reflinks.
  */
 int dir_clonepaths(struct lxc_storage *orig, struct lxc_storage *new,
 		   const char *oldname, const char *cname, const char *oldpath,
@@ -30,9 +87,6 @@ int dir_clonepaths(struct lxc_storage *orig, struct lxc_storage *new,
 	int ret;
 	size_t len;
 
-	if (snap)
-		return log_error_errno(-EINVAL, EINVAL, "Directories cannot be snapshotted");
-
 	if (!orig->dest || !orig->src)
 		return ret_errno(EINVAL);
 
@@ -51,6 +105,10 @@ int dir_clonepaths(struct lxc_storage *orig, struct lxc_storage *new,
 	if (!new->dest)
 		return log_error_errno(-ENOMEM, ENOMEM, "Failed to duplicate string \"%s\"", new->src);
 
+	if (snap && (!strequal(orig->type, "dir") ||
+		     !dir_can_reflink(lxc_storage_get_path(orig->src, orig->type), new->dest)))
+		return log_error_errno(-EINVAL, EINVAL, "Directories can only be snapshotted on filesystems supporting reflinks");
+
 	TRACE("Created new path \"%s\" for dir storage driver", new->dest);
 	return 0;
 }
@@ -14,6 +14,7 @@ struct bdev_specs;
 
 struct lxc_conf;
 
+__hidden extern bool dir_can_reflink(const char *src, const char *dest);
 __hidden extern int dir_clonepaths(struct lxc_storage *orig, struct lxc_storage *new,
 				   const char *oldname, const char *cname, const char *oldpath,
 				   const char *lxcpath, int snap, uint64_t newsize,
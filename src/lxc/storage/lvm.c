@@ -484,7 +484,7 @@ bool lvm_create_clone(struct lxc_conf *conf, struct lxc_storage *orig,
 	int ret;
 	const char *src;
 	const char *thinpool;
-	struct rsync_data data;
+	struct rsync_data data = {0};
 	const char *cmd_args[2];
 	char cmd_output[PATH_MAX] = {0};
 	char fstype[100] = "ext4";
@@ -3,14 +3,22 @@
 #ifndef _GNU_SOURCE
 #define _GNU_SOURCE 1
 #endif
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <unistd.h>
 
 #include "conf.h"
 #include "config.h"
 #include "confile.h"
+#include "file_utils.h"
 #include "log.h"
 #include "lxccontainer.h"
 #include "macro.h"
@@ -19,8 +27,13 @@
 #include "rsync.h"
 #include "storage.h"
 #include "storage_utils.h"
+#include "string_utils.h"
 #include "utils.h"
 
+#if HAVE_OPENSSL
+#include <openssl/evp.h>
+#endif
+
 lxc_log_define(overlay, lxc);
 
 static char *ovl_name;
@@ -33,6 +46,23 @@ static int ovl_remount_on_enodev(const char *lower, const char *target,
 				 const char *name, unsigned long mountflags,
 				 const void *options);
 
+/*
+ * Return the ":" separating the lower directories of an overlay rootfs path
+ * from its upper directory, which is the last absolute path in it.
+ */
+static char *ovl_upper_sep(char *path)
+{
+	char *sep = NULL;
+
+	for (char *s = path; (s = strstr(s, ":/")); s++)
+		sep = s;
+
+	if (!sep)
+		sep = strrchr(path, ':');
+
+	return sep;
+}
+
 int ovl_clonepaths(struct lxc_storage *orig, struct lxc_storage *new, const char *oldname,
 		   const char *cname, const char *oldpath, const char *lxcpath,
 		   int snap, uint64_t newsize, struct lxc_conf *conf)
@@ -135,7 +165,7 @@ int ovl_clonepaths(struct lxc_storage *orig, struct lxc_storage *new, const char
 		else if (strncmp(osrc, "overlayfs:", STRLITERALLEN("overlayfs:")) == 0)
 			nsrc += STRLITERALLEN("overlayfs:");
 
-		odelta = strchr(nsrc, ':');
+		odelta = ovl_upper_sep(nsrc);
 		if (!odelta)
 			return log_error_errno(-22, ENOENT, "Failed to find \":\" in \"%s\"", nsrc);
 
@@ -321,7 +351,7 @@ int ovl_destroy(struct lxc_storage *orig)
 	else if (strncmp(upper, "overlayfs:", 10) == 0)
 		upper += 10;
 
-	upper = strchr(upper, ':');
+	upper = ovl_upper_sep(upper);
 	if (!upper)
 		return -22;
 	upper++;
@@ -340,13 +370,67 @@ bool ovl_detect(const char *path)
 	return false;
 }
 
+/*
+ * Mount a tmpfs of @size bytes on @dir and create the upper and work
+ * directories in it. The new upper directory takes the owner and mode of
+ * @delta, the upper directory on disk. The tmpfs only exists in the mount
+ * namespace of the container, so its contents are gone when it stops.
+ */
+static int ovl_mount_tmpfs_upper(const char *dir, const char *delta,
+				 uint64_t size, char **upper, char **work)
+{
+	__do_free char *tmpfs_upper = NULL, *tmpfs_work = NULL;
+	char opts[64];
+	struct stat st;
+	int ret;
+
+	ret = stat(delta, &st);
+	if (ret < 0)
+		return log_error_errno(-errno, errno, "Failed to stat \"%s\"", delta);
+
+	ret = strnprintf(opts, sizeof(opts), "size=%" PRIu64 ",mode=0755", size);
+	if (ret < 0)
+		return ret_errno(EINVAL);
+
+	ret = mount("tmpfs", dir, "tmpfs", 0, opts);
+	if (ret < 0)
+		return log_error_errno(-errno, errno, "Failed to mount tmpfs on \"%s\"", dir);
+
+	tmpfs_upper = must_make_path(dir, LXC_OVERLAY_DELTA_DIR, NULL);
+	tmpfs_work = must_make_path(dir, LXC_OVERLAY_WORK_DIR, NULL);
+
+	if (mkdir(tmpfs_upper, 0755) < 0 || mkdir(tmpfs_work, 0755) < 0) {
+		SYSERROR("Failed to create overlay directories on tmpfs");
+		goto on_error;
+	}
+
+	if (chown(tmpfs_upper, st.st_uid, st.st_gid) < 0 ||
+	    chmod(tmpfs_upper, st.st_mode & 07777) < 0) {
+		SYSERROR("Failed to set owner and mode of \"%s\"", tmpfs_upper);
+		goto on_error;
+	}
+
+	TRACE("Mounted tmpfs of %" PRIu64 " bytes for overlay upper layer on \"%s\"", size, dir);
+	*upper = move_ptr(tmpfs_upper);
+	*work = move_ptr(tmpfs_work);
+	return 0;
+
+on_error:
+	ret = -errno;
+	if (umount2(dir, MNT_DETACH) < 0)
+		SYSWARN("Failed to unmount tmpfs from \"%s\"", dir);
+
+	return ret;
+}
+
 int ovl_mount(struct lxc_storage *bdev)
 {
 	__do_free char *options = NULL, *options_work = NULL;
+	__do_free char *tmpfs_lower = NULL, *tmpfs_upper = NULL, *tmpfs_work = NULL;
 	unsigned long mntflags = 0;
 	char *mntdata = NULL;
 	char *tmp, *dup, *lower, *upper;
-	char *work, *lastslash;
+	char *work, *workdir, *lastslash;
 	size_t len, len2;
 	int ret, ret2;
 
@@ -432,6 +516,28 @@ int ovl_mount(struct lxc_storage *bdev)
 		return -22;
 	}
 
+	/*
+	 * Keep the writes of an ephemeral container in memory: the upper
+	 * directory on disk becomes the topmost lower layer and a tmpfs
+	 * mounted over the workdir holds the new upper and work directories.
+	 */
+	workdir = work;
+	if ((bdev->flags & LXC_STORAGE_INTERNAL_TMPFS_UPPER) && bdev->rootfs) {
+		ret = ovl_mount_tmpfs_upper(work, upper, bdev->rootfs->overlay_tmpfs,
+					    &tmpfs_upper, &tmpfs_work);
+		if (ret < 0) {
+			free(mntdata);
+			free(dup);
+			free(work);
+			return ret;
+		}
+
+		tmpfs_lower = must_concat(NULL, upper, ":", lower, NULL);
+		lower = tmpfs_lower;
+		upper = tmpfs_upper;
+		workdir = tmpfs_work;
+	}
+
 	/*
 	 * TODO:
 	 * We should check whether bdev->src is a blockdev but for now only
@@ -445,13 +551,13 @@ int ovl_mount(struct lxc_storage *bdev)
 		ret = snprintf(options, len, "upperdir=%s,lowerdir=%s,%s",
 			       upper, lower, mntdata);
 
-		len2 = strlen(lower) + strlen(upper) + strlen(work) +
+		len2 = strlen(lower) + strlen(upper) + strlen(workdir) +
 		       strlen("upperdir=,lowerdir=,workdir=") +
 		       strlen(mntdata) + 1;
 		options_work = must_realloc(NULL, len2);
 		ret2 = snprintf(options, len2,
 				"upperdir=%s,lowerdir=%s,workdir=%s,%s", upper,
-				lower, work, mntdata);
+				lower, workdir, mntdata);
 	} else {
 		len = strlen(lower) + strlen(upper) +
 		      strlen("upperdir=,lowerdir=") + 1;
@@ -459,16 +565,18 @@ int ovl_mount(struct lxc_storage *bdev)
 		ret = snprintf(options, len, "upperdir=%s,lowerdir=%s", upper,
 			       lower);
 
-		len2 = strlen(lower) + strlen(upper) + strlen(work) +
+		len2 = strlen(lower) + strlen(upper) + strlen(workdir) +
 		       strlen("upperdir=,lowerdir=,workdir=") + 1;
 		options_work = must_realloc(NULL, len2);
 		ret2 = snprintf(options_work, len2,
 				"upperdir=%s,lowerdir=%s,workdir=%s", upper,
-				lower, work);
+				lower, workdir);
 	}
 
 	if (ret < 0 || ret >= len || ret2 < 0 || ret2 >= len2) {
 		ERROR("Failed to create string");
+		if (tmpfs_work)
+			(void)umount2(work, MNT_DETACH);
 		free(mntdata);
 		free(dup);
 		free(work);
@@ -498,6 +606,9 @@ int ovl_mount(struct lxc_storage *bdev)
 		     bdev->dest, options_work);
 	}
 
+	if (ret < 0 && tmpfs_work && umount2(work, MNT_DETACH) < 0)
+		SYSWARN("Failed to unmount tmpfs from \"%s\"", work);
+
 	free(dup);
 	free(work);
 	return ret;
@@ -812,3 +923,688 @@ static int ovl_do_rsync(const char *src, const char *dest,
 
 	return ret;
 }
+
+static bool ovl_layer_digest_valid(const char *digest, size_t len)
+{
+	if (len != LXC_LAYER_DIGEST_LEN)
+		return false;
+
+	for (size_t i = 0; i < len; i++)
+		if (digest[i] == '\0' || !strchr("0123456789abcdef", digest[i]))
+			return false;
+
+	return true;
+}
+
+#if HAVE_OPENSSL
+#define OVL_LAYER_LINK_BUCKETS 1024
+
+static int ovl_layer_filter(const struct dirent *direntp)
+{
+	return !strequal(direntp->d_name, ".") && !strequal(direntp->d_name, "..");
+}
+
+/* Unlike alphasort() this doesn't depend on the locale. */
+static int ovl_layer_sort(const struct dirent **a, const struct dirent **b)
+{
+	return strcmp((*a)->d_name, (*b)->d_name);
+}
+
+/* A regular file with more than one link that was already hashed. */
+struct ovl_layer_link {
+	dev_t dev;
+	ino_t ino;
+	char *path;
+	struct ovl_layer_link *next;
+};
+
+struct ovl_layer_hash_ctx {
+	EVP_MD_CTX *ctx;
+	struct ovl_layer_link *links[OVL_LAYER_LINK_BUCKETS];
+};
+
+static int ovl_layer_name_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/*
+ * If @link isn't NULL the entry is a further link to the file hashed as
+ * @link, which is hashed instead of the contents.
+ */
+static int ovl_layer_hash_header(struct ovl_layer_hash_ctx *h, const char *path,
+				 size_t len, const struct stat *st,
+				 const char *link)
+{
+	char header[128];
+	uint64_t size = 0;
+	int ret;
+
+	if (S_ISREG(st->st_mode) || S_ISLNK(st->st_mode))
+		size = st->st_size;
+	else if (S_ISCHR(st->st_mode) || S_ISBLK(st->st_mode))
+		size = st->st_rdev;
+
+	ret = strnprintf(header, sizeof(header), "%o %u %u %" PRIu64 "%s",
+			 st->st_mode, st->st_uid, st->st_gid, size,
+			 link ? " link" : "");
+	if (ret < 0)
+		return ret;
+
+	/* All strings are hashed with their terminating \0. */
+	if (!EVP_DigestUpdate(h->ctx, path, len + 1) ||
+	    !EVP_DigestUpdate(h->ctx, header, ret + 1))
+		return -EINVAL;
+
+	if (link && !EVP_DigestUpdate(h->ctx, link, strlen(link) + 1))
+		return -EINVAL;
+
+	return 0;
+}
+
+/*
+ * Hash the extended attributes of @fd, or of @path if @fd is negative,
+ * sorted by name so the order the filesystem lists them in doesn't matter.
+ */
+static int ovl_layer_hash_xattrs(struct ovl_layer_hash_ctx *h, int fd,
+				 const char *path)
+{
+	__do_free char *names = NULL, *value = NULL;
+	__do_free char **sorted = NULL;
+	ssize_t len, value_size = 0;
+	char count[INTTYPE_TO_STRLEN(int)];
+	int nr = 0, ret;
+
+	for (;;) {
+		len = fd >= 0 ? flistxattr(fd, NULL, 0) : llistxattr(path, NULL, 0);
+		if (len < 0 && errno == ENOTSUP)
+			len = 0;
+		if (len <= 0)
+			break;
+
+		free_disarm(names);
+		names = malloc(len);
+		if (!names)
+			return -ENOMEM;
+
+		len = fd >= 0 ? flistxattr(fd, names, len) : llistxattr(path, names, len);
+		if (len >= 0)
+			break;
+		if (errno != ERANGE)
+			return -errno;
+	}
+	if (len < 0)
+		return -errno;
+
+	for (char *name = names; name < names + len; name += strlen(name) + 1)
+		nr++;
+
+	ret = strnprintf(count, sizeof(count), "%d", nr);
+	if (ret < 0)
+		return ret;
+
+	if (!EVP_DigestUpdate(h->ctx, count, ret + 1))
+		return -EINVAL;
+
+	if (nr == 0)
+		return 0;
+
+	sorted = malloc(nr * sizeof(*sorted));
+	if (!sorted)
+		return -ENOMEM;
+
+	nr = 0;
+	for (char *name = names; name < names + len; name += strlen(name) + 1)
+		sorted[nr++] = name;
+	qsort(sorted, nr, sizeof(*sorted), ovl_layer_name_cmp);
+
+	for (int i = 0; i < nr; i++) {
+		char size_str[INTTYPE_TO_STRLEN(ssize_t)];
+		ssize_t size;
+
+		size = fd >= 0 ? fgetxattr(fd, sorted[i], NULL, 0) : lgetxattr(path, sorted[i], NULL, 0);
+		if (size < 0)
+			return -errno;
+
+		if (size > value_size) {
+			free_disarm(value);
+			value = malloc(size);
+			if (!value)
+				return -ENOMEM;
+			value_size = size;
+		}
+
+		size = fd >= 0 ? fgetxattr(fd, sorted[i], value, size) : lgetxattr(path, sorted[i], value, size);
+		if (size < 0)
+			return -errno;
+
+		ret = strnprintf(size_str, sizeof(size_str), "%zd", size);
+		if (ret < 0)
+			return ret;
+
+		if (!EVP_DigestUpdate(h->ctx, sorted[i], strlen(sorted[i]) + 1) ||
+		    !EVP_DigestUpdate(h->ctx, size_str, ret + 1) ||
+		    !EVP_DigestUpdate(h->ctx, value, size))
+			return -EINVAL;
+	}
+
+	return 0;
+}
+
+/*
+ * Return the path of the first link to @st that was hashed, or remember
+ * @path as that if there was none yet.
+ */
+static int ovl_layer_hash_link(struct ovl_layer_hash_ctx *h, const char *path,
+			       const struct stat *st, const char **link)
+{
+	struct ovl_layer_link *l;
+	unsigned int bucket;
+
+	*link = NULL;
+	if (st->st_nlink < 2)
+		return 0;
+
+	bucket = (st->st_ino ^ st->st_dev) % OVL_LAYER_LINK_BUCKETS;
+	for (l = h->links[bucket]; l; l = l->next) {
+		if (l->dev == st->st_dev && l->ino == st->st_ino) {
+			*link = l->path;
+			return 0;
+		}
+	}
+
+	l = zalloc(sizeof(*l));
+	if (!l)
+		return -ENOMEM;
+
+	l->path = strdup(path);
+	if (!l->path) {
+		free(l);
+		return -ENOMEM;
+	}
+	l->dev = st->st_dev;
+	l->ino = st->st_ino;
+	l->next = h->links[bucket];
+	h->links[bucket] = l;
+
+	return 0;
+}
+
+static int ovl_layer_hash_file(struct ovl_layer_hash_ctx *h, int dfd, const char *name)
+{
+	__do_close int fd = -EBADF;
+	char buf[65536];
+	ssize_t bytes;
+
+	fd = openat(dfd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	while ((bytes = lxc_read_nointr(fd, buf, sizeof(buf))) > 0)
+		if (!EVP_DigestUpdate(h->ctx, buf, bytes))
+			return -EINVAL;
+
+	return bytes < 0 ? -errno : 0;
+}
+
+static int ovl_layer_hash_tree(struct ovl_layer_hash_ctx *h, int dfd, char *path, size_t len);
+
+static int ovl_layer_hash_entry(struct ovl_layer_hash_ctx *h, int dfd, const char *name,
+				char *path, size_t len)
+{
+	__do_close int fd = -EBADF;
+	char target[PATH_MAX];
+	char proc_path[LXC_PROC_SELF_FD_LEN + NAME_MAX + 1];
+	const char *link = NULL;
+	struct stat st;
+	ssize_t bytes;
+	size_t name_len = strlen(name);
+	int ret;
+
+	if (len + 1 + name_len >= PATH_MAX)
+		return -ENAMETOOLONG;
+
+	path[len] = '/';
+	memcpy(path + len + 1, name, name_len + 1);
+	len += 1 + name_len;
+
+	if (fstatat(dfd, name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+		return -errno;
+
+	if (S_ISREG(st.st_mode)) {
+		ret = ovl_layer_hash_link(h, path, &st, &link);
+		if (ret < 0)
+			return ret;
+	}
+
+	ret = ovl_layer_hash_header(h, path, len, &st, link);
+	if (ret < 0)
+		return ret;
+
+	/* Further links share the attributes and contents of the first one. */
+	if (link)
+		return 0;
+
+	ret = strnprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d/%s", dfd, name);
+	if (ret < 0)
+		return ret;
+
+	ret = ovl_layer_hash_xattrs(h, -EBADF, proc_path);
+	if (ret < 0)
+		return ret;
+
+	switch (st.st_mode & S_IFMT) {
+	case S_IFREG:
+		return ovl_layer_hash_file(h, dfd, name);
+	case S_IFLNK:
+		bytes = readlinkat(dfd, name, target, sizeof(target));
+		if (bytes < 0)
+			return -errno;
+
+		return EVP_DigestUpdate(h->ctx, target, bytes) ? 0 : -EINVAL;
+	case S_IFDIR:
+		fd = openat(dfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+		if (fd < 0)
+			return -errno;
+
+		return ovl_layer_hash_tree(h, fd, path, len);
+	}
+
+	return 0;
+}
+
+/*
+ * Hash the path, type, mode, ownership and extended attributes of every entry
+ * below @dfd followed by the contents of files and the targets of symlinks.
+ * Further links to a file are hashed as the path of its first link. Entries
+ * are visited in a fixed order and timestamps are left out, so equal trees
+ * get the same digest wherever they were copied from.
+ */
+static int ovl_layer_hash_tree(struct ovl_layer_hash_ctx *h, int dfd, char *path, size_t len)
+{
+	struct dirent **entries = NULL;
+	int nr, ret = 0;
+
+	nr = scandirat(dfd, ".", &entries, ovl_layer_filter, ovl_layer_sort);
+	if (nr < 0)
+		return -errno;
+
+	for (int i = 0; i < nr && ret == 0; i++)
+		ret = ovl_layer_hash_entry(h, dfd, entries[i]->d_name, path, len);
+
+	for (int i = 0; i < nr; i++)
+		free(entries[i]);
+	free(entries);
+
+	return ret;
+}
+
+static int ovl_layer_hash(const char *rootfs, char *digest)
+{
+	__do_close int fd = -EBADF;
+	struct ovl_layer_hash_ctx h = {};
+	unsigned char md[EVP_MAX_MD_SIZE];
+	unsigned int md_len = 0;
+	char path[PATH_MAX] = "";
+	struct stat st;
+	int ret;
+
+	fd = open(rootfs, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	if (fstat(fd, &st) < 0)
+		return -errno;
+
+	h.ctx = EVP_MD_CTX_create();
+	if (!h.ctx)
+		return -ENOMEM;
+
+	if (!EVP_DigestInit_ex(h.ctx, EVP_sha256(), NULL))
+		ret = -EINVAL;
+	else
+		ret = ovl_layer_hash_header(&h, path, 0, &st, NULL);
+
+	if (ret == 0)
+		ret = ovl_layer_hash_xattrs(&h, fd, NULL);
+
+	if (ret == 0)
+		ret = ovl_layer_hash_tree(&h, fd, path, 0);
+
+	if (ret == 0 && !EVP_DigestFinal_ex(h.ctx, md, &md_len))
+		ret = -EINVAL;
+	EVP_MD_CTX_destroy(h.ctx);
+
+	for (int i = 0; i < OVL_LAYER_LINK_BUCKETS; i++) {
+		struct ovl_layer_link *next;
+
+		for (struct ovl_layer_link *l = h.links[i]; l; l = next) {
+			next = l->next;
+			free(l->path);
+			free(l);
+		}
+	}
+
+	if (ret < 0)
+		return ret;
+
+	if (md_len * 2 != LXC_LAYER_DIGEST_LEN)
+		return -EINVAL;
+
+	for (unsigned int i = 0; i < md_len; i++)
+		snprintf(digest + i * 2, 3, "%02x", md[i]);
+
+	return 0;
+}
+
+static int ovl_layer_build(const char *dir, const char *src, char *digest)
+{
+	__do_free char *refs = NULL, *rootfs = NULL;
+	int ret;
+
+	/* mkdtemp() creates it with mode 0700. */
+	if (chmod(dir, 0755) < 0)
+		return log_error_errno(-errno, errno, "Failed to change mode of \"%s\"", dir);
+
+	refs = must_make_path(dir, "refs", NULL);
+	if (mkdir(refs, 0755) < 0)
+		return log_error_errno(-errno, errno, "Failed to create directory \"%s\"", refs);
+
+	/* Data is shared with @src if the filesystem supports reflinks. */
+	rootfs = must_make_path(dir, "rootfs", NULL);
+	if (lxc_copy_tree(src, rootfs, 0, 0) < 0)
+		return log_error(-EIO, "Failed to copy \"%s\" into \"%s\"", src, rootfs);
+
+	ret = ovl_layer_hash(rootfs, digest);
+	if (ret < 0)
+		return log_error_errno(ret, -ret, "Failed to compute digest of \"%s\"", rootfs);
+
+	return 0;
+}
+#endif
+
+int ovl_layer_import(const char *lxcpath, const char *src, char *digest)
+{
+#if HAVE_OPENSSL
+	__do_free char *layer = NULL, *store = NULL, *tmp = NULL;
+	int ret;
+
+	store = must_make_path(lxcpath, LXC_LAYER_STORE, NULL);
+	ret = mkdir_p(store, 0755);
+	if (ret < 0 && errno != EEXIST)
+		return log_error_errno(-errno, errno, "Failed to create directory \"%s\"", store);
+
+	/* The layer is only moved into place once its digest is known, so the
+	 * store never contains partial layers.
+	 */
+	tmp = must_make_path(store, ".import.XXXXXX", NULL);
+	if (!mkdtemp(tmp))
+		return log_error_errno(-errno, errno, "Failed to create directory in \"%s\"", store);
+
+	ret = ovl_layer_build(tmp, src, digest);
+	if (ret == 0) {
+		layer = must_make_path(store, digest, NULL);
+		if (rename(tmp, layer) == 0) {
+			INFO("Imported \"%s\" as layer %s", src, digest);
+			return 0;
+		}
+
+		if (errno == EEXIST || errno == ENOTEMPTY)
+			INFO("Layer %s of \"%s\" already exists", digest, src);
+		else
+			ret = log_error_errno(-errno, errno, "Failed to move layer to \"%s\"", layer);
+	}
+
+	if (lxc_rmdir_onedev(tmp, NULL) < 0)
+		WARN("Failed to remove \"%s\"", tmp);
+
+	return ret;
+#else
+	return log_error_errno(-EOPNOTSUPP, EOPNOTSUPP, "Layers can't be imported without openssl support");
+#endif
+}
+
+char *ovl_layers_rootfs(const char *lxcpath, const char *name,
+			const char *const *digests, int nr,
+			const struct lxc_conf *conf)
+{
+	__do_free char *delta = NULL, *rootfs = NULL, *work = NULL;
+	int ret;
+
+	rootfs = strdup("overlay");
+	if (!rootfs)
+		return ret_set_errno(NULL, ENOMEM);
+
+	for (int i = 0; i < nr; i++) {
+		__do_free char *layer = NULL;
+		char *tmp;
+
+		if (!digests[i] || !ovl_layer_digest_valid(digests[i], strlen(digests[i])))
+			return log_error_errno(NULL, EINVAL, "Invalid layer digest \"%s\"",
+					       digests[i] ? digests[i] : "(null)");
+
+		layer = must_make_path(lxcpath, LXC_LAYER_STORE, digests[i], "rootfs", NULL);
+		if (!dir_exists(layer))
+			return log_error_errno(NULL, ENOENT, "Layer %s not found in \"%s\"",
+					       digests[i], lxcpath);
+
+		tmp = must_concat(NULL, rootfs, ":", layer, NULL);
+		free(rootfs);
+		rootfs = tmp;
+	}
+
+	delta = must_make_path(lxcpath, name, LXC_OVERLAY_DELTA_PATH, NULL);
+	ret = mkdir_p(delta, 0755);
+	if (ret < 0 && errno != EEXIST)
+		return log_error_errno(NULL, errno, "Failed to create directory \"%s\"", delta);
+
+	work = must_make_path(lxcpath, name, LXC_OVERLAY_WORK_PATH, NULL);
+	ret = mkdir_p(work, 0755);
+	if (ret < 0 && errno != EEXIST)
+		return log_error_errno(NULL, errno, "Failed to create directory \"%s\"", work);
+
+	if (am_guest_unpriv() || !lxc_list_empty(&conf->id_map)) {
+		__do_free char *lxc_overlay_private_dir = NULL;
+
+		lxc_overlay_private_dir = must_make_path(lxcpath, name, LXC_OVERLAY_PRIVATE_DIR, NULL);
+		ret = chown_mapped_root(lxc_overlay_private_dir, conf);
+		if (ret < 0)
+			WARN("Failed to update ownership of %s", lxc_overlay_private_dir);
+
+		ret = chown_mapped_root(delta, conf);
+		if (ret < 0)
+			WARN("Failed to update ownership of %s", delta);
+
+		ret = chown_mapped_root(work, conf);
+		if (ret < 0)
+			WARN("Failed to update ownership of %s", work);
+	}
+
+	return must_concat(NULL, rootfs, ":", delta, NULL);
+}
+
+/*
+ * If @lower is the rootfs of a layer, i.e. "<store>/<digest>/rootfs", write
+ * the path of the directory holding its references to @refs.
+ */
+static bool ovl_layer_refs(const char *lower, char *refs, size_t size)
+{
+	size_t len = strlen(lower);
+	const char *digest, *end;
+
+	if (len < STRLITERALLEN("/" LXC_LAYER_STORE "/") + LXC_LAYER_DIGEST_LEN +
+		  STRLITERALLEN("/rootfs"))
+		return false;
+
+	end = lower + len - STRLITERALLEN("/rootfs");
+	if (!strequal(end, "/rootfs"))
+		return false;
+
+	digest = end - LXC_LAYER_DIGEST_LEN;
+	if (!ovl_layer_digest_valid(digest, LXC_LAYER_DIGEST_LEN))
+		return false;
+
+	if (strncmp(digest - STRLITERALLEN("/" LXC_LAYER_STORE "/"),
+		    "/" LXC_LAYER_STORE "/", STRLITERALLEN("/" LXC_LAYER_STORE "/")))
+		return false;
+
+	return strnprintf(refs, size, "%.*s/refs", (int)(end - lower), lower) >= 0;
+}
+
+int ovl_layers_ref(const char *rootfs_path, const char *lxcpath,
+		   const char *name, bool inc)
+{
+	__do_free char *lowers = NULL, *target = NULL;
+	char refname[PATH_MAX];
+	char *lower, *sep;
+	int nr_layers = 0, nr_other = 0;
+
+	/* The configuration keeps the storage type separately. */
+	if (strncmp(rootfs_path, "overlay:", 8) == 0)
+		rootfs_path += 8;
+	else if (strncmp(rootfs_path, "overlayfs:", 10) == 0)
+		rootfs_path += 10;
+	else if (rootfs_path[0] != '/')
+		return 0;
+
+	lowers = strdup(rootfs_path);
+	if (!lowers)
+		return ret_errno(ENOMEM);
+
+	sep = ovl_upper_sep(lowers);
+	if (!sep)
+		return 0;
+	*sep = '\0';
+
+	/* A reference is a symlink to the directory of the container named
+	 * after that directory. Overlay paths can't contain ":" so it can
+	 * stand in for "/".
+	 */
+	target = must_make_path(lxcpath, name, NULL);
+	if (strnprintf(refname, sizeof(refname), "%s", target + strspn(target, "/")) < 0)
+		return ret_errno(ENAMETOOLONG);
+
+	for (char *s = refname; (s = strchr(s, '/')); s++)
+		*s = ':';
+
+	lxc_iterate_parts(lower, lowers, ":") {
+		char refs[PATH_MAX], ref[PATH_MAX];
+
+		if (!ovl_layer_refs(lower, refs, sizeof(refs))) {
+			nr_other++;
+			continue;
+		}
+		nr_layers++;
+
+		if (strnprintf(ref, sizeof(ref), "%s/%s", refs, refname) < 0)
+			return ret_errno(ENAMETOOLONG);
+
+		if (inc) {
+			if (symlink(target, ref) < 0 && errno != EEXIST)
+				return log_error_errno(-errno, errno, "Failed to add reference \"%s\"", ref);
+		} else {
+			if (unlink(ref) < 0 && errno != ENOENT)
+				return log_error_errno(-errno, errno, "Failed to remove reference \"%s\"", ref);
+		}
+	}
+
+	return nr_layers > 0 && nr_other == 0;
+}
+
+/*
+ * Check whether any container still references @layer and drop the
+ * references of containers which don't exist anymore.
+ */
+static bool ovl_layer_in_use(const char *layer)
+{
+	__do_closedir DIR *dir = NULL;
+	__do_free char *refs = NULL;
+	struct dirent *direntp;
+	bool used = false;
+
+	refs = must_make_path(layer, "refs", NULL);
+	dir = opendir(refs);
+	if (!dir)
+		return true;
+
+	while ((direntp = readdir(dir))) {
+		char target[PATH_MAX];
+		ssize_t len;
+
+		if (strequal(direntp->d_name, ".") || strequal(direntp->d_name, ".."))
+			continue;
+
+		len = readlinkat(dirfd(dir), direntp->d_name, target, sizeof(target) - 1);
+		if (len < 0) {
+			used = true;
+			continue;
+		}
+		target[len] = '\0';
+
+		if (access(target, F_OK) < 0 && errno == ENOENT) {
+			INFO("Dropping reference of removed container \"%s\" on \"%s\"", target, layer);
+			(void)unlinkat(dirfd(dir), direntp->d_name, 0);
+			continue;
+		}
+
+		used = true;
+	}
+
+	return used;
+}
+
+int ovl_layers_prune(const char *lxcpath)
+{
+	__do_closedir DIR *dir = NULL;
+	__do_free char *store = NULL;
+	struct dirent *direntp;
+	int nr = 0;
+
+	store = must_make_path(lxcpath, LXC_LAYER_STORE, NULL);
+	dir = opendir(store);
+	if (!dir) {
+		if (errno == ENOENT)
+			return 0;
+
+		return log_error_errno(-errno, errno, "Failed to open \"%s\"", store);
+	}
+
+	while ((direntp = readdir(dir))) {
+		const char *digest = direntp->d_name;
+		char layer[PATH_MAX], unused[PATH_MAX];
+
+		if (!ovl_layer_digest_valid(digest, strlen(digest)))
+			continue;
+
+		if (strnprintf(layer, sizeof(layer), "%s/%s", store, digest) < 0 ||
+		    strnprintf(unused, sizeof(unused), "%s/.prune.%s", store, digest) < 0)
+			continue;
+
+		if (ovl_layer_in_use(layer))
+			continue;
+
+		/* A container adding a reference after the layer has been moved
+		 * away fails to, one adding it before is seen here.
+		 */
+		if (rename(layer, unused) < 0) {
+			SYSWARN("Failed to move layer \"%s\"", layer);
+			continue;
+		}
+
+		if (ovl_layer_in_use(unused)) {
+			if (rename(unused, layer) < 0)
+				SYSERROR("Failed to move layer \"%s\" back", unused);
+			continue;
+		}
+
+		if (lxc_rmdir_onedev(unused, NULL) < 0) {
+			WARN("Failed to remove layer \"%s\"", unused);
+			continue;
+		}
+
+		INFO("Removed unused layer %s", digest);
+		nr++;
+	}
+
+	return nr;
+}
@@ -58,4 +58,38 @@ __hidden extern char *ovl_get_rootfs(const char *rootfs_path, size_t *rootfslen)
 __hidden extern int ovl_mkdir(const struct mntent *mntent, const struct lxc_rootfs *rootfs,
 			      const char *lxc_name, const char *lxc_path);
 
+/* Read-only lower layers shared between overlay containers are kept in
+ * "<lxcpath>/" LXC_LAYER_STORE "/<digest>/rootfs", where digest is the
+ * sha256 of the layer's contents. Every container using a layer holds a
+ * reference to it in "<lxcpath>/" LXC_LAYER_STORE "/<digest>/refs".
+ */
+#define LXC_LAYER_STORE ".layers"
+
+/* Copy @src into the layer store of @lxcpath and write its digest to @digest,
+ * which must hold LXC_LAYER_DIGEST_LEN + 1 bytes.
+ */
+__hidden extern int ovl_layer_import(const char *lxcpath, const char *src, char *digest);
+
+/* Create the upper- and workdir of container @name and return an overlay
+ * rootfs path stacking the layers @digests of the store of @lxcpath on top of
+ * each other, the first one being the topmost. Allocated memory must be freed
+ * by caller.
+ */
+__hidden extern char *ovl_layers_rootfs(const char *lxcpath, const char *name,
+					const char *const *digests, int nr,
+					const struct lxc_conf *conf);
+
+/* Take or drop the references of the container @name in @lxcpath on the
+ * layers used by the overlay rootfs path @rootfs_path, with or without its
+ * "overlay:" prefix. Returns 1 if all of its lower directories are layers of
+ * a store, 0 if not.
+ */
+__hidden extern int ovl_layers_ref(const char *rootfs_path, const char *lxcpath,
+				   const char *name, bool inc);
+
+/* Remove the layers in the store of @lxcpath which aren't used by any
+ * container anymore and return their number.
+ */
+__hidden extern int ovl_layers_prune(const char *lxcpath);
+
 #endif /* __LXC_OVERLAY_H */
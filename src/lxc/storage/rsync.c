@@ -3,20 +3,31 @@
 #ifndef _GNU_SOURCE
 #define _GNU_SOURCE 1
 #endif
+#include <dirent.h>
+#include <fcntl.h>
 #include <grp.h>
+#include <pthread.h>
 #include <sched.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/mount.h>
+#include <sys/param.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/xattr.h>
 #include <unistd.h>
 
 #include "config.h"
+#include "file_utils.h"
 #include "log.h"
+#include "memory_utils.h"
 #include "rsync.h"
 #include "storage.h"
+#include "string_utils.h"
 #include "syscall_wrappers.h"
 #include "utils.h"
 
@@ -41,6 +52,843 @@ int lxc_rsync_exec_wrapper(void *data)
 	return lxc_rsync_exec(args->src, args->dest);
 }
 
+/*
+ * Built-in replacement for "rsync -aHXS --delete src/ dest". Directories are
+ * handed out to a pool of threads. Each thread pushes the subdirectories it
+ * finds onto its own queue and takes work from the tail of it; idle threads
+ * steal from the head of the other queues so that a single large directory
+ * doesn't serialize the copy.
+ */
+#define COPY_MAX_THREADS 16
+#define COPY_LINK_BUCKETS 1024
+#define COPY_BUF_SIZE (128 * 1024)
+
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
+struct copy_queue {
+	pthread_mutex_t lock;
+	char **paths;
+	size_t head;
+	size_t tail;
+	size_t size;
+};
+
+/* A regular file with more than one link that was already copied. */
+struct copy_link {
+	dev_t dev;
+	ino_t ino;
+	char *path;
+	bool ready;
+	bool copied;
+	struct copy_link *next;
+};
+
+/* Directory modes and times are applied once nothing is written below them. */
+struct copy_dir {
+	char *path;
+	mode_t mode;
+	struct timespec times[2];
+	struct copy_dir *next;
+};
+
+struct copy_ctx {
+	const char *src;
+	const char *dest;
+	int src_fd;
+	int dest_fd;
+	int flags;
+
+	int nr_queues;
+	struct copy_queue *queues;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	/* Directories queued or being copied. */
+	size_t pending;
+	unsigned long generation;
+	int error;
+	char *error_path;
+	struct copy_dir *dirs;
+	unsigned long xattr_failures;
+
+	pthread_mutex_t link_lock;
+	pthread_cond_t link_cond;
+	struct copy_link *links[COPY_LINK_BUCKETS];
+};
+
+struct copy_worker {
+	struct copy_ctx *ctx;
+	int id;
+};
+
+static char *copy_path(const char *dir, const char *name)
+{
+	if (strequal(dir, "."))
+		return strdup(name);
+
+	return must_make_path(dir, name, NULL);
+}
+
+static void copy_fail(struct copy_ctx *ctx, int error, const char *dir,
+		      const char *name)
+{
+	pthread_mutex_lock(&ctx->lock);
+	if (!ctx->error) {
+		ctx->error = error ?: EIO;
+		ctx->error_path = name ? copy_path(dir, name) : strdup(dir);
+	}
+	pthread_cond_broadcast(&ctx->cond);
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+static bool copy_failed(struct copy_ctx *ctx)
+{
+	bool failed;
+
+	pthread_mutex_lock(&ctx->lock);
+	failed = ctx->error != 0;
+	pthread_mutex_unlock(&ctx->lock);
+
+	return failed;
+}
+
+static int copy_push(struct copy_ctx *ctx, int id, char *path)
+{
+	struct copy_queue *q = &ctx->queues[id];
+
+	pthread_mutex_lock(&q->lock);
+	if (q->tail == q->size) {
+		size_t size = q->size ? q->size * 2 : 64;
+		char **paths;
+
+		paths = realloc(q->paths, size * sizeof(*paths));
+		if (!paths) {
+			pthread_mutex_unlock(&q->lock);
+			return -ENOMEM;
+		}
+		q->paths = paths;
+		q->size = size;
+	}
+	q->paths[q->tail++] = path;
+	pthread_mutex_unlock(&q->lock);
+
+	pthread_mutex_lock(&ctx->lock);
+	ctx->pending++;
+	ctx->generation++;
+	pthread_cond_broadcast(&ctx->cond);
+	pthread_mutex_unlock(&ctx->lock);
+
+	return 0;
+}
+
+static char *copy_take(struct copy_queue *q, bool steal)
+{
+	char *path = NULL;
+
+	pthread_mutex_lock(&q->lock);
+	if (q->head < q->tail) {
+		if (steal)
+			path = q->paths[q->head++];
+		else
+			path = q->paths[--q->tail];
+
+		if (q->head == q->tail)
+			q->head = q->tail = 0;
+	}
+	pthread_mutex_unlock(&q->lock);
+
+	return path;
+}
+
+static char *copy_next(struct copy_ctx *ctx, int id)
+{
+	char *path;
+
+	path = copy_take(&ctx->queues[id], false);
+	for (int i = 1; !path && i < ctx->nr_queues; i++)
+		path = copy_take(&ctx->queues[(id + i) % ctx->nr_queues], true);
+
+	return path;
+}
+
+static void copy_done(struct copy_ctx *ctx)
+{
+	pthread_mutex_lock(&ctx->lock);
+	if (--ctx->pending == 0)
+		pthread_cond_broadcast(&ctx->cond);
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+static int copy_range(int src_fd, int dest_fd, off_t off, off_t len)
+{
+	__do_free char *buf = NULL;
+	bool use_cfr = true;
+
+	while (len > 0) {
+		ssize_t bytes;
+
+#if HAVE_COPY_FILE_RANGE
+		if (use_cfr) {
+			loff_t in = off, out = off;
+
+			bytes = copy_file_range(src_fd, &in, dest_fd, &out, len, 0);
+			if (bytes < 0 && (errno == EXDEV || errno == ENOSYS ||
+					  errno == EINVAL || errno == EOPNOTSUPP)) {
+				use_cfr = false;
+				continue;
+			}
+		} else
+#endif
+		{
+			if (!buf) {
+				buf = malloc(COPY_BUF_SIZE);
+				if (!buf)
+					return -ENOMEM;
+			}
+
+			bytes = pread(src_fd, buf, MIN(len, COPY_BUF_SIZE), off);
+			if (bytes > 0)
+				bytes = lxc_pwrite_nointr(dest_fd, buf, bytes, off);
+		}
+		if (bytes < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		/* The file shrank while we were copying it. */
+		if (bytes == 0)
+			break;
+
+		off += bytes;
+		len -= bytes;
+	}
+
+	return 0;
+}
+
+/*
+ * Share the extents if the filesystem can (btrfs, XFS), otherwise copy only
+ * the data regions so that holes stay holes.
+ */
+static int copy_data(int src_fd, int dest_fd, off_t size, int flags)
+{
+	off_t off = 0;
+	int ret;
+
+	if (size == 0)
+		return 0;
+
+	if (ioctl(dest_fd, FICLONE, src_fd) == 0)
+		return 0;
+
+	if (flags & LXC_COPY_REFLINK)
+		return -errno;
+
+	while (off < size) {
+		off_t data, hole;
+
+		data = lseek(src_fd, off, SEEK_DATA);
+		if (data < 0) {
+			/* The rest of the file is a hole. */
+			if (errno == ENXIO)
+				break;
+
+			data = off;
+			hole = size;
+		} else {
+			hole = lseek(src_fd, data, SEEK_HOLE);
+			if (hole < 0)
+				hole = size;
+		}
+
+		ret = copy_range(src_fd, dest_fd, data, MIN(hole, size) - data);
+		if (ret < 0)
+			return ret;
+
+		off = hole;
+	}
+
+	if (ftruncate(dest_fd, size) < 0)
+		return -errno;
+
+	return 0;
+}
+
+/*
+ * Copy the extended attributes, which includes POSIX ACLs and file
+ * capabilities. Attributes the target filesystem or our privileges don't
+ * allow are counted and skipped.
+ */
+static int copy_xattrs(struct copy_ctx *ctx, int src_fd, int dest_fd,
+		       const char *src, const char *dest)
+{
+	__do_free char *names = NULL, *value = NULL;
+	ssize_t len, value_size = 0;
+	unsigned long failures = 0;
+
+	for (;;) {
+		len = src_fd >= 0 ? flistxattr(src_fd, NULL, 0) : llistxattr(src, NULL, 0);
+		if (len <= 0)
+			return (len == 0 || errno == ENOTSUP) ? 0 : -errno;
+
+		free_disarm(names);
+		names = malloc(len);
+		if (!names)
+			return -ENOMEM;
+
+		len = src_fd >= 0 ? flistxattr(src_fd, names, len) : llistxattr(src, names, len);
+		if (len >= 0)
+			break;
+		if (errno != ERANGE)
+			return -errno;
+	}
+
+	for (char *name = names; name < names + len; name += strlen(name) + 1) {
+		ssize_t size;
+		int ret;
+
+		size = src_fd >= 0 ? fgetxattr(src_fd, name, NULL, 0) : lgetxattr(src, name, NULL, 0);
+		if (size < 0)
+			continue;
+
+		if (size > value_size) {
+			free_disarm(value);
+			value = malloc(size);
+			if (!value)
+				return -ENOMEM;
+			value_size = size;
+		}
+
+		size = src_fd >= 0 ? fgetxattr(src_fd, name, value, size) : lgetxattr(src, name, value, size);
+		if (size < 0)
+			continue;
+
+		if (dest_fd >= 0)
+			ret = fsetxattr(dest_fd, name, value, size, 0);
+		else
+			ret = lsetxattr(dest, name, value, size, 0);
+		if (ret < 0)
+			failures++;
+	}
+
+	if (failures) {
+		pthread_mutex_lock(&ctx->lock);
+		ctx->xattr_failures += failures;
+		pthread_mutex_unlock(&ctx->lock);
+	}
+
+	return 0;
+}
+
+/* Ownership first: chown() clears the setuid bits and file capabilities. */
+static int copy_metadata(struct copy_ctx *ctx, int dfd, const char *dir,
+			 const char *name, const struct stat *st)
+{
+	__do_free char *rel = NULL, *src = NULL, *dest = NULL;
+	struct timespec times[2] = { st->st_atim, st->st_mtim };
+	int ret;
+
+	if (fchownat(dfd, name, st->st_uid, st->st_gid, AT_SYMLINK_NOFOLLOW) < 0)
+		return -errno;
+
+	rel = copy_path(dir, name);
+	src = must_make_path(ctx->src, rel, NULL);
+	dest = must_make_path(ctx->dest, rel, NULL);
+	ret = copy_xattrs(ctx, -EBADF, -EBADF, src, dest);
+	if (ret < 0)
+		return ret;
+
+	if (S_ISLNK(st->st_mode) || S_ISDIR(st->st_mode)) {
+		if (S_ISLNK(st->st_mode) &&
+		    utimensat(dfd, name, times, AT_SYMLINK_NOFOLLOW) < 0)
+			return -errno;
+
+		return 0;
+	}
+
+	if (fchmodat(dfd, name, st->st_mode & 07777, 0) < 0)
+		return -errno;
+
+	if (utimensat(dfd, name, times, AT_SYMLINK_NOFOLLOW) < 0)
+		return -errno;
+
+	return 0;
+}
+
+static int copy_file(struct copy_ctx *ctx, int sfd, int dfd, const char *name,
+		     const struct stat *st)
+{
+	__do_close int src_fd = -EBADF, dest_fd = -EBADF;
+	struct timespec times[2] = { st->st_atim, st->st_mtim };
+	int ret;
+
+	src_fd = openat(sfd, name, O_RDONLY | O_NOFOLLOW | O_NOCTTY | O_CLOEXEC);
+	if (src_fd < 0)
+		return -errno;
+
+	dest_fd = openat(dfd, name, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+	if (dest_fd < 0)
+		return -errno;
+
+	ret = copy_data(src_fd, dest_fd, st->st_size, ctx->flags);
+	if (ret < 0)
+		return ret;
+
+	if (fchown(dest_fd, st->st_uid, st->st_gid) < 0)
+		return -errno;
+
+	ret = copy_xattrs(ctx, src_fd, dest_fd, NULL, NULL);
+	if (ret < 0)
+		return ret;
+
+	if (fchmod(dest_fd, st->st_mode & 07777) < 0)
+		return -errno;
+
+	if (futimens(dest_fd, times) < 0)
+		return -errno;
+
+	return 0;
+}
+
+/*
+ * Copy a regular file, or link it to the copy of another link to the same
+ * inode. A later link waits until the first one has been copied.
+ */
+static int copy_regular(struct copy_ctx *ctx, int sfd, int dfd,
+			const char *dir, const char *name, const struct stat *st)
+{
+	struct copy_link *link;
+	unsigned int bucket;
+	int ret;
+
+	if (st->st_nlink < 2)
+		return copy_file(ctx, sfd, dfd, name, st);
+
+	bucket = (st->st_ino ^ st->st_dev) % COPY_LINK_BUCKETS;
+
+	pthread_mutex_lock(&ctx->link_lock);
+	for (link = ctx->links[bucket]; link; link = link->next)
+		if (link->dev == st->st_dev && link->ino == st->st_ino)
+			break;
+
+	if (link) {
+		while (!link->ready)
+			pthread_cond_wait(&ctx->link_cond, &ctx->link_lock);
+		pthread_mutex_unlock(&ctx->link_lock);
+
+		if (link->copied && linkat(ctx->dest_fd, link->path, dfd, name, 0) == 0)
+			return 0;
+
+		return copy_file(ctx, sfd, dfd, name, st);
+	}
+
+	link = zalloc(sizeof(*link));
+	if (link)
+		link->path = copy_path(dir, name);
+	if (!link || !link->path) {
+		pthread_mutex_unlock(&ctx->link_lock);
+		free(link);
+		return -ENOMEM;
+	}
+	link->dev = st->st_dev;
+	link->ino = st->st_ino;
+	link->next = ctx->links[bucket];
+	ctx->links[bucket] = link;
+	pthread_mutex_unlock(&ctx->link_lock);
+
+	ret = copy_file(ctx, sfd, dfd, name, st);
+
+	pthread_mutex_lock(&ctx->link_lock);
+	link->ready = true;
+	link->copied = ret == 0;
+	pthread_cond_broadcast(&ctx->link_cond);
+	pthread_mutex_unlock(&ctx->link_lock);
+
+	return ret;
+}
+
+static int copy_remove(struct copy_ctx *ctx, int dfd, const char *dir,
+		       const char *name, const struct stat *st)
+{
+	__do_free char *rel = NULL, *path = NULL;
+
+	if (!S_ISDIR(st->st_mode))
+		return unlinkat(dfd, name, 0) < 0 ? -errno : 0;
+
+	rel = copy_path(dir, name);
+	path = must_make_path(ctx->dest, rel, NULL);
+	if (lxc_rmdir_onedev(path, NULL) < 0)
+		return -ENOTEMPTY;
+
+	return 0;
+}
+
+static int copy_add_dir(struct copy_ctx *ctx, char *path, const struct stat *st)
+{
+	struct copy_dir *dir;
+
+	dir = malloc(sizeof(*dir));
+	if (!dir)
+		return -ENOMEM;
+
+	dir->path = path;
+	dir->mode = st->st_mode & 07777;
+	dir->times[0] = st->st_atim;
+	dir->times[1] = st->st_mtim;
+
+	pthread_mutex_lock(&ctx->lock);
+	dir->next = ctx->dirs;
+	ctx->dirs = dir;
+	pthread_mutex_unlock(&ctx->lock);
+
+	return 0;
+}
+
+static int copy_entry(struct copy_ctx *ctx, int id, int sfd, int dfd,
+		      const char *dir, const char *name)
+{
+	struct stat st, dst;
+	int ret;
+
+	if (fstatat(sfd, name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+		return -errno;
+
+	if (fstatat(dfd, name, &dst, AT_SYMLINK_NOFOLLOW) == 0 &&
+	    !(S_ISDIR(st.st_mode) && S_ISDIR(dst.st_mode))) {
+		ret = copy_remove(ctx, dfd, dir, name, &dst);
+		if (ret < 0)
+			return ret;
+	}
+
+	switch (st.st_mode & S_IFMT) {
+	case S_IFDIR: {
+		char *path;
+
+		if (mkdirat(dfd, name, 0700) < 0 && errno != EEXIST)
+			return -errno;
+
+		ret = copy_metadata(ctx, dfd, dir, name, &st);
+		if (ret < 0)
+			return ret;
+
+		path = copy_path(dir, name);
+		if (!path)
+			return -ENOMEM;
+
+		ret = copy_add_dir(ctx, path, &st);
+		if (ret < 0) {
+			free(path);
+			return ret;
+		}
+
+		/* The path is owned by ctx->dirs. */
+		return copy_push(ctx, id, path);
+	}
+	case S_IFREG:
+		return copy_regular(ctx, sfd, dfd, dir, name, &st);
+	case S_IFLNK: {
+		__do_free char *target = NULL;
+		ssize_t len;
+
+		target = malloc(st.st_size + 1);
+		if (!target)
+			return -ENOMEM;
+
+		len = readlinkat(sfd, name, target, st.st_size + 1);
+		if (len < 0)
+			return -errno;
+		if (len > st.st_size)
+			return -ENAMETOOLONG;
+		target[len] = '\0';
+
+		if (symlinkat(target, dfd, name) < 0)
+			return -errno;
+		break;
+	}
+	default:
+		if (mknodat(dfd, name, st.st_mode, st.st_rdev) < 0)
+			return -errno;
+		break;
+	}
+
+	return copy_metadata(ctx, dfd, dir, name, &st);
+}
+
+/* Remove what isn't in the source, like rsync's --delete. */
+static int copy_delete(struct copy_ctx *ctx, int sfd, int dfd, const char *dir)
+{
+	__do_closedir DIR *d = NULL;
+	struct dirent *de;
+	int fd, ret;
+
+	fd = fcntl(dfd, F_DUPFD_CLOEXEC, 0);
+	if (fd < 0)
+		return -errno;
+
+	d = fdopendir(fd);
+	if (!d) {
+		close(fd);
+		return -errno;
+	}
+
+	while ((de = readdir(d))) {
+		struct stat st;
+
+		if (strequal(de->d_name, ".") || strequal(de->d_name, ".."))
+			continue;
+
+		if (faccessat(sfd, de->d_name, F_OK, AT_SYMLINK_NOFOLLOW) == 0 || errno != ENOENT)
+			continue;
+
+		if (fstatat(dfd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+			return -errno;
+
+		ret = copy_remove(ctx, dfd, dir, de->d_name, &st);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+/* Failures are reported with the entry that failed, see copy_fail(). */
+static int copy_dir(struct copy_ctx *ctx, int id, const char *dir)
+{
+	__do_close int sfd = -EBADF, dfd = -EBADF;
+	__do_closedir DIR *d = NULL;
+	struct dirent *de;
+	int fd, ret;
+
+	sfd = openat(ctx->src_fd, dir, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (sfd < 0)
+		return -errno;
+
+	dfd = openat(ctx->dest_fd, dir, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (dfd < 0)
+		return -errno;
+
+	ret = copy_delete(ctx, sfd, dfd, dir);
+	if (ret < 0)
+		return ret;
+
+	fd = fcntl(sfd, F_DUPFD_CLOEXEC, 0);
+	if (fd < 0)
+		return -errno;
+
+	d = fdopendir(fd);
+	if (!d) {
+		close(fd);
+		return -errno;
+	}
+
+	while ((de = readdir(d))) {
+		if (strequal(de->d_name, ".") || strequal(de->d_name, ".."))
+			continue;
+
+		ret = copy_entry(ctx, id, sfd, dfd, dir, de->d_name);
+		if (ret < 0) {
+			copy_fail(ctx, -ret, dir, de->d_name);
+			return ret;
+		}
+
+		if (copy_failed(ctx))
+			break;
+	}
+
+	return 0;
+}
+
+static void *copy_worker(void *data)
+{
+	struct copy_worker *w = data;
+	struct copy_ctx *ctx = w->ctx;
+
+	for (;;) {
+		unsigned long generation;
+		bool done;
+		char *dir;
+
+		pthread_mutex_lock(&ctx->lock);
+		generation = ctx->generation;
+		pthread_mutex_unlock(&ctx->lock);
+
+		dir = copy_next(ctx, w->id);
+		if (dir) {
+			if (!copy_failed(ctx)) {
+				int ret;
+
+				ret = copy_dir(ctx, w->id, dir);
+				if (ret < 0)
+					copy_fail(ctx, -ret, dir, NULL);
+			}
+			copy_done(ctx);
+			continue;
+		}
+
+		/* Sleep until new work is queued or everything is copied. */
+		pthread_mutex_lock(&ctx->lock);
+		while (ctx->generation == generation && ctx->pending > 0 && !ctx->error)
+			pthread_cond_wait(&ctx->cond, &ctx->lock);
+		done = ctx->pending == 0 || ctx->error;
+		pthread_mutex_unlock(&ctx->lock);
+
+		if (done)
+			break;
+	}
+
+	return NULL;
+}
+
+static void copy_ctx_free(struct copy_ctx *ctx)
+{
+	for (int i = 0; i < COPY_LINK_BUCKETS; i++) {
+		struct copy_link *next;
+
+		for (struct copy_link *link = ctx->links[i]; link; link = next) {
+			next = link->next;
+			free(link->path);
+			free(link);
+		}
+	}
+
+	for (struct copy_dir *next, *dir = ctx->dirs; dir; dir = next) {
+		next = dir->next;
+		free(dir->path);
+		free(dir);
+	}
+
+	/* Only left over if the copy failed. The paths are owned by ctx->dirs. */
+	for (int i = 0; i < ctx->nr_queues; i++) {
+		free(ctx->queues[i].paths);
+		pthread_mutex_destroy(&ctx->queues[i].lock);
+	}
+	free(ctx->queues);
+
+	pthread_mutex_destroy(&ctx->lock);
+	pthread_cond_destroy(&ctx->cond);
+	pthread_mutex_destroy(&ctx->link_lock);
+	pthread_cond_destroy(&ctx->link_cond);
+	free(ctx->error_path);
+	close_prot_errno_disarm(ctx->src_fd);
+	close_prot_errno_disarm(ctx->dest_fd);
+}
+
+int lxc_copy_tree(const char *src, const char *dest, int threads, int flags)
+{
+	struct copy_ctx ctx = {
+		.src		= src,
+		.dest		= dest,
+		.src_fd		= -EBADF,
+		.dest_fd	= -EBADF,
+		.flags		= flags,
+		.lock		= PTHREAD_MUTEX_INITIALIZER,
+		.cond		= PTHREAD_COND_INITIALIZER,
+		.link_lock	= PTHREAD_MUTEX_INITIALIZER,
+		.link_cond	= PTHREAD_COND_INITIALIZER,
+	};
+	pthread_t tids[COPY_MAX_THREADS];
+	struct copy_worker workers[COPY_MAX_THREADS];
+	struct stat st;
+	int nr_threads = 0, ret = -1;
+	char *root;
+
+	if (threads <= 0)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	threads = MAX(1, MIN(threads, COPY_MAX_THREADS));
+
+	ctx.src_fd = open(src, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (ctx.src_fd < 0) {
+		SYSERROR("Failed to open \"%s\"", src);
+		goto out;
+	}
+
+	if (fstat(ctx.src_fd, &st) < 0) {
+		SYSERROR("Failed to stat \"%s\"", src);
+		goto out;
+	}
+
+	if (mkdir(dest, 0700) < 0 && errno != EEXIST) {
+		SYSERROR("Failed to create \"%s\"", dest);
+		goto out;
+	}
+
+	ctx.dest_fd = open(dest, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (ctx.dest_fd < 0) {
+		SYSERROR("Failed to open \"%s\"", dest);
+		goto out;
+	}
+
+	ctx.queues = zalloc(threads * sizeof(*ctx.queues));
+	if (!ctx.queues)
+		goto out;
+	ctx.nr_queues = threads;
+	for (int i = 0; i < threads; i++)
+		pthread_mutex_init(&ctx.queues[i].lock, NULL);
+
+	/* Like rsync with a trailing slash the root itself is copied too. */
+	if (fchown(ctx.dest_fd, st.st_uid, st.st_gid) < 0 ||
+	    copy_xattrs(&ctx, ctx.src_fd, ctx.dest_fd, NULL, NULL) < 0) {
+		SYSERROR("Failed to copy ownership of \"%s\"", src);
+		goto out;
+	}
+
+	root = strdup(".");
+	if (!root || copy_add_dir(&ctx, root, &st) < 0) {
+		free(root);
+		goto out;
+	}
+
+	if (copy_push(&ctx, 0, root) < 0)
+		goto out;
+
+	/* The calling thread is a worker too. */
+	for (int i = 0; i < threads; i++)
+		workers[i] = (struct copy_worker){ .ctx = &ctx, .id = i };
+
+	for (; nr_threads < threads - 1; nr_threads++)
+		if (pthread_create(&tids[nr_threads], NULL, copy_worker, &workers[nr_threads + 1]))
+			break;
+
+	copy_worker(&workers[0]);
+
+	for (int i = 0; i < nr_threads; i++)
+		pthread_join(tids[i], NULL);
+
+	if (ctx.error) {
+		errno = ctx.error;
+		SYSERROR("Failed to copy \"%s\" from \"%s\" to \"%s\"",
+			 ctx.error_path ?: "", src, dest);
+		goto out;
+	}
+
+	/* Deepest directories were recorded last. */
+	for (struct copy_dir *dir = ctx.dirs; dir; dir = dir->next) {
+		if (fchmodat(ctx.dest_fd, dir->path, dir->mode, 0) < 0 ||
+		    utimensat(ctx.dest_fd, dir->path, dir->times, AT_SYMLINK_NOFOLLOW) < 0) {
+			SYSERROR("Failed to set mode and times of \"%s/%s\"", dest, dir->path);
+			goto out;
+		}
+	}
+
+	if (ctx.xattr_failures)
+		WARN("Failed to copy %lu extended attributes from \"%s\" to \"%s\"",
+		     ctx.xattr_failures, src, dest);
+
+	TRACE("Copied \"%s\" to \"%s\" using %d threads", src, dest, nr_threads + 1);
+	ret = 0;
+
+out:
+	copy_ctx_free(&ctx);
+	return ret;
+}
+
+/*
+ * Copy @src into @dest with lxc_copy_tree() and fall back to exec'ing rsync.
+ * Callers run this in a child that is expected to exec, so a successful copy
+ * exits the child.
+ */
 int lxc_rsync_exec(const char *src, const char *dest)
 {
 	int ret;
@@ -61,6 +909,10 @@ int lxc_rsync_exec(const char *src, const char *dest)
 	s[l - 2] = '/';
 	s[l - 1] = '\0';
 
+	if (lxc_copy_tree(src, dest, 0, 0) == 0)
+		_exit(EXIT_SUCCESS);
+
+	WARN("Falling back to rsync to copy \"%s\" into \"%s\"", src, dest);
 	execlp("rsync", "rsync", "-aHXS", "--delete", s, dest, (char *)NULL);
 	free(s);
 	return -1;
@@ -104,6 +956,15 @@ int lxc_rsync(struct rsync_data *data)
 	src = lxc_storage_get_path(orig->dest, orig->type);
 	dest = lxc_storage_get_path(new->dest, new->type);
 
+	/* Don't fall back to copying the data, see storage_copy(). */
+	if (data->flags & LXC_COPY_REFLINK) {
+		if (lxc_copy_tree(src, dest, 0, LXC_COPY_REFLINK) == 0)
+			_exit(EXIT_SUCCESS);
+
+		ERROR("Failed to reflink \"%s\" into \"%s\"", src, dest);
+		return -1;
+	}
+
 	ret = lxc_rsync_exec(src, dest);
 	if (ret < 0) {
 		ERROR("Failed to rsync from \"%s\" into \"%s\"", src, dest);
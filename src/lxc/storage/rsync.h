@@ -7,9 +7,14 @@
 
 #include "compiler.h"
 
+/* Fail instead of copying the data of a file that can't be reflinked. */
+#define LXC_COPY_REFLINK (1 << 0)
+
 struct rsync_data {
 	struct lxc_storage *orig;
 	struct lxc_storage *new;
+	/* LXC_COPY_* flags */
+	int flags;
 };
 
 struct rsync_data_char {
@@ -21,6 +26,12 @@ struct rsync_data_char {
 __hidden extern int lxc_rsync_exec_wrapper(void *data);
 __hidden extern int lxc_storage_rsync_exec_wrapper(void *data);
 __hidden extern int lxc_rsync_exec(const char *src, const char *dest);
+/*
+ * Copy the contents of @src into @dest like "rsync -aHXS --delete src/ dest"
+ * using up to @threads threads, or one per cpu if @threads is 0.
+ */
+__hidden extern int lxc_copy_tree(const char *src, const char *dest, int threads,
+				  int flags);
 __hidden extern int lxc_rsync(struct rsync_data *data);
 
 #endif /* __LXC_RSYNC_H */
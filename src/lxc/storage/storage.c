@@ -392,6 +392,17 @@ struct lxc_storage *storage_copy(struct lxc_container *c, const char *cname,
 		}
 	}
 
+	/* If the caller requested maybe_snapshot of a directory and the
+	 * filesystem supports reflinks, then create a dir snapshot sharing the
+	 * extents of all files with the original.
+	 */
+	if (maybe_snap && !strcmp(orig->type, "dir") &&
+	    (!bdevtype || !strcmp(bdevtype, "dir")) &&
+	    dir_can_reflink(lxc_storage_get_path(orig->src, orig->type), lxcpath)) {
+		bdevtype = "dir";
+		snap = true;
+	}
+
 	/* Special case for snapshot. If the caller requested maybe_snapshot and
 	 * keepbdevtype and the backing store is directory, then proceed with a
 	 * a copy clone rather than returning error.
@@ -510,12 +521,15 @@ struct lxc_storage *storage_copy(struct lxc_container *c, const char *cname,
 		}
 	}
 
-	if (snap)
+	/* A dir snapshot is a copy that must reflink every file. */
+	if (snap && strcmp(new->type, "dir"))
 		goto on_success;
 
 	/* rsync the contents from source to target */
 	data.orig = orig;
 	data.new = new;
+	if (snap)
+		data.flags = LXC_COPY_REFLINK;
 	if (am_guest_unpriv())
 		ret = userns_exec_full(c->lxc_conf,
 				       lxc_storage_rsync_exec_wrapper, &data,
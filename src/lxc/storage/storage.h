@@ -45,6 +45,7 @@
 #define DEFAULT_FSTYPE "ext4"
 
 #define LXC_STORAGE_INTERNAL_OVERLAY_RESTORE  (1 << 6)
+#define LXC_STORAGE_INTERNAL_TMPFS_UPPER      (1 << 7)
 
 struct lxc_storage;
 
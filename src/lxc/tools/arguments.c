@@ -280,7 +280,8 @@ extern int lxc_arguments_parse(struct lxc_arguments *args, int argc,
 	}
 
 	/* Check the command options */
-	if (!args->name && strncmp(args->progname, "lxc-autostart", strlen(args->progname)) != 0
+	if (!args->name && !args->groups &&
+	    strncmp(args->progname, "lxc-autostart", strlen(args->progname)) != 0
 	                && strncmp(args->progname, "lxc-unshare", strlen(args->progname)) != 0) {
 	    //未指定名称，针对lxc-autostart,lxc-unshare使用argv待解析的第一个参数做为name
 		if (args->argv) {
@@ -86,6 +86,9 @@ struct lxc_arguments {
 	int all;
 	int ignore_auto;
 	int list;
+	int jobs;
+	int ready;
+	int timings;
 	char *groups; /* also used by lxc-ls */
 
 	/* lxc-snapshot and lxc-copy */
@@ -0,0 +1,180 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lxc/lxccontainer.h>
+
+#include "arguments.h"
+#include "config.h"
+#include "freeze_utils.h"
+#include "log.h"
+#include "memory_utils.h"
+#include "string_utils.h"
+
+lxc_log_define(freeze_utils, lxc);
+
+/* Check whether @c is in one of @groups. */
+static bool in_groups(struct lxc_container *c, char **groups)
+{
+	__do_free char *value = NULL;
+	char *token;
+	int len;
+
+	len = c->get_config_item(c, "lxc.group", NULL, 0);
+	if (len <= 0)
+		return false;
+
+	value = malloc(len + 1);
+	if (!value)
+		return false;
+
+	if (c->get_config_item(c, "lxc.group", value, len + 1) != len)
+		return false;
+
+	lxc_iterate_parts(token, value, "\n")
+		for (char **group = groups; *group; group++)
+			if (strequal(token, *group))
+				return true;
+
+	return false;
+}
+
+static bool add_container(struct lxc_container ***containers, int *count,
+			  struct lxc_container *c)
+{
+	struct lxc_container **new;
+
+	for (int i = 0; i < *count; i++) {
+		if (strequal((*containers)[i]->name, c->name)) {
+			lxc_container_put(c);
+			return true;
+		}
+	}
+
+	new = realloc(*containers, sizeof(*new) * (*count + 1));
+	if (!new) {
+		lxc_container_put(c);
+		return false;
+	}
+
+	new[(*count)++] = c;
+	*containers = new;
+	return true;
+}
+
+void put_containers(struct lxc_container **containers, int count)
+{
+	for (int i = 0; i < count; i++)
+		lxc_container_put(containers[i]);
+	free(containers);
+}
+
+int select_containers(const struct lxc_arguments *args,
+		      struct lxc_container ***ret)
+{
+	struct lxc_container **containers = NULL;
+	const char *lxcpath = args->lxcpath[0];
+	int count = 0;
+
+	for (int i = -1; i < args->argc; i++) {
+		const char *name = i < 0 ? args->name : args->argv[i];
+		struct lxc_container *c;
+
+		if (!name)
+			continue;
+
+		c = lxc_container_new(name, lxcpath);
+		if (!c) {
+			ERROR("No such container: %s:%s", lxcpath, name);
+			put_containers(containers, count);
+			return -1;
+		}
+
+		if (!add_container(&containers, &count, c)) {
+			put_containers(containers, count);
+			return -1;
+		}
+	}
+
+	if (args->groups) {
+		__do_free struct lxc_container **active = NULL;
+		char **groups;
+		int nr_active;
+
+		groups = lxc_string_split_and_trim(args->groups, ',');
+		if (!groups) {
+			put_containers(containers, count);
+			return -1;
+		}
+
+		nr_active = list_active_containers(lxcpath, NULL, &active);
+		for (int i = 0; i < nr_active; i++) {
+			if (!in_groups(active[i], groups)) {
+				lxc_container_put(active[i]);
+				continue;
+			}
+
+			if (!add_container(&containers, &count, active[i])) {
+				for (i++; i < nr_active; i++)
+					lxc_container_put(active[i]);
+				nr_active = -1;
+			}
+		}
+
+		lxc_free_array((void **)groups, free);
+		if (nr_active < 0) {
+			put_containers(containers, count);
+			return -1;
+		}
+	}
+
+	*ret = containers;
+	return count;
+}
+
+int freeze_many(const struct lxc_arguments *args, bool freeze)
+{
+	struct lxc_container **containers = NULL;
+	__do_free int *results = NULL;
+	const char *verb = freeze ? "freeze" : "unfreeze";
+	int count, nr_done = 0;
+
+	if (args->rcfile) {
+		ERROR("The rcfile can only be used with a single container");
+		return -1;
+	}
+
+	count = select_containers(args, &containers);
+	if (count < 0)
+		return -1;
+
+	for (int i = 0; i < count; i++) {
+		if (!containers[i]->may_control(containers[i])) {
+			ERROR("Insufficent privileges to control %s:%s", args->lxcpath[0], containers[i]->name);
+			goto out;
+		}
+	}
+
+	results = malloc(sizeof(*results) * (count ?: 1));
+	if (!results)
+		goto out;
+
+	if (freeze)
+		nr_done = lxc_containers_freeze(containers, count, args->timeout, results);
+	else
+		nr_done = lxc_containers_unfreeze(containers, count, args->timeout, results);
+	for (int i = 0; i < count; i++)
+		if (results[i] < 0)
+			ERROR("Failed to %s %s:%s: %s", verb, args->lxcpath[0],
+			      containers[i]->name, strerror(-results[i]));
+
+out:
+	put_containers(containers, count);
+	return nr_done == count ? 0 : -1;
+}
@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#ifndef __LXC_FREEZE_UTILS_H
+#define __LXC_FREEZE_UTILS_H
+
+#include <stdbool.h>
+
+#include <lxc/lxccontainer.h>
+
+#include "arguments.h"
+#include "compiler.h"
+
+/*
+ * Collect the containers named in @args and the running members of the
+ * groups in @args->groups. Returns the number of containers stored in @ret or
+ * -1 on error.
+ */
+__hidden extern int select_containers(const struct lxc_arguments *args,
+				      struct lxc_container ***ret);
+
+__hidden extern void put_containers(struct lxc_container **containers, int count);
+
+/*
+ * Freeze or unfreeze all containers selected by @args within @args->timeout
+ * seconds. Returns 0 if all of them were handled and -1 otherwise.
+ */
+__hidden extern int freeze_many(const struct lxc_arguments *args, bool freeze);
+
+#endif /* __LXC_FREEZE_UTILS_H */
@@ -3,9 +3,14 @@
 #ifndef _GNU_SOURCE
 #define _GNU_SOURCE 1
 #endif
+#include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <lxc/lxccontainer.h>
@@ -50,6 +55,16 @@ static int my_parser(struct lxc_arguments *args, int c, char *arg)
 		if (lxc_safe_long(arg, &args->timeout) < 0)
 			return -1;
 		break;
+	case 'j':
+		if (lxc_safe_int(arg, &args->jobs) < 0 || args->jobs <= 0)
+			return -1;
+		break;
+	case 'R':
+		args->ready = 1;
+		break;
+	case 'T':
+		args->timings = 1;
+		break;
 	}
 	return 0;
 }
@@ -63,6 +78,9 @@ static const struct option my_longopts[] = {
 	{"ignore-auto", no_argument, 0, 'A'},
 	{"groups", required_argument, 0, 'g'},
 	{"timeout", required_argument, 0, 't'},
+	{"jobs", required_argument, 0, 'j'},
+	{"ready", no_argument, 0, 'R'},
+	{"timings", no_argument, 0, 'T'},
 	{"help", no_argument, 0, 'h'},
 	LXC_COMMON_OPTIONS
 };
@@ -82,7 +100,13 @@ Options:\n\
   -a, --all         list all auto-started containers (ignore groups)\n\
   -A, --ignore-auto ignore lxc.start.auto and select all matching containers\n\
   -g, --groups      list of groups (comma separated) to select\n\
-  -t, --timeout=T   wait T seconds before hard-stopping\n",
+  -t, --timeout=T   wait T seconds before hard-stopping\n\
+\n\
+  -j, --jobs=N      start up to N containers of the same lxc.start.order\n\
+                    at once\n\
+  -R, --ready       wait up to the timeout for each started container to\n\
+                    be RUNNING before starting the next order\n\
+  -T, --timings     print how long each container took to start\n",
 	.options  = my_longopts,
 	.parser   = my_parser,
 	.checker  = NULL,
@@ -301,11 +325,163 @@ static int toss_list(struct lxc_list *c_groups_list)
 	return 1;
 }
 
+/* A container waiting to be started by the parallel scheduler. */
+struct start_job {
+	struct lxc_container *c;
+	int order;
+	int delay;
+	/* Only wait for a container someone else is starting. */
+	bool wait_only;
+	pid_t pid;
+	int64_t begin;
+	int64_t end;
+	bool failed;
+};
+
+static int64_t now_msec(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static bool add_job(struct start_job **jobs, int *nr_jobs,
+		    struct lxc_container *c, bool wait_only)
+{
+	struct start_job *new;
+
+	new = realloc(*jobs, sizeof(*new) * (*nr_jobs + 1));
+	if (!new)
+		return false;
+
+	new[*nr_jobs] = (struct start_job){
+		.c		= c,
+		.order		= get_config_integer(c, "lxc.start.order"),
+		.delay		= get_config_integer(c, "lxc.start.delay"),
+		.wait_only	= wait_only,
+		.pid		= -1,
+	};
+	(*nr_jobs)++;
+	*jobs = new;
+	return true;
+}
+
+/* Start the container in a worker process so that several can start at once. */
+static pid_t spawn_job(struct start_job *job)
+{
+	struct lxc_container *c = job->c;
+	pid_t pid;
+
+	job->begin = now_msec();
+
+	pid = fork();
+	if (pid != 0)
+		return pid;
+
+	if (!job->wait_only && !c->start(c, 0, NULL))
+		_exit(EXIT_FAILURE);
+
+	if (my_args.ready && !c->wait(c, "RUNNING", my_args.timeout))
+		_exit(EXIT_FAILURE);
+
+	_exit(EXIT_SUCCESS);
+}
+
+static void reap_job(struct start_job *jobs, int nr_jobs, pid_t pid, int status)
+{
+	for (int i = 0; i < nr_jobs; i++) {
+		if (jobs[i].pid != pid)
+			continue;
+
+		jobs[i].end = now_msec();
+		jobs[i].failed = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+		jobs[i].pid = -1;
+		if (jobs[i].failed)
+			ERROR("Error starting container: %s", jobs[i].c->name);
+		return;
+	}
+}
+
+/*
+ * Start @jobs, which are sorted by lxc.start.order, with up to my_args.jobs
+ * workers. All containers of an order are started before the next order is
+ * begun. The longest lxc.start.delay of an order is waited once after it.
+ */
+static int run_jobs(struct start_job *jobs, int nr_jobs)
+{
+	int64_t started = now_msec();
+	int failed = 0;
+
+	for (int first = 0, last; first < nr_jobs; first = last) {
+		int next, running = 0, delay = 0;
+
+		for (last = first; last < nr_jobs && jobs[last].order == jobs[first].order; last++)
+			delay = jobs[last].delay > delay ? jobs[last].delay : delay;
+
+		for (next = first; next < last || running > 0;) {
+			int status;
+			pid_t pid;
+
+			while (next < last && running < my_args.jobs) {
+				jobs[next].pid = spawn_job(&jobs[next]);
+				if (jobs[next].pid < 0) {
+					SYSERROR("Failed to fork worker for container %s", jobs[next].c->name);
+					jobs[next].end = jobs[next].begin;
+					jobs[next].failed = true;
+				} else {
+					running++;
+				}
+				next++;
+			}
+
+			if (running == 0)
+				continue;
+
+			pid = waitpid(-1, &status, 0);
+			if (pid < 0) {
+				if (errno == EINTR)
+					continue;
+
+				SYSERROR("Failed to wait for workers");
+				return nr_jobs;
+			}
+
+			reap_job(jobs + first, last - first, pid, status);
+			running--;
+		}
+
+		if (delay > 0 && last < nr_jobs)
+			sleep(delay);
+	}
+
+	if (my_args.timings)
+		printf("%-20s %8s %10s %10s %s\n", "NAME", "ORDER", "START(ms)", "TIME(ms)", "RESULT");
+
+	for (int i = 0; i < nr_jobs; i++) {
+		if (jobs[i].failed)
+			failed++;
+
+		if (my_args.timings)
+			printf("%-20s %8d %10lld %10lld %s\n", jobs[i].c->name,
+			       jobs[i].order, (long long)(jobs[i].begin - started),
+			       (long long)(jobs[i].end - jobs[i].begin),
+			       jobs[i].failed ? "failed" : jobs[i].wait_only ? "waited" : "started");
+	}
+
+	if (my_args.timings)
+		fflush(stdout);
+
+	return failed;
+}
+
 int main(int argc, char *argv[])
 {
 	int count = 0, failed = 0, i = 0, ret = 0;
 	struct lxc_list *cmd_group;
 	struct lxc_container **containers = NULL;
+	struct start_job *jobs = NULL;
+	int nr_jobs = 0;
 	struct lxc_list **c_groups_lists = NULL;
 	struct lxc_log log;
 
@@ -325,7 +501,7 @@ int main(int argc, char *argv[])
 			exit(EXIT_FAILURE);
 	}
 
-	count = list_defined_containers(my_args.lxcpath[0], NULL, &containers);
+	count = list_defined_containers_parallel(my_args.lxcpath[0], 0, NULL, &containers);
 
 	if (count < 0)
 		exit(EXIT_FAILURE);
@@ -339,6 +515,10 @@ int main(int argc, char *argv[])
 	if (cmd_groups_list && my_args.all)
 		ERROR("Specifying -a (all) with -g (groups) doesn't make sense. All option overrides");
 
+	/* Readiness and timings are handled by the scheduler. */
+	if ((my_args.ready || my_args.timings) && my_args.jobs == 0)
+		my_args.jobs = 1;
+
 	/* We need a default cmd_groups_list even for the -a
 	 * case in order to force a pass through the loop for
 	 * the NULL group.  This, someday, could be taken from
@@ -357,6 +537,7 @@ int main(int argc, char *argv[])
 		 */
 		for (i = 0; i < count; i++) {
 			struct lxc_container *c = containers[i];
+			bool queued = false;
 
 			if (!c)
 				/* Skip - must have been already processed */
@@ -458,6 +639,13 @@ int main(int argc, char *argv[])
 						       get_config_integer(c, "lxc.start.delay"));
 						fflush(stdout);
 					}
+					else if (my_args.jobs > 0) {
+						queued = add_job(&jobs, &nr_jobs, c, false);
+						if (!queued) {
+							failed++;
+							ERROR("Error queueing container: %s", c->name);
+						}
+					}
 					else {
 						if (!c->start(c, 0, NULL)) {
 							failed++;
@@ -466,15 +654,21 @@ int main(int argc, char *argv[])
 							sleep(get_config_integer(c, "lxc.start.delay"));
 						}
 					}
+				} else if (my_args.jobs > 0 && my_args.ready && !my_args.list &&
+					   strequal(c->state(c), "STARTING")) {
+					queued = add_job(&jobs, &nr_jobs, c, true);
 				}
 			}
 
 			/*
 			 * If we get this far and we haven't hit any skip "continue"
 			 * then we're done with this container...  We can dump any
-			 * c_groups_list and the container itself.
+			 * c_groups_list and the container itself. Queued containers
+			 * are released once they have been started.
 			 */
-			if (lxc_container_put(c) > 0)
+			if (queued)
+				containers[i] = NULL;
+			else if (lxc_container_put(c) > 0)
 				containers[i] = NULL;
 
 			if (c_groups_lists) {
@@ -483,6 +677,15 @@ int main(int argc, char *argv[])
 			}
 		}
 
+		if (nr_jobs > 0) {
+			failed += run_jobs(jobs, nr_jobs);
+
+			for (i = 0; i < nr_jobs; i++)
+				lxc_container_put(jobs[i].c);
+			free(jobs);
+			jobs = NULL;
+			nr_jobs = 0;
+		}
 	}
 
 	/* clean up any lingering detritus, if container exists here
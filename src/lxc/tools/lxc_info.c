@@ -5,6 +5,7 @@
 #endif
 #include <libgen.h>
 #include <limits.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -15,8 +16,10 @@
 #include <lxc/lxccontainer.h>
 
 #include "arguments.h"
+#include "commands.h"
 #include "config.h"
 #include "log.h"
+#include "start.h"
 #include "utils.h"
 
 lxc_log_define(lxc_info, lxc);
@@ -25,6 +28,7 @@ static bool ips;
 static bool state;
 static bool pid;
 static bool stats;
+static bool timings;
 static bool humanize = true;
 static char **key = NULL;
 static int nr_keys = 0;
@@ -48,6 +52,7 @@ static int my_parser(struct lxc_arguments *args, int c, char *arg)
 	case 's': state = true; filter_count += 1; break;
 	case 'p': pid = true; filter_count += 1; break;
 	case 'S': stats = true; filter_count += 5; break;
+	case 'T': timings = true; filter_count += 1; break;
 	case 'H': humanize = false; break;
 	}
 	return 0;
@@ -59,6 +64,7 @@ static const struct option my_longopts[] = {
 	{"state", no_argument, 0, 's'},
 	{"pid", no_argument, 0, 'p'},
 	{"stats", no_argument, 0, 'S'},
+	{"timings", no_argument, 0, 'T'},
 	{"no-humanize", no_argument, 0, 'H'},
 	LXC_COMMON_OPTIONS,
 };
@@ -76,6 +82,7 @@ Options :\n\
   -i, --ips             shows the IP addresses\n\
   -p, --pid             shows the process id of the init container\n\
   -S, --stats           shows usage stats\n\
+  -T, --timings         shows how long each phase of the last start took\n\
   -H, --no-humanize     shows stats as raw numbers, not humanized\n\
   -s, --state           shows the state of the container\n\
   --rcfile=FILE         Load configuration file FILE\n",
@@ -279,6 +286,38 @@ static void print_info_msg_str(const char *k, const char *value)
 	fflush(stdout);
 }
 
+static void print_timings(struct lxc_container *c)
+{
+	struct lxc_start_timings t;
+	int ret;
+
+	ret = lxc_cmd_get_start_timings(c->name, c->config_path, &t);
+	if (ret < 0) {
+		fprintf(stderr, "No start timings recorded for %s\n", c->name);
+		return;
+	}
+
+	for (int i = 0; i < LXC_START_PHASE_MAX; i++) {
+		if (!t.phases[i])
+			continue;
+
+		if (humanize)
+			printf("%-24s %" PRIu64 ".%03" PRIu64 " ms\n",
+			       lxc_start_phase_name(i), t.phases[i] / 1000000,
+			       (t.phases[i] / 1000) % 1000);
+		else
+			printf("%s %" PRIu64 "\n", lxc_start_phase_name(i),
+			       t.phases[i]);
+	}
+
+	if (humanize)
+		printf("%-24s %" PRIu64 ".%03" PRIu64 " ms\n", "total",
+		       t.total / 1000000, (t.total / 1000) % 1000);
+	else
+		printf("total %" PRIu64 "\n", t.total);
+	fflush(stdout);
+}
+
 static int print_info(const char *name, const char *lxcpath)
 {
 	int i;
@@ -320,7 +359,7 @@ static int print_info(const char *name, const char *lxcpath)
 		return -1;
 	}
 
-	if (!state && !pid && !ips && !stats && nr_keys <= 0) {
+	if (!state && !pid && !ips && !stats && !timings && nr_keys <= 0) {
 		state = pid = ips = stats = true;
 		print_info_msg_str("Name:", c->name);
 	}
@@ -352,6 +391,9 @@ static int print_info(const char *name, const char *lxcpath)
 				}
 			}
 		}
+
+		if (timings)
+			print_timings(c);
 	}
 
 	if (stats) {
@@ -3,7 +3,9 @@
 #ifndef _GNU_SOURCE
 #define _GNU_SOURCE 1
 #endif
+#include <arpa/inet.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <limits.h>
 #include <regex.h>
@@ -21,10 +23,15 @@
 
 #include <lxc/lxccontainer.h>
 
+#include "../../include/netns_ifaddrs.h"
 #include "arguments.h"
+#include "cgroups/cgroup.h"
 #include "config.h"
+#include "file_utils.h"
 #include "log.h"
+#include "macro.h"
 #include "memory_utils.h"
+#include "network.h"
 #include "utils.h"
 
 lxc_log_define(lxc_ls, lxc);
@@ -45,6 +52,20 @@ lxc_log_define(lxc_ls, lxc);
 #  define SOCK_CLOEXEC                02000000
 #endif
 
+/* Config items retrieved together with the state of running containers. */
+enum {
+	LS_INFO_GROUP,
+	LS_INFO_START_AUTO,
+	LS_INFO_IDMAP,
+	LS_INFO_MAX,
+};
+
+static const char *ls_info_keys[LS_INFO_MAX] = {
+	[LS_INFO_GROUP]		= "lxc.group",
+	[LS_INFO_START_AUTO]	= "lxc.start.auto",
+	[LS_INFO_IDMAP]		= "lxc.idmap",
+};
+
 /* Store container info. */
 struct ls {
 	char *name;
@@ -89,8 +110,17 @@ static int ls_get(struct ls **m, size_t *size, const struct lxc_arguments *args,
 static char *ls_get_cgroup_item(struct lxc_container *c, const char *item);
 static char *ls_get_config_item(struct lxc_container *c, const char *item,
 		bool running);
+static char *ls_format_groups(char *val);
 static char *ls_get_groups(struct lxc_container *c, bool running);
 static char *ls_get_ips(struct lxc_container *c, const char *inet);
+
+/*
+ * Fast paths for running containers which don't fork. They return false if
+ * the information has to be retrieved through the API instead.
+ */
+static bool ls_get_net(struct ls *l);
+static bool ls_get_memory(const char *cgroup, struct ls *l);
+static void ls_free_info(struct lxc_running_info *info);
 static int ls_recv_str(int fd, char **buf);
 static int ls_send_str(int fd, const char *buf);
 
@@ -339,6 +369,7 @@ static int ls_get(struct ls **m, size_t *size, const struct lxc_arguments *args,
 
 	int num = 0, ret = -1;
 	char **containers = NULL;
+	struct lxc_running_info info = {};
 	/* If we, at some level of nesting, encounter a stopped container but
 	 * want to retrieve nested containers we need to build an absolute path
 	 * beginning from it. Initially, at nesting level 0, basepath will
@@ -361,7 +392,7 @@ static int ls_get(struct ls **m, size_t *size, const struct lxc_arguments *args,
 		num = list_active_containers(path, &containers, NULL);
 	else
 		/*列出所有container名称*/
-		num = list_all_containers(path, &containers, NULL);
+		num = list_all_containers_parallel(path, 0, &containers, NULL);
 	if (num == -1) {
 		num = 0;
 		goto out;
@@ -406,14 +437,28 @@ static int ls_get(struct ls **m, size_t *size, const struct lxc_arguments *args,
 		if (args->ls_defined && !c->is_defined(c))
 			goto put_and_next;
 
+		/* Fetch the state and everything else we need from a running
+		 * container with a single command. */
+		info = (struct lxc_running_info){
+			.flags		= LXC_INFO_STATE | LXC_INFO_INIT_PID |
+					  LXC_INFO_LIMIT_CGROUP,
+			.nr_keys	= LS_INFO_MAX,
+			.keys		= ls_info_keys,
+		};
+		if (!c->get_running_info(c, &info) || !(info.flags & LXC_INFO_STATE))
+			ls_free_info(&info);
+
 		/* This does not allocate memory so no worries about freeing it
 		 * when we goto next or out. */
-		const char *state_tmp = c->state(c);
+		const char *state_tmp = info.values ? info.state : c->state(c);
 		if (!state_tmp)
 			state_tmp = "UNKNOWN";
 
+		/* Same as c->is_running(). */
+		bool running = strcmp(state_tmp, "STOPPED") != 0;
+
 		/*container未运行中，则跳过*/
-		if (args->ls_running && !c->is_running(c))
+		if (args->ls_running && !running)
 			goto put_and_next;
 
 		if (args->ls_frozen && !args->ls_active && strcmp(state_tmp, "FROZEN"))
@@ -422,9 +467,11 @@ static int ls_get(struct ls **m, size_t *size, const struct lxc_arguments *args,
 		if (args->ls_stopped && strcmp(state_tmp, "STOPPED"))
 			goto put_and_next;
 
-		bool running = c->is_running(c);
-
-		char *grp_tmp = ls_get_groups(c, running);
+		char *grp_tmp;
+		if (info.values)
+			grp_tmp = ls_format_groups(move_ptr(info.values[LS_INFO_GROUP]));
+		else
+			grp_tmp = ls_get_groups(c, running);
 		if (!ls_has_all_grps(grp_tmp, grps_must, grps_must_len)) {
 			free(grp_tmp);
 			goto put_and_next;
@@ -466,7 +513,10 @@ static int ls_get(struct ls **m, size_t *size, const struct lxc_arguments *args,
 			if (!l->state)
 				goto put_and_next;
 
-			tmp = ls_get_config_item(c, "lxc.start.auto", running);
+			if (info.values)
+				tmp = move_ptr(info.values[LS_INFO_START_AUTO]);
+			else
+				tmp = ls_get_config_item(c, "lxc.start.auto", running);
 			if (tmp) {
 				unsigned int astart = 0;
 				if (lxc_safe_uint(tmp, &astart) < 0)
@@ -480,28 +530,39 @@ static int ls_get(struct ls **m, size_t *size, const struct lxc_arguments *args,
 			if (running) {
 				char *val;
 
-				l->init = c->init_pid(c);
+				if (info.values && (info.flags & LXC_INFO_INIT_PID))
+					l->init = info.init_pid;
+				else
+					l->init = c->init_pid(c);
 				if (l->init <= 0)
 					goto put_and_next;
 
-				l->interface = ls_get_interface(c);
+				if (!ls_get_net(l)) {
+					l->interface = ls_get_interface(c);
 
-				l->ipv4 = ls_get_ips(c, "inet");
+					l->ipv4 = ls_get_ips(c, "inet");
 
-				l->ipv6 = ls_get_ips(c, "inet6");
-
-				tmp = ls_get_cgroup_item(c, "memory.usage_in_bytes");
-				if (tmp) {
-					l->ram = strtoull(tmp, NULL, 0);
-					l->ram = l->ram / 1024 /1024;
-					free(tmp);
+					l->ipv6 = ls_get_ips(c, "inet6");
 				}
 
-				l->swap = ls_get_swap(c);
+				if (!ls_get_memory(info.limit_cgroup, l)) {
+					tmp = ls_get_cgroup_item(c, "memory.usage_in_bytes");
+					if (tmp) {
+						l->ram = strtoull(tmp, NULL, 0);
+						l->ram = l->ram / 1024 /1024;
+						free(tmp);
+					}
+
+					l->swap = ls_get_swap(c);
+				}
 
-				val = c->get_running_config_item(c, "lxc.idmap");
-				l->unprivileged = !(val == NULL);
-				free(val);
+				if (info.values) {
+					l->unprivileged = info.values[LS_INFO_IDMAP] != NULL;
+				} else {
+					val = c->get_running_config_item(c, "lxc.idmap");
+					l->unprivileged = !(val == NULL);
+					free(val);
+				}
 			} else {
 				ret = c->get_config_item(c, "lxc.idmap", NULL, 0);
 				l->unprivileged = !(ret == 0);
@@ -586,6 +647,7 @@ static int ls_get(struct ls **m, size_t *size, const struct lxc_arguments *args,
 		}
 
 put_and_next:
+		ls_free_info(&info);
 		lxc_container_put(c);
 	}
 	ret = 0;
@@ -639,18 +701,194 @@ static char *ls_get_groups(struct lxc_container *c, bool running)
 			return NULL;
 	}
 
-	if (val) {
-		char *tmp;
+	return ls_format_groups(move_ptr(val));
+}
+
+/* Turn the newline separated value of lxc.group into a list. */
+static char *ls_format_groups(char *val)
+{
+	char *tmp;
+
+	if (!val)
+		return NULL;
 
-		if ((tmp = strrchr(val, '\n')))
-			*tmp = '\0';
+	if ((tmp = strrchr(val, '\n')))
+		*tmp = '\0';
 
-		tmp = lxc_string_replace("\n", ", ", val);
-		free(val);
-		val = tmp;
+	tmp = lxc_string_replace("\n", ", ", val);
+	free(val);
+	return tmp;
+}
+
+static void ls_free_info(struct lxc_running_info *info)
+{
+	if (info->values) {
+		for (int i = 0; i < info->nr_keys; i++)
+			free(info->values[i]);
+		free_disarm(info->values);
 	}
+	free_disarm(info->cgroup);
+	free_disarm(info->limit_cgroup);
+}
 
-	return move_ptr(val);
+static int ls_cmp_str(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* Append a copy of @str to the NULL terminated @list unless it's there. */
+static bool ls_list_add(char ***list, size_t *len, const char *str)
+{
+	char **tmp;
+
+	for (size_t i = 0; i < *len; i++)
+		if (strcmp((*list)[i], str) == 0)
+			return true;
+
+	tmp = realloc(*list, (*len + 2) * sizeof(char *));
+	if (!tmp)
+		return false;
+	*list = tmp;
+
+	tmp[*len] = strdup(str);
+	if (!tmp[*len])
+		return false;
+	tmp[++(*len)] = NULL;
+
+	return true;
+}
+
+/* Sort the list like the API does and join it. */
+static char *ls_list_join(char **list, size_t len)
+{
+	if (!list)
+		return NULL;
+
+	qsort(list, len, sizeof(char *), ls_cmp_str);
+	return lxc_string_join(", ", (const char **)list, false);
+}
+
+/*
+ * Dump the interfaces and addresses of a running container with a single
+ * netlink request from the host, addressing its network namespace through
+ * its id, instead of forking into it once per c->get_interfaces() and
+ * c->get_ips() call.
+ */
+static bool ls_get_net(struct ls *l)
+{
+	call_cleaner(netns_freeifaddrs) struct netns_ifaddrs *ifaddrs = NULL;
+	__do_close int fd = -EBADF;
+	char **lists[3] = {}; /* interfaces, ipv4, ipv6 */
+	size_t lens[3] = {};
+	char path[STRLITERALLEN("/proc/") + INTTYPE_TO_STRLEN(pid_t) + STRLITERALLEN("/ns/net") + 1];
+	bool netnsid_aware = false, ret = false;
+	int netnsid;
+
+	snprintf(path, sizeof(path), "/proc/%d/ns/net", l->init);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	/* Assigned when the container's network was set up. */
+	netnsid = lxc_netns_get_nsid(fd);
+	if (netnsid < 0)
+		return false;
+
+	if (netns_getifaddrs(&ifaddrs, netnsid, &netnsid_aware) < 0 || !netnsid_aware)
+		return false;
+
+	for (struct netns_ifaddrs *ifa = ifaddrs; ifa; ifa = ifa->ifa_next) {
+		char addr[INET6_ADDRSTRLEN];
+		const void *src;
+		int idx;
+
+		if (ifa->ifa_name && !ls_list_add(&lists[0], &lens[0], ifa->ifa_name))
+			goto out;
+
+		if (!ifa->ifa_addr || !ifa->ifa_name || strcmp(ifa->ifa_name, "lo") == 0)
+			continue;
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wcast-align"
+		if (ifa->ifa_addr->sa_family == AF_INET) {
+			src = &((struct sockaddr_in *)ifa->ifa_addr)->sin_addr;
+			idx = 1;
+		} else if (ifa->ifa_addr->sa_family == AF_INET6) {
+			/* Only global addresses like c->get_ips(c, NULL, "inet6", 0). */
+			if (((struct sockaddr_in6 *)ifa->ifa_addr)->sin6_scope_id != 0)
+				continue;
+
+			src = &((struct sockaddr_in6 *)ifa->ifa_addr)->sin6_addr;
+			idx = 2;
+		} else {
+			continue;
+		}
+#pragma GCC diagnostic pop
+
+		if (!inet_ntop(ifa->ifa_addr->sa_family, src, addr, sizeof(addr)))
+			continue;
+
+		if (!ls_list_add(&lists[idx], &lens[idx], addr))
+			goto out;
+	}
+
+	l->interface = ls_list_join(lists[0], lens[0]);
+	l->ipv4 = ls_list_join(lists[1], lens[1]);
+	l->ipv6 = ls_list_join(lists[2], lens[2]);
+	ret = true;
+
+out:
+	for (size_t i = 0; i < ARRAY_SIZE(lists); i++)
+		lxc_free_array((void **)lists[i], free);
+
+	return ret;
+}
+
+/*
+ * Read the memory usage straight from the container's cgroup2 directory. The
+ * cgroup2 mountpoint is opened once for all containers.
+ */
+static bool ls_get_memory(const char *cgroup, struct ls *l)
+{
+	static int dfd_cgroup2 = -EBADF;
+	static bool probed;
+	char path[PATH_MAX], buf[INTTYPE_TO_STRLEN(uint64_t) + 1];
+	ssize_t len;
+
+	if (!probed) {
+		probed = true;
+
+		dfd_cgroup2 = open(DEFAULT_CGROUP_MOUNTPOINT, O_PATH | O_DIRECTORY | O_CLOEXEC);
+		if (dfd_cgroup2 >= 0 && !fhas_fs_type(dfd_cgroup2, CGROUP2_SUPER_MAGIC))
+			close_prot_errno_disarm(dfd_cgroup2);
+	}
+
+	if (dfd_cgroup2 < 0 || !cgroup)
+		return false;
+
+	while (*cgroup == '/')
+		cgroup++;
+
+	if (strnprintf(path, sizeof(path), "%s/memory.current", *cgroup ? cgroup : ".") < 0)
+		return false;
+
+	len = lxc_read_try_buf_at(dfd_cgroup2, path, buf, sizeof(buf) - 1);
+	if (len <= 0)
+		return false;
+
+	l->ram = strtoull(buf, NULL, 0);
+	l->ram = l->ram / 1024 / 1024;
+
+	if (strnprintf(path, sizeof(path), "%s/memory.swap.current", *cgroup ? cgroup : ".") < 0)
+		return true;
+
+	len = lxc_read_try_buf_at(dfd_cgroup2, path, buf, sizeof(buf) - 1);
+	if (len > 0) {
+		l->swap = strtoull(buf, NULL, 0);
+		l->swap = l->swap / 1024 / 1024;
+	}
+
+	return true;
 }
 
 static char *ls_get_ips(struct lxc_container *c, const char *inet)
@@ -333,6 +333,16 @@ int main(int argc, char *argv[])
 			printf("'%s' exited with status [%d]\n",
 			       msg.name, WEXITSTATUS(msg.value));
 			break;
+		case lxc_msg_pressure:
+			if (lxc_pressure2str(msg.value))
+				printf("'%s' exceeded its [%s] pressure threshold\n",
+				       msg.name, lxc_pressure2str(msg.value));
+			break;
+		case lxc_msg_memory_event:
+			if (lxc_memory_event2str(msg.value))
+				printf("'%s' had a memory event [%s]\n",
+				       msg.name, lxc_memory_event2str(msg.value));
+			break;
 		default:
 			/* ignore garbage */
 			break;
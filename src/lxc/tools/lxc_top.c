@@ -5,7 +5,9 @@
 #endif
 #define __STDC_FORMAT_MACROS /* Required for PRIu64 to work. */
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -16,13 +18,18 @@
 #include <sys/ioctl.h>
 #include <sys/time.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <lxc/lxccontainer.h>
 
 #include "arguments.h"
+#include "cgroups/cgroup.h"
+#include "cgroups/cgroup_utils.h"
+#include "commands.h"
 #include "config.h"
 #include "mainloop.h"
+#include "memory_utils.h"
 #include "utils.h"
 
 #define USER_HZ   100
@@ -53,25 +60,43 @@ struct stats {
 };
 
 struct container_stats {
-	struct lxc_container *c;
+	const char *name;
 	struct stats *stats;
 };
 
 static int batch = 0;
 static int delay_set = 0;
-static int delay = 3;
+static unsigned int delay_ms = 3000;
 static char sort_by = 'n';
 static int sort_reverse = 0;
 static struct termios oldtios;
 static struct container_stats *container_stats = NULL;
 static int ct_alloc_cnt = 0;
 
+/* Parse a delay in seconds, fractions allow sub-second refreshes. */
+static int parse_delay(const char *arg, unsigned int *ms)
+{
+	char *end;
+	double val;
+
+	errno = 0;
+	val = strtod(arg, &end);
+	if (errno || end == arg || *end != '\0')
+		return -EINVAL;
+
+	if (val < 0.001 || val > UINT_MAX / 1000)
+		return -ERANGE;
+
+	*ms = (unsigned int)(val * 1000);
+	return 0;
+}
+
 static int my_parser(struct lxc_arguments *args, int c, char *arg)
 {
 	switch (c) {
 	case 'd':
 		delay_set = 1;
-		if (lxc_safe_int(arg, &delay) < 0)
+		if (parse_delay(arg, &delay_ms) < 0)
 			return -1;
 		break;
 	case 'b':
@@ -104,7 +129,8 @@ static struct lxc_arguments my_args = {
 lxc-top monitors the state of the active containers\n\
 \n\
 Options :\n\
-  -d, --delay     delay in seconds between refreshes (default: 3.0)\n\
+  -d, --delay     delay in seconds between refreshes, may be fractional\n\
+                  (default: 3.0)\n\
   -b, --batch     output designed to capture to a file\n\
   -s, --sort      sort by [n,c,b,m] (default: n) where\n\
                   n = Name\n\
@@ -197,139 +223,345 @@ static void size_humanize(unsigned long long val, char *buf, size_t bufsz)
 		fprintf(stderr, "Failed to create string\n");
 }
 
-static uint64_t stat_get_int(struct lxc_container *c, const char *item)
+/*
+ * The statistics lxc-top reads from the files of cgroup1 controllers. On
+ * cgroup2 all of them are read through c->get_metrics() instead.
+ */
+enum {
+	STAT_MEM_USED,
+	STAT_MEM_LIMIT,
+	STAT_MEMSW_USED,
+	STAT_MEMSW_LIMIT,
+	STAT_KMEM_USED,
+	STAT_KMEM_LIMIT,
+	STAT_CPU_USAGE,
+	STAT_CPU_STAT,
+	STAT_IO_BYTES,
+	STAT_IO_SERVICED,
+	STAT_MAX,
+};
+
+static const struct stat_file {
+	const char *controller;
+	const char *file;
+} stat_files[STAT_MAX] = {
+	[STAT_MEM_USED]    = { "memory",  "memory.usage_in_bytes"           },
+	[STAT_MEM_LIMIT]   = { "memory",  "memory.limit_in_bytes"           },
+	[STAT_MEMSW_USED]  = { "memory",  "memory.memsw.usage_in_bytes"     },
+	[STAT_MEMSW_LIMIT] = { "memory",  "memory.memsw.limit_in_bytes"     },
+	[STAT_KMEM_USED]   = { "memory",  "memory.kmem.usage_in_bytes"      },
+	[STAT_KMEM_LIMIT]  = { "memory",  "memory.kmem.limit_in_bytes"      },
+	[STAT_CPU_USAGE]   = { "cpuacct", "cpuacct.usage"                   },
+	[STAT_CPU_STAT]    = { "cpuacct", "cpuacct.stat"                    },
+	[STAT_IO_BYTES]    = { "blkio",   "blkio.throttle.io_service_bytes" },
+	[STAT_IO_SERVICED] = { "blkio",   "blkio.throttle.io_serviced"      },
+};
+
+/*
+ * The cgroup of a running container. It is looked up once and re-read on
+ * every refresh, so sampling neither talks to the container's command socket
+ * nor resolves any paths. On cgroup2 @c caches the container's cgroup for
+ * c->get_metrics(), otherwise @fds hold the open stat files.
+ */
+struct ct_sampler {
+	char *name;
+	struct lxc_container *c;
+	int fds[STAT_MAX];
+};
+
+static struct ct_sampler **samplers = NULL;
+static int nr_samplers = 0;
+
+static void sampler_free(struct ct_sampler *s)
+{
+	if (!s)
+		return;
+
+	lxc_container_put(s->c);
+	for (int i = 0; i < STAT_MAX; i++)
+		close_prot_errno_disarm(s->fds[i]);
+	free(s->name);
+	free(s);
+}
+
+#define SAMPLER_METRICS (LXC_METRICS_CPU | LXC_METRICS_MEMORY | LXC_METRICS_IO)
+
+/*
+ * Ask the container for its cgroup once. On a pure cgroup2 layout
+ * c->get_metrics() keeps the cgroup open, otherwise each controller is asked
+ * for separately.
+ */
+static struct ct_sampler *sampler_new(const char *lxcpath, const char *name)
 {
-	char buf[80];
-	int len;
-	uint64_t val;
-
-	len = c->get_cgroup_item(c, item, buf, sizeof(buf));
-	if (len <= 0) {
-		fprintf(stderr, "Unable to read cgroup item %s\n", item);
-		return 0;
+	__do_close int dfd = -EBADF;
+	struct ct_sampler *s;
+
+	s = zalloc(sizeof(*s));
+	if (!s)
+		return NULL;
+
+	for (int i = 0; i < STAT_MAX; i++)
+		s->fds[i] = -EBADF;
+
+	s->name = strdup(name);
+	if (!s->name)
+		goto on_error;
+
+	s->c = lxc_container_new(name, lxcpath);
+	if (s->c) {
+		struct lxc_metrics metrics = {
+			.flags = SAMPLER_METRICS,
+		};
+
+		if (s->c->get_metrics(s->c, &metrics))
+			return s;
+
+		lxc_container_put(move_ptr(s->c));
 	}
 
-	val = strtoull(buf, NULL, 0);
-	return val;
+	for (int i = 0; i < STAT_MAX; i++) {
+		struct cgroup_fd fd = {
+			.fd = -EBADF,
+		};
+
+		/* The stats are grouped by controller. */
+		if (i == 0 || !strequal(stat_files[i].controller,
+					stat_files[i - 1].controller)) {
+			close_prot_errno_disarm(dfd);
+			if (strnprintf(fd.controller, sizeof(fd.controller), "%s",
+				       stat_files[i].controller) < 0)
+				continue;
+
+			if (lxc_cmd_get_limit_cgroup_fd(name, lxcpath, sizeof(fd), &fd) < 0)
+				continue;
+
+			if (fd.type == UNIFIED_HIERARCHY) {
+				close(fd.fd);
+				continue;
+			}
+
+			dfd = fd.fd;
+		}
+
+		if (dfd >= 0)
+			s->fds[i] = openat(dfd, stat_files[i].file, O_RDONLY | O_CLOEXEC);
+	}
+
+	for (int i = 0; i < STAT_MAX; i++)
+		if (s->fds[i] >= 0)
+			return s;
+
+on_error:
+	sampler_free(s);
+	return NULL;
+}
+
+/*
+ * Re-read a stat file into @buf. The file of a removed cgroup fails with
+ * ENODEV which tells the caller that its container went away or restarted.
+ */
+static ssize_t sampler_read(struct ct_sampler *s, int idx, char *buf, size_t size)
+{
+	ssize_t len;
+
+	if (s->fds[idx] < 0)
+		return -EBADF;
+
+	do {
+		len = pread(s->fds[idx], buf, size - 1, 0);
+	} while (len < 0 && errno == EINTR);
+	if (len < 0)
+		return -errno;
+
+	buf[len] = '\0';
+	return len;
 }
 
-static uint64_t stat_match_get_int(struct lxc_container *c, const char *item,
-				   const char *match, int column)
+/*
+ * examples:
+ *	blkio.throttle.io_service_bytes
+ *	8:0 Read 110309376
+ *	8:0 Write 39018496
+ *	8:0 Sync 2818048
+ *	8:0 Async 146509824
+ *	8:0 Total 149327872
+ *	Total 149327872
+ */
+static void parse_blk_stats(const char *buf, struct blkio_stats *stats)
 {
-	char buf[4096];
-	int i,j,len;
-	uint64_t val = 0;
-	char **lines, **cols;
-	size_t matchlen;
-
-	len = c->get_cgroup_item(c, item, buf, sizeof(buf));
-	if (len <= 0) {
-		fprintf(stderr, "Unable to read cgroup item %s\n", item);
-		goto out;
+	memset(stats, 0, sizeof(struct blkio_stats));
+
+	for (const char *line = buf; *line; line = metrics_next_line(line)) {
+		const char *op;
+
+		if (strnequal(line, "Total ", 6)) {
+			stats->total = metrics_parse_u64(line + 6, NULL);
+			continue;
+		}
+
+		op = strchr(line, ' ');
+		if (!op || op > strchrnul(line, '\n'))
+			continue;
+		op++;
+
+		if (strnequal(op, "Read ", 5))
+			stats->read += metrics_parse_u64(op + 5, NULL);
+		else if (strnequal(op, "Write ", 6))
+			stats->write += metrics_parse_u64(op + 6, NULL);
 	}
+}
 
-	lines = lxc_string_split_and_trim(buf, '\n');
-	if (!lines)
-		goto out;
+/* Limits that are set to "max" show as 0 like they did on cgroup1. */
+static uint64_t limit_or_zero(uint64_t limit)
+{
+	return limit == LXC_METRICS_UNLIMITED ? 0 : limit;
+}
 
-	matchlen = strlen(match);
-	for (i = 0; lines[i]; i++) {
-		if (strncmp(lines[i], match, matchlen) == 0) {
-			cols = lxc_string_split_and_trim(lines[i], ' ');
-			if (!cols)
-				goto err1;
-
-			for (j = 0; cols[j]; j++) {
-				if (j == column) {
-					val = strtoull(cols[j], NULL, 0);
-					break;
-				}
-			}
+/* Sample the stats of a container on cgroup2. Fails if it isn't running. */
+static int sampler_sample_unified(struct ct_sampler *s, struct stats *stats)
+{
+	struct lxc_metrics metrics = {
+		.flags = SAMPLER_METRICS,
+	};
+
+	if (!s->c->get_metrics(s->c, &metrics))
+		return -ENODEV;
+
+	/* Convert to the units cgroup1 reports. */
+	stats->cpu_use_nanos = metrics.cpu_usage_usec * 1000;
+	stats->cpu_use_user = metrics.cpu_user_usec / (1000000 / USER_HZ);
+	stats->cpu_use_sys = metrics.cpu_system_usec / (1000000 / USER_HZ);
+
+	/* cgroup2 accounts swap separately from memory. */
+	stats->mem_used = metrics.memory_current;
+	stats->mem_limit = limit_or_zero(metrics.memory_max);
+	stats->memsw_used = metrics.memory_current + metrics.memory_swap_current;
+	stats->memsw_limit = stats->mem_limit + limit_or_zero(metrics.memory_swap_max);
+
+	stats->io_service_bytes.read = metrics.io_rbytes;
+	stats->io_service_bytes.write = metrics.io_wbytes;
+	stats->io_service_bytes.total = metrics.io_rbytes + metrics.io_wbytes;
+	stats->io_serviced.read = metrics.io_rios;
+	stats->io_serviced.write = metrics.io_wios;
+	stats->io_serviced.total = metrics.io_rios + metrics.io_wios;
+
+	return 0;
+}
+
+/* Sample all stats of a container. Fails if its cgroup is gone. */
+static int sampler_sample(struct ct_sampler *s, struct stats *stats)
+{
+	static char buf[65536];
+	uint64_t vals[STAT_MAX] = {};
+
+	memset(stats, 0, sizeof(*stats));
 
-			lxc_free_array((void **)cols, free);
+	if (s->c)
+		return sampler_sample_unified(s, stats);
+
+	for (int i = 0; i < STAT_MAX; i++) {
+		ssize_t len;
+
+		len = sampler_read(s, i, buf, sizeof(buf));
+		if (len == -ENODEV)
+			return -ENODEV;
+		if (len <= 0)
+			continue;
+
+		switch (i) {
+		case STAT_CPU_STAT:
+			stats->cpu_use_user = metrics_keyed(buf, "user");
+			stats->cpu_use_sys = metrics_keyed(buf, "system");
+			break;
+		case STAT_IO_BYTES:
+			parse_blk_stats(buf, &stats->io_service_bytes);
 			break;
+		case STAT_IO_SERVICED:
+			parse_blk_stats(buf, &stats->io_serviced);
+			break;
+		default:
+			vals[i] = metrics_parse_u64(buf, NULL);
 		}
 	}
 
-err1:
-	lxc_free_array((void **)lines, free);
+	stats->mem_used      = vals[STAT_MEM_USED];
+	stats->mem_limit     = vals[STAT_MEM_LIMIT];
+	stats->memsw_used    = vals[STAT_MEMSW_USED];
+	stats->memsw_limit   = vals[STAT_MEMSW_LIMIT];
+	stats->kmem_used     = vals[STAT_KMEM_USED];
+	stats->kmem_limit    = vals[STAT_KMEM_LIMIT];
+	stats->cpu_use_nanos = vals[STAT_CPU_USAGE];
 
-out:
-	return val;
+	return 0;
+}
+
+static int name_cmp(const void *n1, const void *n2)
+{
+	return strcmp(*(char *const *)n1, *(char *const *)n2);
 }
 
 /*
-examples:
-	blkio.throttle.io_serviced
-	8:0 Read 4259
-	8:0 Write 835
-	8:0 Sync 292
-	8:0 Async 4802
-	8:0 Total 5094
-	Total 5094
-
-	blkio.throttle.io_service_bytes
-	8:0 Read 110309376
-	8:0 Write 39018496
-	8:0 Sync 2818048
-	8:0 Async 146509824
-	8:0 Total 149327872
-	Total 149327872
-*/
-static void stat_get_blk_stats(struct lxc_container *c, const char *item,
-			      struct blkio_stats *stats) {
-	char buf[4096];
-	int i, len;
-	char **lines, **cols;
-
-	len = c->get_cgroup_item(c, item, buf, sizeof(buf));
-	if (len <= 0 || (size_t)len >= sizeof(buf)) {
-		fprintf(stderr, "Unable to read cgroup item %s\n", item);
-		return;
-	}
+ * Match the samplers to the currently active containers: keep the ones of
+ * containers that are still running and open new ones for the others. Both
+ * lists are sorted by name so a single merge pass pairs them up.
+ */
+static int samplers_update(const char *lxcpath, char **names, int nr_names)
+{
+	struct ct_sampler **active;
+	int nr_active = 0, old = 0;
 
-	lines = lxc_string_split_and_trim(buf, '\n');
-	if (!lines)
-		return;
+	active = malloc(sizeof(*active) * (nr_names ?: 1));
+	if (!active)
+		return -ENOMEM;
 
-	memset(stats, 0, sizeof(struct blkio_stats));
+	qsort(names, nr_names, sizeof(*names), name_cmp);
 
-	for (i = 0; lines[i]; i++) {
-		cols = lxc_string_split_and_trim(lines[i], ' ');
-		if (!cols)
-			goto out;
+	for (int i = 0; i < nr_names; i++) {
+		int cmp = 1;
 
-		if (strncmp(cols[1], "Read", strlen(cols[1])) == 0)
-			stats->read += strtoull(cols[2], NULL, 0);
-		else if (strncmp(cols[1], "Write", strlen(cols[1])) == 0)
-			stats->write += strtoull(cols[2], NULL, 0);
+		/* Drop the samplers of containers that stopped. */
+		while (old < nr_samplers) {
+			cmp = strcmp(samplers[old]->name, names[i]);
+			if (cmp >= 0)
+				break;
 
-		if (strncmp(cols[0], "Total", strlen(cols[0])) == 0)
-			stats->total = strtoull(cols[1], NULL, 0);
+			sampler_free(samplers[old++]);
+		}
+
+		if (cmp == 0) {
+			active[nr_active++] = samplers[old++];
+			continue;
+		}
 
-		lxc_free_array((void **)cols, free);
+		active[nr_active] = sampler_new(lxcpath, names[i]);
+		if (active[nr_active])
+			nr_active++;
 	}
 
-out:
-	lxc_free_array((void **)lines, free);
-	return;
+	for (; old < nr_samplers; old++)
+		sampler_free(samplers[old]);
+	free(samplers);
+
+	samplers = active;
+	nr_samplers = nr_active;
+	return 0;
 }
 
-static void stats_get(struct lxc_container *c, struct container_stats *ct, struct stats *total)
+static void stats_get(const char *lxcpath, struct ct_sampler **s,
+		      struct container_stats *ct, struct stats *total)
 {
-	ct->c = c;
-	ct->stats->mem_used      = stat_get_int(c, "memory.usage_in_bytes");
-	ct->stats->mem_limit     = stat_get_int(c, "memory.limit_in_bytes");
-	ct->stats->memsw_used    = stat_get_int(c, "memory.memsw.usage_in_bytes");
-	ct->stats->memsw_limit   = stat_get_int(c, "memory.memsw.limit_in_bytes");
-	ct->stats->kmem_used     = stat_get_int(c, "memory.kmem.usage_in_bytes");
-	ct->stats->kmem_limit    = stat_get_int(c, "memory.kmem.limit_in_bytes");
-	ct->stats->cpu_use_nanos = stat_get_int(c, "cpuacct.usage");
-	ct->stats->cpu_use_user  = stat_match_get_int(c, "cpuacct.stat", "user", 1);
-	ct->stats->cpu_use_sys   = stat_match_get_int(c, "cpuacct.stat", "system", 1);
-
-	stat_get_blk_stats(c, "blkio.throttle.io_service_bytes", &ct->stats->io_service_bytes);
-	stat_get_blk_stats(c, "blkio.throttle.io_serviced", &ct->stats->io_serviced);
+	if (sampler_sample(*s, ct->stats) < 0) {
+		/* The container restarted, so look up its new cgroup. */
+		struct ct_sampler *fresh;
+
+		fresh = sampler_new(lxcpath, (*s)->name);
+		if (fresh) {
+			sampler_free(*s);
+			*s = fresh;
+			(void)sampler_sample(*s, ct->stats);
+		}
+	}
+	ct->name = (*s)->name;
 
 	if (total) {
 		total->mem_used      = total->mem_used      + ct->stats->mem_used;
@@ -431,9 +663,9 @@ static int cmp_name(const void *sct1, const void *sct2)
 	const struct container_stats *ct2 = sct2;
 
 	if (sort_reverse)
-		return strncmp(ct2->c->name, ct1->c->name, strlen(ct2->c->name));
+		return strncmp(ct2->name, ct1->name, strlen(ct2->name));
 
-	return strncmp(ct1->c->name, ct2->c->name, strlen(ct1->c->name));
+	return strncmp(ct1->name, ct2->name, strlen(ct1->name));
 }
 
 static int cmp_cpuuse(const void *sct1, const void *sct2)
@@ -513,11 +745,7 @@ static void ct_free(void)
 	int i;
 
 	for (i = 0; i < ct_alloc_cnt; i++) {
-		if (container_stats[i].c) {
-			lxc_container_put(container_stats[i].c);
-			container_stats[i].c = NULL;
-		}
-
+		container_stats[i].name = NULL;
 		free(container_stats[i].stats);
 		container_stats[i].stats = NULL;
 	}
@@ -602,24 +830,37 @@ int main(int argc, char *argv[])
 	}
 
 	if (batch && !delay_set)
-		delay = 300;
+		delay_ms = 300 * 1000;
 
         if (batch)
 		printf("time_ms,container,cpu_nanos,cpu_sys_userhz,cpu_user_userhz,blkio_bytes,blkio_iops,mem_used_bytes,memsw_used_bytes,kernel_mem_used_bytes\n");
 
 	for(;;) {
-		struct lxc_container **active;
+		char **active = NULL;
 		int i, active_cnt;
 		struct stats total;
 		char total_name[30];
 
-		active_cnt = list_active_containers(my_args.lxcpath[0], NULL, &active);
+		active_cnt = list_active_containers(my_args.lxcpath[0], &active, NULL);
+		if (active_cnt < 0)
+			active_cnt = 0;
+
+		if (samplers_update(my_args.lxcpath[0], active, active_cnt) < 0) {
+			fprintf(stderr, "Cannot alloc mem\n");
+			exit(EXIT_FAILURE);
+		}
+
+		for (i = 0; i < active_cnt; i++)
+			free(active[i]);
+		free(active);
+
+		active_cnt = nr_samplers;
 		ct_realloc(active_cnt);
 
 		memset(&total, 0, sizeof(total));
 
 		for (i = 0; i < active_cnt; i++)
-			stats_get(active[i], &container_stats[i], &total);
+			stats_get(my_args.lxcpath[0], &samplers[i], &container_stats[i], &total);
 
 		ct_sort(active_cnt);
 
@@ -629,7 +870,7 @@ int main(int argc, char *argv[])
 		}
 
 		for (i = 0; i < active_cnt && i < ct_print_cnt; i++) {
-			stats_print(container_stats[i].c->name, container_stats[i].stats, &total);
+			stats_print(container_stats[i].name, container_stats[i].stats, &total);
 			printf("\n");
 		}
 
@@ -639,15 +880,10 @@ int main(int argc, char *argv[])
 		}
 		fflush(stdout);
 
-		for (i = 0; i < active_cnt; i++) {
-			lxc_container_put(container_stats[i].c);
-			container_stats[i].c = NULL;
-		}
-
 		in_char = '\0';
 
 		if (!batch) {
-			ret = lxc_mainloop(&descr, 1000 * delay);
+			ret = lxc_mainloop(&descr, delay_ms);
 			if (ret != 0 || in_char == 'q')
 				break;
 
@@ -668,7 +904,13 @@ int main(int argc, char *argv[])
 				sort_by = in_char;
 			}
 		} else {
-			sleep(delay);
+			struct timespec ts = {
+				.tv_sec = delay_ms / 1000,
+				.tv_nsec = (delay_ms % 1000) * 1000000,
+			};
+
+			while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+				;
 		}
 	}
 
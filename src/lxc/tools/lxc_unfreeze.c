@@ -5,6 +5,7 @@
 #endif
 #include <libgen.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -13,29 +14,53 @@
 
 #include "arguments.h"
 #include "config.h"
+#include "freeze_utils.h"
 #include "log.h"
+#include "string_utils.h"
 
 lxc_log_define(lxc_unfreeze, lxc);
 
+static int my_parser(struct lxc_arguments *args, int c, char *arg)
+{
+	switch (c) {
+	case 'g':
+		args->groups = arg;
+		break;
+	case 't':
+		if (lxc_safe_long(arg, &args->timeout) < 0)
+			return -1;
+		break;
+	}
+
+	return 0;
+}
+
 static const struct option my_longopts[] = {
+	{"groups", required_argument, 0, 'g'},
+	{"timeout", required_argument, 0, 't'},
 	LXC_COMMON_OPTIONS
 };
 
 static struct lxc_arguments my_args = {
 	.progname     = "lxc-unfreeze",
 	.help         = "\
---name=NAME\n\
+--name=NAME [NAME...]\n\
 \n\
-lxc-unfreeze unfreezes a container with the identifier NAME\n\
+lxc-unfreeze unfreezes the containers with the identifiers NAME\n\
 \n\
 Options :\n\
-  -n, --name=NAME   NAME of the container\n\
-  --rcfile=FILE     Load configuration file FILE\n",
+  -n, --name=NAME      NAME of the container\n\
+  -g, --groups=GROUPS  Unfreeze all running containers in one of the\n\
+                       comma separated GROUPS\n\
+  -t, --timeout=T      Wait at most T seconds in total when unfreezing\n\
+                       several containers\n\
+  --rcfile=FILE        Load configuration file FILE\n",
 	.options      = my_longopts,
-	.parser       = NULL,
+	.parser       = my_parser,
 	.checker      = NULL,
 	.log_priority = "ERROR",
 	.log_file     = "none",
+	.timeout      = -1,
 };
 
 int main(int argc, char *argv[])
@@ -56,6 +81,13 @@ int main(int argc, char *argv[])
 	if (lxc_log_init(&log))
 		exit(EXIT_FAILURE);
 
+	if (my_args.groups || my_args.argc > 0) {
+		if (freeze_many(&my_args, false) < 0)
+			exit(EXIT_FAILURE);
+
+		exit(EXIT_SUCCESS);
+	}
+
 	c = lxc_container_new(my_args.name, my_args.lxcpath[0]);
 	if (!c) {
 		ERROR("No such container: %s:%s", my_args.lxcpath[0], my_args.name);
@@ -0,0 +1,567 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+/*
+ * Benchmark the container lifecycle: create, start until RUNNING, an
+ * attach-run-wait round trip, command socket round trips (state and running
+ * config item queries), stop and destroy. Every iteration runs the same
+ * sequence on a freshly created container of the dir backend so runs can be
+ * compared with each other. Results are reported as percentiles in
+ * microseconds and can be written as JSON.
+ *
+ * Nothing is downloaded: the default busybox template only needs a busybox
+ * binary on the host. With "-t none" no template is run and the container's
+ * rootfs and init have to be set with -s, e.g.
+ *
+ *   lxc-test-bench-lifecycle -t none -s lxc.rootfs.path= \
+ *	-s "lxc.init.cmd=/bin/sleep 1000" -s lxc.net.0.type=empty
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/utsname.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lxc/attach_options.h"
+#include "lxc/lxccontainer.h"
+#include "lxctest.h"
+
+#define BENCH_NAME "lxc-bench-lifecycle"
+#define BENCH_MAX_SETS 32
+#define BENCH_MAX_PHASES 64
+
+static int iterations = 10;
+static int warmup = 1;
+static int cmd_iterations = 100;
+static int quiet = 0;
+static int phases = 0;
+static const char *template = "busybox";
+static const char *lxcpath = NULL;
+static const char *json_path = NULL;
+static char *sets[BENCH_MAX_SETS];
+static int nr_sets = 0;
+
+static const struct option options[] = {
+	{ "iterations",     required_argument, NULL, 'i' },
+	{ "warmup",         required_argument, NULL, 'w' },
+	{ "cmd-iterations", required_argument, NULL, 'c' },
+	{ "template",       required_argument, NULL, 't' },
+	{ "lxcpath",        required_argument, NULL, 'P' },
+	{ "set",            required_argument, NULL, 's' },
+	{ "json",           required_argument, NULL, 'o' },
+	{ "phases",         no_argument,       NULL, 'p' },
+	{ "quiet",          no_argument,       NULL, 'q' },
+	{ "help",           no_argument,       NULL, '?' },
+	{ 0, 0, 0, 0 },
+};
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: lxc-test-bench-lifecycle [OPTION]...\n\n"
+	        "  -i, --iterations=N           Measured iterations (default: 10)\n"
+	        "  -w, --warmup=N               Unmeasured iterations run first (default: 1)\n"
+	        "  -c, --cmd-iterations=N       Command round trips per iteration (default: 100)\n"
+	        "  -t, --template=t             Template to use, \"none\" for no template\n"
+	        "                               (default: busybox)\n"
+	        "  -P, --lxcpath=PATH           Create the container in PATH\n"
+	        "  -s, --set=KEY=VALUE          Set a config item before starting\n"
+	        "  -o, --json=FILE              Write results as JSON to FILE (\"-\" for stdout)\n"
+	        "  -p, --phases                 Also report the start phase timings logged\n"
+	        "                               by the container\n"
+	        "  -q, --quiet                  Don't print the summary table\n"
+	        "  -?, --help                   Give this help list\n\n");
+}
+
+struct bench_samples {
+	const char *name;
+	int64_t *values;
+	int nr;
+	int size;
+};
+
+enum {
+	BENCH_CREATE,
+	BENCH_START,
+	BENCH_ATTACH,
+	BENCH_CMD_STATE,
+	BENCH_CMD_CONFIG_ITEM,
+	BENCH_STOP,
+	BENCH_DESTROY,
+	BENCH_MAX,
+};
+
+static struct bench_samples results[BENCH_MAX] = {
+	[BENCH_CREATE]		= { .name = "create"		},
+	[BENCH_START]		= { .name = "start"		},
+	[BENCH_ATTACH]		= { .name = "attach_run_wait"	},
+	[BENCH_CMD_STATE]	= { .name = "cmd_get_state"	},
+	[BENCH_CMD_CONFIG_ITEM]	= { .name = "cmd_get_config_item" },
+	[BENCH_STOP]		= { .name = "stop"		},
+	[BENCH_DESTROY]		= { .name = "destroy"		},
+};
+
+/* Start phases as reported in the container's "Start timings:" log line. */
+static struct bench_samples phase_results[BENCH_MAX_PHASES];
+static int nr_phases = 0;
+
+static int64_t now_usec(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int cmp_int64(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static int64_t percentile(const int64_t *sorted, int n, int pct)
+{
+	int idx = (n * pct + 99) / 100 - 1;
+
+	if (idx < 0)
+		idx = 0;
+
+	return sorted[idx];
+}
+
+static int add_sample(struct bench_samples *s, int64_t value)
+{
+	if (s->nr == s->size) {
+		int64_t *values;
+		int size = s->size ? s->size * 2 : 16;
+
+		values = realloc(s->values, size * sizeof(*values));
+		if (!values)
+			return -ENOMEM;
+
+		s->values = values;
+		s->size = size;
+	}
+
+	s->values[s->nr++] = value;
+	return 0;
+}
+
+static struct bench_samples *phase_samples(const char *name, size_t len)
+{
+	for (int i = 0; i < nr_phases; i++)
+		if (strlen(phase_results[i].name) == len &&
+		    strncmp(phase_results[i].name, name, len) == 0)
+			return &phase_results[i];
+
+	if (nr_phases == BENCH_MAX_PHASES)
+		return NULL;
+
+	phase_results[nr_phases].name = strndup(name, len);
+	if (!phase_results[nr_phases].name)
+		return NULL;
+
+	return &phase_results[nr_phases++];
+}
+
+/*
+ * Pick up the last "Start timings: {...}" line from @log. It's a flat object
+ * of "phase":usec pairs.
+ */
+static int record_phases(const char *log)
+{
+	char *line = NULL, *json = NULL;
+	size_t n = 0;
+	FILE *f;
+	int ret = 0;
+
+	f = fopen(log, "re");
+	if (!f)
+		return -errno;
+
+	while (getline(&line, &n, f) > 0) {
+		char *p = strstr(line, "Start timings: {");
+
+		if (!p)
+			continue;
+
+		free(json);
+		json = strdup(p + strlen("Start timings: "));
+		if (!json) {
+			ret = -ENOMEM;
+			break;
+		}
+	}
+	free(line);
+	fclose(f);
+
+	if (ret < 0 || !json)
+		return ret < 0 ? ret : -ENODATA;
+
+	for (char *p = json; (p = strchr(p, '"'));) {
+		struct bench_samples *s;
+		char *end, *val;
+
+		end = strchr(p + 1, '"');
+		if (!end || end[1] != ':')
+			break;
+
+		s = phase_samples(p + 1, end - p - 1);
+		if (!s) {
+			ret = -ENOMEM;
+			break;
+		}
+
+		val = end + 2;
+		ret = add_sample(s, strtoll(val, &p, 10));
+		if (ret < 0)
+			break;
+	}
+
+	free(json);
+	return ret;
+}
+
+static struct lxc_container *bench_create(int measure)
+{
+	struct lxc_container *c;
+	int64_t begin;
+	bool ok;
+
+	c = lxc_container_new(BENCH_NAME, lxcpath);
+	if (!c) {
+		lxc_error("%s\n", "Failed to allocate container \"" BENCH_NAME "\"");
+		return NULL;
+	}
+
+	if (c->is_defined(c)) {
+		lxc_error("%s\n", "Container \"" BENCH_NAME "\" is already defined");
+		lxc_container_put(c);
+		return NULL;
+	}
+
+	begin = now_usec();
+	/* Like lxc-create, a missing default config isn't an error. */
+	c->load_config(c, lxc_get_global_config_item("lxc.default_config"));
+	if (strcmp(template, "none") == 0)
+		ok = c->create(c, NULL, "dir", NULL, LXC_CREATE_QUIET, NULL);
+	else
+		ok = c->create(c, template, "dir", NULL, LXC_CREATE_QUIET, NULL);
+	if (!ok) {
+		lxc_error("%s\n", "Failed to create container \"" BENCH_NAME "\"");
+		lxc_container_put(c);
+		return NULL;
+	}
+	if (measure && add_sample(&results[BENCH_CREATE], now_usec() - begin) < 0)
+		goto on_error;
+
+	/* Queried through the command socket while the container runs. */
+	if (!c->set_config_item(c, "lxc.uts.name", BENCH_NAME))
+		goto on_error;
+
+	for (int i = 0; i < nr_sets; i++) {
+		char *key = sets[i], *value = strchr(sets[i], '=');
+
+		*value = '\0';
+		ok = c->set_config_item(c, key, value + 1);
+		*value = '=';
+		if (!ok) {
+			lxc_error("Failed to set \"%s\"\n", sets[i]);
+			goto on_error;
+		}
+	}
+
+	if (phases) {
+		char log[4096];
+
+		snprintf(log, sizeof(log), "%s/%s/bench.log", c->config_path, c->name);
+		if (!c->set_config_item(c, "lxc.log.file", log) ||
+		    !c->set_config_item(c, "lxc.log.level", "DEBUG"))
+			goto on_error;
+	}
+
+	if (!c->want_daemonize(c, true))
+		goto on_error;
+
+	return c;
+
+on_error:
+	c->destroy(c);
+	lxc_container_put(c);
+	return NULL;
+}
+
+static int bench_run(struct lxc_container *c, int measure)
+{
+	lxc_attach_options_t attach_options = LXC_ATTACH_OPTIONS_DEFAULT;
+	char *argv[] = { "/bin/true", NULL };
+	char buf[256];
+	int64_t begin;
+	int ret;
+
+	begin = now_usec();
+	if (!c->start(c, 0, NULL) || !c->wait(c, "RUNNING", 30)) {
+		lxc_error("%s\n", "Failed to start container \"" BENCH_NAME "\"");
+		return -1;
+	}
+	if (measure && add_sample(&results[BENCH_START], now_usec() - begin) < 0)
+		return -1;
+
+	begin = now_usec();
+	ret = c->attach_run_wait(c, &attach_options, argv[0], (const char **)argv);
+	if (ret != 0) {
+		lxc_error("Failed to run \"%s\" in container \"%s\": %d\n",
+			  argv[0], BENCH_NAME, ret);
+		return -1;
+	}
+	if (measure && add_sample(&results[BENCH_ATTACH], now_usec() - begin) < 0)
+		return -1;
+
+	for (int i = 0; i < cmd_iterations; i++) {
+		const char *state;
+
+		begin = now_usec();
+		state = c->state(c);
+		if (!state || strcmp(state, "RUNNING") != 0) {
+			lxc_error("Unexpected state \"%s\"\n", state ?: "(null)");
+			return -1;
+		}
+		if (measure && add_sample(&results[BENCH_CMD_STATE], now_usec() - begin) < 0)
+			return -1;
+
+		begin = now_usec();
+		if (!c->get_running_config_item(c, "lxc.uts.name")) {
+			lxc_error("%s\n", "Failed to query running config item");
+			return -1;
+		}
+		if (measure && add_sample(&results[BENCH_CMD_CONFIG_ITEM], now_usec() - begin) < 0)
+			return -1;
+	}
+
+	if (measure && phases) {
+		snprintf(buf, sizeof(buf), "%s/%s/bench.log", c->config_path, c->name);
+		ret = record_phases(buf);
+		if (ret < 0) {
+			lxc_error("Failed to read start timings from \"%s\": %d\n", buf, ret);
+			return -1;
+		}
+	}
+
+	begin = now_usec();
+	if (!c->stop(c) || !c->wait(c, "STOPPED", 30)) {
+		lxc_error("%s\n", "Failed to stop container \"" BENCH_NAME "\"");
+		return -1;
+	}
+	if (measure && add_sample(&results[BENCH_STOP], now_usec() - begin) < 0)
+		return -1;
+
+	return 0;
+}
+
+static int bench_destroy(struct lxc_container *c, int measure)
+{
+	int64_t begin;
+	bool ok;
+
+	if (c->is_running(c))
+		c->stop(c);
+
+	begin = now_usec();
+	ok = c->destroy(c);
+	if (ok && measure && add_sample(&results[BENCH_DESTROY], now_usec() - begin) < 0)
+		ok = false;
+
+	/* The exiting monitor may still have written to the log. */
+	if (phases) {
+		char path[4096];
+
+		snprintf(path, sizeof(path), "%s/%s/bench.log", c->config_path, c->name);
+		(void)unlink(path);
+		snprintf(path, sizeof(path), "%s/%s", c->config_path, c->name);
+		(void)rmdir(path);
+	}
+
+	lxc_container_put(c);
+	return ok ? 0 : -1;
+}
+
+static void print_samples(FILE *f, struct bench_samples *s, bool json, bool last)
+{
+	int64_t sum = 0;
+
+	if (s->nr == 0)
+		return;
+
+	qsort(s->values, s->nr, sizeof(*s->values), cmp_int64);
+	for (int i = 0; i < s->nr; i++)
+		sum += s->values[i];
+
+	if (json)
+		fprintf(f, "\t\t\"%s\": { \"n\": %d, \"min\": %lld, \"mean\": %lld, "
+			"\"p50\": %lld, \"p90\": %lld, \"p99\": %lld, \"max\": %lld }%s\n",
+			s->name, s->nr, (long long)s->values[0],
+			(long long)(sum / s->nr),
+			(long long)percentile(s->values, s->nr, 50),
+			(long long)percentile(s->values, s->nr, 90),
+			(long long)percentile(s->values, s->nr, 99),
+			(long long)s->values[s->nr - 1], last ? "" : ",");
+	else
+		fprintf(f, "%-24s %6d %10lld %10lld %10lld %10lld %10lld %10lld\n",
+			s->name, s->nr, (long long)s->values[0],
+			(long long)(sum / s->nr),
+			(long long)percentile(s->values, s->nr, 50),
+			(long long)percentile(s->values, s->nr, 90),
+			(long long)percentile(s->values, s->nr, 99),
+			(long long)s->values[s->nr - 1]);
+}
+
+static int write_json(const char *path)
+{
+	struct utsname uts = {};
+	FILE *f;
+	int last;
+
+	if (strcmp(path, "-") == 0) {
+		f = stdout;
+	} else {
+		f = fopen(path, "we");
+		if (!f)
+			return -errno;
+	}
+
+	(void)uname(&uts);
+	fprintf(f, "{\n"
+		"\t\"benchmark\": \"lifecycle\",\n"
+		"\t\"unit\": \"usec\",\n"
+		"\t\"lxc_version\": \"%s\",\n"
+		"\t\"kernel\": \"%s\",\n"
+		"\t\"machine\": \"%s\",\n"
+		"\t\"nproc\": %ld,\n"
+		"\t\"template\": \"%s\",\n"
+		"\t\"backend\": \"dir\",\n"
+		"\t\"iterations\": %d,\n"
+		"\t\"warmup\": %d,\n"
+		"\t\"cmd_iterations\": %d,\n"
+		"\t\"results\": {\n",
+		lxc_get_version(), uts.release, uts.machine,
+		sysconf(_SC_NPROCESSORS_ONLN), template, iterations, warmup,
+		cmd_iterations);
+
+	for (last = BENCH_MAX - 1; last > 0 && results[last].nr == 0; last--)
+		;
+	for (int i = 0; i < BENCH_MAX; i++)
+		print_samples(f, &results[i], true, i == last);
+	fprintf(f, "\t}");
+
+	if (nr_phases > 0) {
+		fprintf(f, ",\n\t\"start_phases\": {\n");
+		for (int i = 0; i < nr_phases; i++)
+			print_samples(f, &phase_results[i], true, i == nr_phases - 1);
+		fprintf(f, "\t}");
+	}
+	fprintf(f, "\n}\n");
+
+	if (f != stdout)
+		fclose(f);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int opt, ret = EXIT_FAILURE;
+
+	while ((opt = getopt_long(argc, argv, "i:w:c:t:P:s:o:pq", options, NULL)) != -1) {
+		switch (opt) {
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		case 'w':
+			warmup = atoi(optarg);
+			break;
+		case 'c':
+			cmd_iterations = atoi(optarg);
+			break;
+		case 't':
+			template = optarg;
+			break;
+		case 'P':
+			lxcpath = optarg;
+			break;
+		case 's':
+			if (nr_sets == BENCH_MAX_SETS || !strchr(optarg, '=')) {
+				usage();
+				exit(EXIT_FAILURE);
+			}
+			sets[nr_sets++] = optarg;
+			break;
+		case 'o':
+			json_path = optarg;
+			break;
+		case 'p':
+			phases = 1;
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		default:
+			usage();
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (iterations <= 0 || warmup < 0 || cmd_iterations < 0) {
+		usage();
+		exit(EXIT_FAILURE);
+	}
+
+	for (int i = 0; i < warmup + iterations; i++) {
+		int measure = i >= warmup;
+		struct lxc_container *c;
+
+		c = bench_create(measure);
+		if (!c)
+			goto out;
+
+		if (bench_run(c, measure) < 0) {
+			bench_destroy(c, 0);
+			goto out;
+		}
+
+		if (bench_destroy(c, measure) < 0) {
+			lxc_error("%s\n", "Failed to destroy container \"" BENCH_NAME "\"");
+			goto out;
+		}
+	}
+
+	if (!quiet) {
+		printf("%-24s %6s %10s %10s %10s %10s %10s %10s\n", "usec", "n",
+		       "min", "mean", "p50", "p90", "p99", "max");
+		for (int i = 0; i < BENCH_MAX; i++)
+			print_samples(stdout, &results[i], false, false);
+		if (nr_phases > 0)
+			printf("\nstart phases\n");
+		for (int i = 0; i < nr_phases; i++)
+			print_samples(stdout, &phase_results[i], false, false);
+	}
+
+	if (json_path && write_json(json_path) < 0) {
+		lxc_error("Failed to write \"%s\"\n", json_path);
+		goto out;
+	}
+
+	ret = EXIT_SUCCESS;
+
+out:
+	for (int i = 0; i < BENCH_MAX; i++)
+		free(results[i].values);
+	for (int i = 0; i < nr_phases; i++) {
+		free((char *)phase_results[i].name);
+		free(phase_results[i].values);
+	}
+	exit(ret);
+}
@@ -0,0 +1,202 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+/*
+ * Load a large number of container configs which all include a shared file,
+ * once without and twice with the config cache, and check that a changed
+ * include invalidates the cached configs.
+ *
+ * Usage: lxc-test-config-cache [containers]
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lxc/lxccontainer.h"
+#include "lxctest.h"
+
+static int64_t now_usec(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static bool write_file(const char *path, const char *contents)
+{
+	FILE *f;
+	bool ret;
+
+	f = fopen(path, "we");
+	if (!f)
+		return false;
+
+	ret = fputs(contents, f) >= 0;
+	return fclose(f) == 0 && ret;
+}
+
+static bool create_configs(const char *lxcpath, int containers)
+{
+	char path[PATH_MAX], buf[4096];
+
+	snprintf(path, sizeof(path), "%s/common.conf", lxcpath);
+	if (!write_file(path, "lxc.arch = x86_64\n"
+			      "lxc.tty.max = 4\n"
+			      "lxc.pty.max = 1024\n"
+			      "lxc.cap.drop = sys_module mac_admin mac_override sys_time\n"
+			      "lxc.mount.auto = cgroup:mixed proc:mixed sys:mixed\n"
+			      "lxc.mount.entry = /sys/fs/fuse/connections sys/fs/fuse/connections none bind,optional 0 0\n"
+			      "lxc.cgroup2.devices.allow = c 1:3 rwm\n"
+			      "lxc.cgroup2.devices.allow = c 1:5 rwm\n"
+			      "lxc.cgroup2.devices.allow = c 5:0 rwm\n"
+			      "lxc.cgroup2.devices.allow = c 136:* rwm\n"))
+		return false;
+
+	for (int i = 0; i < containers; i++) {
+		snprintf(path, sizeof(path), "%s/ct-%d", lxcpath, i);
+		if (mkdir(path, 0755) < 0)
+			return false;
+
+		snprintf(path, sizeof(path), "%s/ct-%d/config", lxcpath, i);
+		snprintf(buf, sizeof(buf),
+			 "# Generated by lxc-test-config-cache\n"
+			 "lxc.include = %s/common.conf\n"
+			 "lxc.rootfs.path = dir:%s/ct-%d/rootfs\n"
+			 "lxc.uts.name = ct-%d\n"
+			 "lxc.net.0.type = veth\n"
+			 "lxc.net.0.link = lxcbr0\n"
+			 "lxc.net.0.flags = up\n"
+			 "lxc.net.0.hwaddr = 00:16:3e:%02x:%02x:%02x\n",
+			 lxcpath, lxcpath, i, i,
+			 (i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff);
+		if (!write_file(path, buf))
+			return false;
+	}
+
+	return true;
+}
+
+static void remove_configs(const char *lxcpath, int containers)
+{
+	char path[PATH_MAX];
+
+	for (int i = 0; i < containers; i++) {
+		snprintf(path, sizeof(path), "%s/ct-%d/config", lxcpath, i);
+		(void)unlink(path);
+		snprintf(path, sizeof(path), "%s/ct-%d", lxcpath, i);
+		(void)rmdir(path);
+	}
+
+	snprintf(path, sizeof(path), "%s/common.conf", lxcpath);
+	(void)unlink(path);
+	(void)rmdir(lxcpath);
+}
+
+/* Load all configs and check an item from the config and from the include. */
+static int64_t load_configs(const char *lxcpath, int containers, const char *tty_max)
+{
+	int64_t started = now_usec();
+
+	for (int i = 0; i < containers; i++) {
+		struct lxc_container *c;
+		char name[64], buf[64];
+		bool ok;
+
+		snprintf(name, sizeof(name), "ct-%d", i);
+		c = lxc_container_new(name, lxcpath);
+		if (!c) {
+			lxc_error("Failed to load container \"%s\"\n", name);
+			return -1;
+		}
+
+		ok = c->get_config_item(c, "lxc.uts.name", buf, sizeof(buf)) > 0 &&
+		     strcmp(buf, name) == 0 &&
+		     c->get_config_item(c, "lxc.tty.max", buf, sizeof(buf)) > 0 &&
+		     strcmp(buf, tty_max) == 0;
+		lxc_container_put(c);
+		if (!ok) {
+			lxc_error("Unexpected config of container \"%s\"\n", name);
+			return -1;
+		}
+	}
+
+	return now_usec() - started;
+}
+
+int main(int argc, char *argv[])
+{
+	char template[] = P_tmpdir "/lxc-config-cache-XXXXXX";
+	int64_t uncached, populate, cached, changed;
+	int containers = 10000;
+	int ret = EXIT_FAILURE;
+	char path[PATH_MAX];
+	char *lxcpath;
+
+	if (argc > 1)
+		containers = atoi(argv[1]);
+	if (containers <= 0)
+		exit(EXIT_FAILURE);
+
+	if (!lxc_has_api_extension("config_cache")) {
+		lxc_error("%s\n", "The config_cache API extension is missing");
+		exit(EXIT_FAILURE);
+	}
+
+	lxcpath = mkdtemp(template);
+	if (!lxcpath) {
+		lxc_error("%s\n", "Failed to create temporary lxcpath");
+		exit(EXIT_FAILURE);
+	}
+
+	if (!create_configs(lxcpath, containers)) {
+		lxc_error("%s\n", "Failed to create container configs");
+		goto on_error;
+	}
+
+	/* Files changed within the last second are never cached. */
+	sleep(2);
+
+	uncached = load_configs(lxcpath, containers, "4");
+	if (uncached < 0)
+		goto on_error;
+
+	lxc_config_cache_enable(true);
+
+	populate = load_configs(lxcpath, containers, "4");
+	if (populate < 0)
+		goto on_error;
+
+	cached = load_configs(lxcpath, containers, "4");
+	if (cached < 0)
+		goto on_error;
+
+	/* All snapshots depend on the include and have to be dropped. */
+	snprintf(path, sizeof(path), "%s/common.conf", lxcpath);
+	if (!write_file(path, "lxc.tty.max = 8\n")) {
+		lxc_error("%s\n", "Failed to change the included config");
+		goto on_error;
+	}
+
+	changed = load_configs(lxcpath, containers, "8");
+	if (changed < 0)
+		goto on_error;
+
+	printf("loaded %d configs: uncached %lld usec, populating %lld usec, cached %lld usec (%.1fx), after change %lld usec\n",
+	       containers, (long long)uncached, (long long)populate,
+	       (long long)cached, cached > 0 ? (double)uncached / cached : 0.0,
+	       (long long)changed);
+
+	ret = EXIT_SUCCESS;
+
+on_error:
+	lxc_config_cache_enable(false);
+	remove_configs(lxcpath, containers);
+	exit(ret);
+}
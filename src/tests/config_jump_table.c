@@ -28,15 +28,87 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include <time.h>
 
 #include "confile.h"
 #include "lxc/state.h"
 #include "lxctest.h"
+#include "macro.h"
+
+/* Keys as they show up in generated configs and the entry they belong to. */
+static const char *const lookups[][2] = {
+	{ "lxc.net.0.type",                "lxc.net."            },
+	{ "lxc.net.12.ipv4.address",       "lxc.net."            },
+	{ "lxc.net",                       "lxc.net"             },
+	{ "lxc.mount.entry",               "lxc.mount.entry"     },
+	{ "lxc.cgroup2.memory.max",        "lxc.cgroup2"         },
+	{ "lxc.cgroup.devices.allow",      "lxc.cgroup"          },
+	{ "lxc.cgroup.dir",                "lxc.cgroup.dir"      },
+	{ "lxc.cgroup.relative",           "lxc.cgroup.relative" },
+	{ "lxc.prlimit.nofile",            "lxc.prlimit"         },
+	{ "lxc.sysctl.net.ipv4.ip_forward", "lxc.sysctl"         },
+	{ "lxc.proc.oom_score_adj",        "lxc.proc"            },
+	{ "lxc.namespace.share.net",       "lxc.namespace.share." },
+	{ "lxc.uts.name",                  "lxc.uts.name"        },
+	{ "lxc.rootfs.path",               "lxc.rootfs.path"     },
+	{ "lxc.idmap",                     "lxc.idmap"           },
+	{ "lxc.unknown.key",               NULL                  },
+};
+
+static int64_t now_nsec(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Check that keys resolve to the expected entries and time the lookups.
+ * Usage: lxc-test-config-jump-table [iterations]
+ */
+static int lookup_bench(int iterations)
+{
+	int64_t start, elapsed;
+	size_t hits = 0;
+
+	for (size_t i = 0; i < ARRAY_SIZE(lookups); i++) {
+		struct lxc_config_t *config;
+
+		config = lxc_get_config(lookups[i][0]);
+		if ((config->name == NULL) != (lookups[i][1] == NULL) ||
+		    (config->name && strcmp(config->name, lookups[i][1]))) {
+			lxc_error("configuration key \"%s\" resolved to \"%s\" instead of \"%s\"\n",
+				  lookups[i][0], config->name ? config->name : "(unsupported)",
+				  lookups[i][1] ? lookups[i][1] : "(unsupported)");
+			return -1;
+		}
+	}
+
+	start = now_nsec();
+	for (int n = 0; n < iterations; n++)
+		for (size_t i = 0; i < ARRAY_SIZE(lookups); i++)
+			if (lxc_get_config(lookups[i][0])->name)
+				hits++;
+	elapsed = now_nsec() - start;
+
+	printf("lxc_get_config(): %zu lookups in %lld nsec (%.1f nsec per lookup)\n",
+	       (size_t)iterations * ARRAY_SIZE(lookups), (long long)elapsed,
+	       (double)elapsed / ((double)iterations * ARRAY_SIZE(lookups)));
+
+	return hits == (size_t)iterations * (ARRAY_SIZE(lookups) - 1) ? 0 : -1;
+}
 
 int main(int argc, char *argv[])
 {
 	int fulllen = 0, inlen = 0, ret = EXIT_FAILURE;
 	char *key, *keys, *saveptr = NULL;
+	int iterations = 100000;
+
+	if (argc > 1)
+		iterations = atoi(argv[1]);
+	if (iterations <= 0)
+		exit(ret);
 
 	fulllen = lxc_list_config_items(NULL, inlen);
 
@@ -83,8 +155,18 @@ int main(int argc, char *argv[])
 				  key);
 			goto on_error;
 		}
+
+		if (!config->name || strcmp(config->name, key)) {
+			lxc_error("configuration key \"%s\" shadowed by \"%s\" "
+				  "in jump table\n",
+				  key, config->name ? config->name : "(unsupported)");
+			goto on_error;
+		}
 	}
 
+	if (lookup_bench(iterations) < 0)
+		goto on_error;
+
 	ret = EXIT_SUCCESS;
 
 on_error:
@@ -0,0 +1,415 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+/*
+ * Copy a tree with lxc_copy_tree() and compare the copy against the source:
+ * file types, modes, ownership, modification times, contents, extended
+ * attributes, symlink targets and device numbers. Hardlinks must stay
+ * hardlinks and holes in sparse files must stay holes. Then change the source,
+ * leave stale and conflicting entries in the copy and copy over it again.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#include "lxctest.h"
+#include "file_utils.h"
+#include "memory_utils.h"
+#include "storage/rsync.h"
+#include "string_utils.h"
+#include "utils.h"
+
+/* Offset of the only data in the sparse file. */
+#define SPARSE_DATA_OFFSET (1024 * 1024)
+#define SPARSE_SIZE (4 * 1024 * 1024)
+
+static bool have_xattrs;
+static bool have_holes;
+
+/* Store @dir/@name in @buf, which is PATH_MAX bytes long. */
+static char *path_at(char *buf, const char *dir, const char *name)
+{
+	lxc_test_assert_abort(strnprintf(buf, PATH_MAX, "%s/%s", dir, name) >= 0);
+	return buf;
+}
+
+static bool write_at(const char *path, const char *data, off_t off, off_t size)
+{
+	__do_close int fd = -EBADF;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return false;
+
+	if (size && ftruncate(fd, size) < 0)
+		return false;
+
+	return lxc_pwrite_nointr(fd, data, strlen(data), off) == (ssize_t)strlen(data);
+}
+
+static bool read_all(const char *path, char *buf, size_t size, ssize_t *len)
+{
+	__do_close int fd = -EBADF;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	*len = lxc_read_nointr(fd, buf, size);
+	return *len >= 0;
+}
+
+static bool set_mtime(const char *path, time_t sec)
+{
+	struct timespec times[2] = {
+		{ .tv_sec = sec, .tv_nsec = 0 },
+		{ .tv_sec = sec, .tv_nsec = 123456789 },
+	};
+
+	return utimensat(AT_FDCWD, path, times, AT_SYMLINK_NOFOLLOW) == 0;
+}
+
+static bool populate(const char *src)
+{
+	char path[PATH_MAX], other[PATH_MAX];
+
+	path_at(path, src, "sub/deeper");
+	if (mkdir_p(path, 0755) < 0)
+		return false;
+
+	path_at(path, src, "file");
+	if (!write_at(path, "contents of file\n", 0, 0) || chmod(path, 0640) < 0)
+		return false;
+
+	if (setxattr(path, "user.lxc.test", "value", 5, 0) == 0)
+		have_xattrs = true;
+	else if (errno != ENOTSUP)
+		return false;
+
+	path_at(path, src, "sub/link1");
+	if (!write_at(path, "shared inode\n", 0, 0))
+		return false;
+
+	path_at(other, src, "sub/deeper/link2");
+	if (link(path, other) < 0)
+		return false;
+
+	path_at(path, src, "sparse");
+	if (!write_at(path, "data", SPARSE_DATA_OFFSET, SPARSE_SIZE))
+		return false;
+
+	path_at(path, src, "sym");
+	if (symlink("file", path) < 0)
+		return false;
+
+	path_at(path, src, "sub/dangling");
+	if (symlink("../missing", path) < 0)
+		return false;
+
+	path_at(path, src, "fifo");
+	if (mkfifo(path, 0600) < 0)
+		return false;
+
+	/* Character devices need privilege, the fifo covers mknod otherwise. */
+	path_at(path, src, "null");
+	if (mknod(path, S_IFCHR | 0666, makedev(1, 3)) < 0 && errno != EPERM)
+		return false;
+
+	path_at(path, src, "sub");
+	if (chmod(path, 0750) < 0 || !set_mtime(path, 1000000000))
+		return false;
+
+	path_at(path, src, "sym");
+	return set_mtime(path, 1100000000);
+}
+
+static bool compare_xattrs(const char *src, const char *dest)
+{
+	char src_names[4096], dest_names[4096], src_value[4096], dest_value[4096];
+	ssize_t src_len, dest_len;
+
+	src_len = llistxattr(src, src_names, sizeof(src_names));
+	dest_len = llistxattr(dest, dest_names, sizeof(dest_names));
+	if (src_len < 0 || dest_len < 0)
+		return src_len < 0 && dest_len < 0;
+
+	if (src_len != dest_len)
+		return false;
+
+	for (char *name = src_names; name < src_names + src_len; name += strlen(name) + 1) {
+		ssize_t src_size, dest_size;
+
+		src_size = lgetxattr(src, name, src_value, sizeof(src_value));
+		dest_size = lgetxattr(dest, name, dest_value, sizeof(dest_value));
+		if (src_size != dest_size || src_size < 0 ||
+		    memcmp(src_value, dest_value, src_size))
+			return false;
+	}
+
+	return true;
+}
+
+static bool compare_contents(const char *src, const char *dest, const struct stat *st)
+{
+	__do_free char *src_buf = NULL, *dest_buf = NULL;
+	ssize_t src_len, dest_len;
+
+	src_buf = malloc(st->st_size + 1);
+	dest_buf = malloc(st->st_size + 1);
+	if (!src_buf || !dest_buf)
+		return false;
+
+	if (!read_all(src, src_buf, st->st_size + 1, &src_len) ||
+	    !read_all(dest, dest_buf, st->st_size + 1, &dest_len))
+		return false;
+
+	return src_len == dest_len && memcmp(src_buf, dest_buf, src_len) == 0;
+}
+
+static int count_entries(const char *path)
+{
+	__do_closedir DIR *d = NULL;
+	struct dirent *de;
+	int n = 0;
+
+	d = opendir(path);
+	if (!d)
+		return -1;
+
+	while ((de = readdir(d)))
+		if (!strequal(de->d_name, ".") && !strequal(de->d_name, ".."))
+			n++;
+
+	return n;
+}
+
+/* Compare @src with @dest recursively, the copy must have nothing extra. */
+static bool compare_tree(const char *src, const char *dest)
+{
+	__do_closedir DIR *d = NULL;
+	struct stat src_st, dest_st;
+	struct dirent *de;
+
+	if (lstat(src, &src_st) < 0 || lstat(dest, &dest_st) < 0) {
+		lxc_error("Failed to stat \"%s\" or \"%s\"", src, dest);
+		return false;
+	}
+
+	if (src_st.st_mode != dest_st.st_mode || src_st.st_uid != dest_st.st_uid ||
+	    src_st.st_gid != dest_st.st_gid || src_st.st_rdev != dest_st.st_rdev) {
+		lxc_error("Mode, owner or device of \"%s\" differ", dest);
+		return false;
+	}
+
+	if (src_st.st_mtim.tv_sec != dest_st.st_mtim.tv_sec ||
+	    src_st.st_mtim.tv_nsec != dest_st.st_mtim.tv_nsec) {
+		lxc_error("Modification time of \"%s\" differs", dest);
+		return false;
+	}
+
+	if (!compare_xattrs(src, dest)) {
+		lxc_error("Extended attributes of \"%s\" differ", dest);
+		return false;
+	}
+
+	if (S_ISLNK(src_st.st_mode)) {
+		char src_target[PATH_MAX], dest_target[PATH_MAX];
+		ssize_t src_len, dest_len;
+
+		src_len = readlink(src, src_target, sizeof(src_target));
+		dest_len = readlink(dest, dest_target, sizeof(dest_target));
+		if (src_len < 0 || src_len != dest_len ||
+		    memcmp(src_target, dest_target, src_len)) {
+			lxc_error("Target of \"%s\" differs", dest);
+			return false;
+		}
+
+		return true;
+	}
+
+	if (S_ISREG(src_st.st_mode)) {
+		if (src_st.st_size != dest_st.st_size ||
+		    !compare_contents(src, dest, &src_st)) {
+			lxc_error("Contents of \"%s\" differ", dest);
+			return false;
+		}
+
+		return true;
+	}
+
+	if (!S_ISDIR(src_st.st_mode))
+		return true;
+
+	if (count_entries(src) != count_entries(dest)) {
+		lxc_error("\"%s\" has different entries than \"%s\"", dest, src);
+		return false;
+	}
+
+	d = opendir(src);
+	if (!d)
+		return false;
+
+	while ((de = readdir(d))) {
+		__do_free char *src_path = NULL, *dest_path = NULL;
+
+		if (strequal(de->d_name, ".") || strequal(de->d_name, ".."))
+			continue;
+
+		src_path = must_make_path(src, de->d_name, NULL);
+		dest_path = must_make_path(dest, de->d_name, NULL);
+		if (!compare_tree(src_path, dest_path))
+			return false;
+	}
+
+	return true;
+}
+
+static bool check_links(const char *dest)
+{
+	char path[PATH_MAX];
+	struct stat st1, st2;
+
+	path_at(path, dest, "sub/link1");
+	if (lstat(path, &st1) < 0)
+		return false;
+
+	path_at(path, dest, "sub/deeper/link2");
+	if (lstat(path, &st2) < 0)
+		return false;
+
+	return st1.st_ino == st2.st_ino && st1.st_dev == st2.st_dev &&
+	       st1.st_nlink == 2;
+}
+
+/* The leading hole must still be a hole if the filesystem reports holes. */
+static bool check_sparse(const char *dest)
+{
+	__do_close int fd = -EBADF;
+	char path[PATH_MAX];
+
+	if (!have_holes)
+		return true;
+
+	path_at(path, dest, "sparse");
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	return lseek(fd, 0, SEEK_DATA) == SPARSE_DATA_OFFSET;
+}
+
+static bool check_copy(const char *src, const char *dest)
+{
+	if (lxc_copy_tree(src, dest, 4, 0) < 0) {
+		lxc_error("Failed to copy \"%s\" to \"%s\"", src, dest);
+		return false;
+	}
+
+	if (!compare_tree(src, dest))
+		return false;
+
+	if (!check_links(dest)) {
+		lxc_error("Hardlinks in \"%s\" weren't preserved", dest);
+		return false;
+	}
+
+	if (!check_sparse(dest)) {
+		lxc_error("Holes in \"%s/sparse\" weren't preserved", dest);
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Change the source and leave entries in the copy which are stale or have a
+ * different type than in the source, the next copy has to replace them.
+ */
+static bool dirty(const char *src, const char *dest)
+{
+	char path[PATH_MAX];
+
+	path_at(path, src, "file");
+	if (!write_at(path, "new contents\n", 0, 0))
+		return false;
+
+	path_at(path, src, "added");
+	if (!write_at(path, "added\n", 0, 0))
+		return false;
+
+	path_at(path, dest, "stale");
+	if (!write_at(path, "stale\n", 0, 0))
+		return false;
+
+	path_at(path, dest, "stale-dir/child");
+	if (mkdir_p(path, 0755) < 0)
+		return false;
+
+	path_at(path, dest, "sym");
+	if (unlink(path) < 0 || mkdir(path, 0755) < 0)
+		return false;
+
+	/* Break up the hardlink in the copy. */
+	path_at(path, dest, "sub/deeper/link2");
+	if (unlink(path) < 0 || !write_at(path, "not a link\n", 0, 0))
+		return false;
+
+	path_at(path, dest, "fifo");
+	return unlink(path) == 0 && write_at(path, "not a fifo\n", 0, 0);
+}
+
+int main(int argc, char *argv[])
+{
+	char template[] = P_tmpdir "/lxc-copy-tree-XXXXXX";
+	char src[PATH_MAX], dest[PATH_MAX], path[PATH_MAX];
+	__do_close int fd = -EBADF;
+	int ret = EXIT_FAILURE;
+
+	if (!mkdtemp(template)) {
+		lxc_error("%s", "Failed to create temporary directory");
+		exit(EXIT_FAILURE);
+	}
+	path_at(src, template, "src");
+	path_at(dest, template, "dest");
+
+	if (mkdir(src, 0755) < 0 || !populate(src)) {
+		lxc_error("Failed to populate \"%s\"", src);
+		goto on_error;
+	}
+
+	path_at(path, src, "sparse");
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd >= 0 && lseek(fd, 0, SEEK_DATA) == SPARSE_DATA_OFFSET)
+		have_holes = true;
+	close_prot_errno_disarm(fd);
+
+	if (!have_xattrs)
+		lxc_debug("%s", "Extended attributes aren't supported, not checking them");
+	if (!have_holes)
+		lxc_debug("%s", "Holes aren't reported, not checking sparse files");
+
+	if (!check_copy(src, dest))
+		goto on_error;
+
+	if (!dirty(src, dest)) {
+		lxc_error("Failed to change \"%s\" and \"%s\"", src, dest);
+		goto on_error;
+	}
+
+	if (!check_copy(src, dest))
+		goto on_error;
+
+	ret = EXIT_SUCCESS;
+
+on_error:
+	(void)lxc_rmdir_onedev(template, NULL);
+	exit(ret);
+}
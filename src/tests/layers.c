@@ -0,0 +1,306 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+/*
+ * Import directories into the layer store and check that equal trees get
+ * the same digest while extended attributes and hardlinks change it. A
+ * container created from two layers and its snapshot must hold references on
+ * both layers instead of depending on each other, destroying them must drop
+ * the references and pruning must then remove the layers.
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#include "lxc/lxccontainer.h"
+#include "lxctest.h"
+#include "conf.h"
+#include "file_utils.h"
+#include "memory_utils.h"
+#include "storage/overlay.h"
+#include "string_utils.h"
+#include "utils.h"
+
+/* A valid digest no layer is imported as. */
+#define MISSING_LAYER "0000000000000000000000000000000000000000000000000000000000000000"
+
+static char *path_at(char *buf, const char *dir, const char *name)
+{
+	lxc_test_assert_abort(strnprintf(buf, PATH_MAX, "%s/%s", dir, name) >= 0);
+	return buf;
+}
+
+static bool write_file(const char *path, const char *data)
+{
+	__do_close int fd = -EBADF;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return false;
+
+	return lxc_write_nointr(fd, data, strlen(data)) == (ssize_t)strlen(data);
+}
+
+/* A file "file" with a user xattr if supported and "dir/a" linked to "dir/b". */
+static bool populate(const char *dir, bool *have_xattrs)
+{
+	char path[PATH_MAX], other[PATH_MAX];
+
+	if (mkdir(path_at(path, dir, "dir"), 0755) < 0 ||
+	    !write_file(path_at(path, dir, "file"), "file") ||
+	    !write_file(path_at(path, dir, "dir/a"), "link") ||
+	    link(path, path_at(other, dir, "dir/b")) < 0)
+		return false;
+
+	*have_xattrs = setxattr(path_at(path, dir, "file"), "user.lxc.test", "1", 1, 0) == 0;
+	return *have_xattrs || errno == ENOTSUP;
+}
+
+static bool import(const char *lxcpath, const char *dir, char *digest)
+{
+	int ret;
+
+	ret = lxc_layer_import(lxcpath, dir, digest);
+	if (ret < 0) {
+		lxc_error("Failed to import \"%s\": %s", dir, strerror(-ret));
+		return false;
+	}
+
+	return true;
+}
+
+static bool layer_exists(const char *lxcpath, const char *digest)
+{
+	char path[PATH_MAX];
+
+	return strnprintf(path, sizeof(path), "%s/" LXC_LAYER_STORE "/%s/rootfs",
+			  lxcpath, digest) >= 0 && dir_exists(path);
+}
+
+static int count_refs(const char *lxcpath, const char *digest)
+{
+	__do_closedir DIR *dir = NULL;
+	char path[PATH_MAX];
+	struct dirent *direntp;
+	int nr = 0;
+
+	if (strnprintf(path, sizeof(path), "%s/" LXC_LAYER_STORE "/%s/refs",
+		       lxcpath, digest) < 0)
+		return -1;
+
+	dir = opendir(path);
+	if (!dir)
+		return -1;
+
+	while ((direntp = readdir(dir)))
+		if (!strequal(direntp->d_name, ".") && !strequal(direntp->d_name, ".."))
+			nr++;
+
+	return nr;
+}
+
+static bool check_refs(const char *lxcpath, const char *const *digests,
+		       int expected)
+{
+	for (int i = 0; i < 2; i++) {
+		int nr = count_refs(lxcpath, digests[i]);
+
+		if (nr != expected) {
+			lxc_error("Layer %s has %d instead of %d references",
+				  digests[i], nr, expected);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool container_file_exists(const char *lxcpath, const char *name,
+				  const char *file)
+{
+	char path[PATH_MAX];
+
+	return strnprintf(path, sizeof(path), "%s/%s%s%s", lxcpath, name,
+			  file ? "/" : "", file ? file : "") >= 0 &&
+	       access(path, F_OK) == 0;
+}
+
+/* Destroy @name the way it is found on disk. */
+static bool destroy(const char *lxcpath, const char *name)
+{
+	struct lxc_container *c;
+	bool ret;
+
+	c = lxc_container_new(name, lxcpath);
+	if (!c)
+		return false;
+
+	ret = c->is_defined(c) && c->destroy(c);
+	lxc_container_put(c);
+
+	if (!ret)
+		lxc_error("Failed to destroy \"%s\"", name);
+	return ret;
+}
+
+/* Equal trees get equal digests, xattrs and hardlinks change them. */
+static bool test_import(const char *lxcpath, const char *src, char *digest)
+{
+	char again[LXC_LAYER_DIGEST_LEN + 1], other[LXC_LAYER_DIGEST_LEN + 1];
+	char path[PATH_MAX];
+	bool have_xattrs;
+
+	if (!populate(src, &have_xattrs)) {
+		lxc_error("Failed to populate \"%s\"", src);
+		return false;
+	}
+
+	if (!import(lxcpath, src, digest) || !import(lxcpath, src, again))
+		return false;
+
+	if (!strequal(digest, again) || !layer_exists(lxcpath, digest)) {
+		lxc_error("Importing \"%s\" twice gave layers %s and %s", src, digest, again);
+		return false;
+	}
+
+	if (have_xattrs) {
+		if (setxattr(path_at(path, src, "file"), "user.lxc.test", "2", 1, 0) < 0 ||
+		    !import(lxcpath, src, other))
+			return false;
+
+		if (strequal(digest, other)) {
+			lxc_error("%s", "Changing an xattr kept the digest");
+			return false;
+		}
+
+		if (setxattr(path, "user.lxc.test", "1", 1, 0) < 0)
+			return false;
+	}
+
+	/* Same contents, but "dir/b" is a copy instead of a link. */
+	if (unlink(path_at(path, src, "dir/b")) < 0 || !write_file(path, "link") ||
+	    !import(lxcpath, src, other))
+		return false;
+
+	if (strequal(digest, other)) {
+		lxc_error("%s", "Breaking a hardlink kept the digest");
+		return false;
+	}
+
+	return true;
+}
+
+static bool test_layers(const char *lxcpath, const char *const *digests)
+{
+	struct lxc_container *c = NULL, *clone = NULL;
+	bool ret = false;
+
+	c = lxc_container_new("layers-failed", lxcpath);
+	if (!c)
+		return false;
+
+	/* A missing layer leaves nothing behind. */
+	if (lxc_layers_create(c, (const char *const[]){ digests[0], MISSING_LAYER }, 2) ||
+	    container_file_exists(lxcpath, "layers-failed", NULL)) {
+		lxc_error("%s", "Creating a container from a missing layer didn't fail cleanly");
+		goto out;
+	}
+	lxc_container_put(c);
+
+	c = lxc_container_new("layers", lxcpath);
+	if (!c || !lxc_layers_create(c, digests, 2)) {
+		lxc_error("%s", "Failed to create container from layers");
+		goto out;
+	}
+
+	if (!check_refs(lxcpath, digests, 1))
+		goto out;
+
+	clone = c->clone(c, "layers-clone", lxcpath, LXC_CLONE_SNAPSHOT, "overlay",
+			 NULL, 0, NULL);
+	if (!clone) {
+		lxc_error("%s", "Failed to snapshot \"layers\"");
+		goto out;
+	}
+
+	if (!check_refs(lxcpath, digests, 2))
+		goto out;
+
+	if (container_file_exists(lxcpath, "layers-clone", "lxc_rdepends")) {
+		lxc_error("%s", "\"layers-clone\" depends on \"layers\"");
+		goto out;
+	}
+
+	/* Used layers are kept. */
+	if (lxc_layers_prune(lxcpath) < 0 || !layer_exists(lxcpath, digests[0]) ||
+	    !layer_exists(lxcpath, digests[1])) {
+		lxc_error("%s", "Pruned layers which are in use");
+		goto out;
+	}
+
+	if (!destroy(lxcpath, "layers-clone") || !check_refs(lxcpath, digests, 1))
+		goto out;
+
+	if (!destroy(lxcpath, "layers") || !check_refs(lxcpath, digests, 0))
+		goto out;
+
+	if (lxc_layers_prune(lxcpath) < 2 || layer_exists(lxcpath, digests[0]) ||
+	    layer_exists(lxcpath, digests[1])) {
+		lxc_error("%s", "Failed to prune unused layers");
+		goto out;
+	}
+
+	ret = true;
+
+out:
+	lxc_container_put(clone);
+	lxc_container_put(c);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	char template[] = P_tmpdir "/lxc-layers-XXXXXX";
+	char lower[LXC_LAYER_DIGEST_LEN + 1], upper[LXC_LAYER_DIGEST_LEN + 1];
+	const char *digests[] = { upper, lower };
+	char src[PATH_MAX], dir[PATH_MAX], path[PATH_MAX];
+	int ret = EXIT_FAILURE;
+	char *lxcpath;
+
+	lxcpath = mkdtemp(template);
+	if (!lxcpath) {
+		lxc_error("%s", "Failed to create temporary lxcpath");
+		exit(EXIT_FAILURE);
+	}
+
+	if (mkdir(path_at(src, lxcpath, "lower"), 0755) < 0 ||
+	    mkdir(path_at(dir, lxcpath, "upper"), 0755) < 0 ||
+	    !write_file(path_at(path, dir, "upper"), "upper")) {
+		lxc_error("%s", "Failed to create source directories");
+		goto on_error;
+	}
+
+	if (lxc_layer_import(lxcpath, src, lower) == -EOPNOTSUPP) {
+		lxc_debug("%s", "Layers aren't supported without openssl");
+		ret = EXIT_SUCCESS;
+		goto on_error;
+	}
+
+	if (!test_import(lxcpath, src, lower) ||
+	    !import(lxcpath, dir, upper) ||
+	    !test_layers(lxcpath, digests))
+		goto on_error;
+
+	ret = EXIT_SUCCESS;
+
+on_error:
+	(void)lxc_rmdir_onedev(lxcpath, NULL);
+	exit(ret);
+}
@@ -88,6 +88,18 @@ static void test_list_func(const char *lxcpath, const char *type,
 	}
 }
 
+static int list_defined_parallel(const char *lxcpath, char ***names,
+				 struct lxc_container ***cret)
+{
+	return list_defined_containers_parallel(lxcpath, 4, names, cret);
+}
+
+static int list_all_parallel(const char *lxcpath, char ***names,
+			     struct lxc_container ***cret)
+{
+	return list_all_containers_parallel(lxcpath, 4, names, cret);
+}
+
 int main(int argc, char *argv[])
 {
 	const char *lxcpath = NULL;
@@ -98,6 +110,8 @@ int main(int argc, char *argv[])
 	test_list_func(lxcpath, "Defined:", list_defined_containers);
 	test_list_func(lxcpath, "Active:", list_active_containers);
 	test_list_func(lxcpath, "All:", list_all_containers);
+	test_list_func(lxcpath, "Defined (parallel):", list_defined_parallel);
+	test_list_func(lxcpath, "All (parallel):", list_all_parallel);
 
 	exit(EXIT_SUCCESS);
 }
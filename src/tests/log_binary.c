@@ -0,0 +1,227 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+/*
+ * Write log messages with lxc.log.format = binary and check that
+ * lxc-log-decode turns them back into the messages the text format would
+ * have produced. Two writers in separate pid namespaces both run as pid 1 and
+ * interleave their records in the same log file.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "lxctest.h"
+#include "conf.h"
+#include "log.h"
+#include "utils.h"
+
+lxc_log_define(log_binary, lxc);
+
+#define MAX_EXPECTED 16
+
+static char expected[MAX_EXPECTED][LXC_LOG_BUFFER_SIZE];
+static int nr_expected;
+
+#define LOG_EXPECT(format, ...)								\
+	do {										\
+		INFO(format, ##__VA_ARGS__);						\
+		snprintf(expected[nr_expected++], sizeof(expected[0]), format,		\
+			 ##__VA_ARGS__);						\
+	} while (0)
+
+static void log_alpha(int value)
+{
+	INFO("alpha %d", value);
+}
+
+static void log_beta(const char *value)
+{
+	INFO("beta %s", value);
+}
+
+/*
+ * Run @fn as pid 1 of a new pid namespace if possible, so concurrent writers
+ * share a pid. Falls back to a plain child without the privilege for it.
+ */
+static pid_t spawn_writer(void (*fn)(int fds[2]), int fds[2])
+{
+	pid_t pid;
+	int status;
+
+	pid = fork();
+	if (pid != 0)
+		return pid;
+
+	if (unshare(CLONE_NEWPID) == 0) {
+		pid = fork();
+		if (pid < 0)
+			_exit(EXIT_FAILURE);
+
+		if (pid > 0) {
+			if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+				_exit(EXIT_FAILURE);
+
+			_exit(WEXITSTATUS(status));
+		}
+	}
+
+	fn(fds);
+	_exit(EXIT_SUCCESS);
+}
+
+static void writer_alpha(int fds[2])
+{
+	char c = 0;
+
+	log_alpha(1);
+	if (write(fds[1], &c, 1) != 1 || read(fds[0], &c, 1) != 1)
+		_exit(EXIT_FAILURE);
+
+	log_alpha(3);
+}
+
+static void writer_beta(int fds[2])
+{
+	log_beta("two");
+}
+
+static bool wait_writer(pid_t pid)
+{
+	int status;
+
+	return waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+	       WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+	char template[] = P_tmpdir "/lxc-log-binary-XXXXXX";
+	int ready[2] = {-EBADF, -EBADF}, go[2] = {-EBADF, -EBADF};
+	int alpha_fds[2], beta_fds[2] = {-EBADF, -EBADF};
+	struct lxc_conf conf = {};
+	char path[PATH_MAX], cmd[PATH_MAX + 32], name[] = "log-binary";
+	int ret = EXIT_FAILURE, decoded = 0;
+	pid_t alpha, beta;
+	char *line = NULL;
+	size_t line_sz = 0;
+	FILE *f = NULL;
+
+	if (!mkdtemp(template)) {
+		lxc_error("%s\n", "Failed to create temporary directory");
+		exit(EXIT_FAILURE);
+	}
+	snprintf(path, sizeof(path), "%s/binary.log", template);
+
+	conf.name = name;
+	conf.loglevel = LXC_LOG_LEVEL_TRACE;
+	conf.log_format = LXC_LOG_FORMAT_BINARY;
+	conf.logfd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+	if (conf.logfd < 0) {
+		lxc_error("Failed to open \"%s\"\n", path);
+		goto on_error;
+	}
+	current_config = &conf;
+
+	LOG_EXPECT("int %d unsigned %u long %ld unsigned long %lu", -1, 2U, -3L, 4UL);
+	LOG_EXPECT("long long %lld size %zu ptrdiff %td intmax %jd", -5LL,
+		   (size_t)6, (ptrdiff_t)-7, (intmax_t)8);
+	LOG_EXPECT("string %s width %*d precision %.*s", "str", 5, 42, 3, "abcdef");
+	LOG_EXPECT("double %.2f char %c hex %#x octal %o percent %%", 1.5, 'x', 255, 8);
+	LOG_EXPECT("%s", "");
+
+	errno = ENOENT;
+	INFO("errno %m");
+	snprintf(expected[nr_expected++], sizeof(expected[0]), "errno %s", strerror(ENOENT));
+
+	/*
+	 * Both writers describe their first callsite with the same id, the
+	 * event of the first writer comes after the callsite of the second.
+	 */
+	if (pipe(ready) < 0 || pipe(go) < 0) {
+		lxc_error("%s\n", "Failed to create pipes");
+		goto on_error;
+	}
+	alpha_fds[0] = go[0];
+	alpha_fds[1] = ready[1];
+
+	alpha = spawn_writer(writer_alpha, alpha_fds);
+	if (alpha < 0 || read(ready[0], &(char){0}, 1) != 1) {
+		lxc_error("%s\n", "Failed to start first writer");
+		goto on_error;
+	}
+
+	beta = spawn_writer(writer_beta, beta_fds);
+	if (beta < 0 || !wait_writer(beta)) {
+		lxc_error("%s\n", "Second writer failed");
+		goto on_error;
+	}
+
+	if (write(go[1], &(char){0}, 1) != 1 || !wait_writer(alpha)) {
+		lxc_error("%s\n", "First writer failed");
+		goto on_error;
+	}
+	snprintf(expected[nr_expected++], sizeof(expected[0]), "alpha 1");
+	snprintf(expected[nr_expected++], sizeof(expected[0]), "beta two");
+	snprintf(expected[nr_expected++], sizeof(expected[0]), "alpha 3");
+
+	snprintf(cmd, sizeof(cmd), "lxc-log-decode %s", path);
+	f = popen(cmd, "r");
+	if (!f) {
+		lxc_error("%s\n", "Failed to run lxc-log-decode");
+		goto on_error;
+	}
+
+	while (getline(&line, &line_sz, f) > 0) {
+		size_t len, msg_len;
+
+		line[strcspn(line, "\n")] = '\0';
+		if (decoded >= nr_expected) {
+			lxc_error("Unexpected line \"%s\"\n", line);
+			goto on_error;
+		}
+
+		len = strlen(line);
+		msg_len = strlen(expected[decoded]);
+		if (!strstr(line, " INFO     log_binary - ") || len < msg_len + 3 ||
+		    !strnequal(line + len - msg_len - 3, " - ", 3) ||
+		    !strequal(line + len - msg_len, expected[decoded])) {
+			lxc_error("Decoded \"%s\", expected message \"%s\"\n",
+				  line, expected[decoded]);
+			goto on_error;
+		}
+
+		decoded++;
+	}
+
+	if (decoded != nr_expected) {
+		lxc_error("Decoded %d of %d messages\n", decoded, nr_expected);
+		goto on_error;
+	}
+
+	ret = EXIT_SUCCESS;
+
+on_error:
+	current_config = NULL;
+	if (f)
+		pclose(f);
+	free(line);
+	if (conf.logfd >= 0)
+		close(conf.logfd);
+	for (int i = 0; i < 2; i++) {
+		if (ready[i] >= 0)
+			close(ready[i]);
+		if (go[i] >= 0)
+			close(go[i]);
+	}
+	(void)unlink(path);
+	(void)rmdir(template);
+	exit(ret);
+}
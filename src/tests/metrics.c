@@ -0,0 +1,331 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+/*
+ * Check the cgroup2 metrics parser against a fake cgroup directory. Then read
+ * the metrics of the given containers with the batch API and check that a
+ * container which isn't running reports none.
+ *
+ * Usage: lxc-test-metrics [lxcpath [name ..]]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lxc/lxccontainer.h"
+#include "lxctest.h"
+#include "cgroups/cgroup_utils.h"
+#include "file_utils.h"
+#include "macro.h"
+#include "memory_utils.h"
+
+static const struct {
+	const char *file;
+	const char *content;
+} fake_cgroup[] = {
+	{
+		"cpu.stat",
+		"usage_usec 123456\n"
+		"user_usec 100000\n"
+		"system_usec 23456\n"
+		"nr_periods 10\n"
+		"nr_throttled 2\n"
+		"throttled_usec 789\n",
+	},
+	{ "memory.current",      "1048576\n" },
+	{ "memory.max",          "max\n"     },
+	{ "memory.swap.current", "4096\n"    },
+	{ "memory.swap.max",     "8192\n"    },
+	{
+		"memory.stat",
+		"anon 1000\n"
+		"file_mapped 1\n"
+		"file 2000\n"
+		"kernel_stack 300\n"
+		"slab_reclaimable 2\n"
+		"slab 400\n"
+		"sock 50\n"
+		"shmem 60\n"
+		"pgfault 7000\n"
+		"pgmajfault 8\n",
+	},
+	{
+		"io.stat",
+		"8:0 rbytes=100 wbytes=200 rios=3 wios=4 dbytes=5 dios=6\n"
+		"253:0 rbytes=1000 wbytes=2000 rios=30 wios=40 dbytes=50 dios=60\n",
+	},
+	{ "pids.current",        "7\n"       },
+	{ "pids.max",            "max\n"     },
+	{
+		"cpu.pressure",
+		"some avg10=1.50 avg60=0.25 avg300=0.05 total=123456\n",
+	},
+	{
+		"memory.pressure",
+		"some avg10=0.00 avg60=12.34 avg300=0.00 total=42\n"
+		"full avg10=0.00 avg60=0.00 avg300=99.99 total=21\n",
+	},
+	{
+		"io.pressure",
+		"some avg10=0.10 avg60=0.00 avg300=0.00 total=3\n"
+		"full avg10=0.00 avg60=0.00 avg300=0.00 total=1\n",
+	},
+};
+
+static bool double_equal(double a, double b)
+{
+	return a - b < 1e-9 && b - a < 1e-9;
+}
+
+#define CHECK(expr)							\
+	do {								\
+		if (!(expr)) {						\
+			lxc_error("Check failed: %s\n", #expr);		\
+			return false;					\
+		}							\
+	} while (0)
+
+static bool check_pressure(const struct lxc_pressure *p, double some_avg10,
+			   double some_avg60, double some_avg300,
+			   uint64_t some_total, double full_avg300,
+			   uint64_t full_total)
+{
+	CHECK(double_equal(p->some.avg10, some_avg10));
+	CHECK(double_equal(p->some.avg60, some_avg60));
+	CHECK(double_equal(p->some.avg300, some_avg300));
+	CHECK(p->some.total == some_total);
+	CHECK(double_equal(p->full.avg10, 0));
+	CHECK(double_equal(p->full.avg60, 0));
+	CHECK(double_equal(p->full.avg300, full_avg300));
+	CHECK(p->full.total == full_total);
+
+	return true;
+}
+
+static bool check_parser(int dfd)
+{
+	struct lxc_metrics m = {
+		.flags = LXC_METRICS_ALL,
+	};
+
+	CHECK(cgroup2_read_metrics(dfd, &m) == LXC_METRICS_ALL);
+	CHECK(m.flags == LXC_METRICS_ALL);
+
+	CHECK(m.cpu_usage_usec == 123456);
+	CHECK(m.cpu_user_usec == 100000);
+	CHECK(m.cpu_system_usec == 23456);
+	CHECK(m.cpu_nr_periods == 10);
+	CHECK(m.cpu_nr_throttled == 2);
+	CHECK(m.cpu_throttled_usec == 789);
+
+	CHECK(m.memory_current == 1048576);
+	CHECK(m.memory_max == LXC_METRICS_UNLIMITED);
+	CHECK(m.memory_swap_current == 4096);
+	CHECK(m.memory_swap_max == 8192);
+	CHECK(m.memory_anon == 1000);
+	CHECK(m.memory_file == 2000);
+	CHECK(m.memory_kernel_stack == 300);
+	CHECK(m.memory_slab == 400);
+	CHECK(m.memory_sock == 50);
+	CHECK(m.memory_shmem == 60);
+	CHECK(m.memory_pgfault == 7000);
+	CHECK(m.memory_pgmajfault == 8);
+
+	CHECK(m.io_rbytes == 1100);
+	CHECK(m.io_wbytes == 2200);
+	CHECK(m.io_rios == 33);
+	CHECK(m.io_wios == 44);
+	CHECK(m.io_dbytes == 55);
+	CHECK(m.io_dios == 66);
+
+	CHECK(m.pids_current == 7);
+	CHECK(m.pids_max == LXC_METRICS_UNLIMITED);
+
+	/* Older kernels have no "full" line in cpu.pressure. */
+	CHECK(check_pressure(&m.cpu_pressure, 1.5, 0.25, 0.05, 123456, 0, 0));
+	CHECK(check_pressure(&m.memory_pressure, 0, 12.34, 0, 42, 99.99, 21));
+	CHECK(check_pressure(&m.io_pressure, 0.1, 0, 0, 3, 0, 1));
+
+	/* Only the requested metrics are read. */
+	m = (struct lxc_metrics){ .flags = LXC_METRICS_PIDS | LXC_METRICS_IO };
+	CHECK(cgroup2_read_metrics(dfd, &m) == (LXC_METRICS_PIDS | LXC_METRICS_IO));
+	CHECK(m.pids_current == 7);
+	CHECK(m.io_rbytes == 1100);
+	CHECK(m.cpu_usage_usec == 0);
+	CHECK(m.memory_current == 0);
+
+	return true;
+}
+
+static bool test_parser(void)
+{
+	char template[] = P_tmpdir "/lxc-test-metrics-XXXXXX";
+	__do_close int dfd = -EBADF;
+	bool ret = false;
+
+	if (!mkdtemp(template)) {
+		lxc_error("%s\n", "Failed to create fake cgroup directory");
+		return false;
+	}
+
+	dfd = open(template, O_DIRECTORY | O_RDONLY | O_CLOEXEC);
+	if (dfd < 0) {
+		lxc_error("Failed to open \"%s\"\n", template);
+		goto out;
+	}
+
+	/* An empty cgroup reports nothing. */
+	{
+		struct lxc_metrics m = {
+			.flags = LXC_METRICS_ALL,
+		};
+
+		if (cgroup2_read_metrics(dfd, &m) != 0) {
+			lxc_error("%s\n", "Read metrics from an empty cgroup");
+			goto out;
+		}
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(fake_cgroup); i++) {
+		__do_close int fd = -EBADF;
+		size_t len = strlen(fake_cgroup[i].content);
+
+		fd = openat(dfd, fake_cgroup[i].file,
+			    O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+		if (fd < 0 || lxc_write_nointr(fd, fake_cgroup[i].content, len) != (ssize_t)len) {
+			lxc_error("Failed to write \"%s\"\n", fake_cgroup[i].file);
+			goto out;
+		}
+	}
+
+	ret = check_parser(dfd);
+
+out:
+	for (size_t i = 0; i < ARRAY_SIZE(fake_cgroup); i++)
+		(void)unlinkat(dfd, fake_cgroup[i].file, 0);
+	(void)rmdir(template);
+	return ret;
+}
+
+static void print_pressure(const char *name, const struct lxc_pressure *p)
+{
+	printf("  %s pressure: some %.2f %.2f %.2f %llu full %.2f %.2f %.2f %llu\n",
+	       name, p->some.avg10, p->some.avg60, p->some.avg300,
+	       (unsigned long long)p->some.total, p->full.avg10, p->full.avg60,
+	       p->full.avg300, (unsigned long long)p->full.total);
+}
+
+static void print_metrics(const char *name, const struct lxc_metrics *m)
+{
+	printf("%s: flags 0x%x\n", name, m->flags);
+
+	if (m->flags & LXC_METRICS_CPU)
+		printf("  cpu: usage %llu user %llu system %llu usec, throttled %llu usec\n",
+		       (unsigned long long)m->cpu_usage_usec,
+		       (unsigned long long)m->cpu_user_usec,
+		       (unsigned long long)m->cpu_system_usec,
+		       (unsigned long long)m->cpu_throttled_usec);
+
+	if (m->flags & LXC_METRICS_MEMORY)
+		printf("  memory: current %llu swap %llu anon %llu file %llu bytes\n",
+		       (unsigned long long)m->memory_current,
+		       (unsigned long long)m->memory_swap_current,
+		       (unsigned long long)m->memory_anon,
+		       (unsigned long long)m->memory_file);
+
+	if (m->flags & LXC_METRICS_IO)
+		printf("  io: read %llu written %llu bytes\n",
+		       (unsigned long long)m->io_rbytes,
+		       (unsigned long long)m->io_wbytes);
+
+	if (m->flags & LXC_METRICS_PIDS)
+		printf("  pids: %llu\n", (unsigned long long)m->pids_current);
+
+	if (m->flags & LXC_METRICS_PRESSURE) {
+		print_pressure("cpu", &m->cpu_pressure);
+		print_pressure("memory", &m->memory_pressure);
+		print_pressure("io", &m->io_pressure);
+	}
+
+	if (m->flags & LXC_METRICS_ROOTFS)
+		printf("  rootfs: used %llu of %llu bytes\n",
+		       (unsigned long long)m->rootfs_used,
+		       (unsigned long long)m->rootfs_size);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *lxcpath = argc > 1 ? argv[1] : NULL;
+	int count = argc > 2 ? argc - 2 : 0;
+	struct lxc_container **containers;
+	struct lxc_metrics *metrics;
+	int ret = EXIT_FAILURE, nr_read;
+
+	if (!test_parser())
+		exit(EXIT_FAILURE);
+
+	if (!lxc_has_api_extension("container_metrics")) {
+		lxc_error("%s\n", "The container_metrics API extension is missing");
+		exit(EXIT_FAILURE);
+	}
+
+	/* The last slot holds a container that doesn't exist. */
+	containers = calloc(count + 1, sizeof(*containers));
+	metrics = calloc(count + 1, sizeof(*metrics));
+	if (!containers || !metrics) {
+		lxc_error("%s\n", "Failed to allocate memory");
+		goto on_error;
+	}
+
+	for (int i = 0; i <= count; i++) {
+		const char *name = i < count ? argv[i + 2] : "lxc-test-metrics-missing";
+
+		containers[i] = lxc_container_new(name, lxcpath);
+		if (!containers[i]) {
+			lxc_error("Failed to create container \"%s\"\n", name);
+			goto on_error;
+		}
+
+		metrics[i].flags = LXC_METRICS_ALL | LXC_METRICS_ROOTFS;
+	}
+
+	/* Read twice, the second round goes through the cached cgroups. */
+	for (int round = 0; round < 2; round++) {
+		nr_read = lxc_containers_get_metrics(containers, count + 1, metrics);
+		if (nr_read < 0) {
+			lxc_error("%s\n", "Failed to read container metrics");
+			goto on_error;
+		}
+
+		if (metrics[count].flags != 0) {
+			lxc_error("%s\n", "Read metrics of a container that doesn't exist");
+			goto on_error;
+		}
+
+		for (int i = 0; i < count; i++) {
+			print_metrics(containers[i]->name, &metrics[i]);
+			metrics[i].flags = LXC_METRICS_ALL | LXC_METRICS_ROOTFS;
+		}
+		metrics[count].flags = LXC_METRICS_ALL | LXC_METRICS_ROOTFS;
+	}
+
+	if (lxc_containers_get_metrics(containers, -1, metrics) >= 0) {
+		lxc_error("%s\n", "Accepted a negative number of containers");
+		goto on_error;
+	}
+
+	printf("read metrics of %d of %d containers\n", nr_read, count);
+	ret = EXIT_SUCCESS;
+
+on_error:
+	if (containers)
+		for (int i = 0; i <= count; i++)
+			lxc_container_put(containers[i]);
+	free(containers);
+	free(metrics);
+	exit(ret);
+}
@@ -0,0 +1,202 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+/*
+ * Test and measure the lxc-monitord event bus. A subscriber listening to all
+ * containers and one filtering on a single name and state must see every
+ * message while a third subscriber that never reads stalls. Then a number of
+ * publisher processes flood the bus with state changes for their own
+ * container names. Subscribers that don't keep up miss messages but must
+ * never hold up the publishers.
+ *
+ * Usage: lxc-test-monitor-bus [publishers] [messages per publisher]
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lxctest.h"
+#include "state.h"
+#include "monitor.h"
+#include "utils.h"
+
+/* Round trips through the bus while one subscriber is stalled. */
+#define ROUND_TRIPS 1000
+
+/* How long the flooding publishers may take before they count as blocked. */
+#define PUBLISH_TIMEOUT_USEC (30 * 1000000LL)
+
+static int64_t now_usec(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static pid_t spawn_publisher(const char *lxcpath, int id, int messages)
+{
+	char name[NAME_MAX + 1];
+	pid_t pid;
+
+	pid = fork();
+	if (pid != 0)
+		return pid;
+
+	snprintf(name, sizeof(name), "bus-%d", id);
+	for (int i = 0; i < messages; i++)
+		lxc_monitor_send_state(name, (i & 1) ? STOPPED : RUNNING, lxcpath);
+
+	_exit(EXIT_SUCCESS);
+}
+
+static bool receive_state(int fd, const char *name, lxc_state_t state)
+{
+	struct pollfd pfd = {
+		.fd	= fd,
+		.events	= POLLIN,
+	};
+	struct lxc_msg msg;
+
+	if (poll(&pfd, 1, 5000) <= 0)
+		return false;
+
+	if (recv(fd, &msg, sizeof(msg), 0) != sizeof(msg))
+		return false;
+
+	return msg.type == lxc_msg_state && strequal(msg.name, name) &&
+	       msg.value == state;
+}
+
+/*
+ * Count the messages arriving on both subscriptions until all are in or the
+ * bus went silent for 5s. Returns false if the filtered subscription got a
+ * message it didn't ask for.
+ */
+static bool drain(int fds[2], const int expected[2], int received[2])
+{
+	struct pollfd pfds[2] = {
+		{.fd = fds[0], .events = POLLIN},
+		{.fd = fds[1], .events = POLLIN},
+	};
+	struct lxc_msg msg;
+
+	received[0] = received[1] = 0;
+	while (received[0] < expected[0] || received[1] < expected[1]) {
+		if (poll(pfds, 2, 5000) <= 0)
+			break;
+
+		for (int i = 0; i < 2; i++) {
+			if (!(pfds[i].revents & POLLIN))
+				continue;
+
+			if (recv(fds[i], &msg, sizeof(msg), 0) != sizeof(msg))
+				return true;
+
+			if (i == 1 && (!strequal(msg.name, "bus-0") || msg.value != RUNNING))
+				return false;
+
+			received[i]++;
+		}
+	}
+
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	char template[] = P_tmpdir "/lxc-monitor-bus-XXXXXX";
+	int publishers = 4, messages = 25000;
+	int fds[3] = {-EBADF, -EBADF, -EBADF};
+	int expected[2], received[2], status;
+	int64_t started, published, elapsed;
+	int ret = EXIT_FAILURE;
+	char *lxcpath;
+
+	if (argc > 1)
+		publishers = atoi(argv[1]);
+	if (argc > 2)
+		messages = atoi(argv[2]);
+	if (publishers <= 0 || messages <= 0)
+		exit(EXIT_FAILURE);
+
+	lxcpath = mkdtemp(template);
+	if (!lxcpath) {
+		lxc_error("%s\n", "Failed to create temporary lxcpath");
+		exit(EXIT_FAILURE);
+	}
+
+	if (lxc_monitord_spawn(lxcpath)) {
+		lxc_error("%s\n", "Failed to spawn lxc-monitord");
+		goto on_error;
+	}
+
+	fds[0] = lxc_monitor_subscribe(lxcpath, "bus-*", 1U << lxc_msg_state, 0);
+	fds[1] = lxc_monitor_subscribe(lxcpath, "bus-0", 1U << lxc_msg_state,
+				       1U << RUNNING);
+	fds[2] = lxc_monitor_subscribe(lxcpath, "bus-*", 0, 0);
+	if (fds[0] < 0 || fds[1] < 0 || fds[2] < 0) {
+		lxc_error("%s\n", "Failed to subscribe to the event bus");
+		goto on_error;
+	}
+
+	/* The subscriber on fds[2] never reads and must not hold up the others. */
+	for (int i = 0; i < ROUND_TRIPS; i++) {
+		lxc_monitor_send_state("bus-0", RUNNING, lxcpath);
+
+		if (!receive_state(fds[0], "bus-0", RUNNING) ||
+		    !receive_state(fds[1], "bus-0", RUNNING)) {
+			lxc_error("Message %d was lost on the event bus\n", i);
+			goto on_error;
+		}
+	}
+
+	started = now_usec();
+	for (int i = 0; i < publishers; i++) {
+		if (spawn_publisher(lxcpath, i, messages) < 0) {
+			lxc_error("%s\n", "Failed to fork publisher");
+			goto on_error;
+		}
+	}
+
+	expected[0] = publishers * messages;
+	expected[1] = (messages + 1) / 2;
+	if (!drain(fds, expected, received)) {
+		lxc_error("%s\n", "Filtered subscriber received a message it didn't ask for");
+		goto on_error;
+	}
+	elapsed = now_usec() - started;
+
+	while (waitpid(-1, &status, 0) > 0)
+		;
+	published = now_usec() - started;
+
+	printf("event bus: %d publishers, %d messages in %lld usec (%.0f msgs/sec), lost %d\n",
+	       publishers, received[0], (long long)elapsed,
+	       elapsed > 0 ? (double)received[0] * 1000000 / elapsed : 0.0,
+	       expected[0] - received[0]);
+	printf("filtered subscriber received %d of %d messages\n",
+	       received[1], expected[1]);
+
+	if (published > PUBLISH_TIMEOUT_USEC) {
+		lxc_error("Publishers took %lld usec to send their messages\n",
+			  (long long)published);
+		goto on_error;
+	}
+
+	ret = EXIT_SUCCESS;
+
+on_error:
+	for (int i = 0; i < 3; i++)
+		if (fds[i] >= 0)
+			close(fds[i]);
+	(void)rmdir(lxcpath);
+	exit(ret);
+}
@@ -0,0 +1,150 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+/*
+ * Start an overlay snapshot with lxc.rootfs.overlay.tmpfs set and check that
+ * files written in the container only end up in the tmpfs: they are visible
+ * in the container but neither in the upper directory on disk while it runs
+ * nor after it stopped. The rootfs metrics must report the size of the tmpfs.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lxc/attach_options.h"
+#include "lxc/lxccontainer.h"
+#include "lxctest.h"
+#include "storage/storage_utils.h"
+#include "string_utils.h"
+
+#define BASE_NAME "lxc-overlay-tmpfs-base"
+#define SNAP_NAME "lxc-overlay-tmpfs"
+
+/* Page aligned, so statfs() of the tmpfs reports exactly this size. */
+#define TMPFS_SIZE "64MB"
+#define TMPFS_SIZE_BYTES (64ULL * 1024 * 1024)
+
+#define WRITTEN "/lxc-overlay-tmpfs-written"
+
+static int run(struct lxc_container *c, char *argv[])
+{
+	lxc_attach_options_t attach_options = LXC_ATTACH_OPTIONS_DEFAULT;
+
+	return c->attach_run_wait(c, &attach_options, argv[0], (const char **)argv);
+}
+
+static bool on_disk(struct lxc_container *c)
+{
+	char path[PATH_MAX];
+
+	if (strnprintf(path, sizeof(path), "%s/%s/" LXC_OVERLAY_DELTA_PATH WRITTEN,
+		       c->config_path, c->name) < 0)
+		return true;
+
+	return access(path, F_OK) == 0 || errno != ENOENT;
+}
+
+static void destroy(const char *name)
+{
+	struct lxc_container *c;
+
+	c = lxc_container_new(name, NULL);
+	if (!c)
+		return;
+
+	if (c->is_running(c))
+		c->stop(c);
+
+	if (c->is_defined(c))
+		c->destroy(c);
+
+	lxc_container_put(c);
+}
+
+int main(int argc, char *argv[])
+{
+	char *touch[] = { "touch", WRITTEN, NULL };
+	char *test[] = { "test", "-e", WRITTEN, NULL };
+	struct lxc_container *base = NULL, *c = NULL;
+	struct lxc_metrics m = { .flags = LXC_METRICS_ROOTFS };
+	int ret = EXIT_FAILURE;
+
+	destroy(SNAP_NAME);
+	destroy(BASE_NAME);
+
+	base = lxc_container_new(BASE_NAME, NULL);
+	if (!base || !base->createl(base, "busybox", NULL, NULL, 0, NULL)) {
+		lxc_error("%s\n", "Failed to create busybox container \"" BASE_NAME "\"");
+		goto on_error;
+	}
+
+	c = base->clone(base, SNAP_NAME, NULL, LXC_CLONE_SNAPSHOT, "overlay",
+			NULL, 0, NULL);
+	if (!c) {
+		lxc_error("%s\n", "Failed to snapshot \"" BASE_NAME "\"");
+		goto on_error;
+	}
+
+	if (!c->set_config_item(c, "lxc.rootfs.overlay.tmpfs", TMPFS_SIZE) ||
+	    !c->save_config(c, NULL)) {
+		lxc_error("%s\n", "Failed to set lxc.rootfs.overlay.tmpfs");
+		goto on_error;
+	}
+
+	/* Start the snapshot the way it is found on disk. */
+	lxc_container_put(c);
+	c = lxc_container_new(SNAP_NAME, NULL);
+	if (!c || !c->is_defined(c)) {
+		lxc_error("%s\n", "Failed to load \"" SNAP_NAME "\"");
+		goto on_error;
+	}
+
+	c->want_daemonize(c, true);
+	if (!c->startl(c, 0, NULL) || !c->wait(c, "RUNNING", 30)) {
+		lxc_error("%s\n", "Failed to start \"" SNAP_NAME "\"");
+		goto on_error;
+	}
+
+	if (run(c, touch) != 0 || run(c, test) != 0) {
+		lxc_error("%s\n", "Failed to write \"" WRITTEN "\" in the container");
+		goto on_error;
+	}
+
+	if (on_disk(c)) {
+		lxc_error("%s\n", "\"" WRITTEN "\" was written to the upper directory on disk");
+		goto on_error;
+	}
+
+	if (!c->get_metrics(c, &m) || !(m.flags & LXC_METRICS_ROOTFS)) {
+		lxc_error("%s\n", "Failed to read the rootfs metrics");
+		goto on_error;
+	}
+
+	if (m.rootfs_size != TMPFS_SIZE_BYTES) {
+		lxc_error("Rootfs size is %llu instead of %llu bytes\n",
+			  (unsigned long long)m.rootfs_size, TMPFS_SIZE_BYTES);
+		goto on_error;
+	}
+
+	if (!c->stop(c)) {
+		lxc_error("%s\n", "Failed to stop \"" SNAP_NAME "\"");
+		goto on_error;
+	}
+
+	if (on_disk(c)) {
+		lxc_error("%s\n", "\"" WRITTEN "\" was kept after the container stopped");
+		goto on_error;
+	}
+
+	ret = EXIT_SUCCESS;
+
+on_error:
+	lxc_container_put(c);
+	lxc_container_put(base);
+	destroy(SNAP_NAME);
+	destroy(BASE_NAME);
+	exit(ret);
+}
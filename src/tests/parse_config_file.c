@@ -445,6 +445,16 @@ int main(int argc, char *argv[])
 		goto non_test_error;
 	}
 
+	if (set_get_compare_clear_save_load(c, "lxc.log.buffer.size", "65536", tmpf, true) < 0) {
+		lxc_error("%s\n", "lxc.log.buffer.size");
+		goto non_test_error;
+	}
+
+	if (set_get_compare_clear_save_load(c, "lxc.log.format", "binary", tmpf, true) < 0) {
+		lxc_error("%s\n", "lxc.log.format");
+		goto non_test_error;
+	}
+
 	if (set_get_compare_clear_save_load(c, "lxc.mount.fstab", "/some/path", NULL, true) < 0) {
 		lxc_error("%s\n", "lxc.mount.fstab");
 		goto non_test_error;
@@ -483,6 +493,11 @@ int main(int argc, char *argv[])
 		goto non_test_error;
 	}
 
+	if (set_get_compare_clear_save_load(c, "lxc.rootfs.overlay.tmpfs", "268435456", tmpf, true) < 0) {
+		lxc_error("%s\n", "lxc.rootfs.overlay.tmpfs");
+		goto non_test_error;
+	}
+
 	if (set_get_compare_clear_save_load(c, "lxc.uts.name", "the-shire", tmpf, true) < 0) {
 		lxc_error("%s\n", "lxc.uts.name");
 		goto non_test_error;
@@ -611,6 +626,26 @@ int main(int argc, char *argv[])
 		goto non_test_error;
 	}
 
+	if (set_get_compare_clear_save_load(c, "lxc.monitor.pressure.memory", "full 100000 2000000", tmpf, true) < 0) {
+		lxc_error("%s\n", "lxc.monitor.pressure.memory");
+		goto non_test_error;
+	}
+
+	if (c->set_config_item(c, "lxc.monitor.pressure.io", "some 3000000 2000000")) {
+		lxc_error("%s\n", "Managed to set a pressure trigger stalling longer than its window");
+		goto non_test_error;
+	}
+
+	if (set_get_compare_clear_save_load(c, "lxc.monitor.memory_events", "high oom_kill", tmpf, true) < 0) {
+		lxc_error("%s\n", "lxc.monitor.memory_events");
+		goto non_test_error;
+	}
+
+	if (c->set_config_item(c, "lxc.monitor.memory_events", "oom swap")) {
+		lxc_error("%s\n", "Managed to set an unknown memory event");
+		goto non_test_error;
+	}
+
 	if (set_get_compare_clear_save_load(c, "lxc.group", "some,container,groups", tmpf, false) < 0) {
 		lxc_error("%s\n", "lxc.group");
 		goto non_test_error;
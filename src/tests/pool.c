@@ -0,0 +1,332 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+/*
+ * Fill a pool with snapshots of a container, claim one and check that the
+ * claimed container was renamed in its configuration, got its own hostname
+ * in its configuration and rootfs and took over the dependency of its entry
+ * on the pooled container. Pools can't be created by threaded callers or for
+ * backing stores which claims would have to mount.
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lxc/lxccontainer.h"
+#include "lxctest.h"
+#include "file_utils.h"
+#include "memory_utils.h"
+#include "string_utils.h"
+#include "utils.h"
+
+#define POOL_SIZE 2
+
+/* How long the pool's helper may take to clone its entries. */
+#define POOL_TIMEOUT_SEC 60
+
+static int count_ready(const char *lxcpath, const char *name)
+{
+	__do_closedir DIR *dir = NULL;
+	char prefix[NAME_MAX + 1];
+	struct dirent *direntp;
+	int nr = 0;
+
+	if (strnprintf(prefix, sizeof(prefix), ".pool.%s.", name) < 0)
+		return -1;
+
+	dir = opendir(lxcpath);
+	if (!dir)
+		return -1;
+
+	while ((direntp = readdir(dir))) {
+		char path[PATH_MAX];
+
+		if (!strnequal(direntp->d_name, prefix, strlen(prefix)))
+			continue;
+
+		if (strnprintf(path, sizeof(path), "%s/%s/lxc_pool_ready",
+			       lxcpath, direntp->d_name) < 0)
+			return -1;
+
+		if (file_exists(path))
+			nr++;
+	}
+
+	return nr;
+}
+
+static bool wait_ready(const char *lxcpath, const char *name)
+{
+	for (int i = 0; i < POOL_TIMEOUT_SEC * 10; i++) {
+		if (count_ready(lxcpath, name) >= POOL_SIZE)
+			return true;
+
+		(void)nanosleep(&(struct timespec){ .tv_nsec = 100000000 }, NULL);
+	}
+
+	lxc_error("Pool of \"%s\" wasn't filled", name);
+	return false;
+}
+
+static bool read_file(const char *lxcpath, const char *name, const char *file,
+		      char *buf, size_t size)
+{
+	__do_close int fd = -EBADF;
+	char path[PATH_MAX];
+	ssize_t len;
+
+	if (strnprintf(path, sizeof(path), "%s/%s/%s", lxcpath, name, file) < 0)
+		return false;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	len = lxc_read_nointr(fd, buf, size - 1);
+	if (len < 0)
+		return false;
+	buf[len] = '\0';
+
+	return true;
+}
+
+static bool container_exists(const char *lxcpath, const char *name)
+{
+	char path[PATH_MAX];
+
+	return strnprintf(path, sizeof(path), "%s/%s", lxcpath, name) >= 0 &&
+	       dir_exists(path);
+}
+
+/* The claimed container must not refer to the pool entry it was anymore. */
+static bool check_claimed(struct lxc_container *c, const char *lxcpath,
+			  const char *name)
+{
+	char config[4096], dir[PATH_MAX], rootfs[PATH_MAX], utsname[NAME_MAX + 1];
+	char hostname[NAME_MAX + 1];
+
+	if (!c || !c->is_defined(c)) {
+		lxc_error("Failed to claim \"%s\"", name);
+		return false;
+	}
+
+	if (!read_file(lxcpath, name, "config", config, sizeof(config)) ||
+	    strstr(config, ".pool.")) {
+		lxc_error("Configuration of \"%s\" refers to its pool entry", name);
+		return false;
+	}
+
+	if (strnprintf(dir, sizeof(dir), "%s/%s/", lxcpath, name) < 0)
+		return false;
+
+	if (c->get_config_item(c, "lxc.rootfs.path", rootfs, sizeof(rootfs)) < 0 ||
+	    !strstr(rootfs, dir)) {
+		lxc_error("Rootfs of \"%s\" isn't in \"%s\"", name, dir);
+		return false;
+	}
+
+	if (c->get_config_item(c, "lxc.uts.name", utsname, sizeof(utsname)) < 0 ||
+	    !strequal(utsname, name)) {
+		lxc_error("Hostname of \"%s\" isn't \"%s\"", name, name);
+		return false;
+	}
+
+	/* Written when the entry was cloned, so it's in the upper layer. */
+	if (!read_file(lxcpath, name, "overlay/delta/etc/hostname", hostname,
+		       sizeof(hostname)) || !strequal(hostname, name)) {
+		lxc_error("Rootfs of \"%s\" doesn't have the hostname \"%s\"", name, name);
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * The snapshot depends on @base, which must list the claimed container
+ * instead of the pool entry it was.
+ */
+static bool check_rdepends(const char *lxcpath, const char *base, const char *name)
+{
+	char rdepends[PATH_MAX], snapshots[4096], expected[PATH_MAX];
+	char *line;
+	int i = 0;
+
+	if (strnprintf(expected, sizeof(expected), "%s\n%s\n", lxcpath, base) < 0)
+		return false;
+
+	if (!read_file(lxcpath, name, "lxc_rdepends", rdepends, sizeof(rdepends)) ||
+	    !strequal(rdepends, expected)) {
+		lxc_error("\"%s\" doesn't depend on \"%s\"", name, base);
+		return false;
+	}
+
+	if (strnprintf(expected, sizeof(expected), "%s\n%s\n", lxcpath, name) < 0)
+		return false;
+
+	if (!read_file(lxcpath, base, "lxc_snapshots", snapshots, sizeof(snapshots)) ||
+	    !strstr(snapshots, expected)) {
+		lxc_error("\"%s\" doesn't list \"%s\" as snapshot", base, name);
+		return false;
+	}
+
+	/* Entries are listed as lxcpath and name, every one must exist. */
+	lxc_iterate_parts(line, snapshots, "\n") {
+		if (i++ % 2 == 0)
+			continue;
+
+		if (!container_exists(lxcpath, line)) {
+			lxc_error("\"%s\" lists the removed container \"%s\"", base, line);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void *wait_pipe(void *data)
+{
+	char c;
+
+	(void)lxc_read_nointr(*(int *)data, &c, 1);
+	return NULL;
+}
+
+static bool test_threaded(struct lxc_container *base)
+{
+	int fds[2];
+	pthread_t thread;
+	struct lxc_pool *p;
+
+	if (pipe2(fds, O_CLOEXEC) < 0)
+		return false;
+
+	if (pthread_create(&thread, NULL, wait_pipe, &fds[0])) {
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	}
+
+	p = lxc_pool_new(base, POOL_SIZE, LXC_CLONE_SNAPSHOT, "overlay");
+
+	close(fds[1]);
+	pthread_join(thread, NULL);
+	close(fds[0]);
+
+	if (p) {
+		lxc_error("%s", "Created a pool while threaded");
+		lxc_pool_put(p, true);
+		return false;
+	}
+
+	return true;
+}
+
+static bool test_unsupported(struct lxc_container *base)
+{
+	struct lxc_pool *p;
+
+	p = lxc_pool_new(base, POOL_SIZE, 0, "zfs");
+	if (p || errno != EOPNOTSUPP) {
+		lxc_error("%s", "Created a pool of zfs clones");
+		lxc_pool_put(p, true);
+		return false;
+	}
+
+	return true;
+}
+
+static bool test_pool(struct lxc_container *base, const char *lxcpath,
+		      const char *name)
+{
+	struct lxc_container *c = NULL;
+	struct lxc_pool *p;
+	bool ret = false;
+
+	p = lxc_pool_new(base, POOL_SIZE, LXC_CLONE_SNAPSHOT, "overlay");
+	if (!p) {
+		lxc_error("Failed to create pool of \"%s\"", base->name);
+		return false;
+	}
+
+	if (!wait_ready(lxcpath, base->name))
+		goto out;
+
+	c = lxc_pool_claim(p, name);
+	if (!check_claimed(c, lxcpath, name))
+		goto out;
+
+	if (!check_rdepends(lxcpath, base->name, name))
+		goto out;
+
+	/* The helper replaces the claimed entry. */
+	if (!wait_ready(lxcpath, base->name))
+		goto out;
+
+	ret = true;
+
+out:
+	if (c) {
+		c->destroy(c);
+		lxc_container_put(c);
+	}
+	lxc_pool_put(p, true);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	char template[] = P_tmpdir "/lxc-pool-XXXXXX";
+	struct lxc_container *base = NULL;
+	char rootfs[PATH_MAX], hostname[PATH_MAX];
+	int ret = EXIT_FAILURE;
+	char *lxcpath;
+
+	lxcpath = mkdtemp(template);
+	if (!lxcpath) {
+		lxc_error("%s", "Failed to create temporary lxcpath");
+		exit(EXIT_FAILURE);
+	}
+
+	/* The snapshots use the rootfs of the pooled container as lower layer. */
+	if (strnprintf(rootfs, sizeof(rootfs), "%s/pool-base/rootfs", lxcpath) < 0 ||
+	    strnprintf(hostname, sizeof(hostname), "%s/etc", rootfs) < 0 ||
+	    mkdir_p(hostname, 0755) < 0) {
+		lxc_error("Failed to create \"%s\"", rootfs);
+		goto on_error;
+	}
+
+	if (strnprintf(hostname, sizeof(hostname), "%s/etc/hostname", rootfs) < 0 ||
+	    lxc_write_to_file(hostname, "pool-base", STRLITERALLEN("pool-base"), false, 0644) < 0) {
+		lxc_error("Failed to create \"%s\"", hostname);
+		goto on_error;
+	}
+
+	base = lxc_container_new("pool-base", lxcpath);
+	if (!base || !base->set_config_item(base, "lxc.rootfs.path", rootfs) ||
+	    !base->save_config(base, NULL)) {
+		lxc_error("%s", "Failed to create \"pool-base\"");
+		goto on_error;
+	}
+
+	if (!test_threaded(base) || !test_unsupported(base) ||
+	    !test_pool(base, lxcpath, "pool-claimed"))
+		goto on_error;
+
+	ret = EXIT_SUCCESS;
+
+on_error:
+	if (base) {
+		if (base->is_defined(base))
+			base->destroy(base);
+		lxc_container_put(base);
+	}
+	(void)lxc_rmdir_onedev(lxcpath, NULL);
+	exit(ret);
+}
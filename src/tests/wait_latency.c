@@ -0,0 +1,187 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+/*
+ * Measure how long c->wait("RUNNING") takes to wake up after a container
+ * reached RUNNING. The waiter is started before the container so it has to
+ * wait for the monitor to come up.
+ *
+ * Usage: lxc-test-wait-latency [iterations]
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lxc/lxccontainer.h"
+#include "lxctest.h"
+
+#define CT_NAME "wait-latency"
+
+static int64_t now_usec(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int cmp_int64(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static int64_t percentile(const int64_t *sorted, int n, int pct)
+{
+	int idx = (n * pct + 99) / 100 - 1;
+
+	if (idx < 0)
+		idx = 0;
+
+	return sorted[idx];
+}
+
+/* Wait for the container in a child and report when the wait returned. */
+static pid_t spawn_waiter(int fd)
+{
+	struct lxc_container *c;
+	int64_t woken;
+	pid_t pid;
+
+	pid = fork();
+	if (pid != 0)
+		return pid;
+
+	c = lxc_container_new(CT_NAME, NULL);
+	if (!c)
+		_exit(EXIT_FAILURE);
+
+	if (!c->wait(c, "RUNNING", 30))
+		_exit(EXIT_FAILURE);
+
+	woken = now_usec();
+	if (write(fd, &woken, sizeof(woken)) != sizeof(woken))
+		_exit(EXIT_FAILURE);
+
+	lxc_container_put(c);
+	_exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char *argv[])
+{
+	struct lxc_container *c;
+	int64_t *latency = NULL;
+	int iterations = 20;
+	int i, status;
+	int ret = EXIT_FAILURE;
+
+	if (argc > 1)
+		iterations = atoi(argv[1]);
+	if (iterations <= 0)
+		exit(EXIT_FAILURE);
+
+	latency = calloc(iterations, sizeof(*latency));
+	if (!latency)
+		exit(EXIT_FAILURE);
+
+	c = lxc_container_new(CT_NAME, NULL);
+	if (!c) {
+		lxc_error("%s\n", "Failed to create container \"" CT_NAME "\"");
+		goto on_error_free;
+	}
+
+	if (c->is_defined(c)) {
+		lxc_error("%s\n", "Container \"" CT_NAME "\" is defined");
+		goto on_error_put;
+	}
+
+	if (!c->createl(c, "busybox", NULL, NULL, 0, NULL)) {
+		lxc_error("%s\n", "Failed to create busybox container \"" CT_NAME "\"");
+		goto on_error_put;
+	}
+
+	if (!c->want_daemonize(c, true)) {
+		lxc_error("%s\n", "Failed to mark container \"" CT_NAME "\" daemonized");
+		goto on_error_destroy;
+	}
+
+	for (i = 0; i < iterations; i++) {
+		int64_t started, woken;
+		int pipefd[2];
+		pid_t pid;
+
+		if (pipe(pipefd) < 0)
+			goto on_error_destroy;
+
+		pid = spawn_waiter(pipefd[1]);
+		close(pipefd[1]);
+		if (pid < 0) {
+			close(pipefd[0]);
+			goto on_error_destroy;
+		}
+
+		/* Give the waiter time to find the container isn't running. */
+		usleep(100000);
+
+		if (!c->startl(c, 0, NULL)) {
+			lxc_error("%s\n", "Failed to start container \"" CT_NAME "\"");
+			close(pipefd[0]);
+			goto on_error_destroy;
+		}
+		started = now_usec();
+
+		if (read(pipefd[0], &woken, sizeof(woken)) != sizeof(woken)) {
+			lxc_error("%s\n", "Waiter failed");
+			close(pipefd[0]);
+			goto on_error_stop;
+		}
+		close(pipefd[0]);
+
+		if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+		    WEXITSTATUS(status) != EXIT_SUCCESS)
+			goto on_error_stop;
+
+		/*
+		 * The daemonized start returns once the container is RUNNING so
+		 * a waiter may well beat it.
+		 */
+		latency[i] = woken - started;
+
+		if (!c->stop(c)) {
+			lxc_error("%s\n", "Failed to stop container \"" CT_NAME "\"");
+			goto on_error_destroy;
+		}
+	}
+
+	qsort(latency, iterations, sizeof(*latency), cmp_int64);
+	printf("wait wakeup latency after start (usec, n=%d): min %lld p50 %lld p90 %lld p99 %lld max %lld\n",
+	       iterations, (long long)latency[0],
+	       (long long)percentile(latency, iterations, 50),
+	       (long long)percentile(latency, iterations, 90),
+	       (long long)percentile(latency, iterations, 99),
+	       (long long)latency[iterations - 1]);
+
+	ret = EXIT_SUCCESS;
+
+on_error_stop:
+	if (c->is_running(c) && !c->stop(c))
+		lxc_error("%s\n", "Failed to stop container \"" CT_NAME "\"");
+
+on_error_destroy:
+	if (!c->destroy(c))
+		lxc_error("%s\n", "Failed to destroy container \"" CT_NAME "\"");
+
+on_error_put:
+	lxc_container_put(c);
+
+on_error_free:
+	free(latency);
+	exit(ret);
+}